@@ -0,0 +1,151 @@
+/***********************************************************************
+ * Filename: chart_reduce.cpp
+ * Author: agent
+ * Date: 2026-10-17
+ * Description:
+ *     Implements the ChartReduce class. Indexes of kept samples are
+ *     returned in ascending order, so the caller can send values and
+ *     times of the points without another copy of the series.
+ *
+ ***********************************************************************/
+
+
+#include "chart_reduce.h"
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+
+//*****************************************************************************
+//! Largest-Triangle-Three-Buckets, first and last sample are kept and every
+//! bucket gives the sample forming largest triangle with previously selected
+//! sample and average of next bucket. Missing samples are never selected,
+//! bucket without data gives its first index (sent as null to keep the gap).
+//*****************************************************************************
+uint16_t ChartReduce::Lttb(const int32_t *vals, uint32_t n, uint16_t points, uint32_t *idx)
+{
+    uint16_t out = 0;
+    idx[out++] = 0;
+    float every = (float)(n - 2) / (points - 2);
+    uint32_t a = 0;
+
+    for (uint16_t i = 0; i < points - 2; i++)
+    {
+        uint32_t start = (uint32_t)(i * every) + 1;
+        uint32_t end = std::min((uint32_t)((i + 1) * every) + 1, n - 1);
+        uint32_t nextEnd = std::min((uint32_t)((i + 2) * every) + 1, n);
+
+        float avgX = 0;
+        float avgY = 0;
+        uint32_t avgCnt = 0;
+        for (uint32_t j = end; j < nextEnd; j++)
+        {
+            if (vals[j] != CHART_NO_DATA)
+            {
+                avgX += j;
+                avgY += vals[j];
+                avgCnt++;
+            }
+        }
+        if (avgCnt > 0)
+        {
+            avgX /= avgCnt;
+            avgY /= avgCnt;
+        }
+        else
+        {
+            avgX = (float)(end + nextEnd) / 2;
+            avgY = (vals[a] != CHART_NO_DATA) ? vals[a] : 0;
+        }
+
+        float ax = a;
+        float ay = (vals[a] != CHART_NO_DATA) ? vals[a] : avgY;
+        float best = -1;
+        uint32_t bestIdx = start;
+        for (uint32_t j = start; j < end; j++)
+        {
+            if (vals[j] == CHART_NO_DATA)
+            {
+                continue;
+            }
+            float area = fabsf((ax - avgX) * (vals[j] - ay) - (ax - j) * (avgY - ay));
+            if (area > best)
+            {
+                best = area;
+                bestIdx = j;
+            }
+        }
+        idx[out++] = bestIdx;
+        if (best >= 0)
+        {
+            a = bestIdx;
+        }
+    }
+    idx[out++] = n - 1;
+    return out;
+}
+
+//*****************************************************************************
+//! Min/max buckets, every bucket gives its minimum and maximum in time order
+//*****************************************************************************
+uint16_t ChartReduce::MinMax(const int32_t *vals, uint32_t n, uint16_t points, uint32_t *idx)
+{
+    uint16_t out = 0;
+    uint16_t buckets = std::max(points / 2, 1);
+    for (uint16_t b = 0; b < buckets; b++)
+    {
+        uint32_t start = (uint64_t)b * n / buckets;
+        uint32_t end = (uint64_t)(b + 1) * n / buckets;
+        uint32_t iMin = start;
+        uint32_t iMax = start;
+        bool any = false;
+        for (uint32_t j = start; j < end; j++)
+        {
+            if (vals[j] == CHART_NO_DATA)
+            {
+                continue;
+            }
+            if (!any || (vals[j] < vals[iMin]))
+            {
+                iMin = j;
+            }
+            if (!any || (vals[j] > vals[iMax]))
+            {
+                iMax = j;
+            }
+            any = true;
+        }
+        idx[out++] = std::min(iMin, iMax);
+        if (iMin != iMax)
+        {
+            idx[out++] = std::max(iMin, iMax);
+        }
+    }
+    return out;
+}
+
+//*****************************************************************************
+//! Reduce n samples to at most 'points' samples, idx receives indexes of kept
+//! samples in ascending order (room for 'points' items), returns their count,
+//! points must be at least CHART_MIN_POINTS
+//*****************************************************************************
+uint16_t ChartReduce::Reduce(chartreduce_t mode, const int32_t *vals, uint32_t n, uint16_t points, uint32_t *idx)
+{
+    if ((points == 0) || (n <= points))
+    {
+        for (uint32_t i = 0; i < n; i++)
+        {
+            idx[i] = i;
+        }
+        return n;
+    }
+    if (mode == ChartReduce_MinMax)
+    {
+        return MinMax(vals, n, points, idx);
+    }
+    return Lttb(vals, n, points, idx);
+}
+
+chartreduce_t ChartReduce::Parse(const char *txt)
+{
+    return ((txt != NULL) && (strcmp(txt, "minmax") == 0)) ? ChartReduce_MinMax : ChartReduce_Lttb;
+}
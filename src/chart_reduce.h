@@ -0,0 +1,35 @@
+/***********************************************************************
+ * Filename: chart_reduce.h
+ * Author: agent
+ * Date: 2026-10-17
+ * Description:
+ *     Declares the ChartReduce class, reduction of a chart series to
+ *     a limited number of points for the web chart. LTTB keeps the
+ *     shape of the curve, min/max buckets keep every extreme. The
+ *     class uses only the C++ standard library, so it builds natively
+ *     as well as on target.
+ *
+ ***********************************************************************/
+
+
+#pragma once
+#include <stdint.h>
+
+#define CHART_NO_DATA INT32_MIN          /*chybejici vzorek*/
+#define CHART_MIN_POINTS 3               /*min. pocet bodu redukovaneho grafu*/
+
+typedef enum
+{
+    ChartReduce_Lttb = 0,
+    ChartReduce_MinMax,
+} chartreduce_t;
+
+class ChartReduce
+{
+public:
+    static uint16_t Lttb(const int32_t *vals, uint32_t n, uint16_t points, uint32_t *idx);
+    static uint16_t MinMax(const int32_t *vals, uint32_t n, uint16_t points, uint32_t *idx);
+    static uint16_t Reduce(chartreduce_t mode, const int32_t *vals, uint32_t n, uint16_t points, uint32_t *idx);
+
+    static chartreduce_t Parse(const char *txt);
+};
@@ -0,0 +1,654 @@
+/***********************************************************************
+ * Filename: chart_series.cpp
+ * Author: agent
+ * Date: 2026-10-17
+ * Description:
+ *     Implements the ChartSeries class. Raw samples are aggregated into
+ *     hourly and daily min/mean/max values (UTC intervals), each tier is
+ *     a ring of fixed period where gaps are stored as missing samples.
+ *     Whole series is written to LittleFS whenever an hour is closed.
+ *
+ ***********************************************************************/
+
+
+#include "chart_series.h"
+#include "common.h"
+
+static const char *const resNames[ChartRes_Nmr] = {"raw", "hour", "day"};
+
+ChartSeries::ChartSeries(bool sgn) : sgn(sgn), fname(NULL)
+{
+    memset(tier, 0, sizeof(tier));
+    memset(acc, 0, sizeof(acc));
+}
+
+ChartSeries::~ChartSeries()
+{
+    for (int i = 0; i < ChartRes_Nmr; i++)
+    {
+        free(tier[i].buf);
+    }
+    free(fname);
+}
+
+uint16_t ChartSeries::Missing(void) const
+{
+    return sgn ? 0x8000 : 0xFFFF;
+}
+
+int32_t ChartSeries::Bits(uint16_t v) const
+{
+    return sgn ? (int32_t)(int16_t)v : (int32_t)v;
+}
+
+uint16_t ChartSeries::Encode(int32_t v) const
+{
+    if (v == CHART_NO_DATA)
+    {
+        return Missing();
+    }
+    /*hodnota oznacujici chybejici vzorek neni povolena*/
+    int32_t lo = sgn ? -32767 : 0;
+    int32_t hi = sgn ? 32767 : 65534;
+    return (uint16_t)std::max(lo, std::min(v, hi));
+}
+
+int32_t ChartSeries::Decode(uint16_t v) const
+{
+    return (v == Missing()) ? CHART_NO_DATA : Bits(v);
+}
+
+void ChartSeries::TierAlloc(chartres_t res, uint16_t cap, uint8_t width, uint32_t period)
+{
+    charttier_t &t = tier[res];
+    free(t.buf);
+    t.buf = (cap > 0) ? (uint16_t *)ps_malloc(cap * width * sizeof(uint16_t)) : NULL;
+    t.cap = (t.buf != NULL) ? cap : 0;
+    t.cnt = 0;
+    t.head = 0;
+    t.width = width;
+    t.period = period;
+    t.last = 0;
+    memset(&acc[res], 0, sizeof(acc[res]));
+}
+
+//*****************************************************************************
+//! Set size of raw tier and its sampling period, all stored data are cleared
+//*****************************************************************************
+void ChartSeries::Init(uint16_t rawSamples, uint32_t rawPeriod)
+{
+    TierAlloc(ChartRes_Raw, rawSamples, 1, (rawPeriod > 0) ? rawPeriod : CHART_RAW_PERIOD_S);
+    TierAlloc(ChartRes_Hour, CHART_HOUR_SAMPLES, 3, 3600);
+    TierAlloc(ChartRes_Day, CHART_DAY_SAMPLES, 3, 24 * 3600);
+}
+
+void ChartSeries::Clear(void)
+{
+    for (int i = 0; i < ChartRes_Nmr; i++)
+    {
+        tier[i].cnt = 0;
+        tier[i].head = 0;
+        tier[i].last = 0;
+    }
+    memset(acc, 0, sizeof(acc));
+}
+
+//*****************************************************************************
+//! Push one point (width values) into tier, gaps since last point are
+//! filled by missing samples so that age of point maps directly to time
+//*****************************************************************************
+void ChartSeries::TierPush(charttier_t &t, const int32_t *vals, uint32_t time)
+{
+    if (t.cap == 0)
+    {
+        return;
+    }
+
+    auto put = [this, &t](const int32_t *v)
+    {
+        uint16_t *p = &t.buf[t.head * t.width];
+        for (uint8_t w = 0; w < t.width; w++)
+        {
+            p[w] = (v != NULL) ? Encode(v[w]) : Missing();
+        }
+        t.head = (t.head + 1) % t.cap;
+        t.seq++;
+        if (t.cnt < t.cap)
+        {
+            t.cnt++;
+        }
+    };
+
+    if ((time == 0) && (t.last != 0))
+    { /*cas neni znam, pokracuje se v rade*/
+        time = t.last + t.period;
+    }
+    if ((t.last != 0) && (time > t.last))
+    {
+        uint32_t n = (time - t.last + t.period / 2) / t.period;
+        for (uint32_t i = 1; (i < n) && (i <= t.cap); i++)
+        {
+            put(NULL);
+        }
+    }
+    put(vals);
+    t.last = time;
+}
+
+const uint16_t *ChartSeries::TierAt(const charttier_t &t, uint16_t age) const
+{
+    return &t.buf[((t.head + t.cap - 1 - age) % t.cap) * t.width];
+}
+
+//*****************************************************************************
+//! Add sample into aggregate of tier, returns true when interval was closed
+//*****************************************************************************
+bool ChartSeries::Accumulate(chartres_t res, int32_t val, uint32_t time)
+{
+    charttier_t &t = tier[res];
+    chartacc_t &a = acc[res];
+    if (t.cap == 0)
+    {
+        return false;
+    }
+
+    bool closed = false;
+    uint32_t slot = time - (time % t.period);
+    if ((a.cnt > 0) && (slot != a.slot))
+    {
+        if (slot > a.slot)
+        {
+            int32_t v[3] = {a.min, a.sum / (int32_t)a.cnt, a.max};
+            TierPush(t, v, a.slot);
+            closed = true;
+        }
+        a.cnt = 0;
+    }
+    if (a.cnt == 0)
+    {
+        a.min = val;
+        a.max = val;
+        a.sum = 0;
+        a.slot = slot;
+    }
+    a.min = std::min(a.min, val);
+    a.max = std::max(a.max, val);
+    a.sum += val;
+    a.cnt++;
+    return closed;
+}
+
+//*****************************************************************************
+//! Add new sample, t is unix time of sample (not synchronized time is
+//! accepted for raw tier only)
+//*****************************************************************************
+void ChartSeries::Add(int32_t val, time_t t)
+{
+    bool valid = (t >= (time_t)CHART_VALID_TIME);
+    uint32_t time = valid ? (uint32_t)t : 0;
+
+    TierPush(tier[ChartRes_Raw], &val, time);
+    if (valid)
+    {
+        bool hourClosed = Accumulate(ChartRes_Hour, val, time);
+        bool dayClosed = Accumulate(ChartRes_Day, val, time);
+        if (hourClosed || dayClosed)
+        {
+            Save();
+        }
+    }
+}
+
+int32_t ChartSeries::Last(void) const
+{
+    const charttier_t &t = tier[ChartRes_Raw];
+    return (t.cnt > 0) ? Decode(TierAt(t, 0)[0]) : CHART_NO_DATA;
+}
+
+uint16_t ChartSeries::RawCount(void) const
+{
+    return tier[ChartRes_Raw].cnt;
+}
+
+int32_t ChartSeries::RawAt(uint16_t age) const
+{
+    return Decode(TierAt(tier[ChartRes_Raw], age)[0]);
+}
+
+uint32_t ChartSeries::RawPeriod(void) const
+{
+    return tier[ChartRes_Raw].period;
+}
+
+//*****************************************************************************
+//! Snapshot of raw tier position, samples are then read in short blocks
+//! (newest first) without holding the chart lock for the whole transfer
+//*****************************************************************************
+void ChartSeries::RawCursor(chartcursor_t &cur) const
+{
+    cur.seq = tier[ChartRes_Raw].seq;
+    cur.cnt = tier[ChartRes_Raw].cnt;
+    cur.pos = 0;
+}
+
+//*****************************************************************************
+//! Read next n samples of cursor, samples overwritten since the snapshot
+//! are returned as CHART_NO_DATA, returns count of read samples
+//*****************************************************************************
+uint16_t ChartSeries::RawRead(chartcursor_t &cur, int32_t *out, uint16_t n) const
+{
+    const charttier_t &t = tier[ChartRes_Raw];
+    n = std::min(n, (uint16_t)(cur.cnt - cur.pos));
+    for (uint16_t k = 0; k < n; k++)
+    {
+        uint32_t age = (t.seq - cur.seq) + cur.pos + k;
+        out[k] = (age < t.cnt) ? Decode(TierAt(t, age)[0]) : CHART_NO_DATA;
+    }
+    cur.pos += n;
+    return n;
+}
+
+size_t ChartSeries::PutVarint(uint8_t *buf, uint32_t v)
+{
+    size_t n = 0;
+    while (v >= 0x80)
+    {
+        buf[n++] = (uint8_t)(v | 0x80);
+        v >>= 7;
+    }
+    buf[n++] = (uint8_t)v;
+    return n;
+}
+
+bool ChartSeries::GetVarint(const uint8_t *buf, size_t len, size_t &pos, uint32_t &v)
+{
+    v = 0;
+    for (uint8_t shift = 0; shift < 35; shift += 7)
+    {
+        if (pos >= len)
+        {
+            return false;
+        }
+        uint8_t b = buf[pos++];
+        v |= (uint32_t)(b & 0x7F) << shift;
+        if ((b & 0x80) == 0)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+size_t ChartSeries::MaxFileSize(void) const
+{
+    size_t size = sizeof(ChartFileHdr_t) + sizeof(uint32_t);
+    for (int i = 0; i < ChartRes_Nmr; i++)
+    { /*zigzag rozdil 16 bit hodnot ma max. 17 bitu = 3 bajty*/
+        size += sizeof(ChartTierHdr_t) + sizeof(chartacc_t) + 3 * tier[i].cap * tier[i].width;
+    }
+    return size;
+}
+
+//*****************************************************************************
+//! Encode tier, values are stored per column from oldest as zigzag varint
+//! of difference to previous value
+//*****************************************************************************
+size_t ChartSeries::EncodeTier(chartres_t res, uint8_t *buf) const
+{
+    const charttier_t &t = tier[res];
+    ChartTierHdr_t hdr;
+    hdr.width = t.width;
+    hdr.reserved = 0;
+    hdr.cnt = t.cnt;
+    hdr.period = t.period;
+    hdr.last = t.last;
+
+    size_t pos = 0;
+    memcpy(buf + pos, &hdr, sizeof(hdr));
+    pos += sizeof(hdr);
+    memcpy(buf + pos, &acc[res], sizeof(chartacc_t));
+    pos += sizeof(chartacc_t);
+
+    for (uint8_t w = 0; w < t.width; w++)
+    {
+        int32_t prev = 0;
+        for (uint16_t age = t.cnt; age-- > 0;)
+        {
+            int32_t v = Bits(TierAt(t, age)[w]);
+            int32_t d = v - prev;
+            prev = v;
+            pos += PutVarint(buf + pos, ((uint32_t)d << 1) ^ (uint32_t)(d >> 31));
+        }
+    }
+    return pos;
+}
+
+bool ChartSeries::DecodeTier(chartres_t res, const uint8_t *buf, size_t len, size_t &pos)
+{
+    charttier_t &t = tier[res];
+    ChartTierHdr_t hdr;
+    chartacc_t a;
+    if (pos + sizeof(hdr) + sizeof(a) > len)
+    {
+        return false;
+    }
+    memcpy(&hdr, buf + pos, sizeof(hdr));
+    pos += sizeof(hdr);
+    memcpy(&a, buf + pos, sizeof(a));
+    pos += sizeof(a);
+
+    /*tier s jinou periodou (zmena definice grafu) se zahodi*/
+    bool use = (hdr.width == t.width) && (hdr.period == t.period) && (t.cap > 0);
+    uint16_t keep = std::min(hdr.cnt, t.cap);
+    uint16_t skip = hdr.cnt - keep;
+
+    for (uint8_t w = 0; w < hdr.width; w++)
+    {
+        int32_t prev = 0;
+        for (uint16_t k = 0; k < hdr.cnt; k++)
+        {
+            uint32_t z;
+            if (!GetVarint(buf, len, pos, z))
+            {
+                return false;
+            }
+            prev += (int32_t)((z >> 1) ^ (0 - (z & 1)));
+            if (use && (k >= skip))
+            {
+                t.buf[(k - skip) * t.width + w] = (uint16_t)prev;
+            }
+        }
+    }
+
+    if (use)
+    {
+        t.cnt = keep;
+        t.head = keep % t.cap;
+        t.last = hdr.last;
+        acc[res] = a;
+    }
+    return true;
+}
+
+static uint32_t ChartHash(const uint8_t *data, size_t len)
+{
+    uint32_t hash = 2166136261UL;
+    for (size_t i = 0; i < len; i++)
+    {
+        hash = (hash ^ data[i]) * 16777619UL;
+    }
+    return hash;
+}
+
+//*****************************************************************************
+//! Assign file to series and load stored data, Init must be called before
+//*****************************************************************************
+bool ChartSeries::Open(const char *name)
+{
+    free(fname);
+    fname = strdup(name);
+    Clear();
+
+    std::lock_guard<std::mutex> lock(storageFS_lock);
+    File file = storageFS.open(fname, "r");
+    if (!file)
+    {
+        return false;
+    }
+    size_t len = file.size();
+    if ((len < sizeof(ChartFileHdr_t) + sizeof(uint32_t)) || (len > MaxFileSize()))
+    {
+        file.close();
+        return false;
+    }
+    uint8_t *buf = (uint8_t *)ps_malloc(len);
+    if (buf == NULL)
+    {
+        file.close();
+        return false;
+    }
+    bool ok = (file.read(buf, len) == len);
+    file.close();
+
+    ChartFileHdr_t hdr;
+    uint32_t hash;
+    memcpy(&hdr, buf, sizeof(hdr));
+    memcpy(&hash, buf + len - sizeof(hash), sizeof(hash));
+    len -= sizeof(hash);
+    ok = ok && (hash == ChartHash(buf, len)) && (hdr.magic == CHART_FILE_MAGIC) &&
+         (hdr.version == CHART_FILE_VERSION) && (hdr.sgn == sgn) && (hdr.tiers == ChartRes_Nmr);
+
+    size_t pos = sizeof(hdr);
+    for (int i = 0; ok && (i < ChartRes_Nmr); i++)
+    {
+        ok = DecodeTier((chartres_t)i, buf, len, pos);
+    }
+    ok = ok && (pos == len);
+    free(buf);
+
+    if (!ok)
+    {
+        Clear();
+    }
+    return ok;
+}
+
+//*****************************************************************************
+//! Write series into its file, temporary file is renamed for atomic update
+//*****************************************************************************
+void ChartSeries::Save(void)
+{
+    if (fname == NULL)
+    {
+        return;
+    }
+    uint8_t *buf = (uint8_t *)ps_malloc(MaxFileSize());
+    if (buf == NULL)
+    {
+        return;
+    }
+
+    ChartFileHdr_t hdr;
+    hdr.magic = CHART_FILE_MAGIC;
+    hdr.version = CHART_FILE_VERSION;
+    hdr.sgn = sgn;
+    hdr.tiers = ChartRes_Nmr;
+    hdr.reserved = 0;
+    memcpy(buf, &hdr, sizeof(hdr));
+    size_t len = sizeof(hdr);
+    for (int i = 0; i < ChartRes_Nmr; i++)
+    {
+        len += EncodeTier((chartres_t)i, buf + len);
+    }
+    uint32_t hash = ChartHash(buf, len);
+    memcpy(buf + len, &hash, sizeof(hash));
+    len += sizeof(hash);
+
+    String tmpName = String(fname) + "~";
+    std::lock_guard<std::mutex> lock(storageFS_lock);
+    File file = storageFS.open(tmpName, "w", true);
+    if (file)
+    {
+        bool ok = (file.write(buf, len) == len);
+        file.close();
+        if (!ok || !storageFS.rename(tmpName, fname))
+        {
+            storageFS.remove(tmpName);
+        }
+    }
+    free(buf);
+}
+
+void ChartSeries::Remove(void)
+{
+    if (fname != NULL)
+    {
+        std::lock_guard<std::mutex> lock(storageFS_lock);
+        storageFS.remove(fname);
+    }
+}
+
+//*****************************************************************************
+//! Finest tier which holds data from time 'from'
+//*****************************************************************************
+chartres_t ChartSeries::SelectRes(time_t from) const
+{
+    for (int i = 0; i < ChartRes_Nmr; i++)
+    {
+        const charttier_t &t = tier[i];
+        if ((t.cnt > 0) && (t.last != 0) && ((time_t)(t.last - (t.cnt - 1) * t.period) <= from))
+        {
+            return (chartres_t)i;
+        }
+    }
+    return (tier[ChartRes_Day].cnt > 0) ? ChartRes_Day : ChartRes_Raw;
+}
+
+//*****************************************************************************
+//! Get points of tier in time range <from, to> from oldest, missing samples
+//! are null. Raw tier fills "vals", aggregated tiers "min", "avg" and "max".
+//! With q.points the raw tier is reduced by LTTB or min/max buckets and the
+//! aggregated tiers are merged into q.points buckets, times of points are
+//! then sent in "t" array.
+//*****************************************************************************
+void ChartSeries::Query(const chartquery_t &q, JsonObject obj) const
+{
+    chartres_t res = (q.res < ChartRes_Nmr) ? q.res : SelectRes(q.from);
+    uint16_t points = (q.points > 0) ? std::max(q.points, (uint16_t)CHART_MIN_POINTS) : 0;
+    const charttier_t &t = tier[res];
+    obj["res"] = resNames[res];
+    obj["period"] = t.period;
+
+    JsonArray arr[3];
+    if (t.width == 1)
+    {
+        arr[0] = obj["vals"].to<JsonArray>();
+    }
+    else
+    {
+        arr[0] = obj["min"].to<JsonArray>();
+        arr[1] = obj["avg"].to<JsonArray>();
+        arr[2] = obj["max"].to<JsonArray>();
+    }
+    auto add = [](JsonArray a, int32_t v)
+    {
+        if (v == CHART_NO_DATA)
+        {
+            a.add(nullptr);
+        }
+        else
+        {
+            a.add(v);
+        }
+    };
+
+    time_t from = q.from;
+    time_t to = q.to;
+    if ((t.cnt == 0) || (t.last == 0))
+    {
+        obj["t0"] = 0;
+        return;
+    }
+
+    time_t last = t.last;
+    time_t oldest = last - (time_t)(t.cnt - 1) * t.period;
+    if ((to <= 0) || (to > last))
+    {
+        to = last;
+    }
+    if (from < oldest)
+    {
+        from = oldest;
+    }
+    if (from > to)
+    {
+        obj["t0"] = 0;
+        return;
+    }
+
+    uint16_t ageFrom = (last - from) / t.period;
+    uint16_t ageTo = (last - to + t.period - 1) / t.period;
+    uint32_t n = ageFrom - ageTo + 1;
+    time_t t0 = last - (time_t)ageFrom * t.period;
+    obj["t0"] = t0;
+
+    if ((points == 0) || (n <= points))
+    {
+        for (uint16_t age = ageFrom + 1; age-- > ageTo;)
+        {
+            const uint16_t *p = TierAt(t, age);
+            for (uint8_t w = 0; w < t.width; w++)
+            {
+                add(arr[w], Decode(p[w]));
+            }
+        }
+        return;
+    }
+
+    JsonArray times = obj["t"].to<JsonArray>();
+    if (t.width == 1)
+    {
+        int32_t *vals = (int32_t *)ps_malloc(n * sizeof(int32_t));
+        uint32_t *idx = (uint32_t *)ps_malloc(points * sizeof(uint32_t));
+        if ((vals != NULL) && (idx != NULL))
+        {
+            for (uint32_t i = 0; i < n; i++)
+            {
+                vals[i] = Decode(TierAt(t, ageFrom - i)[0]);
+            }
+            uint16_t cnt = ChartReduce::Reduce(q.mode, vals, n, points, idx);
+            for (uint16_t k = 0; k < cnt; k++)
+            {
+                add(arr[0], vals[idx[k]]);
+                times.add(t0 + (time_t)idx[k] * t.period);
+            }
+        }
+        free(vals);
+        free(idx);
+        return;
+    }
+
+    /*agregovane hodnoty se slucuji do points intervalu*/
+    for (uint16_t b = 0; b < points; b++)
+    {
+        uint32_t start = (uint64_t)b * n / points;
+        uint32_t end = (uint64_t)(b + 1) * n / points;
+        int32_t vMin = CHART_NO_DATA;
+        int32_t vMax = CHART_NO_DATA;
+        int32_t sum = 0;
+        uint32_t cnt = 0;
+        for (uint32_t i = start; i < end; i++)
+        {
+            const uint16_t *p = TierAt(t, ageFrom - i);
+            if (p[1] == Missing())
+            {
+                continue;
+            }
+            vMin = ((vMin == CHART_NO_DATA) || (Decode(p[0]) < vMin)) ? Decode(p[0]) : vMin;
+            vMax = std::max(vMax, Decode(p[2]));
+            sum += Decode(p[1]);
+            cnt++;
+        }
+        add(arr[0], vMin);
+        add(arr[1], (cnt > 0) ? sum / (int32_t)cnt : CHART_NO_DATA);
+        add(arr[2], vMax);
+        times.add(t0 + (time_t)start * t.period);
+    }
+}
+
+chartres_t ChartSeries::ParseRes(const char *txt)
+{
+    for (int i = 0; i < ChartRes_Nmr; i++)
+    {
+        if ((txt != NULL) && (strcmp(txt, resNames[i]) == 0))
+        {
+            return (chartres_t)i;
+        }
+    }
+    return ChartRes_Auto;
+}
+
+const char *ChartSeries::ResName(chartres_t res)
+{
+    return (res < ChartRes_Nmr) ? resNames[res] : "auto";
+}
@@ -0,0 +1,150 @@
+/***********************************************************************
+ * Filename: chart_series.h
+ * Author: agent
+ * Date: 2026-10-17
+ * Description:
+ *     Declares the ChartSeries class, a multi-resolution time series
+ *     used by chart parameters. Samples are kept in three tiers
+ *     (raw samples, hourly and daily min/mean/max) and persisted to
+ *     the storage partition as delta/zigzag varint compressed blocks.
+ *
+ *     File layout (little endian):
+ *       ChartFileHdr_t
+ *       ChartTierHdr_t + chartacc_t + width * cnt varints, per tier
+ *       uint32_t FNV-1a hash of all preceding bytes
+ *
+ ***********************************************************************/
+
+
+#pragma once
+
+#include <stdint.h>
+#include <time.h>
+#include "Arduino.h"
+#include "ArduinoJson.h"
+#include "chart_reduce.h"
+
+#define CHART_RAW_PERIOD_S (3 * 60)      /*perioda vzorkovani lokalnich grafu*/
+#define CHART_RAW_SAMPLES 512            /*24 h pri periode 3 min + rezerva*/
+#define CHART_HOUR_SAMPLES (30 * 24)     /*hodinove hodnoty za 30 dni*/
+#define CHART_DAY_SAMPLES 366            /*denni hodnoty za rok*/
+#define CHART_VALID_TIME 1577836800UL    /*2020-01-01, starsi cas neni synchronizovan*/
+#define CHART_FILE_MAGIC 0x53524843UL    /*"CHRS"*/
+#define CHART_FILE_VERSION 1
+#define CHART_DIR "/charts"
+
+typedef enum
+{
+    ChartRes_Raw = 0,
+    ChartRes_Hour,
+    ChartRes_Day,
+    ChartRes_Nmr,
+    ChartRes_Auto = 0xFF,
+} chartres_t;
+
+typedef struct
+{
+    chartres_t res;
+    time_t from;
+    time_t to;         /*0 = po posledni vzorek*/
+    uint16_t points;   /*max. pocet bodu, 0 = bez redukce*/
+    chartreduce_t mode;
+} chartquery_t;
+
+typedef struct
+{
+    uint16_t *buf;   /*cap * width hodnot*/
+    uint16_t cap;
+    uint16_t cnt;
+    uint16_t head;   /*index pro dalsi zapis*/
+    uint8_t width;   /*1 = vzorek, 3 = min, mean, max*/
+    uint32_t period; /*perioda vzorku [s]*/
+    uint32_t last;   /*cas nejnovejsiho vzorku, 0 = neznamy*/
+    uint32_t seq;    /*pocet vsech zapsanych vzorku*/
+} charttier_t;
+
+typedef struct
+{
+    uint32_t seq; /*seq raw tieru pri vytvoreni kurzoru*/
+    uint16_t cnt; /*pocet vzorku k precteni*/
+    uint16_t pos; /*pocet jiz prectenych vzorku*/
+} chartcursor_t;
+
+typedef struct
+{
+    int32_t min;
+    int32_t max;
+    int32_t sum;
+    uint32_t cnt;
+    uint32_t slot; /*zacatek agregovaneho intervalu [s]*/
+} __attribute__((packed)) chartacc_t;
+
+typedef struct
+{
+    uint32_t magic;
+    uint8_t version;
+    uint8_t sgn;
+    uint8_t tiers;
+    uint8_t reserved;
+} __attribute__((packed)) ChartFileHdr_t;
+
+typedef struct
+{
+    uint8_t width;
+    uint8_t reserved;
+    uint16_t cnt;
+    uint32_t period;
+    uint32_t last;
+} __attribute__((packed)) ChartTierHdr_t;
+
+class ChartSeries
+{
+private:
+    charttier_t tier[ChartRes_Nmr];
+    chartacc_t acc[ChartRes_Nmr];
+    bool sgn;
+    char *fname;
+
+    uint16_t Encode(int32_t v) const;
+    int32_t Decode(uint16_t v) const;
+    int32_t Bits(uint16_t v) const;
+    uint16_t Missing(void) const;
+
+    void TierAlloc(chartres_t res, uint16_t cap, uint8_t width, uint32_t period);
+    void TierPush(charttier_t &t, const int32_t *vals, uint32_t time);
+    const uint16_t *TierAt(const charttier_t &t, uint16_t age) const;
+    bool Accumulate(chartres_t res, int32_t val, uint32_t time);
+
+    static size_t PutVarint(uint8_t *buf, uint32_t v);
+    static bool GetVarint(const uint8_t *buf, size_t len, size_t &pos, uint32_t &v);
+    size_t MaxFileSize(void) const;
+    size_t EncodeTier(chartres_t res, uint8_t *buf) const;
+    bool DecodeTier(chartres_t res, const uint8_t *buf, size_t len, size_t &pos);
+
+public:
+    ChartSeries(bool sgn);
+    ~ChartSeries();
+
+    ChartSeries(const ChartSeries &) = delete;
+    ChartSeries &operator=(const ChartSeries &) = delete;
+
+    void Init(uint16_t rawSamples, uint32_t rawPeriod);
+    void Clear(void);
+    bool Open(const char *name);
+    void Save(void);
+    void Remove(void);
+
+    void Add(int32_t val, time_t t);
+    int32_t Last(void) const;
+    uint16_t RawCount(void) const;
+    int32_t RawAt(uint16_t age) const;
+    uint32_t RawPeriod(void) const;
+    void RawCursor(chartcursor_t &cur) const;
+    uint16_t RawRead(chartcursor_t &cur, int32_t *out, uint16_t n) const;
+
+    chartres_t SelectRes(time_t from) const;
+    void Query(const chartquery_t &q, JsonObject obj) const;
+
+    static chartres_t ParseRes(const char *txt);
+    static const char *ResName(chartres_t res);
+};
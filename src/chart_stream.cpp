@@ -0,0 +1,102 @@
+/***********************************************************************
+ * Filename: chart_stream.cpp
+ * Author: agent
+ * Date: 2026-10-17
+ * Description:
+ *     Implements the ChartStream class. A text (prefix, one value or
+ *     suffix) is formatted only when the previous one is sent whole,
+ *     so any chunk size down to one byte gives the same output.
+ *
+ ***********************************************************************/
+
+#include <algorithm>
+#include <stdio.h>
+#include <string.h>
+#include "chart_stream.h"
+
+void ChartStream::SetText(bool suffix)
+{
+    Text(suffix, text, sizeof(text));
+    textLen = strlen(text);
+    textPos = 0;
+}
+
+//*****************************************************************************
+//! Start the array, single sample is sent twice so the chart draws a line
+//*****************************************************************************
+void ChartStream::Begin(bool single)
+{
+    valCnt = 0;
+    valPos = 0;
+    first = true;
+    dup = single;
+    SetText(false);
+    phase = ChartStream_Prefix;
+}
+
+//*****************************************************************************
+//! Write next part of chart JSON into buf, returns written length (0 = done)
+//*****************************************************************************
+size_t ChartStream::Read(char *buf, size_t maxLen)
+{
+    size_t out = 0;
+    while ((out < maxLen) && (phase != ChartStream_Done))
+    {
+        if (textPos < textLen)
+        {
+            size_t n = std::min(maxLen - out, (size_t)(textLen - textPos));
+            memcpy(buf + out, text + textPos, n);
+            textPos += n;
+            out += n;
+            continue;
+        }
+
+        switch (phase)
+        {
+        case ChartStream_Prefix:
+            phase = ChartStream_Vals;
+            break;
+
+        case ChartStream_Vals:
+            if (valPos == valCnt)
+            {
+                valCnt = ReadBlock(vals, CHART_STREAM_BLOCK);
+                valPos = 0;
+                if (valCnt == 0)
+                {
+                    SetText(true);
+                    phase = ChartStream_Suffix;
+                }
+            }
+            else
+            {
+                char num[12];
+                int32_t v = vals[valPos++];
+                if (v == CHART_NO_DATA)
+                {
+                    strcpy(num, "null");
+                }
+                else
+                {
+                    snprintf(num, sizeof(num), "%ld", (long)v);
+                }
+                if (dup)
+                {
+                    textLen = snprintf(text, sizeof(text), "%s,%s", num, num);
+                }
+                else
+                {
+                    textLen = snprintf(text, sizeof(text), "%s%s", first ? "" : ",", num);
+                }
+                textPos = 0;
+                first = false;
+            }
+            break;
+
+        default:
+            phase = ChartStream_Done;
+            break;
+        }
+    }
+    return out;
+}
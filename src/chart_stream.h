@@ -0,0 +1,58 @@
+/***********************************************************************
+ * Filename: chart_stream.h
+ * Author: agent
+ * Date: 2026-10-17
+ * Description:
+ *     Declares the ChartStream class, JSON array of chart samples
+ *     written in chunks straight into a response buffer. Samples are
+ *     read in blocks of CHART_STREAM_BLOCK from the derived class, so
+ *     neither a JsonDocument nor a copy of the whole series is needed.
+ *     The class uses only the C++ standard library, so it builds
+ *     natively as well as on target.
+ *
+ ***********************************************************************/
+
+
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include "chart_reduce.h"
+
+#define CHART_STREAM_BLOCK 32 /*pocet vzorku ctenych pod jednim zamcenim*/
+
+typedef enum
+{
+    ChartStream_Prefix,
+    ChartStream_Vals,
+    ChartStream_Suffix,
+    ChartStream_Done,
+} chartstream_phase_t;
+
+class ChartStream
+{
+protected:
+    int32_t vals[CHART_STREAM_BLOCK];
+    uint8_t valCnt;
+    uint8_t valPos;
+    char text[48]; /*prave odesilany text (prefix, hodnota, suffix)*/
+    uint8_t textLen;
+    uint8_t textPos;
+    uint8_t phase;
+    bool first;
+    bool dup; /*jediny vzorek se posila dvakrat (kvuli vykresleni grafu)*/
+
+    void SetText(bool suffix);
+
+    //! next block of samples, 0 = no more samples
+    virtual uint16_t ReadBlock(int32_t *out, uint16_t n) = 0;
+    //! text before ("[") and after ("]") the array
+    virtual void Text(bool suffix, char *txt, size_t len) = 0;
+
+public:
+    ChartStream() : phase(ChartStream_Done) {}
+    virtual ~ChartStream() {}
+
+    void Begin(bool single);
+    size_t Read(char *buf, size_t maxLen);
+    bool Done(void) const { return phase == ChartStream_Done; }
+};
@@ -8,6 +8,7 @@
  ***********************************************************************/
 
 #include "device_manager.h"
+#include "esp_rom_crc.h"
 
 #define TIME_SCHEDULE(_t_secs) ((uint32_t)((_t_secs) * 1000 / COMMON_LOOP_TASK_PERIOD_MS))
 
@@ -15,6 +16,7 @@ std::vector<std::unique_ptr<Device>> DeviceManager::devices; // List of devices
 std::mutex DeviceManager::mutex;
 int32_t DeviceManager::updateDeviceId;
 uint32_t DeviceManager::saveTimer;
+fwbase_t DeviceManager::fwBasePending;
 
 void Device::setMacAddress(const uint8_t *addr)
 {
@@ -69,31 +71,90 @@ ParameterWrapper *Device::getParameterRegister(uint16_t addr)
 
 void Device::addParameter(const pardef_t_espnow &pd_esp_now)
 {
-    bool exists = false;
-    ParameterWrapper *existingParam = getParameter(pd_esp_now.adr);
-    if (existingParam)
+    ParameterWrapper *param = getParameter(pd_esp_now.adr);
+    Register *prevReg = (param != NULL) ? param->reg : NULL;
+    if (param)
     {
-        existingParam->UpdateDefinitions(pd_esp_now);
+        param->UpdateDefinitions(pd_esp_now);
     }
     else
     {
-        ParameterWrapper *param = new ParameterWrapper(pd_esp_now);
+        param = new ParameterWrapper(pd_esp_now);
         if (param)
         {
             parameters.push_back(std::unique_ptr<ParameterWrapper>(param));
         }
     }
+
+    /*graf se otevira jen pro novy registr, jinak by se ztratily neulozene vzorky*/
+    if (param && (param->reg != prevReg) && chart_base::IsChart(param->pd))
+    {
+        openChart(param);
+    }
+}
+
+//*****************************************************************************
+//! Assign storage file to chart parameter, file is named by MAC and address
+//*****************************************************************************
+void Device::chartFileName(const ParameterWrapper *param, char *buf, size_t len)
+{
+    snprintf(buf, len, CHART_DIR "/%02X%02X%02X%02X%02X%02X_%u.bin",
+             macAddress[0], macAddress[1], macAddress[2],
+             macAddress[3], macAddress[4], macAddress[5], param->pd.adr);
+}
+
+void Device::openChart(ParameterWrapper *param)
+{
+    char fname[40];
+    chartFileName(param, fname, sizeof(fname));
+    static_cast<chart_base *>(param->reg)->Open(param->pd.max, param->pd.min * 60, fname);
+}
+
+void Device::removeCharts(void)
+{
+    for (auto &par : parameters)
+    {
+        if (chart_base::IsChart(par->pd))
+        {
+            static_cast<chart_base *>(par->reg)->Remove();
+        }
+    }
+}
+
+bool Device::ChartJsonQuery(const String &name, const chartquery_t &q, JsonObject doc)
+{
+    ParameterWrapper *par = getParameter(name.c_str());
+    if ((par == NULL) || !chart_base::IsChart(par->pd))
+    {
+        return false;
+    }
+    static_cast<chart_base *>(par->reg)->Query(q, doc);
+    return true;
 }
 
-uint8_t Device::setRegisterVal(uint16_t addr, int16_t val)
+uint16_t Device::setRegisterRange(uint16_t addr, const int16_t *vals, uint16_t nmr)
 {
-    uint8_t nmr = 0;
-    ParameterWrapper *pReg = getParameterRegister(addr);
-    if (pReg && !pReg->changed)
+    uint16_t cnt = 0;
+    uint16_t i = 0;
+    while (i < nmr)
     {
-        nmr = pReg->reg->SetRegVal(val, addr);
+        uint16_t adr = addr + i;
+        ParameterWrapper *pReg = getParameterRegister(adr);
+        if (pReg == NULL)
+        {
+            i++;
+            continue;
+        }
+
+        /*all words of one parameter are written at once*/
+        uint16_t n = std::min((uint16_t)(pReg->pd.adr + pReg->reg->GetSize() - adr), (uint16_t)(nmr - i));
+        if (!pReg->changed)
+        {
+            cnt += pReg->reg->SetRegVals(&vals[i], adr, n);
+        }
+        i += n;
     }
-    return nmr;
+    return cnt;
 }
 
 void Device::GetDeviceJson(JsonObject obj, bool for_saving)
@@ -141,30 +202,48 @@ void Device::GetParametersJson(JsonArray arr, bool for_saving)
     }
 }
 
-bool Device::ParameterJsonRead(const String &name, JsonObject doc)
+bool Device::ParameterJsonRead(const String &name, JsonObject doc, uint16_t points, chartreduce_t mode)
 {
     ParameterWrapper *par = getParameter(name.c_str());
     JsonVariant var = doc[name].to<JsonVariant>();
     if (par != NULL && par->reg->IsReadable())
     {
-        par->reg->GetJsonVal(var);
+        if ((points > 0) && chart_base::IsChart(par->pd))
+        {
+            static_cast<chart_base *>(par->reg)->GetJsonValReduced(var, points, mode);
+        }
+        else
+        {
+            par->reg->GetJsonVal(var);
+        }
         return true;
     }
     return false;
 }
 
+//*****************************************************************************
+//! Write several parameters, frames of changed parameters are built once
+//! after the whole batch instead of after every parameter
+//*****************************************************************************
 bool Device::SetParametersJson(JsonArray arr)
 {
     bool retval = true;
+    bool changed = false;
 
     for (JsonObject par : arr)
     {
-        retval &= SetParameterJson(par);
+        bool res = SetParameterJson(par, false);
+        changed |= res;
+        retval &= res;
+    }
+    if (changed)
+    {
+        BuildParamFrames();
     }
     return retval;
 }
 
-bool Device::SetParameterJson(JsonObject par)
+bool Device::SetParameterJson(JsonObject par, bool rebuild)
 {
     bool retval = true;
     uint16_t addr;
@@ -195,6 +274,10 @@ bool Device::SetParameterJson(JsonObject par)
         if (res)
         {
             wPar->changed = true;
+            if (rebuild)
+            {
+                BuildParamFrames();
+            }
         }
         else
         {
@@ -244,7 +327,8 @@ uint32_t Device::GetCommunicationPeriod(void)
         if (par->pd.atr & COMM_PERIOD_FLAG)
         {
             int16_t tmp;
-            par->reg->GetRegVal(&tmp, par->pd.adr);
+            RegCursor cur;
+            par->reg->GetRegVal(&tmp, par->pd.adr, cur);
             return (uint32_t)tmp;
         }
     }
@@ -258,13 +342,106 @@ uint32_t Device::GetFWVersion(void)
         if (par->pd.atr & FW_VERSION_FLAG)
         {
             int16_t tmp;
-            par->reg->GetRegVal(&tmp, par->pd.adr);
+            RegCursor cur;
+            par->reg->GetRegVal(&tmp, par->pd.adr, cur);
             return (uint32_t)tmp;
         }
     }
     return 0;
 }
 
+bool Device::SupportsBatchWrite(void)
+{
+    for (auto &par : parameters)
+    {
+        if (par->pd.atr & BATCH_WRITE_FLAG)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+//*****************************************************************************
+//! Pack changed parameters into as few MSG_WRITE_PARAMS_REQUEST frames as
+//! possible, adjacent parameters share one range. Frames are ready when
+//! the accessory wakes up.
+//*****************************************************************************
+void Device::BuildParamFrames(void)
+{
+    paramFrames.clear();
+    if (!SupportsBatchWrite())
+    {
+        return;
+    }
+
+    std::vector<ParameterWrapper *> list;
+    for (auto &par : parameters)
+    {
+        if (par->changed)
+        {
+            list.push_back(par.get());
+        }
+    }
+    std::sort(list.begin(), list.end(), [](const ParameterWrapper *a, const ParameterWrapper *b)
+              { return a->pd.adr < b->pd.adr; });
+
+    Message *frame = NULL;
+    WriteRangeHeader *range = NULL;
+    for (auto par : list)
+    {
+        uint16_t nmr = std::min(par->reg->GetSize(), (size_t)MAX_PARAM_READS_WRITES);
+        bool extend = (range != NULL) && ((range->regAddr + range->nmr) == par->pd.adr) &&
+                      ((range->nmr + nmr) <= UINT8_MAX) && ((frame->payloadSize + nmr * sizeof(int16_t)) <= MAX_PAYLOAD_SIZE);
+        if (!extend)
+        {
+            if ((frame == NULL) || ((frame->payloadSize + sizeof(WriteRangeHeader) + nmr * sizeof(int16_t)) > MAX_PAYLOAD_SIZE))
+            {
+                paramFrames.emplace_back();
+                frame = &paramFrames.back();
+                frame->messageType = MSG_WRITE_PARAMS_REQUEST;
+                frame->payloadSize = 0;
+            }
+            range = (WriteRangeHeader *)(frame->payload + frame->payloadSize);
+            range->regAddr = par->pd.adr;
+            range->nmr = 0;
+            frame->payloadSize += sizeof(WriteRangeHeader);
+        }
+
+        int16_t values[MAX_PARAM_READS_WRITES];
+        par->reg->GetRegVals(values, par->pd.adr, nmr);
+        memcpy(frame->payload + frame->payloadSize, values, nmr * sizeof(int16_t));
+        frame->payloadSize += nmr * sizeof(int16_t);
+        range->nmr += nmr;
+    }
+}
+
+//*****************************************************************************
+//! Set changed flag of all parameters written by frame
+//*****************************************************************************
+void Device::MarkParamFrame(const Message *frame, bool changed)
+{
+    uint8_t pos = 0;
+    while ((pos + sizeof(WriteRangeHeader)) <= frame->payloadSize)
+    {
+        WriteRangeHeader range;
+        memcpy(&range, frame->payload + pos, sizeof(range));
+        uint16_t i = 0;
+        while (i < range.nmr)
+        {
+            ParameterWrapper *par = getParameterRegister(range.regAddr + i);
+            if (par == NULL)
+            {
+                i++;
+                continue;
+            }
+            par->changed = changed;
+            i = par->pd.adr + par->reg->GetSize() - range.regAddr;
+        }
+        pos += sizeof(range) + range.nmr * sizeof(int16_t);
+    }
+}
+
 bool Device::FWUpdateBegin(size_t len)
 {
     if (fwUpdateRequested || fwUpdateData != NULL)
@@ -348,91 +525,86 @@ void CameraDevice::handleByteStream(const ByteStreamPayload *payload)
 
 bool Device::FWUpdateEnd()
 {
-    if (fwUpdateData != NULL)
+    if (fwUpdateRequested)
     {
         free(fwUpdateData);
         fwSize = 0;
         fwDataCap = 0;
         fwUpdateData = NULL;
         fwUpdateRequested = false;
+        fwNoDelta = false;
+        FWPackFree();
         SystemLog::PutLog("Firmware zarizeni byl uspesne aktualizovan", v_info);
         return true;
     }
     return false;
 }
 
+void Device::FWPackFree(void)
+{
+    if (fwPackData != NULL)
+    {
+        free(fwPackData);
+        fwPackData = NULL;
+    }
+    fwPackSize = 0;
+    fwPackState = FW_PACK_NONE;
+}
+
 void DeviceManager::applyPendingChanges(const uint8_t *mac_addr)
 {
-    std::unique_lock<std::mutex> lock(mutex);
+    std::lock_guard<std::mutex> lock(mutex);
 
     Device *dev = GetDeviceByMac(mac_addr);
     if (dev)
     {
         dev->lastCommunication = millis();
         dev->nextCommunication = 0;
-        for (auto &par : dev->parameters)
+        bool batch = dev->SupportsBatchWrite();
+        if (batch)
         {
-            if (par->changed)
+            if (dev->paramFrames.empty())
+            { /*podpora davkoveho zapisu zjistena az po zmene*/
+                dev->BuildParamFrames();
+            }
+            for (auto &frame : dev->paramFrames)
             {
-                WriteRequestPayload payload;
-                payload.regAddr = par->pd.adr;
-                payload.nmr = par->reg->GetSize();
-                for (int i = 0; i < payload.nmr; i++)
-                {
-                    par->reg->GetRegVal(&payload.values[i], payload.regAddr + i);
-                }
-                if (ESPNowCtrl::SendMessage(mac_addr, MSG_WRITE_PARAM_REQUEST, payload, 4 + payload.nmr * 2))
+                if (!ESPNowCtrl::SendMessage(mac_addr, MSG_WRITE_PARAMS_REQUEST, frame.payload, frame.payloadSize, paramFrameDone))
                 {
-                    par->changed = false;
+                    break;
                 }
+                dev->MarkParamFrame(&frame, false);
             }
+            /*neodeslane parametry zustavaji zmenene*/
+            dev->BuildParamFrames();
         }
-
-        if (dev->fwUpdateRequested)
+        for (auto &par : dev->parameters)
         {
-            dev->locked = true;
-            uint32_t fwSize = dev->fwSize;
-            uint8_t *updateData = dev->fwUpdateData;
-            lock.unlock();
-            uint8_t max_data_len = sizeof(UpdateRequestPayload::data);
-            UpdateRequestPayload payload;
-            for (uint32_t pos = 0; pos < fwSize; pos += max_data_len)
+            if (par->changed && !batch)
             {
-                payload.index = pos;
-                payload.isFW = 1;
-
-                uint8_t nmr;
-
-                if ((pos + max_data_len) < fwSize)
-                {
-                    nmr = max_data_len;
-                    payload.isFinal = 0;
-                }
-                else
+                WriteRequestPayload payload;
+                payload.regAddr = par->pd.adr;
+                payload.nmr = std::min(par->reg->GetSize(), (size_t)MAX_PARAM_READS_WRITES);
+                int16_t values[MAX_PARAM_READS_WRITES];
+                par->reg->GetRegVals(values, payload.regAddr, payload.nmr);
+                memcpy(payload.values, values, payload.nmr * sizeof(int16_t));
+                if (ESPNowCtrl::SendMessage(mac_addr, MSG_WRITE_PARAM_REQUEST, payload, 4 + payload.nmr * 2, paramWriteDone))
                 {
-                    nmr = fwSize - pos;
-                    payload.isFinal = 1;
+                    par->changed = false;
                 }
-                payload.nmr = nmr;
-                memcpy(payload.data, updateData + pos, nmr);
+            }
+        }
 
-                if (!ESPNowCtrl::SendMessage(mac_addr, MSG_FW_UPDATE_REQUEST, payload, sizeof(UpdateRequestPayload) - max_data_len + nmr, 10))
-                {
-                    SystemLog::PutLog("Pri aktualizaci firmwaru zarizeni doslo k chybe, pos: " + String(pos), v_error);
-                    dev->locked = false;
-                    break;
-                }
-                delay(2);
+        if (dev->locked && (dev->fwPackState != FW_PACK_BUSY))
+        { /*prenos firmwaru probiha, TRANSMIT_DONE odesle fwFinish*/
+            return;
+        }
 
-                if (payload.isFinal)
-                {
-                    lock.lock();
-                    dev->FWUpdateEnd();
-                    dev->locked = false;
-                    delay(1000);
-                    break;
-                }
-            }
+        /*behem komprese se zarizeni aktualizuje az pri pristim probuzeni*/
+        if (dev->fwUpdateRequested && ((dev->fwPackState == FW_PACK_READY) || (dev->fwPackState == FW_PACK_RAW)))
+        {
+            fwStart(dev);
+            return;
         }
         ESPNowCtrl::SendMessage(mac_addr, MSG_TRANSMIT_DONE);
     }
@@ -442,7 +614,297 @@ void DeviceManager::applyPendingChanges(const uint8_t *mac_addr)
         PairResponsePayload response;
         response.state = PAIR_STATE_EXPIRED;
         ESPNowCtrl::SendMessage(mac_addr, MSG_PAIR_RESPONSE, response, sizeof(PairResponsePayload));
-        ESPNowCtrl::SendMessage(mac_addr, MSG_TRANSMIT_DONE);
+        if (!ESPNowCtrl::SendMessage(mac_addr, MSG_TRANSMIT_DONE, expiredDone))
+        {
+            ESPNowCtrl::DeletePeer(mac_addr);
+        }
+    }
+}
+
+//*****************************************************************************
+//! Write request was not delivered, parameter is sent again next time
+//*****************************************************************************
+void DeviceManager::paramWriteDone(const uint8_t *mac_addr, const Message *msg, bool ok, void *arg)
+{
+    if (ok)
+    {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    Device *dev = GetDeviceByMac(mac_addr);
+    if (dev)
+    {
+        const WriteRequestPayload *payload = (const WriteRequestPayload *)(msg->payload);
+        ParameterWrapper *par = dev->getParameter(payload->regAddr);
+        if (par)
+        {
+            par->changed = true;
+        }
+    }
+}
+
+//*****************************************************************************
+//! Frame of parameters was not delivered, its parameters are sent again
+//*****************************************************************************
+void DeviceManager::paramFrameDone(const uint8_t *mac_addr, const Message *msg, bool ok, void *arg)
+{
+    if (ok)
+    {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    Device *dev = GetDeviceByMac(mac_addr);
+    if (dev)
+    {
+        dev->MarkParamFrame(msg, true);
+        dev->BuildParamFrames();
+    }
+}
+
+//*****************************************************************************
+//! Queue one FW chunk, next chunk is queued from fwChunkDone (mutex locked)
+//*****************************************************************************
+bool DeviceManager::sendFWChunk(Device *dev, uint32_t pos)
+{
+    uint8_t max_data_len = sizeof(UpdateRequestPayload::data);
+    UpdateRequestPayload payload;
+    payload.index = pos;
+    payload.atr = 0;
+    payload.isFW = 1;
+
+    uint8_t nmr;
+    if ((pos + max_data_len) < dev->fwSize)
+    {
+        nmr = max_data_len;
+        payload.isFinal = 0;
+    }
+    else
+    {
+        nmr = dev->fwSize - pos;
+        payload.isFinal = 1;
+    }
+    payload.nmr = nmr;
+    memcpy(payload.data, dev->fwUpdateData + pos, nmr);
+
+    return ESPNowCtrl::SendMessage(dev->macAddress, MSG_FW_UPDATE_REQUEST, payload, sizeof(UpdateRequestPayload) - max_data_len + nmr, fwChunkDone, NULL, 10);
+}
+
+void DeviceManager::fwChunkDone(const uint8_t *mac_addr, const Message *msg, bool ok, void *arg)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    Device *dev = GetDeviceByMac(mac_addr);
+    if ((dev == NULL) || !dev->locked || dev->fwWindowed)
+    {
+        return;
+    }
+
+    const UpdateRequestPayload *payload = (const UpdateRequestPayload *)(msg->payload);
+    if (!ok)
+    {
+        SystemLog::PutLog("Pri aktualizaci firmwaru zarizeni doslo k chybe, pos: " + String(payload->index), v_error);
+    }
+    else if (payload->isFinal)
+    {
+        fwBaseKeep(dev);
+        dev->FWUpdateEnd();
+    }
+    else if (sendFWChunk(dev, payload->index + payload->nmr))
+    {
+        return;
+    }
+    fwFinish(dev);
+}
+
+//*****************************************************************************
+//! Start windowed FW transfer, CRC32 of image (fwPackPending) is sent in
+//! verify frame
+//*****************************************************************************
+void DeviceManager::fwStart(Device *dev)
+{
+    dev->locked = true;
+    dev->fwWindowed = true;
+    dev->fwQueued = 0;
+    dev->fwWindow.Begin((dev->fwPackState == FW_PACK_RAW) ? dev->fwSize : dev->fwPackSize, millis());
+    fwPump(dev);
+}
+
+void DeviceManager::fwFinish(Device *dev)
+{
+    dev->locked = false;
+    dev->fwWindowed = false;
+    ESPNowCtrl::SendMessage(dev->macAddress, MSG_TRANSMIT_DONE);
+}
+
+//*****************************************************************************
+//! Keep FW_PIPE_DEPTH frames queued, window limits unacknowledged chunks
+//*****************************************************************************
+void DeviceManager::fwPump(Device *dev)
+{
+    bool packed = (dev->fwPackState != FW_PACK_RAW);
+    const uint8_t *data = packed ? dev->fwPackData : dev->fwUpdateData;
+    while (dev->fwQueued < FW_PIPE_DEPTH)
+    {
+        if (dev->fwWindow.NextVerify())
+        {
+            FwVerifyPayload verify;
+            verify.size = dev->fwSize;
+            verify.crc32 = dev->fwCrc;
+            verify.isFW = 1;
+            if (!ESPNowCtrl::SendMessage(dev->macAddress, MSG_FW_UPDATE_VERIFY, verify, sizeof(FwVerifyPayload), fwWindowDone))
+            {
+                break;
+            }
+            dev->fwQueued++;
+            continue;
+        }
+
+        uint32_t chunk;
+        bool ackReq;
+        if (!dev->fwWindow.Next(chunk, ackReq))
+        {
+            break;
+        }
+
+        UpdateRequestPayload payload;
+        uint8_t nmr = dev->fwWindow.ChunkLen(chunk);
+        payload.index = FwWindow::ChunkOffset(chunk);
+        payload.nmr = nmr;
+        payload.atr = 0;
+        payload.isFW = 1;
+        payload.isWindowed = 1;
+        payload.ackReq = ackReq;
+        payload.isCompressed = packed;
+        payload.isDelta = (dev->fwPackState == FW_PACK_DELTA);
+        memcpy(payload.data, data + payload.index, nmr);
+        /*ztraceny blok resi okno, ne opakovani na urovni ESPNowCtrl*/
+        if (!ESPNowCtrl::SendMessage(dev->macAddress, MSG_FW_UPDATE_REQUEST, payload, sizeof(UpdateRequestPayload) - sizeof(payload.data) + nmr, fwWindowDone, NULL, 1))
+        {
+            dev->fwWindow.Lost(chunk);
+            break;
+        }
+        dev->fwQueued++;
+    }
+}
+
+void DeviceManager::fwWindowDone(const uint8_t *mac_addr, const Message *msg, bool ok, void *arg)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    Device *dev = GetDeviceByMac(mac_addr);
+    if ((dev == NULL) || !dev->locked || !dev->fwWindowed)
+    {
+        return;
+    }
+
+    if (dev->fwQueued > 0)
+    {
+        dev->fwQueued--;
+    }
+    if (!ok && (msg->messageType == MSG_FW_UPDATE_REQUEST))
+    {
+        const UpdateRequestPayload *payload = (const UpdateRequestPayload *)(msg->payload);
+        dev->fwWindow.Lost(payload->index / FW_CHUNK_SIZE);
+    }
+    fwPump(dev);
+}
+
+void DeviceManager::fwAckHandler(const uint8_t *mac_addr, const FwUpdateAckPayload *payload)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    Device *dev = GetDeviceByMac(mac_addr);
+    if ((dev == NULL) || !dev->locked || !dev->fwWindowed)
+    {
+        return;
+    }
+
+    dev->lastCommunication = millis();
+    switch (payload->state)
+    {
+    case FW_ACK_PROGRESS:
+        dev->fwWindow.Ack(payload->base, payload->bitmap, millis());
+        fwPump(dev);
+        break;
+
+    case FW_ACK_VERIFY_OK:
+        if (dev->fwWindow.Done())
+        {
+            fwBaseKeep(dev);
+            dev->FWUpdateEnd();
+            fwFinish(dev);
+        }
+        break;
+
+    case FW_ACK_UNSUPPORTED:
+    case FW_ACK_BASE_MISMATCH:
+        /*odpovedi na bloky odeslane pred restartem se ignoruji*/
+        if (dev->fwPackState == FW_PACK_DELTA)
+        { /*cely image se komprimuje v Task, prenese se pri pristim probuzeni*/
+            SystemLog::PutLog("Zarizeni odmitlo rozdilovy FW, bude prenesen cely image", v_warning);
+            dev->fwNoDelta = true;
+            dev->FWPackFree();
+            fwFinish(dev);
+        }
+        else if ((payload->state == FW_ACK_UNSUPPORTED) && (dev->fwPackState == FW_PACK_READY))
+        {
+            SystemLog::PutLog("Zarizeni nepodporuje komprimovany FW, prenasi se puvodni image", v_warning);
+            dev->FWPackFree();
+            dev->fwPackState = FW_PACK_RAW;
+            fwStart(dev);
+        }
+        break;
+
+    default:
+        SystemLog::PutLog("Kontrolni soucet firmwaru v zarizeni nesouhlasi", v_error);
+        fwFinish(dev);
+        break;
+    }
+}
+
+//*****************************************************************************
+//! ACK timeouts of running transfers, accessory which never answered
+//! is updated again by stop-and-wait transfer (firmware without ACK)
+//*****************************************************************************
+void DeviceManager::fwTimeouts(void)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    uint32_t now = millis();
+    for (auto &device : devices)
+    {
+        Device *dev = device.get();
+        if (!dev->locked || !dev->fwWindowed || !dev->fwWindow.Timeout(now))
+        {
+            continue;
+        }
+        if (!dev->fwWindow.Failed())
+        {
+            fwPump(dev);
+        }
+        else if (!dev->fwWindow.AckSeen())
+        {
+            SystemLog::PutLog("Zarizeni nepotvrzuje bloky FW, pouzit prenos stop-and-wait", v_warning);
+            dev->fwWindowed = false;
+            if (!sendFWChunk(dev, 0))
+            {
+                fwFinish(dev);
+            }
+        }
+        else
+        {
+            SystemLog::PutLog("Pri aktualizaci firmwaru zarizeni doslo k chybe, pos: " + String(FwWindow::ChunkOffset(dev->fwWindow.Base())), v_error);
+            fwFinish(dev);
+        }
+    }
+}
+
+//*****************************************************************************
+//! Unknown device was told its pairing expired, temporary peer is removed
+//*****************************************************************************
+void DeviceManager::expiredDone(const uint8_t *mac_addr, const Message *msg, bool ok, void *arg)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (GetDeviceByMac(mac_addr) == NULL)
+    {
         ESPNowCtrl::DeletePeer(mac_addr);
     }
 }
@@ -478,10 +940,10 @@ void DeviceManager::paramReadResponseHandler(const uint8_t *mac_addr, const Read
     Device *dev = GetDeviceByMac(mac_addr);
     if (dev)
     {
-        for (int i = 0; i < payload->nmr; i++)
-        {
-            dev->setRegisterVal(i + payload->regAddr, payload->values[i]);
-        }
+        int16_t values[MAX_PARAM_READS_WRITES];
+        uint16_t nmr = std::min((uint16_t)payload->nmr, (uint16_t)MAX_PARAM_READS_WRITES);
+        memcpy(values, payload->values, nmr * sizeof(int16_t));
+        dev->setRegisterRange(payload->regAddr, values, nmr);
     }
 }
 
@@ -554,6 +1016,13 @@ void DeviceManager::handleDataReceived(const uint8_t *mac_addr, const Message *m
         byteStreamHandler(mac_addr, (const ByteStreamPayload *)(msg->payload));
         break;
 
+    case MSG_FW_UPDATE_ACK:
+        if (msg->payloadSize == sizeof(FwUpdateAckPayload))
+        {
+            fwAckHandler(mac_addr, (const FwUpdateAckPayload *)(msg->payload));
+        }
+        break;
+
     default:
         break;
     }
@@ -597,8 +1066,7 @@ void DeviceManager::timeSyncRequestHandler(const uint8_t *mac_addr)
     payload.currentTime = Now();
     payload.sunriseTime = CasVychodu.Get();
     payload.sunsetTime = CasZapadu.Get();
-    String tmp = PopisCasu.Get();
-    strncpy(payload.timezone, tmp.c_str(), sizeof(payload.timezone) - 1);
+    PopisCasu.Get(payload.timezone, sizeof(payload.timezone));
     ESPNowCtrl::SendMessage(mac_addr, MSG_TIME_SYNC_RESPONSE, payload, sizeof(TimeSyncPayload));
 }
 
@@ -653,12 +1121,234 @@ void DeviceManager::Init()
     }
 }
 
+//*****************************************************************************
+//! Compress uploaded image outside of mutex, device is locked meanwhile so
+//! it is not removed and transfer does not start. Container is used only
+//! when it saves frames, patch against cached base only when it saves
+//! frames against the full container.
+//*****************************************************************************
+void DeviceManager::fwPackPending(void)
+{
+    Device *dev = NULL;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (auto &device : devices)
+        {
+            if (device->fwUpdateRequested && !device->locked && (device->fwPackState == FW_PACK_NONE))
+            {
+                dev = device.get();
+                dev->fwPackState = FW_PACK_BUSY;
+                dev->locked = true;
+                break;
+            }
+        }
+    }
+    if (dev == NULL)
+    {
+        return;
+    }
+
+    dev->fwCrc = esp_rom_crc32_le(0, dev->fwUpdateData, dev->fwSize);
+    uint32_t rawFrames = (dev->fwSize + FW_CHUNK_SIZE - 1) / FW_CHUNK_SIZE;
+
+    uint8_t *delta = NULL;
+    size_t deltaLen = dev->fwNoDelta ? 0 : fwDeltaPack(dev, delta);
+
+    size_t cap = FwPack::MaxSize(dev->fwSize);
+    uint8_t *pack = (uint8_t *)ps_malloc(cap);
+    size_t len = (pack != NULL) ? FwPack::Pack(dev->fwUpdateData, dev->fwSize, pack, cap) : 0;
+    if ((len == 0) || (((len + FW_CHUNK_SIZE - 1) / FW_CHUNK_SIZE) >= rawFrames))
+    {
+        free(pack);
+        pack = NULL;
+        len = 0;
+    }
+
+    FwPackState_t state = FW_PACK_RAW;
+    uint32_t frames = rawFrames;
+    if (pack != NULL)
+    {
+        state = FW_PACK_READY;
+        frames = (len + FW_CHUNK_SIZE - 1) / FW_CHUNK_SIZE;
+        SystemLog::PutLog("FW zarizeni komprimovan: " + String(dev->fwSize) + " -> " + String((uint32_t)len) + " B", v_info);
+    }
+    if ((delta != NULL) && (((deltaLen + FW_CHUNK_SIZE - 1) / FW_CHUNK_SIZE) < frames))
+    {
+        free(pack);
+        pack = delta;
+        len = deltaLen;
+        state = FW_PACK_DELTA;
+        SystemLog::PutLog("FW zarizeni prenasen jako rozdil: " + String((uint32_t)len) + " B", v_info);
+    }
+    else
+    {
+        free(delta);
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    dev->fwPackData = pack;
+    dev->fwPackSize = len;
+    dev->fwPackState = state;
+    dev->locked = false;
+}
+
+//*****************************************************************************
+//! Patch from cached base of the device type to uploaded image, packed by
+//! FwPack; returns container size or 0 (no base, same image, no memory)
+//*****************************************************************************
+size_t DeviceManager::fwDeltaPack(Device *dev, uint8_t *&pack)
+{
+    uint32_t baseSize, baseCrc;
+    uint8_t *base = fwBaseLoad(dev->deviceType, baseSize, baseCrc);
+    if ((base == NULL) || (baseCrc == dev->fwCrc))
+    {
+        free(base);
+        return 0;
+    }
+
+    /*patch vetsi nez image nema smysl*/
+    uint8_t *patch = (uint8_t *)ps_malloc(dev->fwSize);
+    size_t patchLen = (patch != NULL) ? FwDelta::Diff(base, baseSize, baseCrc, dev->fwUpdateData, dev->fwSize, patch, dev->fwSize) : 0;
+    free(base);
+
+    size_t len = 0;
+    if (patchLen != 0)
+    {
+        size_t cap = FwPack::MaxSize(patchLen);
+        pack = (uint8_t *)ps_malloc(cap);
+        len = (pack != NULL) ? FwPack::Pack(patch, patchLen, pack, cap) : 0;
+        if (len == 0)
+        {
+            free(pack);
+            pack = NULL;
+        }
+    }
+    free(patch);
+    return len;
+}
+
+String DeviceManager::fwBaseFileName(DeviceType_t type)
+{
+    return "/fwbase_" + String((uint32_t)type) + ".bin";
+}
+
+//*****************************************************************************
+//! Cached base image of device type (PSRAM, caller frees) or NULL
+//*****************************************************************************
+uint8_t *DeviceManager::fwBaseLoad(DeviceType_t type, uint32_t &size, uint32_t &crc)
+{
+    fwbasehdr_t hdr;
+    uint8_t *pack = NULL;
+    size_t packSize = 0;
+    {
+        std::lock_guard<std::mutex> lock(storageFS_lock);
+        File file = storageFS.open(fwBaseFileName(type), "r");
+        if (!file)
+        {
+            return NULL;
+        }
+        if ((file.read((uint8_t *)&hdr, sizeof(hdr)) == sizeof(hdr)) && (hdr.magic == FW_BASE_MAGIC) && (file.size() > sizeof(hdr)))
+        {
+            packSize = file.size() - sizeof(hdr);
+            pack = (uint8_t *)ps_malloc(packSize);
+            if ((pack != NULL) && (file.read(pack, packSize) != packSize))
+            {
+                free(pack);
+                pack = NULL;
+            }
+        }
+        file.close();
+    }
+    if (pack == NULL)
+    {
+        return NULL;
+    }
+
+    uint8_t *base = (uint8_t *)ps_malloc(hdr.size);
+    if ((base == NULL) || !FwPack::Unpack(pack, packSize, base, hdr.size) || (esp_rom_crc32_le(0, base, hdr.size) != hdr.crc32))
+    {
+        free(base);
+        base = NULL;
+    }
+    free(pack);
+    size = hdr.size;
+    crc = hdr.crc32;
+    return base;
+}
+
+//*****************************************************************************
+//! Image installed in accessory becomes base of its type, it is saved by
+//! Task outside of mutex (mutex locked)
+//*****************************************************************************
+void DeviceManager::fwBaseKeep(Device *dev)
+{
+    if (dev->fwUpdateData == NULL)
+    {
+        return;
+    }
+    free(fwBasePending.data);
+    fwBasePending.type = dev->deviceType;
+    fwBasePending.data = dev->fwUpdateData;
+    fwBasePending.size = dev->fwSize;
+    fwBasePending.crc = dev->fwCrc;
+    dev->fwUpdateData = NULL;
+}
+
+void DeviceManager::fwBaseSave(void)
+{
+    fwbase_t b;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        b = fwBasePending;
+        fwBasePending.data = NULL;
+    }
+    if (b.data == NULL)
+    {
+        return;
+    }
+
+    size_t cap = FwPack::MaxSize(b.size);
+    uint8_t *pack = (uint8_t *)ps_malloc(cap);
+    size_t len = (pack != NULL) ? FwPack::Pack(b.data, b.size, pack, cap) : 0;
+    free(b.data);
+    if (len != 0)
+    {
+        fwbasehdr_t hdr = {FW_BASE_MAGIC, b.size, b.crc};
+        String fname = fwBaseFileName(b.type);
+        String tmpName = fname + "~";
+        std::lock_guard<std::mutex> lock(storageFS_lock);
+        storageFS.remove(fname);
+        /*base je jen optimalizace, nesmi vytlacit logy a grafy*/
+        if ((storageFS.totalBytes() - storageFS.usedBytes()) > (len + sizeof(hdr) + FW_BASE_RESERVE))
+        {
+            File file = storageFS.open(tmpName, "w", true);
+            if (file)
+            {
+                bool ok = (file.write((const uint8_t *)&hdr, sizeof(hdr)) == sizeof(hdr)) && (file.write(pack, len) == len);
+                file.close();
+                if (!ok || !storageFS.rename(tmpName, fname))
+                {
+                    storageFS.remove(tmpName);
+                }
+            }
+        }
+        else
+        {
+            SystemLog::PutLog("Malo mista pro ulozeni FW zarizeni, rozdilove aktualizace nebudou mozne", v_warning);
+        }
+    }
+    free(pack);
+}
+
 void DeviceManager::Task()
 {
     if (EndTimer(saveTimer))
     {
         SaveDevicesToJson();
     }
+    fwBaseSave();
+    fwPackPending();
+    fwTimeouts();
 }
 
 Device *DeviceManager::CreateDevice(DeviceType_t deviceType, const uint8_t *macAddr)
@@ -832,12 +1522,12 @@ void DeviceManager::GetDeviceParameters(uint16_t id, JsonArray arr)
     }
 }
 
-bool DeviceManager::GetDeviceParameter(uint16_t id, const String &name, JsonObject doc)
+bool DeviceManager::GetDeviceParameter(uint16_t id, const String &name, JsonObject doc, uint16_t points, chartreduce_t mode)
 {
     std::lock_guard<std::mutex> lock(mutex);
     if (id < devices.size())
     {
-        return devices[id]->ParameterJsonRead(name, doc);
+        return devices[id]->ParameterJsonRead(name, doc, points, mode);
     }
     return false;
 }
@@ -851,6 +1541,16 @@ bool DeviceManager::GetDeviceParameterLocked(uint16_t id, const String &name, Js
     return false;
 }
 
+bool DeviceManager::GetDeviceChart(uint16_t id, const String &name, const chartquery_t &q, JsonObject doc)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (id < devices.size())
+    {
+        return devices[id]->ChartJsonQuery(name, q, doc);
+    }
+    return false;
+}
+
 bool DeviceManager::SetDeviceParameters(uint16_t id, JsonArray arr)
 {
     std::lock_guard<std::mutex> lock(mutex);
@@ -20,8 +20,38 @@
 #include "parameters.h"
 #include "log.h"
 #include "esp_now_ctrl.h"
+#include "fw_window.h"
+#include "fw_pack.h"
+#include "fw_delta.h"
 
 #define COMMUNICATION_TIMEOUT_S 60
+#define FW_PIPE_DEPTH 2 /*bloky FW soucasne ve fronte ESPNowCtrl*/
+#define FW_BASE_MAGIC 0x31425746 /*"FWB1"*/
+#define FW_BASE_RESERVE (256 * 1024) /*volne misto storage pro logy a grafy*/
+
+typedef enum
+{
+    FW_PACK_NONE = 0, /*image jeste nebyl komprimovan*/
+    FW_PACK_BUSY,     /*komprese bezi v DeviceManager::Task*/
+    FW_PACK_READY,    /*prenasi se kontejner FwPack*/
+    FW_PACK_RAW,      /*prenasi se puvodni image*/
+    FW_PACK_DELTA,    /*prenasi se kontejner FwPack s patchem FwDelta*/
+} FwPackState_t;
+
+typedef struct
+{
+    uint32_t magic;
+    uint32_t size;  /*velikost rozbaleneho image*/
+    uint32_t crc32; /*esp_rom_crc32_le(0, image, size)*/
+} __attribute__((packed)) fwbasehdr_t;
+
+typedef struct
+{
+    DeviceType_t type;
+    uint8_t *data;
+    uint32_t size;
+    uint32_t crc;
+} fwbase_t;
 
 class ParameterWrapper
 {
@@ -153,10 +183,19 @@ public:
     bool fwUpdateRequested;
     bool locked;
     uint32_t fwSize;
+    FwWindow fwWindow;
+    bool fwWindowed; /*false = prenos stop-and-wait pro starsi firmware zarizeni*/
+    uint8_t fwQueued;
+    uint32_t fwCrc;
+    uint8_t *fwPackData;
+    uint32_t fwPackSize;
+    FwPackState_t fwPackState;
+    bool fwNoDelta; /*zarizeni odmitlo patch, posila se cely image*/
+    std::vector<Message> paramFrames; /*zmenene parametry pripravene k odeslani*/
     Log_t logs[50];
     size_t logCount;
 
-    Device(DeviceType_t deviceType, const uint8_t *macAddr) : deviceType(deviceType), pairState(PAIR_STATE_INITIAL_REQUEST), fwUpdateRequested(false), fwUpdateData(NULL), fwSize(0), fwDataCap(0), locked(false), lastCommunication(0), nextCommunication(0), logCount(0)  
+    Device(DeviceType_t deviceType, const uint8_t *macAddr) : deviceType(deviceType), pairState(PAIR_STATE_INITIAL_REQUEST), fwUpdateRequested(false), fwUpdateData(NULL), fwSize(0), fwDataCap(0), locked(false), fwWindowed(false), fwQueued(0), fwCrc(0), fwPackData(NULL), fwPackSize(0), fwPackState(FW_PACK_NONE), fwNoDelta(false), lastCommunication(0), nextCommunication(0), logCount(0)  
     {
         setMacAddress(macAddr);
         ESPNowCtrl::AddPeer(macAddress, 0);
@@ -164,11 +203,16 @@ public:
 
     virtual ~Device()
     {
+        removeCharts();
         ESPNowCtrl::DeletePeer(macAddress);
         if (fwUpdateData != NULL)
         {
             free(fwUpdateData);
         }
+        if (fwPackData != NULL)
+        {
+            free(fwPackData);
+        }
     }
 
     void setMacAddress(const uint8_t *addr);
@@ -185,17 +229,25 @@ public:
 
     void addParameter(const pardef_t_espnow &pd_esp_now);
 
-    uint8_t setRegisterVal(uint16_t addr, int16_t val);
+    void chartFileName(const ParameterWrapper *param, char *buf, size_t len);
+
+    void openChart(ParameterWrapper *param);
+
+    void removeCharts(void);
+
+    bool ChartJsonQuery(const String &name, const chartquery_t &q, JsonObject doc);
+
+    uint16_t setRegisterRange(uint16_t addr, const int16_t *vals, uint16_t nmr);
 
     void GetDeviceJson(JsonObject obj, bool for_saving = false);
 
     void GetParametersJson(JsonArray arr, bool for_saving = false);
 
-    bool ParameterJsonRead(const String &name, JsonObject doc);
+    bool ParameterJsonRead(const String &name, JsonObject doc, uint16_t points = 0, chartreduce_t mode = ChartReduce_Lttb);
 
     bool SetParametersJson(JsonArray arr);
 
-    bool SetParameterJson(JsonObject par);
+    bool SetParameterJson(JsonObject par, bool rebuild = true);
 
     void PairDevice(String &name);
 
@@ -205,12 +257,20 @@ public:
 
     uint32_t GetFWVersion(void);
 
+    bool SupportsBatchWrite(void);
+
+    void BuildParamFrames(void);
+
+    void MarkParamFrame(const Message *frame, bool changed);
+
     bool FWUpdateBegin(size_t len);
 
     bool FWUpdateWrite(size_t index, uint8_t *data, size_t len, bool final);
 
     bool FWUpdateEnd();
 
+    void FWPackFree(void);
+
     virtual void handleByteStream(const ByteStreamPayload *payload)
     {
     }
@@ -287,6 +347,42 @@ private:
 
     static void byteStreamHandler(const uint8_t *mac_addr, const ByteStreamPayload *payload);
 
+    static void paramWriteDone(const uint8_t *mac_addr, const Message *msg, bool ok, void *arg);
+
+    static void paramFrameDone(const uint8_t *mac_addr, const Message *msg, bool ok, void *arg);
+
+    static bool sendFWChunk(Device *dev, uint32_t pos);
+
+    static void fwChunkDone(const uint8_t *mac_addr, const Message *msg, bool ok, void *arg);
+
+    static void expiredDone(const uint8_t *mac_addr, const Message *msg, bool ok, void *arg);
+
+    static void fwStart(Device *dev);
+
+    static void fwPump(Device *dev);
+
+    static void fwFinish(Device *dev);
+
+    static void fwWindowDone(const uint8_t *mac_addr, const Message *msg, bool ok, void *arg);
+
+    static void fwAckHandler(const uint8_t *mac_addr, const FwUpdateAckPayload *payload);
+
+    static void fwTimeouts(void);
+
+    static void fwPackPending(void);
+
+    static String fwBaseFileName(DeviceType_t type);
+
+    static uint8_t *fwBaseLoad(DeviceType_t type, uint32_t &size, uint32_t &crc);
+
+    static void fwBaseKeep(Device *dev);
+
+    static void fwBaseSave(void);
+
+    static size_t fwDeltaPack(Device *dev, uint8_t *&pack);
+
+    static fwbase_t fwBasePending;
+
 public:
     static std::mutex mutex;
 
@@ -308,10 +404,12 @@ public:
 
     static void GetDeviceParameters(uint16_t id, JsonArray arr);
 
-    static bool GetDeviceParameter(uint16_t id, const String &name, JsonObject doc);
+    static bool GetDeviceParameter(uint16_t id, const String &name, JsonObject doc, uint16_t points = 0, chartreduce_t mode = ChartReduce_Lttb);
 
     static bool GetDeviceParameterLocked(uint16_t id, const String &name, JsonObject doc);
 
+    static bool GetDeviceChart(uint16_t id, const String &name, const chartquery_t &q, JsonObject doc);
+
     static bool SetDeviceParameters(uint16_t id, JsonArray arr);
 
     static bool SetDeviceParameter(uint16_t id, JsonObject par);
@@ -7,6 +7,12 @@
  *     for initializing ESP-NOW communication, sending and receiving 
  *     messages, and managing peers. The class handles data reception 
  *     and transmission using callbacks and FreeRTOS queues.
+ *     Sending does not block the caller: messages are queued and the
+ *     ESP-NOW task sends them with one message in flight per peer,
+ *     retries with exponential backoff and reports the result through
+ *     a completion callback, received data are processed meanwhile.
+ *     Received frames are copied once, from WiFi task to a buffer of
+ *     a preallocated pool, only buffer index goes through the queue.
  *
  ***********************************************************************/
 
@@ -24,6 +30,13 @@ DataReceivedCallback ESPNowCtrl::onDataReceivedCallback;
 DataSentCallback ESPNowCtrl::onDataSentCallback;
 QueueHandle_t ESPNowCtrl::sendQueue = NULL;
 QueueHandle_t ESPNowCtrl::receiveQueue = NULL;
+QueueHandle_t ESPNowCtrl::rxFreeQueue = NULL;
+ESPNowItem_t ESPNowCtrl::rxPool[ESPNOW_RX_POOL];
+volatile ESPNowRxStats_t ESPNowCtrl::rxStats;
+QueueHandle_t ESPNowCtrl::txQueue = NULL;
+TaskHandle_t ESPNowCtrl::taskHandle = NULL;
+ESPNowTxSlot_t ESPNowCtrl::txSlots[ESPNOW_TX_SLOTS];
+uint32_t ESPNowCtrl::txSeq = 0;
 
 void ESPNowCtrl::Init()
 {
@@ -38,8 +51,14 @@ void ESPNowCtrl::Init()
     }
     esp_now_set_wake_window(UINT16_MAX);
 
-    sendQueue = xQueueCreate(10, sizeof(esp_now_send_status_t));
-    receiveQueue = xQueueCreate(50, sizeof(ESPNowItem_t));
+    sendQueue = xQueueCreate(ESPNOW_TX_SLOTS, sizeof(ESPNowSendStatus_t));
+    receiveQueue = xQueueCreate(ESPNOW_RX_POOL, sizeof(uint8_t));
+    rxFreeQueue = xQueueCreate(ESPNOW_RX_POOL, sizeof(uint8_t));
+    for (uint8_t i = 0; i < ESPNOW_RX_POOL; i++)
+    {
+        xQueueSendToBack(rxFreeQueue, &i, 0);
+    }
+    txQueue = xQueueCreate(ESPNOW_TX_QUEUE_LEN, sizeof(ESPNowTxItem_t));
 
     esp_now_register_recv_cb(onDataRecv);
 
@@ -73,32 +92,41 @@ void ESPNowCtrl::SetChannel(uint8_t channel)
     esp_wifi_set_channel(channel, WIFI_SECOND_CHAN_NONE);
 }
 
-bool ESPNowCtrl::SendMessageInternal(const uint8_t *peer_addr, uint8_t messageType, const uint8_t *payload, uint8_t payloadSize, uint8_t retryCount)
+//*****************************************************************************
+//! Queue message for ESP-NOW task, callable from any task including
+//! the ESP-NOW task itself (e.g. from receive or done callback)
+//*****************************************************************************
+bool ESPNowCtrl::SendMessageInternal(const uint8_t *peer_addr, uint8_t messageType, const uint8_t *payload, uint8_t payloadSize, SendDoneCallback done, void *arg, uint8_t retryCount)
 {
-    for (uint8_t retries = 0; retries < retryCount; retries++)
+    if ((payloadSize > MAX_PAYLOAD_SIZE) || (txQueue == NULL))
     {
-        SendMessageRaw(peer_addr, messageType, payload, payloadSize);
+        return false;
+    }
 
-        esp_now_send_status_t status;
-        if (xQueueReceive(sendQueue, &status, (TickType_t)pdMS_TO_TICKS(1000)) == pdPASS)
-        {
-            if (status == ESP_NOW_SEND_SUCCESS)
-            {
-                return true;
-            }
-            delay(50);
-        }
-        else
-        {
-            Serial.println("Timeout waiting for send status.");
-        }
+    ESPNowTxItem_t item;
+    memcpy(item.mac_addr, peer_addr, sizeof(item.mac_addr));
+    item.retries = std::max(retryCount, (uint8_t)1);
+    item.done = done;
+    item.arg = arg;
+    item.msg.messageType = messageType;
+    item.msg.payloadSize = payloadSize;
+    if (payloadSize > 0)
+    {
+        memcpy(item.msg.payload, payload, payloadSize);
     }
-    return false; // Failed to send after retrying
+
+    if (xQueueSendToBack(txQueue, &item, 0) != pdPASS)
+    {
+        SystemLog::PutLog("ESP-Now TX fronta je plna", v_warning);
+        return false;
+    }
+    wake();
+    return true;
 }
 
-bool ESPNowCtrl::SendMessage(const uint8_t *peer_addr, uint8_t messageType, uint8_t retryCount)
+bool ESPNowCtrl::SendMessage(const uint8_t *peer_addr, uint8_t messageType, SendDoneCallback done, void *arg, uint8_t retryCount)
 {
-    return SendMessageInternal(peer_addr, messageType, nullptr, 0, retryCount);
+    return SendMessageInternal(peer_addr, messageType, nullptr, 0, done, arg, retryCount);
 }
 
 void ESPNowCtrl::SendMessageRaw(const uint8_t *peer_addr, uint8_t messageType, const uint8_t *payloadData, uint8_t payloadSize)
@@ -128,49 +156,247 @@ void ESPNowCtrl::SetDataSentCallback(DataSentCallback callback)
     onDataSentCallback = callback;
 }
 
+void ESPNowCtrl::wake(void)
+{
+    TaskHandle_t task = taskHandle;
+    if (task != NULL)
+    {
+        xTaskNotifyGive(task);
+    }
+}
+
+//*****************************************************************************
+//! Called from WiFi task, it must not block: frame is dropped when no
+//! buffer is free. Buffers and statistics are written only here, buffer
+//! is released by ESP-NOW task after processing.
+//*****************************************************************************
 void ESPNowCtrl::onDataRecv(const uint8_t *mac_addr, const uint8_t *incomingData, int len)
 {
-    if (len <= sizeof(Message))
+    if ((len < 0) || (len > sizeof(Message)))
+    {
+        rxStats.dropInvalid++;
+        return;
+    }
+
+    uint8_t idx;
+    if (xQueueReceive(rxFreeQueue, &idx, 0) != pdPASS)
     {
-        ESPNowItem_t msg;
-        memcpy(msg.mac_addr, mac_addr, 6);
-        memcpy(msg.data, incomingData, len);
-        msg.len = len;
+        rxStats.dropNoBuf++;
+        wake();
+        return;
+    }
+
+    ESPNowItem_t &item = rxPool[idx];
+    memcpy(item.mac_addr, mac_addr, 6);
+    memcpy(item.data, incomingData, len);
+    item.len = len;
 
-        xQueueSendToBack(receiveQueue, &msg, pdMS_TO_TICKS(100));
+    uint8_t inUse = ESPNOW_RX_POOL - uxQueueMessagesWaiting(rxFreeQueue);
+    if (inUse > rxStats.highWater)
+    {
+        rxStats.highWater = inUse;
     }
+
+    /*fronta ma kapacitu celeho poolu, odeslani neselze*/
+    xQueueSendToBack(receiveQueue, &idx, 0);
+    wake();
 }
 
+void ESPNowCtrl::GetRxStats(ESPNowRxStats_t &stats)
+{
+    stats.dropNoBuf = rxStats.dropNoBuf;
+    stats.dropInvalid = rxStats.dropInvalid;
+    stats.inUse = (rxFreeQueue != NULL) ? (ESPNOW_RX_POOL - uxQueueMessagesWaiting(rxFreeQueue)) : 0;
+    stats.highWater = rxStats.highWater;
+}
+
+void ESPNowCtrl::onDataSent(const uint8_t *mac_addr, esp_now_send_status_t status)
+{
+    // if (onDataSentCallback != NULL)
+    // {
+    //     onDataSentCallback(mac_addr, status);
+    // }
+    ESPNowSendStatus_t st;
+    memcpy(st.mac_addr, mac_addr, sizeof(st.mac_addr));
+    st.status = status;
+    /*WiFi task neblokujeme, ztraceny status vyresi timeout*/
+    xQueueSendToBack(sendQueue, &st, 0);
+    wake();
+}
+
+//*****************************************************************************
+//! One iteration of ESP-NOW task: TX pipeline, received data, then wait
+//! for callback notification or for nearest TX deadline
+//*****************************************************************************
 void ESPNowCtrl::Task()
 {
-    ESPNowItem_t data;
+    if (taskHandle == NULL)
+    {
+        taskHandle = xTaskGetCurrentTaskHandle();
+    }
+
+    serviceTx();
+
+    uint8_t idx;
+    while (xQueueReceive(receiveQueue, &idx, 0) == pdPASS)
+    {
+        processReceived(rxPool[idx]);
+        xQueueSendToBack(rxFreeQueue, &idx, 0);
+        /*odpovedi zarazene behem zpracovani odejdou hned*/
+        serviceTx();
+    }
+
+    ulTaskNotifyTake(pdTRUE, txWaitTicks());
+}
 
-    if (xQueueReceive(receiveQueue, &data, portMAX_DELAY) == pdPASS)
+void ESPNowCtrl::processReceived(const ESPNowItem_t &data)
+{
+    if (onDataReceivedCallback != NULL)
     {
-        if (onDataReceivedCallback != NULL)
+        if (data.len < (sizeof(Message) - MAX_PAYLOAD_SIZE))
         {
-            if (data.len < (sizeof(Message) - MAX_PAYLOAD_SIZE))
-            {
-                SystemLog::PutLog("ESP-Now data too short", v_warning);
-                return;
-            }
-            Message *msg = (Message *)data.data;
-            if (data.len != (sizeof(Message) - MAX_PAYLOAD_SIZE + msg->payloadSize))
+            SystemLog::PutLog("ESP-Now data too short", v_warning);
+            return;
+        }
+        const Message *msg = (const Message *)data.data;
+        if (data.len != (sizeof(Message) - MAX_PAYLOAD_SIZE + msg->payloadSize))
+        {
+            SystemLog::PutLog("ESP-Now data incorrect length", v_error);
+            return;
+        }
+        onDataReceivedCallback(data.mac_addr, msg, data.len);
+    }
+}
+
+//*****************************************************************************
+//! TX pipeline: send results, new messages, lost callbacks, due messages
+//*****************************************************************************
+void ESPNowCtrl::serviceTx(void)
+{
+    uint32_t now = millis();
+
+    ESPNowSendStatus_t st;
+    while (xQueueReceive(sendQueue, &st, 0) == pdPASS)
+    {
+        for (auto &slot : txSlots)
+        {
+            if ((slot.state == TX_INFLIGHT) && (memcmp(slot.item.mac_addr, st.mac_addr, sizeof(st.mac_addr)) == 0))
             {
-                SystemLog::PutLog("ESP-Now data incorrect length", v_error);
-                return;
+                attemptDone(slot, st.status == ESP_NOW_SEND_SUCCESS, now);
+                break;
             }
-            onDataReceivedCallback(data.mac_addr, msg, data.len);
         }
-        taskYIELD();
+    }
+
+    for (auto &slot : txSlots)
+    {
+        if (slot.state != TX_FREE)
+        {
+            continue;
+        }
+        if (xQueueReceive(txQueue, &slot.item, 0) != pdPASS)
+        {
+            break;
+        }
+        slot.state = TX_WAIT;
+        slot.attempt = 0;
+        slot.seq = txSeq++;
+        slot.due = now;
+    }
+
+    for (auto &slot : txSlots)
+    {
+        if ((slot.state == TX_INFLIGHT) && ((int32_t)(now - slot.due) >= 0))
+        { /*send callback neprisel*/
+            Serial.println("Timeout waiting for send status.");
+            attemptDone(slot, false, now);
+        }
+    }
+
+    for (auto &slot : txSlots)
+    {
+        if ((slot.state == TX_WAIT) && ((int32_t)(now - slot.due) >= 0) && !peerBusy(slot))
+        {
+            transmit(slot, now);
+        }
     }
 }
 
-void ESPNowCtrl::onDataSent(const uint8_t *mac_addr, esp_now_send_status_t status)
+//*****************************************************************************
+//! Peer has message in flight or older message waiting, order of messages
+//! to one peer is kept also across retries
+//*****************************************************************************
+bool ESPNowCtrl::peerBusy(const ESPNowTxSlot_t &slot)
 {
-    // if (onDataSentCallback != NULL)
-    // {
-    //     onDataSentCallback(mac_addr, status);
-    // }
-    xQueueSendToBack(sendQueue, &status, pdMS_TO_TICKS(100));
-}
\ No newline at end of file
+    for (const auto &other : txSlots)
+    {
+        if ((&other == &slot) || (other.state == TX_FREE) || (memcmp(other.item.mac_addr, slot.item.mac_addr, sizeof(slot.item.mac_addr)) != 0))
+        {
+            continue;
+        }
+        if ((other.state == TX_INFLIGHT) || ((int32_t)(other.seq - slot.seq) < 0))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+void ESPNowCtrl::transmit(ESPNowTxSlot_t &slot, uint32_t now)
+{
+    slot.attempt++;
+    size_t len = sizeof(slot.item.msg.messageType) + sizeof(slot.item.msg.payloadSize) + slot.item.msg.payloadSize;
+    if (esp_now_send(slot.item.mac_addr, (uint8_t *)&slot.item.msg, len) != ESP_OK)
+    { /*napr. peer neni registrovan, send callback neprijde*/
+        attemptDone(slot, false, now);
+        return;
+    }
+    slot.state = TX_INFLIGHT;
+    slot.due = now + ESPNOW_TX_TIMEOUT_MS;
+}
+
+void ESPNowCtrl::attemptDone(ESPNowTxSlot_t &slot, bool ok, uint32_t now)
+{
+    if (ok || (slot.attempt >= slot.item.retries))
+    {
+        finish(slot, ok);
+        return;
+    }
+    slot.state = TX_WAIT;
+    slot.due = now + std::min((uint32_t)ESPNOW_TX_BACKOFF_MS << (slot.attempt - 1), (uint32_t)ESPNOW_TX_BACKOFF_MAX_MS);
+}
+
+//*****************************************************************************
+//! Slot is released before callback, so callback may queue next message
+//*****************************************************************************
+void ESPNowCtrl::finish(ESPNowTxSlot_t &slot, bool ok)
+{
+    slot.state = TX_FREE;
+    /*volny slot prevezme dalsi zpravu z fronty v pristim pruchodu*/
+    wake();
+    if (slot.item.done != NULL)
+    {
+        ESPNowTxItem_t item = slot.item;
+        item.done(item.mac_addr, &item.msg, ok, item.arg);
+    }
+}
+
+TickType_t ESPNowCtrl::txWaitTicks(void)
+{
+    uint32_t now = millis();
+    bool pending = false;
+    int32_t wait = INT32_MAX;
+    for (const auto &slot : txSlots)
+    {
+        if ((slot.state == TX_INFLIGHT) || ((slot.state == TX_WAIT) && !peerBusy(slot)))
+        { /*zpravy za obsazenym peerem probudi jeho send callback nebo timeout*/
+            pending = true;
+            wait = std::min(wait, (int32_t)(slot.due - now));
+        }
+    }
+    if (!pending)
+    {
+        return portMAX_DELAY;
+    }
+    return (wait > 0) ? std::max((TickType_t)pdMS_TO_TICKS(wait), (TickType_t)1) : 0;
+}
@@ -24,6 +24,14 @@
 #define MAX_PARAM_DEFS 5
 #define MAX_PARAM_READS_WRITES 118
 
+#define ESPNOW_TX_QUEUE_LEN 16      /*zpravy cekajici na prevzeti ESP-NOW taskem*/
+#define ESPNOW_TX_SLOTS 16          /*zpravy rozpracovane ESP-NOW taskem*/
+#define ESPNOW_TX_RETRIES 3
+#define ESPNOW_TX_TIMEOUT_MS 200    /*max. cekani na send callback*/
+#define ESPNOW_TX_BACKOFF_MS 50     /*odklad prvniho opakovani, dalsi se zdvojnasobuji*/
+#define ESPNOW_TX_BACKOFF_MAX_MS 800
+#define ESPNOW_RX_POOL 32           /*predalokovane buffery prijatych ramcu*/
+
 extern uint8_t BroadcastAddress[];
 
 typedef enum
@@ -56,6 +64,9 @@ typedef enum
     MSG_BYTE_STREAM,
     MSG_DISCOVERY,
     MSG_ACK,
+    MSG_FW_UPDATE_ACK,
+    MSG_FW_UPDATE_VERIFY,
+    MSG_WRITE_PARAMS_REQUEST,
 } MessageType_t;
 
 typedef enum
@@ -129,6 +140,13 @@ typedef struct
     int16_t values[MAX_PARAM_READS_WRITES];
 } __attribute__((packed)) WriteRequestPayload;
 
+/*MSG_WRITE_PARAMS_REQUEST: { WriteRangeHeader, int16_t values[nmr] } ... do payloadSize*/
+typedef struct
+{
+    uint16_t regAddr;
+    uint8_t nmr;
+} __attribute__((packed)) WriteRangeHeader;
+
 typedef struct
 {
     uint32_t index;
@@ -140,12 +158,39 @@ typedef struct
         {
             uint8_t isFinal : 1;
             uint8_t isFW : 1;
-            uint8_t : 6;
+            uint8_t isWindowed : 1; /*okenkovy prenos, potvrzuje MSG_FW_UPDATE_ACK*/
+            uint8_t ackReq : 1;     /*zadost o okamzite MSG_FW_UPDATE_ACK*/
+            uint8_t isCompressed : 1; /*data jsou kontejner FwPack, zarizeni je rozbaluje za behu*/
+            uint8_t isDelta : 1;      /*rozbalena data jsou patch FwDelta k bezicimu firmwaru*/
+            uint8_t : 2;
         };
     };
     uint8_t data[230];
 } __attribute__((packed)) UpdateRequestPayload;
 
+typedef enum
+{
+    FW_ACK_PROGRESS = 0,
+    FW_ACK_VERIFY_OK,
+    FW_ACK_VERIFY_FAIL,
+    FW_ACK_UNSUPPORTED, /*zarizeni neumi rozbalit kontejner FwPack nebo patch*/
+    FW_ACK_BASE_MISMATCH, /*CRC bezici firmware nesouhlasi s baseCrc patche*/
+} FwAckState_t;
+
+typedef struct
+{
+    uint32_t base;   /*pocet souvisle prijatych bloku*/
+    uint32_t bitmap; /*bit i = prijat blok base + 1 + i*/
+    uint8_t state;
+} __attribute__((packed)) FwUpdateAckPayload;
+
+typedef struct
+{
+    uint32_t size;   /*velikost rozbaleneho image*/
+    uint32_t crc32;  /*esp_rom_crc32_le(0, image, size)*/
+    uint8_t isFW;
+} __attribute__((packed)) FwVerifyPayload;
+
 typedef struct
 {
     uint32_t index;
@@ -175,34 +220,96 @@ typedef struct
 
 typedef void (*DataReceivedCallback)(const uint8_t *mac_addr, const Message *incomingData, int len);
 typedef void (*DataSentCallback)(const uint8_t *mac_addr, esp_now_send_status_t status);
+/*dokonceni odeslani zpravy, vola se z ESP-NOW tasku po potvrzeni nebo po vycerpani opakovani*/
+typedef void (*SendDoneCallback)(const uint8_t *mac_addr, const Message *msg, bool ok, void *arg);
+
+typedef struct
+{
+    uint8_t mac_addr[6];
+    uint8_t retries;
+    SendDoneCallback done;
+    void *arg;
+    Message msg;
+} ESPNowTxItem_t;
+
+typedef enum
+{
+    TX_FREE = 0,
+    TX_WAIT,     /*ceka na odeslani nebo na uplynuti odkladu*/
+    TX_INFLIGHT, /*odeslano, ceka na send callback*/
+} ESPNowTxState_t;
+
+typedef struct
+{
+    ESPNowTxItem_t item;
+    ESPNowTxState_t state;
+    uint8_t attempt;
+    uint32_t seq; /*poradi prevzeti, zpravy jednoho peeru se odesilaji v poradi*/
+    uint32_t due; /*cas odeslani nebo timeout send callbacku [ms]*/
+} ESPNowTxSlot_t;
+
+typedef struct
+{
+    uint8_t mac_addr[6];
+    esp_now_send_status_t status;
+} ESPNowSendStatus_t;
+
+typedef struct
+{
+    uint32_t dropNoBuf;   /*ramec zahozen, vsechny buffery obsazene*/
+    uint32_t dropInvalid; /*ramec delsi nez Message*/
+    uint8_t inUse;
+    uint8_t highWater;    /*max. soucasne obsazenych bufferu*/
+} ESPNowRxStats_t;
 
 class ESPNowCtrl
 {
 private:
     static QueueHandle_t sendQueue;
-    static QueueHandle_t receiveQueue;
+    static QueueHandle_t receiveQueue; /*indexy obsazenych bufferu rxPool*/
+    static QueueHandle_t rxFreeQueue;  /*indexy volnych bufferu rxPool*/
+    static ESPNowItem_t rxPool[ESPNOW_RX_POOL];
+    static volatile ESPNowRxStats_t rxStats;
+    static QueueHandle_t txQueue;
+    static TaskHandle_t taskHandle;
     static DataReceivedCallback onDataReceivedCallback;
     static DataSentCallback onDataSentCallback;
 
+    /*vlastni pouze ESP-NOW task*/
+    static ESPNowTxSlot_t txSlots[ESPNOW_TX_SLOTS];
+    static uint32_t txSeq;
+
     static void onDataRecv(const uint8_t *mac_addr, const uint8_t *incomingData, int len);
     static void onDataSent(const uint8_t *mac_addr, esp_now_send_status_t status);
 
+    static void wake(void);
+    static void serviceTx(void);
+    static void transmit(ESPNowTxSlot_t &slot, uint32_t now);
+    static void attemptDone(ESPNowTxSlot_t &slot, bool ok, uint32_t now);
+    static void finish(ESPNowTxSlot_t &slot, bool ok);
+    static bool peerBusy(const ESPNowTxSlot_t &slot);
+    static TickType_t txWaitTicks(void);
+    static void processReceived(const ESPNowItem_t &data);
+
 public:
     static void Init();
     static void SetDataReceivedCallback(DataReceivedCallback callback);
     static void SetDataSentCallback(DataSentCallback callback);
+    static void GetRxStats(ESPNowRxStats_t &stats);
 
     static void SetChannel(uint8_t channel);
 
+    /*SendMessage neblokuje, zprava se zaradi do fronty a vysledek se oznami callbackem done,
+      vraci false pouze kdyz zpravu nelze zaradit*/
     template <typename Payload>
-    static bool SendMessage(const uint8_t *peer_addr, uint8_t messageType, const Payload &payloadData, uint8_t payloadSize, uint8_t retryCount = 3)
+    static bool SendMessage(const uint8_t *peer_addr, uint8_t messageType, const Payload &payloadData, uint8_t payloadSize, SendDoneCallback done = NULL, void *arg = NULL, uint8_t retryCount = ESPNOW_TX_RETRIES)
     {
-        return SendMessageInternal(peer_addr, messageType, (const uint8_t *)(&payloadData), payloadSize, retryCount);
+        return SendMessageInternal(peer_addr, messageType, (const uint8_t *)(&payloadData), payloadSize, done, arg, retryCount);
     }
     static void SendMessageRaw(const uint8_t *peer_addr, uint8_t messageType, const uint8_t *payloadData, uint8_t payloadSize);
-    static bool SendMessageInternal(const uint8_t *peer_addr, uint8_t messageType, const uint8_t *payload, uint8_t payloadSize, uint8_t retryCount);
+    static bool SendMessageInternal(const uint8_t *peer_addr, uint8_t messageType, const uint8_t *payload, uint8_t payloadSize, SendDoneCallback done, void *arg, uint8_t retryCount);
 
-    static bool SendMessage(const uint8_t *peer_addr, uint8_t messageType, uint8_t retryCount = 3);
+    static bool SendMessage(const uint8_t *peer_addr, uint8_t messageType, SendDoneCallback done = NULL, void *arg = NULL, uint8_t retryCount = ESPNOW_TX_RETRIES);
 
     static void AddPeer(const uint8_t *mac_addr, uint8_t channel);
     static void DeletePeer(const uint8_t *mac_addr);
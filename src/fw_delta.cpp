@@ -0,0 +1,310 @@
+/***********************************************************************
+ * Filename: fw_delta.cpp
+ * Author: agent
+ * Date: 2026-10-17
+ * Description:
+ *     Implements the FwDelta class. Base is indexed by hash of
+ *     FW_DELTA_SEED bytes every FW_DELTA_STEP bytes, target is scanned
+ *     byte by byte. An exact seed is extended to both sides while
+ *     matches outnumber mismatches (bsdiff scoring), so code moved by
+ *     a few bytes with changed addresses stays one region.
+ *
+ ***********************************************************************/
+
+#include <algorithm>
+#include <new>
+#include <string.h>
+#include "fw_delta.h"
+
+#define HASH_BITS 16
+#define HASH_NONE 0xFFFFFFFF
+
+static inline uint32_t Hash16(const uint8_t *p)
+{
+    uint64_t a, b;
+    memcpy(&a, p, sizeof(a));
+    memcpy(&b, p + 8, sizeof(b));
+    return (uint32_t)(((a * 0x9E3779B97F4A7C15ULL) ^ (b * 0xC2B2AE3D27D4EB4FULL)) >> (64 - HASH_BITS));
+}
+
+typedef struct
+{
+    uint8_t *out;
+    size_t cap;
+    size_t pos;
+
+    bool Put(const void *data, size_t len)
+    {
+        if ((cap - pos) < len)
+        {
+            return false;
+        }
+        if (len > 0)
+        { /*prazdny cil muze mit data == NULL*/
+            memcpy(out + pos, data, len);
+        }
+        pos += len;
+        return true;
+    }
+
+    bool PutByte(uint8_t val)
+    {
+        return Put(&val, 1);
+    }
+
+    //! Diff bytes coded as runs: tag < 0x80 -> tag + 1 diff bytes follow,
+    //! tag >= 0x80 -> (tag & 0x7F) + 1 zero diff bytes (base is copied)
+    bool PutDiff(const uint8_t *base, const uint8_t *target, size_t len)
+    {
+        size_t i = 0;
+        while (i < len)
+        {
+            size_t z = 0;
+            while (((i + z) < len) && (z < FW_DELTA_RUN_MAX) && (base[i + z] == target[i + z]))
+            {
+                z++;
+            }
+            if ((z >= 2) || ((i + z) == len))
+            {
+                if (!PutByte(0x80 | (z - 1)))
+                {
+                    return false;
+                }
+                i += z;
+                continue;
+            }
+
+            /*rozdilne bajty do zacatku behu aspon 2 shodnych*/
+            size_t n = 0;
+            while (((i + n) < len) && (n < FW_DELTA_RUN_MAX) &&
+                   !((base[i + n] == target[i + n]) && ((i + n + 1) < len) && (base[i + n + 1] == target[i + n + 1])))
+            {
+                n++;
+            }
+            n = std::max(n, (size_t)1);
+            if (!PutByte(n - 1) || ((cap - pos) < n))
+            {
+                return false;
+            }
+            for (size_t k = 0; k < n; k++)
+            {
+                out[pos++] = target[i + k] - base[i + k];
+            }
+            i += n;
+        }
+        return true;
+    }
+} patchwriter_t;
+
+//*****************************************************************************
+//! Length of region from (b, t) with best score matches - mismatches
+//*****************************************************************************
+uint32_t FwDelta::extendForward(const uint8_t *base, uint32_t baseSize, uint32_t b, const uint8_t *target, uint32_t targetSize, uint32_t t)
+{
+    int32_t s = 0;
+    int32_t best = 0;
+    uint32_t bestLen = 0;
+    for (uint32_t k = 0; ((b + k) < baseSize) && ((t + k) < targetSize); k++)
+    {
+        s += (base[b + k] == target[t + k]) ? 1 : -1;
+        if (s > best)
+        {
+            best = s;
+            bestLen = k + 1;
+        }
+        else if ((k + 1 - bestLen) >= FW_DELTA_FUZZ)
+        {
+            break;
+        }
+    }
+    return bestLen;
+}
+
+uint32_t FwDelta::extendBack(const uint8_t *base, uint32_t b, const uint8_t *target, uint32_t t, uint32_t limit)
+{
+    int32_t s = 0;
+    int32_t best = 0;
+    uint32_t bestLen = 0;
+    for (uint32_t k = 1; (k <= limit) && (k <= b); k++)
+    {
+        s += (base[b - k] == target[t - k]) ? 1 : -1;
+        if (s > best)
+        {
+            best = s;
+            bestLen = k;
+        }
+        else if ((k - bestLen) >= FW_DELTA_FUZZ)
+        {
+            break;
+        }
+    }
+    return bestLen;
+}
+
+//*****************************************************************************
+//! Build patch, returns its size or 0 (cap too small, no memory)
+//*****************************************************************************
+size_t FwDelta::Diff(const uint8_t *base, uint32_t baseSize, uint32_t baseCrc, const uint8_t *target, uint32_t targetSize, uint8_t *out, size_t cap)
+{
+    uint32_t entries = (baseSize >= FW_DELTA_SEED) ? ((baseSize - FW_DELTA_SEED) / FW_DELTA_STEP + 1) : 0;
+    uint32_t *head = new (std::nothrow) uint32_t[1 << HASH_BITS];
+    uint32_t *prev = new (std::nothrow) uint32_t[std::max(entries, (uint32_t)1)];
+    if ((head == NULL) || (prev == NULL))
+    {
+        delete[] head;
+        delete[] prev;
+        return 0;
+    }
+    std::fill(head, head + (1 << HASH_BITS), HASH_NONE);
+    for (uint32_t e = 0; e < entries; e++)
+    {
+        uint32_t h = Hash16(base + e * FW_DELTA_STEP);
+        prev[e] = head[h];
+        head[h] = e;
+    }
+
+    patchwriter_t w = {out, cap, 0};
+    fwdeltahdr_t hdr = {FW_DELTA_MAGIC, baseSize, baseCrc, targetSize};
+    bool ok = w.Put(&hdr, sizeof(hdr));
+
+    /*aktualni oblast add*/
+    uint32_t curT = 0;
+    uint32_t curB = 0;
+    uint32_t curLen = 0;
+    uint32_t t = 0;
+    while (ok && ((t + FW_DELTA_SEED) <= targetSize))
+    {
+        uint32_t bestLen = 0;
+        uint32_t bestB = 0;
+        uint32_t e = head[Hash16(target + t)];
+        for (uint8_t chain = 0; (e != HASH_NONE) && (chain < FW_DELTA_CHAIN); chain++, e = prev[e])
+        {
+            uint32_t b = e * FW_DELTA_STEP;
+            uint32_t l = 0;
+            while (((b + l) < baseSize) && ((t + l) < targetSize) && (base[b + l] == target[t + l]))
+            {
+                l++;
+            }
+            if (l > bestLen)
+            {
+                bestLen = l;
+                bestB = b;
+            }
+        }
+
+        if (bestLen < FW_DELTA_SEED)
+        {
+            t++;
+            continue;
+        }
+
+        if (((int64_t)bestB - t) == ((int64_t)curB - curT))
+        { /*stejny posun jako aktualni oblast, mezera se pokryje diff bajty*/
+            curLen = t - curT + extendForward(base, baseSize, bestB, target, targetSize, t);
+            t = curT + curLen;
+            continue;
+        }
+
+        uint32_t curEnd = curT + curLen;
+        uint32_t back = extendBack(base, bestB, target, t, t - curEnd);
+        uint32_t newT = t - back;
+        uint32_t newB = bestB - back;
+
+        fwdeltactrl_t ctrl = {curLen, newT - curEnd, (int32_t)((int64_t)newB - (curB + curLen))};
+        ok = w.Put(&ctrl, sizeof(ctrl)) && w.PutDiff(base + curB, target + curT, curLen) && w.Put(target + curEnd, ctrl.extraLen);
+
+        curT = newT;
+        curB = newB;
+        curLen = back + extendForward(base, baseSize, bestB, target, targetSize, t);
+        t = curT + curLen;
+    }
+
+    if (ok && (targetSize > 0))
+    { /*prazdny cil je jen hlavicka, Apply pak zadny ridici zaznam necte*/
+        uint32_t curEnd = curT + curLen;
+        fwdeltactrl_t ctrl = {curLen, targetSize - curEnd, 0};
+        ok = w.Put(&ctrl, sizeof(ctrl)) && w.PutDiff(base + curB, target + curT, curLen) && w.Put(target + curEnd, ctrl.extraLen);
+    }
+
+    delete[] head;
+    delete[] prev;
+    return ok ? w.pos : 0;
+}
+
+//*****************************************************************************
+//! Apply patch to base, reference of the format for accessory side
+//*****************************************************************************
+bool FwDelta::Apply(const uint8_t *base, uint32_t baseSize, const uint8_t *patch, size_t patchSize, uint8_t *target, uint32_t targetCap)
+{
+    fwdeltahdr_t hdr;
+    if (patchSize < sizeof(hdr))
+    {
+        return false;
+    }
+    memcpy(&hdr, patch, sizeof(hdr));
+    if ((hdr.magic != FW_DELTA_MAGIC) || (hdr.baseSize != baseSize) || (hdr.targetSize > targetCap))
+    {
+        return false;
+    }
+
+    size_t p = sizeof(hdr);
+    uint32_t o = 0;
+    int64_t b = 0;
+    while (o < hdr.targetSize)
+    {
+        fwdeltactrl_t ctrl;
+        if ((patchSize - p) < sizeof(ctrl))
+        {
+            return false;
+        }
+        memcpy(&ctrl, patch + p, sizeof(ctrl));
+        p += sizeof(ctrl);
+
+        if ((ctrl.addLen > (hdr.targetSize - o)) || ((b + ctrl.addLen) > baseSize))
+        {
+            return false;
+        }
+        for (uint32_t done = 0; done < ctrl.addLen;)
+        {
+            if (p >= patchSize)
+            {
+                return false;
+            }
+            uint8_t tag = patch[p++];
+            uint32_t n = (tag & 0x7F) + 1;
+            if ((n > (ctrl.addLen - done)) || (!(tag & 0x80) && (n > (patchSize - p))))
+            {
+                return false;
+            }
+            for (uint32_t k = 0; k < n; k++)
+            {
+                target[o + done + k] = base[b + done + k] + ((tag & 0x80) ? 0 : patch[p + k]);
+            }
+            if (!(tag & 0x80))
+            {
+                p += n;
+            }
+            done += n;
+        }
+        o += ctrl.addLen;
+        b += ctrl.addLen;
+
+        if ((ctrl.extraLen > (hdr.targetSize - o)) || (ctrl.extraLen > (patchSize - p)))
+        {
+            return false;
+        }
+        if (ctrl.extraLen > 0)
+        {
+            memcpy(target + o, patch + p, ctrl.extraLen);
+        }
+        o += ctrl.extraLen;
+        p += ctrl.extraLen;
+
+        b += ctrl.seek;
+        if ((b < 0) || (b > baseSize))
+        {
+            return false;
+        }
+    }
+    return p == patchSize;
+}
@@ -0,0 +1,64 @@
+/***********************************************************************
+ * Filename: fw_delta.h
+ * Author: agent
+ * Date: 2026-10-17
+ * Description:
+ *     Declares the FwDelta class, binary delta between the firmware
+ *     running in an accessory (base) and the new image (target).
+ *     Layout follows bsdiff: target is built sequentially from
+ *     regions similar to base (base byte + diff byte) and from new
+ *     bytes, so the accessory applies the patch while it receives it,
+ *     reading base from its running partition. The patch is sent
+ *     packed by FwPack. Diff bytes of similar regions are mostly zero,
+ *     so they are run-length coded (PackBits style) before packing.
+ *     The class uses only the C++ standard library, so it builds
+ *     natively as well as on target.
+ *
+ *     Patch (little endian):
+ *       fwdeltahdr_t
+ *       { fwdeltactrl_t, diff runs (addLen bytes), extra[extraLen] } ...
+ *     Diff run: tag < 0x80 -> tag + 1 diff bytes follow,
+ *               tag >= 0x80 -> (tag & 0x7F) + 1 bytes equal to base.
+ *     For each control: target += base[pos..] + diff, target += extra,
+ *     pos += addLen + seek. Accessory refuses the patch when CRC32 of
+ *     its base (baseSize bytes) is not baseCrc.
+ *
+ ***********************************************************************/
+
+
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+#define FW_DELTA_MAGIC 0x31445746 /*"FWD1"*/
+#define FW_DELTA_SEED 16          /*min. presna shoda pro zahajeni oblasti*/
+#define FW_DELTA_STEP 8           /*krok indexovani base*/
+#define FW_DELTA_CHAIN 8          /*max. pocet kandidatu jednoho hashe*/
+#define FW_DELTA_FUZZ 64          /*oblast konci, kdyz se skore 64 B nezlepsi*/
+#define FW_DELTA_RUN_MAX 128      /*max. delka behu v kodovani diff*/
+
+typedef struct
+{
+    uint32_t magic;
+    uint32_t baseSize;
+    uint32_t baseCrc;
+    uint32_t targetSize;
+} __attribute__((packed)) fwdeltahdr_t;
+
+typedef struct
+{
+    uint32_t addLen;   /*bajty base + diff*/
+    uint32_t extraLen; /*nove bajty*/
+    int32_t seek;      /*posun v base za oblasti add*/
+} __attribute__((packed)) fwdeltactrl_t;
+
+class FwDelta
+{
+private:
+    static uint32_t extendForward(const uint8_t *base, uint32_t baseSize, uint32_t b, const uint8_t *target, uint32_t targetSize, uint32_t t);
+    static uint32_t extendBack(const uint8_t *base, uint32_t b, const uint8_t *target, uint32_t t, uint32_t limit);
+
+public:
+    static size_t Diff(const uint8_t *base, uint32_t baseSize, uint32_t baseCrc, const uint8_t *target, uint32_t targetSize, uint8_t *out, size_t cap);
+    static bool Apply(const uint8_t *base, uint32_t baseSize, const uint8_t *patch, size_t patchSize, uint8_t *target, uint32_t targetCap);
+};
@@ -0,0 +1,300 @@
+/***********************************************************************
+ * Filename: fw_pack.cpp
+ * Author: agent
+ * Date: 2026-10-17
+ * Description:
+ *     Implements the FwPack class. Matches are searched by hash chains
+ *     of 3 byte prefixes, backreference is used when it is shorter
+ *     than the literals it replaces. Bits are written MSB first:
+ *     1 + 8 bit literal, 0 + (offset - 1):W + (count - 1):L reference.
+ *
+ ***********************************************************************/
+
+#include <algorithm>
+#include <new>
+#include <string.h>
+#include "fw_pack.h"
+
+#define HASH_BITS 12
+#define HASH_NONE 0xFFFF
+#define MATCH_MAX (1U << FW_PACK_LOOKAHEAD)
+#define OFFSET_MAX (1U << FW_PACK_WINDOW)
+#define REF_BITS (1 + FW_PACK_WINDOW + FW_PACK_LOOKAHEAD)
+
+static inline uint16_t Hash3(const uint8_t *p)
+{
+    uint32_t h = (uint32_t)(p[0] | (p[1] << 8) | (p[2] << 16)) * 2654435761U;
+    return h >> (32 - HASH_BITS);
+}
+
+typedef struct
+{
+    uint8_t *out;
+    size_t cap;
+    size_t pos;
+    uint32_t acc;
+    uint8_t n;
+    bool full;
+
+    void Put(uint32_t val, uint8_t bits)
+    {
+        acc = (acc << bits) | (val & ((1UL << bits) - 1));
+        n += bits;
+        while (n >= 8)
+        {
+            n -= 8;
+            if (pos >= cap)
+            {
+                full = true;
+                return;
+            }
+            out[pos++] = (uint8_t)(acc >> n);
+        }
+    }
+
+    size_t Flush(void)
+    {
+        if (n > 0)
+        {
+            Put(0, 8 - n);
+        }
+        return full ? 0 : pos;
+    }
+} bitwriter_t;
+
+typedef struct
+{
+    const uint8_t *in;
+    size_t len;
+    size_t pos;
+    uint32_t acc;
+    uint8_t n;
+
+    bool Get(uint8_t bits, uint32_t &val)
+    {
+        while (n < bits)
+        {
+            if (pos >= len)
+            {
+                return false;
+            }
+            acc = (acc << 8) | in[pos++];
+            n += 8;
+        }
+        n -= bits;
+        val = (acc >> n) & ((1UL << bits) - 1);
+        return true;
+    }
+} bitreader_t;
+
+size_t FwPack::MaxSize(uint32_t rawSize)
+{
+    uint32_t blocks = (rawSize + FW_PACK_BLOCK - 1) / FW_PACK_BLOCK;
+    return sizeof(fwpackhdr_t) + blocks * sizeof(uint32_t) + rawSize;
+}
+
+//*****************************************************************************
+//! Compress one block, returns 0 when result would not fit to cap
+//*****************************************************************************
+size_t FwPack::packBlock(const uint8_t *in, uint32_t len, uint8_t *out, size_t cap, uint16_t *head, uint16_t *prev)
+{
+    bitwriter_t bw = {out, cap, 0, 0, 0, false};
+    std::fill(head, head + (1 << HASH_BITS), HASH_NONE);
+
+    uint32_t i = 0;
+    while ((i < len) && !bw.full)
+    {
+        uint32_t bestLen = 0;
+        uint32_t bestOff = 0;
+        if ((i + 2) < len)
+        {
+            uint32_t maxLen = std::min(MATCH_MAX, len - i);
+            uint16_t cand = head[Hash3(in + i)];
+            for (uint8_t chain = 0; (chain < FW_PACK_CHAIN) && (cand != HASH_NONE) && ((i - cand) <= OFFSET_MAX); chain++)
+            {
+                if (in[cand + bestLen] == in[i + bestLen])
+                {
+                    uint32_t l = 0;
+                    while ((l < maxLen) && (in[cand + l] == in[i + l]))
+                    {
+                        l++;
+                    }
+                    if (l > bestLen)
+                    {
+                        bestLen = l;
+                        bestOff = i - cand;
+                        if (l == maxLen)
+                        {
+                            break;
+                        }
+                    }
+                }
+                cand = prev[cand];
+            }
+        }
+
+        uint32_t step;
+        if ((bestLen * 9) > REF_BITS)
+        {
+            bw.Put(0, 1);
+            bw.Put(bestOff - 1, FW_PACK_WINDOW);
+            bw.Put(bestLen - 1, FW_PACK_LOOKAHEAD);
+            step = bestLen;
+        }
+        else
+        {
+            bw.Put(0x100 | in[i], 9);
+            step = 1;
+        }
+
+        for (uint32_t end = i + step; i < end; i++)
+        {
+            if ((i + 2) < len)
+            {
+                uint16_t h = Hash3(in + i);
+                prev[i] = head[h];
+                head[h] = i;
+            }
+        }
+    }
+    return bw.Flush();
+}
+
+bool FwPack::unpackBlock(const uint8_t *in, size_t len, uint8_t *out, uint32_t rawLen)
+{
+    bitreader_t br = {in, len, 0, 0, 0};
+    uint32_t o = 0;
+    while (o < rawLen)
+    {
+        uint32_t tag, val, off, cnt;
+        if (!br.Get(1, tag))
+        {
+            return false;
+        }
+        if (tag)
+        {
+            if (!br.Get(8, val))
+            {
+                return false;
+            }
+            out[o++] = (uint8_t)val;
+            continue;
+        }
+        if (!br.Get(FW_PACK_WINDOW, off) || !br.Get(FW_PACK_LOOKAHEAD, cnt))
+        {
+            return false;
+        }
+        off++;
+        cnt++;
+        if ((off > o) || ((o + cnt) > rawLen))
+        {
+            return false;
+        }
+        for (; cnt > 0; cnt--, o++)
+        {
+            out[o] = out[o - off];
+        }
+    }
+    return true;
+}
+
+//*****************************************************************************
+//! Build container, returns its size or 0 (cap too small, no memory);
+//! cap of MaxSize(rawSize) is always enough
+//*****************************************************************************
+size_t FwPack::Pack(const uint8_t *raw, uint32_t rawSize, uint8_t *out, size_t cap)
+{
+    uint32_t blocks = (rawSize + FW_PACK_BLOCK - 1) / FW_PACK_BLOCK;
+    size_t hdrLen = sizeof(fwpackhdr_t) + blocks * sizeof(uint32_t);
+    if ((blocks > UINT16_MAX) || (cap < hdrLen))
+    {
+        return 0;
+    }
+
+    uint16_t *head = new (std::nothrow) uint16_t[1 << HASH_BITS];
+    uint16_t *prev = new (std::nothrow) uint16_t[FW_PACK_BLOCK];
+    size_t pos = hdrLen;
+    for (uint32_t b = 0; (b < blocks) && (head != NULL) && (prev != NULL); b++)
+    {
+        const uint8_t *in = raw + b * FW_PACK_BLOCK;
+        uint32_t len = std::min(rawSize - b * FW_PACK_BLOCK, (uint32_t)FW_PACK_BLOCK);
+        size_t n = packBlock(in, len, out + pos, std::min(cap - pos, (size_t)len - 1), head, prev);
+        if (n == 0)
+        { /*nekomprimovatelny blok se ulozi primo*/
+            if ((cap - pos) < len)
+            {
+                pos = 0;
+                break;
+            }
+            memcpy(out + pos, in, len);
+            n = len;
+        }
+        pos += n;
+        uint32_t end = pos - hdrLen;
+        memcpy(out + sizeof(fwpackhdr_t) + b * sizeof(uint32_t), &end, sizeof(end));
+    }
+
+    if ((head == NULL) || (prev == NULL))
+    {
+        pos = 0;
+    }
+    delete[] head;
+    delete[] prev;
+
+    if (pos != 0)
+    {
+        fwpackhdr_t hdr;
+        hdr.magic = FW_PACK_MAGIC;
+        hdr.window = FW_PACK_WINDOW;
+        hdr.lookahead = FW_PACK_LOOKAHEAD;
+        hdr.blockCnt = blocks;
+        hdr.blockSize = FW_PACK_BLOCK;
+        hdr.rawSize = rawSize;
+        memcpy(out, &hdr, sizeof(hdr));
+    }
+    return pos;
+}
+
+//*****************************************************************************
+//! Inflate whole container, reference of the format for accessory decoder
+//*****************************************************************************
+bool FwPack::Unpack(const uint8_t *pack, size_t packSize, uint8_t *raw, uint32_t rawCap)
+{
+    fwpackhdr_t hdr;
+    if (packSize < sizeof(hdr))
+    {
+        return false;
+    }
+    memcpy(&hdr, pack, sizeof(hdr));
+    size_t hdrLen = sizeof(hdr) + hdr.blockCnt * sizeof(uint32_t);
+    if ((hdr.magic != FW_PACK_MAGIC) || (hdr.window != FW_PACK_WINDOW) || (hdr.lookahead != FW_PACK_LOOKAHEAD) ||
+        (hdr.blockSize == 0) || (hdr.rawSize > rawCap) || (packSize < hdrLen) ||
+        (hdr.blockCnt != ((hdr.rawSize + hdr.blockSize - 1) / hdr.blockSize)))
+    {
+        return false;
+    }
+
+    const uint8_t *data = pack + hdrLen;
+    uint32_t start = 0;
+    for (uint32_t b = 0; b < hdr.blockCnt; b++)
+    {
+        uint32_t end;
+        memcpy(&end, pack + sizeof(hdr) + b * sizeof(uint32_t), sizeof(end));
+        uint32_t rawLen = std::min(hdr.rawSize - b * hdr.blockSize, hdr.blockSize);
+        if ((end < start) || (end > (packSize - hdrLen)))
+        {
+            return false;
+        }
+        uint8_t *out = raw + b * hdr.blockSize;
+        if ((end - start) == rawLen)
+        {
+            memcpy(out, data + start, rawLen);
+        }
+        else if (!unpackBlock(data + start, end - start, out, rawLen))
+        {
+            return false;
+        }
+        start = end;
+    }
+    return true;
+}
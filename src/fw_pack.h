@@ -0,0 +1,55 @@
+/***********************************************************************
+ * Filename: fw_pack.h
+ * Author: agent
+ * Date: 2026-10-17
+ * Description:
+ *     Declares the FwPack class, compression of accessory firmware
+ *     into a streaming container. The image is split into blocks of
+ *     FW_PACK_BLOCK bytes, each block is compressed independently by
+ *     LZSS in heatshrink bit format (window FW_PACK_WINDOW, lookahead
+ *     FW_PACK_LOOKAHEAD), so the accessory inflates it on the fly with
+ *     a small buffer and may restart at any block. The class uses only
+ *     the C++ standard library, so it builds natively as well as on
+ *     target.
+ *
+ *     Container (little endian):
+ *       fwpackhdr_t
+ *       uint32_t end[blockCnt]  end of compressed block, relative to
+ *                               data; block as long as its raw data
+ *                               is stored uncompressed
+ *       data
+ *
+ ***********************************************************************/
+
+
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+#define FW_PACK_MAGIC 0x315A5746 /*"FWZ1"*/
+#define FW_PACK_BLOCK 4096       /*= sektor flash*/
+#define FW_PACK_WINDOW 11        /*heatshrink -w, 2^W B okno dekoderu*/
+#define FW_PACK_LOOKAHEAD 4      /*heatshrink -l, max. delka shody 2^L*/
+#define FW_PACK_CHAIN 32         /*max. pocet porovnani pri hledani shody*/
+
+typedef struct
+{
+    uint32_t magic;
+    uint8_t window;
+    uint8_t lookahead;
+    uint16_t blockCnt;
+    uint32_t blockSize;
+    uint32_t rawSize;
+} __attribute__((packed)) fwpackhdr_t;
+
+class FwPack
+{
+private:
+    static size_t packBlock(const uint8_t *in, uint32_t len, uint8_t *out, size_t cap, uint16_t *head, uint16_t *prev);
+    static bool unpackBlock(const uint8_t *in, size_t len, uint8_t *out, uint32_t rawLen);
+
+public:
+    static size_t MaxSize(uint32_t rawSize);
+    static size_t Pack(const uint8_t *raw, uint32_t rawSize, uint8_t *out, size_t cap);
+    static bool Unpack(const uint8_t *pack, size_t packSize, uint8_t *raw, uint32_t rawCap);
+};
@@ -0,0 +1,170 @@
+/***********************************************************************
+ * Filename: fw_window.cpp
+ * Author: agent
+ * Date: 2026-10-17
+ * Description:
+ *     Implements the FwWindow class. Chunks of one peer are delivered
+ *     in order of sending, so a chunk missing below the highest
+ *     acknowledged chunk and sent before it is lost and is sent again
+ *     without waiting for a timeout.
+ *
+ ***********************************************************************/
+
+#include <algorithm>
+#include "fw_window.h"
+
+void FwWindow::Begin(uint32_t imageSize, uint32_t now)
+{
+    size = imageSize;
+    chunks = (imageSize + FW_CHUNK_SIZE - 1) / FW_CHUNK_SIZE;
+    base = 0;
+    next = 0;
+    acked = 0;
+    resend = 0;
+    sendSeq = 0;
+    lastAckMs = now;
+    probes = 0;
+    probe = false;
+    ackSeen = false;
+    verifyPending = (chunks == 0);
+    std::fill(seq, seq + FW_WINDOW_CHUNKS, 0);
+}
+
+uint8_t FwWindow::ChunkLen(uint32_t chunk) const
+{
+    return (uint8_t)std::min(size - ChunkOffset(chunk), (uint32_t)FW_CHUNK_SIZE);
+}
+
+void FwWindow::sent(uint32_t chunk)
+{
+    seq[chunk % FW_WINDOW_CHUNKS] = ++sendSeq;
+}
+
+//*****************************************************************************
+//! Chunk to send: lost chunks first (oldest first), then new chunks while
+//! window is not full. ACK is requested at half and at end of window.
+//*****************************************************************************
+bool FwWindow::Next(uint32_t &chunk, bool &ackReq)
+{
+    uint32_t limit = std::min(base + FW_WINDOW_CHUNKS, chunks);
+    if (resend != 0)
+    {
+        uint8_t i = __builtin_ctz(resend);
+        resend &= ~(1UL << i);
+        chunk = base + i;
+    }
+    else if (next < limit)
+    {
+        chunk = next++;
+    }
+    else
+    {
+        return false;
+    }
+
+    sent(chunk);
+    ackReq = probe || (((chunk + 1) % (FW_WINDOW_CHUNKS / 2)) == 0) || ((resend == 0) && (next >= limit));
+    probe = false;
+    return true;
+}
+
+//*****************************************************************************
+//! Verify frame (size + CRC32) is due, after last ACK and after timeout
+//*****************************************************************************
+bool FwWindow::NextVerify(void)
+{
+    bool due = verifyPending;
+    verifyPending = false;
+    return due;
+}
+
+//*****************************************************************************
+//! Chunk was not sent (no MAC ACK), it is sent again at once
+//*****************************************************************************
+void FwWindow::Lost(uint32_t chunk)
+{
+    if ((chunk >= base) && (chunk < next))
+    {
+        uint8_t i = chunk - base;
+        if (!(acked & (1UL << i)))
+        {
+            resend |= 1UL << i;
+        }
+    }
+}
+
+//*****************************************************************************
+//! ACK from accessory: chunks < ackBase received, bit i of bitmap means
+//! chunk ackBase + 1 + i received
+//*****************************************************************************
+void FwWindow::Ack(uint32_t ackBase, uint32_t bitmap, uint32_t now)
+{
+    ackSeen = true;
+    probes = 0;
+    lastAckMs = now;
+
+    uint32_t hi = base; /*nejvyssi potvrzeny blok + 1*/
+    for (uint32_t c = base; c < next; c++)
+    {
+        uint32_t d = c - ackBase - 1;
+        if ((c < ackBase) || ((c > ackBase) && (d < 32) && (bitmap & (1UL << d))))
+        {
+            acked |= 1UL << (c - base);
+            hi = c + 1;
+        }
+    }
+
+    if (hi > base)
+    { /*mezery odeslane drive nez nejvyssi potvrzeny blok jsou ztracene*/
+        uint32_t hiSeq = seq[(hi - 1) % FW_WINDOW_CHUNKS];
+        for (uint32_t c = base; c < (hi - 1); c++)
+        {
+            uint8_t i = c - base;
+            if (!(acked & (1UL << i)) && ((int32_t)(seq[c % FW_WINDOW_CHUNKS] - hiSeq) < 0))
+            {
+                resend |= 1UL << i;
+            }
+        }
+    }
+
+    while ((base < next) && (acked & 1))
+    {
+        acked >>= 1;
+        resend >>= 1;
+        base++;
+    }
+
+    if (Done())
+    {
+        verifyPending = true;
+    }
+}
+
+//*****************************************************************************
+//! No ACK for FW_ACK_TIMEOUT_MS: oldest unacknowledged chunk (or verify
+//! frame) is sent again with ACK request, returns true when something
+//! was scheduled
+//*****************************************************************************
+bool FwWindow::Timeout(uint32_t now)
+{
+    if (!Done() && (base >= next))
+    { /*nic neceka na potvrzeni*/
+        return false;
+    }
+    if ((now - lastAckMs) < FW_ACK_TIMEOUT_MS)
+    {
+        return false;
+    }
+    lastAckMs = now;
+    probes++;
+    if (Done())
+    {
+        verifyPending = true;
+    }
+    else
+    {
+        resend |= 1;
+        probe = true;
+    }
+    return true;
+}
@@ -0,0 +1,64 @@
+/***********************************************************************
+ * Filename: fw_window.h
+ * Author: agent
+ * Date: 2026-10-17
+ * Description:
+ *     Declares the FwWindow class, sender side of the windowed
+ *     (selective repeat) firmware transfer to accessories. Up to
+ *     FW_WINDOW_CHUNKS chunks may wait for acknowledgement, the
+ *     accessory reports received chunks by bitmap ACK and only lost
+ *     chunks are sent again. After all chunks are acknowledged the
+ *     image is verified by CRC32 before it is applied. The class uses
+ *     only the C++ standard library, so it builds natively as well as
+ *     on target.
+ *
+ ***********************************************************************/
+
+
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+#define FW_CHUNK_SIZE 230       /*= sizeof(UpdateRequestPayload::data)*/
+#define FW_WINDOW_CHUNKS 32     /*= pocet bitu bitmapy ACK*/
+#define FW_ACK_TIMEOUT_MS 300   /*bez ACK se posle znovu nejstarsi blok s zadosti o ACK*/
+#define FW_PROBE_MAX 8          /*max. pocet timeoutu za sebou*/
+
+class FwWindow
+{
+protected:
+    uint32_t size;
+    uint32_t chunks;
+    uint32_t base;                   /*prvni nepotvrzeny blok*/
+    uint32_t next;                   /*prvni dosud neodeslany blok*/
+    uint32_t acked;                  /*bit i = blok base + i potvrzen*/
+    uint32_t resend;                 /*bit i = blok base + i k opakovani*/
+    uint32_t seq[FW_WINDOW_CHUNKS];  /*poradi posledniho odeslani bloku, index blok % okno*/
+    uint32_t sendSeq;
+    uint32_t lastAckMs;
+    uint8_t probes;
+    bool probe;                      /*pristi blok zada o ACK*/
+    bool ackSeen;
+    bool verifyPending;
+
+    void sent(uint32_t chunk);
+
+public:
+    FwWindow() : size(0), chunks(0), base(0), next(0) {}
+
+    void Begin(uint32_t imageSize, uint32_t now);
+    bool Next(uint32_t &chunk, bool &ackReq);
+    bool NextVerify(void);
+    void Lost(uint32_t chunk);
+    void Ack(uint32_t ackBase, uint32_t bitmap, uint32_t now);
+    bool Timeout(uint32_t now);
+
+    bool Done(void) const { return base >= chunks; }
+    bool Failed(void) const { return probes > FW_PROBE_MAX; }
+    bool AckSeen(void) const { return ackSeen; }
+    uint32_t Chunks(void) const { return chunks; }
+    uint32_t Base(void) const { return base; }
+
+    static uint32_t ChunkOffset(uint32_t chunk) { return chunk * FW_CHUNK_SIZE; }
+    uint8_t ChunkLen(uint32_t chunk) const;
+};
@@ -88,7 +88,7 @@ bool LightCtrl::IsNight(void)
 		else
 		{
 			AutomatikaZavreni.Set(Manualni);
-			CasZapadu.Set(0);
+			CasZapadu.Set((time_t)0);
 		}
 		break;
 	}
@@ -124,7 +124,7 @@ bool LightCtrl::IsDay(void)
 		else
 		{
 			AutomatikaOtevreni.Set(Manualni);
-			CasVychodu.Set(0);
+			CasVychodu.Set((time_t)0);
 		}
 		break;
 	}
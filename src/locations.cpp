@@ -62,12 +62,14 @@ void Location::Init(void)
         PopisCasu.Set(tz_strings[act_loc]);
     }
 
-    if (PopisCasu.Get().isEmpty())
+    if (PopisCasu.IsEmpty())
     {
         PopisCasu.Set(tz_strings[act_loc]);
     }
 
-    SetTimezone(PopisCasu.Get().c_str());
+    char tz[STRING_REG_MAX_LEN + 1];
+    PopisCasu.Get(tz);
+    SetTimezone(tz);
 }
 
 void Location::CheckLocalization(void)
@@ -89,7 +91,9 @@ void Location::CheckLocalization(void)
         ZemepisnaDelka.Set((int32_t)longitudes[act_loc]);
         PopisCasu.Set(tz_strings[act_loc]);
 
-        SetTimezone(PopisCasu.Get().c_str());
+        char tz[STRING_REG_MAX_LEN + 1];
+        PopisCasu.Get(tz);
+        SetTimezone(tz);
         lastSunsetTime = -1;
     }
 
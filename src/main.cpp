@@ -19,6 +19,8 @@
 #include <HardwareSerial.h>
 #include "modbus_serial.h"
 #include "modbus_slave.h"
+#include "modbus_tcp.h"
+#include "modbus_master.h"
 #include "semphr.h"
 #include "servo.h"
 #include "pin_map.h"
@@ -44,6 +46,9 @@
 
 ModbusSerial mdbSerial;
 ModbusSlave mdbSlave(mdbSerial);
+ModbusMaster mdbMaster(mdbSerial);
+ModbusTcp mdbTcp;
+ModbusSlave mdbTcpSlave(mdbTcp, TcpExceptionError, TcpCorrectPackets);
 Motor motor(MOTOR_UP, MOTOR_DOWN, MOTOR_EN, 0);
 Encoder encoder(ENCODER_A, ENCODER_B, ENCODER_PWR);
 Servo servo(motor, encoder);
@@ -67,10 +72,22 @@ void ModbusTask(void *pvParameters)
   while (true)
   {
     mdbSlave.Run();
+    if (MdbMaster.Get())
+    {
+      mdbMaster.Run();
+    }
     delay(1);
   }
 }
 
+void ModbusTcpTask(void *pvParameters)
+{
+  while (true)
+  {
+    mdbTcpSlave.Run();
+  }
+}
+
 void ServoTask(void *pvParameters)
 {
   while (true)
@@ -101,10 +118,17 @@ void DoorControlTask(void *pvParameters)
 
 void LedControlTask(void *pvParameters)
 {
+  bool notified = StavDvirka.Subscribe(Register::NotifyTask, xTaskGetCurrentTaskHandle());
+  notified &= WiFiAPOn.Subscribe(Register::NotifyTask, xTaskGetCurrentTaskHandle());
+  if (!notified)
+  {
+    SystemLog::PutLog("LED: odber zmen parametru selhal, stav se vyhodnocuje v kazdem kroku", v_error);
+  }
+  bool update = true;
   while (true)
   {
     if (WiFiAPOn.Get())
-    {
+    { /*pocet pripojenych stanic neni parametr, vyhodnocuje se v kazdem kroku*/
       if (WiFi.softAPgetStationNum() > 0)
       {
         LedR = 0;
@@ -116,7 +140,7 @@ void LedControlTask(void *pvParameters)
         LedG = 0xFFFF;
       }
     }
-    else
+    else if (update)
     {
       switch (StavDvirka.Get())
       {
@@ -162,7 +186,8 @@ void LedControlTask(void *pvParameters)
     }
     LedR.CtrlTask();
     LedG.CtrlTask();
-    delay(LED_CTRL_TIME_MS);
+    /*dalsi krok vzoru, nebo drive pri zmene stavu dvirek*/
+    update = (ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(LED_CTRL_TIME_MS)) != 0) || !notified;
   }
 }
 
@@ -229,6 +254,12 @@ void SystemLogTask(void *pvParameters)
     PsramUsed.Set(PsramSize.Get() - (ESP.getFreePsram() / 1024));
     HeapUsed.Set(HeapSize.Get() - (ESP.getFreeHeap() / 1024));
 
+    ESPNowRxStats_t rx;
+    ESPNowCtrl::GetRxStats(rx);
+    EspNowRxDrop.Set((int32_t)rx.dropNoBuf);
+    EspNowRxInvalid.Set((int32_t)rx.dropInvalid);
+    EspNowRxPeak.Set(rx.highWater);
+
     AccessLvlTask();
 
     delay(2000);
@@ -242,7 +273,16 @@ void DataChartTask(void *pvParameters)
   {
     Teplota24H.Set(Teplota_C.Get());
     Svetlo24H.Set(Osvetleni_proc.Get());
-    delay(3 * 60 * 1000);
+    delay(CHART_RAW_PERIOD_S * 1000);
+  }
+}
+
+void NvStoreTask(void *pvParameters)
+{
+  while (true)
+  {
+    Register::NvTask();
+    delay(NV_TASK_PERIOD_MS);
   }
 }
 
@@ -259,6 +299,8 @@ void IRAM_ATTR onTimer()
   encoder.Read();
 }
 
+/*pri unit testech setup() a loop() definuje test*/
+#ifndef PIO_UNIT_TESTING
 void setup()
 {
   Serial.begin(115200);
@@ -266,10 +308,18 @@ void setup()
   Register::InitAll();
   storageFS.begin(true, "/storage", 5, "storage");
 
-  Svetlo24H.SetSize(512);
-  Teplota24H.SetSize(512);
+  /*grafy se ukladaji do storage oddilu pod jmenem parametru*/
+  for (uint16_t i = 0; i < Register::NmrParameters; i++)
+  {
+    if (chart_base::IsChart(Register::ParDef[i]))
+    {
+      String fname = String(CHART_DIR "/") + Register::ParDef[i].ptxt + ".bin";
+      static_cast<chart_base *>(Register::GetParByIdx(i))->Open(CHART_RAW_SAMPLES, CHART_RAW_PERIOD_S, fname.c_str());
+    }
+  }
 
   mdbSlave.Init();
+  mdbMaster.Init();
   servo.Init();
   encoder.SetPosition(AktualniPoloha_puls.Get());
 
@@ -283,6 +333,7 @@ void setup()
   lightCtrl.Init();
   WiFiCtrl::Init();
   WebServer::Init(CaptivePortal.Get() == povoleno);
+  mdbTcpSlave.Init();
   ESPNowCtrl::Init();
   DeviceManager::Init();
   MQTT::Init();
@@ -342,6 +393,7 @@ void setup()
   SystemLog::PutLog(start_txt.c_str(), v_empty);
 
   xTaskCreateUniversal(ModbusTask, "mdbTask", getArduinoLoopTaskStackSize(), NULL, 1, NULL, -1);
+  xTaskCreateUniversal(ModbusTcpTask, "mdbTcpTask", getArduinoLoopTaskStackSize(), NULL, 1, NULL, -1);
   xTaskCreateUniversal(EncoderTask, "encoderTask", getArduinoLoopTaskStackSize(), NULL, 3, NULL, ARDUINO_RUNNING_CORE);
   xTaskCreateUniversal(ServoTask, "servoTask", getArduinoLoopTaskStackSize(), NULL, 3, NULL, ARDUINO_RUNNING_CORE);
   xTaskCreateUniversal(DoorControlTask, "doorCtrlTask", getArduinoLoopTaskStackSize(), NULL, 2, NULL, ARDUINO_RUNNING_CORE);
@@ -352,6 +404,7 @@ void setup()
   xTaskCreateUniversal(DataChartTask, "chartTask", getArduinoLoopTaskStackSize(), NULL, 1, NULL, ARDUINO_RUNNING_CORE);
   xTaskCreateUniversal(ESPNowTask, "espNowTask", getArduinoLoopTaskStackSize(), NULL, 2, NULL, 0);
   xTaskCreateUniversal(MQTTTask, "mqttTask", getArduinoLoopTaskStackSize(), NULL, 1, NULL, -1);
+  xTaskCreateUniversal(NvStoreTask, "nvTask", getArduinoLoopTaskStackSize(), NULL, 1, NULL, ARDUINO_RUNNING_CORE);
 
   // hw_timer_t *timer = NULL;
   // // inicializace časovače
@@ -395,4 +448,5 @@ void loop()
   {
     WiFiAPOn.Set(WiFiAPOn.Get() ? 0 : 1);
   }
-}
\ No newline at end of file
+}
+#endif
@@ -0,0 +1,212 @@
+/***********************************************************************
+ * Filename: modbus_diag.cpp
+ * Author: agent
+ * Date: 2026-10-17
+ * Description:
+ *     Implements the ModbusDiag class and mdbdiag_reg parameter class.
+ *
+ ***********************************************************************/
+
+#include "Arduino.h"
+#include "modbus_diag.h"
+#include "parameters.h"
+
+ModbusDiag ModbusDiag::Rtu;
+ModbusDiag ModbusDiag::Tcp;
+
+const uint8_t ModbusDiag::FcCodes[MDB_DIAG_FC_NMR - 1] = {3, 6, 8, 16, 17, 23, 70, 71, 72};
+const uint8_t ModbusDiag::ExcCodes[MDB_DIAG_EXC_NMR] = {1, 2, 3, 4, 6, 0x11};
+/*horni meze tridy histogramu [us], posledni trida je bez omezeni*/
+const uint32_t ModbusDiag::LatBounds[MDB_DIAG_LAT_BINS - 1] = {250, 500, 1000, 2000, 5000, 10000, 50000};
+
+ModbusDiag::ModbusDiag() : latMax(0), listenOnly(false)
+{
+	Clear();
+}
+
+void ModbusDiag::Request(uint8_t fun)
+{
+	uint8_t i = 0;
+	while ((i < (MDB_DIAG_FC_NMR - 1)) && (FcCodes[i] != fun))
+	{
+		i++;
+	}
+	fc[i].fetch_add(1, std::memory_order_relaxed);
+}
+
+void ModbusDiag::Exception(uint8_t code)
+{
+	for (uint8_t i = 0; i < MDB_DIAG_EXC_NMR; i++)
+	{
+		if (ExcCodes[i] == code)
+		{
+			exc[i].fetch_add(1, std::memory_order_relaxed);
+			break;
+		}
+	}
+	Count(MdbDiag_ExcErr);
+}
+
+void ModbusDiag::Latency(uint32_t us)
+{
+	uint8_t i = 0;
+	while ((i < (MDB_DIAG_LAT_BINS - 1)) && (us >= LatBounds[i]))
+	{
+		i++;
+	}
+	lat[i].fetch_add(1, std::memory_order_relaxed);
+
+	uint32_t m = latMax.load(std::memory_order_relaxed);
+	while ((us > m) && !latMax.compare_exchange_weak(m, us, std::memory_order_relaxed))
+	{
+	}
+}
+
+//*****************************************************************************
+//! FC8 clear counters (0x0A), restart (0x01) also clears them
+//*****************************************************************************
+void ModbusDiag::Clear(void)
+{
+	for (auto &c : cnt)
+	{
+		c = 0;
+	}
+	for (auto &c : fc)
+	{
+		c = 0;
+	}
+	for (auto &c : exc)
+	{
+		c = 0;
+	}
+	for (auto &c : lat)
+	{
+		c = 0;
+	}
+	latMax = 0;
+}
+
+//*****************************************************************************
+//! Diagnostic register is derived from state of the interface, so it is
+//! always current and is cleared together with counters
+//*****************************************************************************
+uint16_t ModbusDiag::GetDiagReg(void) const
+{
+	uint16_t v = 0;
+	if (listenOnly)
+	{
+		v |= MDB_DIAGREG_LISTEN_ONLY;
+	}
+	if (Get(MdbDiag_Overrun) != 0)
+	{
+		v |= MDB_DIAGREG_OVERRUN;
+	}
+	if (Get(MdbDiag_BusCommErr) != 0)
+	{
+		v |= MDB_DIAGREG_COMM_ERR;
+	}
+	if (Get(MdbDiag_ExcErr) != 0)
+	{
+		v |= MDB_DIAGREG_EXC;
+	}
+	return v;
+}
+
+//*****************************************************************************
+//! One word of register block, 32 bit counters are saturated to 16 bits
+//*****************************************************************************
+int16_t ModbusDiag::ReadReg(uint16_t offset) const
+{
+	uint32_t v = 0;
+	if (offset < MDB_DIAG_REG_DIAG)
+	{
+		v = cnt[offset - MDB_DIAG_REG_CNT];
+	}
+	else if (offset == MDB_DIAG_REG_DIAG)
+	{
+		v = GetDiagReg();
+	}
+	else if (offset < MDB_DIAG_REG_EXC)
+	{
+		v = fc[offset - MDB_DIAG_REG_FC];
+	}
+	else if (offset < MDB_DIAG_REG_LAT)
+	{
+		v = exc[offset - MDB_DIAG_REG_EXC];
+	}
+	else if (offset < MDB_DIAG_REG_LATMAX)
+	{
+		v = lat[offset - MDB_DIAG_REG_LAT];
+	}
+	else if (offset == MDB_DIAG_REG_LATMAX)
+	{
+		v = latMax;
+	}
+	return (int16_t)std::min(v, (uint32_t)UINT16_MAX);
+}
+
+void ModbusDiag::GetJson(JsonObject obj) const
+{
+	static const char *const cntNames[MdbDiag_CntNmr] = {"busMsg", "busCommErr", "excErr", "slaveMsg", "noRsp", "nak", "busy", "overrun"};
+	JsonObject bus = obj["bus"].to<JsonObject>();
+	for (uint8_t i = 0; i < MdbDiag_CntNmr; i++)
+	{
+		bus[cntNames[i]] = cnt[i].load(std::memory_order_relaxed);
+	}
+	obj["diagReg"] = GetDiagReg();
+	obj["listenOnly"] = listenOnly.load();
+
+	JsonObject f = obj["fc"].to<JsonObject>();
+	for (uint8_t i = 0; i < MDB_DIAG_FC_NMR; i++)
+	{
+		f[(i < (MDB_DIAG_FC_NMR - 1)) ? String(FcCodes[i]) : String("other")] = fc[i].load(std::memory_order_relaxed);
+	}
+
+	JsonObject e = obj["exc"].to<JsonObject>();
+	for (uint8_t i = 0; i < MDB_DIAG_EXC_NMR; i++)
+	{
+		e[String(ExcCodes[i])] = exc[i].load(std::memory_order_relaxed);
+	}
+
+	JsonObject l = obj["lat"].to<JsonObject>();
+	JsonArray bounds = l["le"].to<JsonArray>();
+	JsonArray counts = l["cnt"].to<JsonArray>();
+	for (uint8_t i = 0; i < MDB_DIAG_LAT_BINS; i++)
+	{
+		if (i < (MDB_DIAG_LAT_BINS - 1))
+		{
+			bounds.add(LatBounds[i]);
+		}
+		counts.add(lat[i].load(std::memory_order_relaxed));
+	}
+	l["max"] = latMax.load(std::memory_order_relaxed);
+}
+
+//*****************************************************************************
+//! Parameter view of diagnostic block, read only, value is computed on read
+//*****************************************************************************
+uint8_t mdbdiag_reg::GetRegVal(int16_t *out)
+{
+	*out = diag.ReadReg(0);
+	return 1;
+}
+
+uint8_t mdbdiag_reg::GetRegVal(int16_t *out, uint16_t addr, RegCursor &cur)
+{
+	*out = diag.ReadReg(getidx(addr));
+	return 1;
+}
+
+uint16_t mdbdiag_reg::GetRegVals(int16_t *out, uint16_t addr, uint16_t nmr)
+{
+	for (uint16_t i = 0; i < nmr; i++)
+	{
+		out[i] = diag.ReadReg(getidx(addr + i));
+	}
+	return nmr;
+}
+
+void mdbdiag_reg::GetJsonVal(JsonVariant json_val)
+{
+	diag.GetJson(json_val.to<JsonObject>());
+}
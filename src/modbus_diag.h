@@ -0,0 +1,87 @@
+/***********************************************************************
+ * Filename: modbus_diag.h
+ * Author: agent
+ * Date: 2026-10-17
+ * Description:
+ *     Declares the ModbusDiag class with lock-free diagnostic counters
+ *     of one Modbus interface: FC8 counters (Modbus specification,
+ *     chapter 6.8), request count per function code, exception count
+ *     per code and histogram of RX complete -> TX start latency.
+ *     Counters are read as block of registers (mdbdiag_reg) and
+ *     as JSON object through /api/get_params.
+ *
+ ***********************************************************************/
+
+
+#pragma once
+#include <atomic>
+#include "common.h"
+
+/*FC8 pocitadla, poradi odpovida subfunkcim 0x0B..0x12*/
+typedef enum
+{
+	MdbDiag_BusMsg = 0,
+	MdbDiag_BusCommErr,
+	MdbDiag_ExcErr,
+	MdbDiag_SlaveMsg,
+	MdbDiag_NoRsp,
+	MdbDiag_Nak,
+	MdbDiag_Busy,
+	MdbDiag_Overrun,
+	MdbDiag_CntNmr
+} mdbdiagcnt_t;
+
+/*bity diagnostickeho registru (FC8 sub 2)*/
+#define MDB_DIAGREG_LISTEN_ONLY 0x0001 /*rezim listen only*/
+#define MDB_DIAGREG_OVERRUN 0x0002	   /*pocitadlo preteceni neni nulove*/
+#define MDB_DIAGREG_COMM_ERR 0x0004	   /*byly prijaty vadne ramce*/
+#define MDB_DIAGREG_EXC 0x0008		   /*byly odeslany vyjimky*/
+
+#define MDB_DIAG_FC_NMR 10	/*sledovane funkce + ostatni*/
+#define MDB_DIAG_EXC_NMR 6
+#define MDB_DIAG_LAT_BINS 8
+
+/*rozlozeni bloku registru*/
+#define MDB_DIAG_REG_CNT 0
+#define MDB_DIAG_REG_DIAG (MDB_DIAG_REG_CNT + MdbDiag_CntNmr)
+#define MDB_DIAG_REG_FC (MDB_DIAG_REG_DIAG + 1)
+#define MDB_DIAG_REG_EXC (MDB_DIAG_REG_FC + MDB_DIAG_FC_NMR)
+#define MDB_DIAG_REG_LAT (MDB_DIAG_REG_EXC + MDB_DIAG_EXC_NMR)
+#define MDB_DIAG_REG_LATMAX (MDB_DIAG_REG_LAT + MDB_DIAG_LAT_BINS)
+#define MDB_DIAG_REGS (MDB_DIAG_REG_LATMAX + 1)
+
+class ModbusDiag
+{
+protected:
+	std::atomic<uint16_t> cnt[MdbDiag_CntNmr];
+	std::atomic<uint32_t> fc[MDB_DIAG_FC_NMR];
+	std::atomic<uint32_t> exc[MDB_DIAG_EXC_NMR];
+	std::atomic<uint32_t> lat[MDB_DIAG_LAT_BINS];
+	std::atomic<uint32_t> latMax;
+	std::atomic<bool> listenOnly;
+
+	static const uint8_t FcCodes[MDB_DIAG_FC_NMR - 1];
+	static const uint8_t ExcCodes[MDB_DIAG_EXC_NMR];
+	static const uint32_t LatBounds[MDB_DIAG_LAT_BINS - 1];
+
+public:
+	ModbusDiag();
+
+	void Count(mdbdiagcnt_t c) { cnt[c].fetch_add(1, std::memory_order_relaxed); }
+	void Request(uint8_t fun);
+	void Exception(uint8_t code);
+	void Latency(uint32_t us);
+	void Clear(void);
+
+	uint16_t Get(mdbdiagcnt_t c) const { return cnt[c].load(std::memory_order_relaxed); }
+	uint16_t GetDiagReg(void) const;
+	bool ListenOnly(void) const { return listenOnly; }
+	void SetListenOnly(bool on) { listenOnly = on; }
+	void ClearOverrun(void) { cnt[MdbDiag_Overrun] = 0; }
+
+	int16_t ReadReg(uint16_t offset) const;
+	void GetJson(JsonObject obj) const;
+
+	static ModbusDiag Rtu;
+	static ModbusDiag Tcp;
+};
@@ -0,0 +1,178 @@
+/***********************************************************************
+ * Filename: modbus_master.cpp
+ * Author: agent
+ * Date: 2026-10-17
+ * Description:
+ *     Implements the ModbusMaster class. Master requests run in the
+ *     Modbus task between slave frames (MdbMaster enabled), the bus is
+ *     taken only when the slave is idle, no frame is in progress and
+ *     the line has been silent for MdbPollIdle, one request per slot.
+ *
+ ***********************************************************************/
+
+#include "Arduino.h"
+#include "modbus_master.h"
+#include "parameters.h"
+
+static uint16_reg *const PollSlave[MDB_POLL_ENTRIES] = {&MdbPoll1Slave, &MdbPoll2Slave, &MdbPoll3Slave, &MdbPoll4Slave};
+static uint16_reg *const PollReg[MDB_POLL_ENTRIES] = {&MdbPoll1Reg, &MdbPoll2Reg, &MdbPoll3Reg, &MdbPoll4Reg};
+static uint16_reg *const PollCnt[MDB_POLL_ENTRIES] = {&MdbPoll1Cnt, &MdbPoll2Cnt, &MdbPoll3Cnt, &MdbPoll4Cnt};
+static uint16_reg *const PollPeriod[MDB_POLL_ENTRIES] = {&MdbPoll1Perioda, &MdbPoll2Perioda, &MdbPoll3Perioda, &MdbPoll4Perioda};
+static int16_reg *const ExtVal[MDB_POLL_VALUES] = {&MdbExt1, &MdbExt2, &MdbExt3, &MdbExt4, &MdbExt5, &MdbExt6, &MdbExt7, &MdbExt8};
+
+void ModbusMaster::Init(void)
+{
+	Load();
+	uint32_t now = millis();
+	for (uint8_t i = 0; i < MDB_POLL_ENTRIES; i++)
+	{
+		due[i] = now;
+	}
+}
+
+//*****************************************************************************
+//! Read poll list from parameters, values are assigned to MdbExt in order,
+//! entry with address of this device is disabled
+//*****************************************************************************
+void ModbusMaster::Load(void)
+{
+	uint8_t val = 0;
+	for (uint8_t i = 0; i < MDB_POLL_ENTRIES; i++)
+	{
+		mdbpoll_t &p = poll[i];
+		p.slave = PollSlave[i]->Get();
+		p.reg = PollReg[i]->Get();
+		p.cnt = std::min((int32_t)PollCnt[i]->Get(), (int32_t)(MDB_POLL_VALUES - val));
+		p.val = val;
+		p.periodMs = PollPeriod[i]->Get() * 1000UL;
+		if ((p.slave == 0) || (p.slave == Bus.getdeviceid()) || (p.cnt == 0) || (((uint32_t)p.reg + p.cnt) > 0x10000UL))
+		{
+			p.slave = 0;
+			continue;
+		}
+		val += p.cnt;
+	}
+}
+
+//*****************************************************************************
+//! Merge due entries into minimal set of FC3 requests, entries of one slave
+//! are merged when gap between them is at most MDB_POLL_GAP_MAX registers
+//*****************************************************************************
+uint8_t ModbusMaster::Coalesce(const mdbpoll_t *entries, uint8_t cnt, uint8_t dueMask, mdbpollreq_t *out)
+{
+	uint8_t order[MDB_POLL_ENTRIES];
+	uint8_t n = 0;
+
+	/*razeni podle slave a registru, polozek je malo*/
+	for (uint8_t i = 0; (i < cnt) && (i < MDB_POLL_ENTRIES); i++)
+	{
+		if (!(dueMask & (1 << i)) || (entries[i].slave == 0))
+		{
+			continue;
+		}
+		uint8_t j = n++;
+		while ((j > 0) && ((entries[order[j - 1]].slave > entries[i].slave) ||
+						   ((entries[order[j - 1]].slave == entries[i].slave) && (entries[order[j - 1]].reg > entries[i].reg))))
+		{
+			order[j] = order[j - 1];
+			j--;
+		}
+		order[j] = i;
+	}
+
+	uint8_t reqs = 0;
+	for (uint8_t k = 0; k < n; k++)
+	{
+		const mdbpoll_t &e = entries[order[k]];
+		uint32_t end = (uint32_t)e.reg + e.cnt;
+		if (reqs > 0)
+		{
+			mdbpollreq_t &r = out[reqs - 1];
+			uint32_t rend = (uint32_t)r.reg + r.cnt;
+			if ((r.slave == e.slave) && (e.reg <= (rend + MDB_POLL_GAP_MAX)) && ((std::max(end, rend) - r.reg) <= MDB_POLL_REGS_MAX))
+			{
+				r.cnt = std::max(end, rend) - r.reg;
+				r.entries |= 1 << order[k];
+				continue;
+			}
+		}
+		out[reqs].slave = e.slave;
+		out[reqs].reg = e.reg;
+		out[reqs].cnt = e.cnt;
+		out[reqs].entries = 1 << order[k];
+		reqs++;
+	}
+	return reqs;
+}
+
+//*****************************************************************************
+//! One FC3 transaction, results are spread to MdbExt of served entries
+//*****************************************************************************
+bool ModbusMaster::Execute(const mdbpollreq_t &r)
+{
+	uint8_t pdu[ReadHRReqLen];
+	uint8_t rsp[ReadHRRspLenMin + 2 * MDB_POLL_REGS_MAX];
+	uint16_t regs[MDB_POLL_REGS_MAX];
+
+	size_t len = ModbusRtuCodec::ReadRegsReq(pdu, MbFun_ReadHoldingRegs, r.reg, r.cnt);
+	len = Bus.Transaction(r.slave, pdu, len, rsp, sizeof(rsp), MdbPollTimeout.Get());
+	bool ok = ModbusRtuCodec::ReadRegsRsp(rsp, len, MbFun_ReadHoldingRegs, r.cnt, regs);
+
+	uint16_t stav = MdbPollStav.Get();
+	for (uint8_t i = 0; i < MDB_POLL_ENTRIES; i++)
+	{
+		if (!(r.entries & (1 << i)))
+		{
+			continue;
+		}
+		if (ok)
+		{
+			const uint16_t *data = regs + (poll[i].reg - r.reg);
+			for (uint8_t k = 0; k < poll[i].cnt; k++)
+			{
+				ExtVal[poll[i].val + k]->Set((int16_t)data[k]);
+			}
+			stav |= 1 << i;
+		}
+		else
+		{
+			stav &= ~(1 << i);
+		}
+	}
+	MdbPollStav.Set(stav);
+
+	if (ok)
+	{
+		MdbPollOk.Inc();
+	}
+	else
+	{
+		MdbPollError.Inc();
+	}
+	return ok;
+}
+
+void ModbusMaster::Run(void)
+{
+	uint32_t now = millis();
+	if (reqPos >= reqCnt)
+	{ /*vsechny dotazy obslouzeny, plan dalsiho kola*/
+		Load();
+		uint8_t mask = 0;
+		for (uint8_t i = 0; i < MDB_POLL_ENTRIES; i++)
+		{
+			if ((poll[i].slave != 0) && ((int32_t)(now - due[i]) >= 0))
+			{
+				mask |= 1 << i;
+				due[i] = now + poll[i].periodMs;
+			}
+		}
+		reqCnt = Coalesce(poll, MDB_POLL_ENTRIES, mask, req);
+		reqPos = 0;
+	}
+
+	if ((reqPos < reqCnt) && Bus.BusIdle(MdbPollIdle.Get()))
+	{
+		Execute(req[reqPos++]);
+	}
+}
@@ -0,0 +1,65 @@
+/***********************************************************************
+ * Filename: modbus_master.h
+ * Author: agent
+ * Date: 2026-10-17
+ * Description:
+ *     Declares the ModbusMaster class, a poller of external RS-485
+ *     devices sharing the bus with the Modbus slave. Poll entries are
+ *     configured by NV parameters (slave, start register, count,
+ *     period); due entries of one slave with adjacent registers are
+ *     merged into a single FC3 request and results are mapped into
+ *     RAM parameters MdbExt1..MdbExt8.
+ *     The RTU slave keeps running, the poller (MdbMaster enabled)
+ *     sends a request only in an idle slot of the slave. A request of
+ *     another master arriving while the poller waits for a response is
+ *     handed over to the slave by ModbusSerial::Transaction.
+ *
+ ***********************************************************************/
+
+
+#pragma once
+#include "common.h"
+#include "modbus_serial.h"
+
+#define MDB_POLL_ENTRIES 4
+#define MDB_POLL_VALUES 8
+#define MDB_POLL_GAP_MAX 4	 /*max. mezera mezi registry slucovanych polozek*/
+#define MDB_POLL_REGS_MAX 0x7D /*max. pocet registru jednoho FC3 dotazu*/
+
+typedef struct
+{
+	uint8_t slave; /*0 = vypnuto*/
+	uint16_t reg;
+	uint8_t cnt;
+	uint8_t val;	   /*index prvni hodnoty MdbExt*/
+	uint32_t periodMs;
+} mdbpoll_t;
+
+typedef struct
+{
+	uint8_t slave;
+	uint16_t reg;
+	uint16_t cnt;
+	uint8_t entries; /*bitova maska obslouzenych polozek*/
+} mdbpollreq_t;
+
+class ModbusMaster
+{
+protected:
+	ModbusSerial &Bus;
+	mdbpoll_t poll[MDB_POLL_ENTRIES];
+	uint32_t due[MDB_POLL_ENTRIES]; /*cas dalsiho dotazu [ms]*/
+	mdbpollreq_t req[MDB_POLL_ENTRIES];
+	uint8_t reqCnt;
+	uint8_t reqPos;
+
+	void Load(void);
+	bool Execute(const mdbpollreq_t &r);
+
+public:
+	ModbusMaster(ModbusSerial &bus) : Bus(bus), reqCnt(0), reqPos(0) {}
+	void Init(void);
+	void Run(void);
+
+	static uint8_t Coalesce(const mdbpoll_t *entries, uint8_t cnt, uint8_t dueMask, mdbpollreq_t *out);
+};
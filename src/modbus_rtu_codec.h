@@ -0,0 +1,54 @@
+/***********************************************************************
+ * Filename: modbus_rtu_codec.h
+ * Author: agent
+ * Date: 2026-10-17
+ * Description:
+ *     Declares the ModbusRtuCodec class, platform independent part of
+ *     Modbus RTU: CRC16, framing (address + PDU + CRC) and encoding of
+ *     requests and responses. It uses only the C++ standard library,
+ *     so it builds natively as well as on target.
+ *
+ ***********************************************************************/
+
+
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+#define MODBUS_RTU_ADU_MAX 256
+#define MODBUS_RTU_ADU_MIN 4 /*adresa + funkce + crc(2)*/
+#define MODBUS_CRC_INIT 0xFFFF
+#define MODBUS_CRC_SLICE_MIN 16 /*kratsi data pocita rychleji bytewise CRC*/
+
+typedef enum
+{
+	RtuFrame_Ok,		/*ramec pro danou adresu se spravnym CRC*/
+	RtuFrame_Short,		/*ramec kratsi nez minimalni ADU*/
+	RtuFrame_OtherAdr,	/*ramec pro jine zarizeni, CRC se nekontroluje*/
+	RtuFrame_Crc		/*chybne CRC*/
+} rtuframe_t;
+
+class ModbusRtuCodec
+{
+private:
+	static uint16_t Tbl[4][256];
+	static bool TblInit(void);
+	static const bool TblReady;
+
+public:
+	static uint16_t Crc(const uint8_t *data, size_t len, uint16_t crc = MODBUS_CRC_INIT);
+	static uint16_t CrcBytewise(const uint8_t *data, size_t len, uint16_t crc = MODBUS_CRC_INIT);
+
+	static size_t Seal(uint8_t *adu, size_t len);
+	static rtuframe_t Check(const uint8_t *adu, size_t len, uint8_t adr);
+
+	static uint16_t GetWord(const uint8_t *p) { return (uint16_t)p[0] << 8 | p[1]; }
+	static void PutWord(uint8_t *p, uint16_t val)
+	{
+		p[0] = (uint8_t)(val >> 8);
+		p[1] = (uint8_t)(val & 0xFF);
+	}
+
+	static size_t ReadRegsReq(uint8_t *pdu, uint8_t fun, uint16_t reg, uint16_t cnt);
+	static bool ReadRegsRsp(const uint8_t *pdu, size_t len, uint8_t fun, uint16_t cnt, uint16_t *out);
+};
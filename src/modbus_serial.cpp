@@ -5,8 +5,13 @@
  * Description:
  *     Implements the ModbusSerial class, which provides functions for 
  *     Modbus communication over a serial interface. 
- *     The class utilizes the Arduino HardwareSerial library and manages 
- *     RS485-specific pin controls and timing.
+ *     The class uses the ESP-IDF UART driver event queue. UART RX
+ *     timeout is set to T1.5, end of frame is confirmed after T3.5 of
+ *     silence, so a frame with inter-character gap between T1.5 and
+ *     T3.5 is discarded as required by the Modbus RTU specification.
+ *     Rest of T3.5 is measured by one-shot esp_timer, which posts
+ *     MODBUS_SILENCE_EVENT into the UART event queue, so the task
+ *     blocks on the queue instead of polling the timer.
  *
  ***********************************************************************/
 
@@ -15,90 +20,73 @@
 #include "modbus_serial.h"
 #include "modbus_slave.h"
 #include "string.h"
-#include <HardwareSerial.h>
 #include "pin_map.h"
 #include "driver/uart.h"
-#include "semphr.h"
+#include "soc/uart_reg.h"
+#include "esp_timer.h"
 #include "parameters.h"
+#include "modbus_rtu_codec.h"
+#include "log.h"
 
-HardwareSerial Rs485(RS485_SERIAL_PORT);
-SemaphoreHandle_t  MdbSem = xSemaphoreCreateBinary();
-static bool RxEvent;
-static bool TxEvent;
-
-#define CRC_INIT_VAL 0xFFFF
-#define RS485_BAUDRATE 38400
-
-static const uint16_t CRC16Table[] =
-	{0x0000, 0xC0C1, 0xC181, 0x0140, 0xC301, 0x03C0, 0x0280, 0xC241, 0xC601,
-	 0x06C0, 0x0780, 0xC741, 0x0500, 0xC5C1, 0xC481, 0x0440, 0xCC01, 0x0CC0,
-	 0x0D80, 0xCD41, 0x0F00, 0xCFC1, 0xCE81, 0x0E40, 0x0A00, 0xCAC1, 0xCB81,
-	 0x0B40, 0xC901, 0x09C0, 0x0880, 0xC841, 0xD801, 0x18C0, 0x1980, 0xD941,
-	 0x1B00, 0xDBC1, 0xDA81, 0x1A40, 0x1E00, 0xDEC1, 0xDF81, 0x1F40, 0xDD01,
-	 0x1DC0, 0x1C80, 0xDC41, 0x1400, 0xD4C1, 0xD581, 0x1540, 0xD701, 0x17C0,
-	 0x1680, 0xD641, 0xD201, 0x12C0, 0x1380, 0xD341, 0x1100, 0xD1C1, 0xD081,
-	 0x1040, 0xF001, 0x30C0, 0x3180, 0xF141, 0x3300, 0xF3C1, 0xF281, 0x3240,
-	 0x3600, 0xF6C1, 0xF781, 0x3740, 0xF501, 0x35C0, 0x3480, 0xF441, 0x3C00,
-	 0xFCC1, 0xFD81, 0x3D40, 0xFF01, 0x3FC0, 0x3E80, 0xFE41, 0xFA01, 0x3AC0,
-	 0x3B80, 0xFB41, 0x3900, 0xF9C1, 0xF881, 0x3840, 0x2800, 0xE8C1, 0xE981,
-	 0x2940, 0xEB01, 0x2BC0, 0x2A80, 0xEA41, 0xEE01, 0x2EC0, 0x2F80, 0xEF41,
-	 0x2D00, 0xEDC1, 0xEC81, 0x2C40, 0xE401, 0x24C0, 0x2580, 0xE541, 0x2700,
-	 0xE7C1, 0xE681, 0x2640, 0x2200, 0xE2C1, 0xE381, 0x2340, 0xE101, 0x21C0,
-	 0x2080, 0xE041, 0xA001, 0x60C0, 0x6180, 0xA141, 0x6300, 0xA3C1, 0xA281,
-	 0x6240, 0x6600, 0xA6C1, 0xA781, 0x6740, 0xA501, 0x65C0, 0x6480, 0xA441,
-	 0x6C00, 0xACC1, 0xAD81, 0x6D40, 0xAF01, 0x6FC0, 0x6E80, 0xAE41, 0xAA01,
-	 0x6AC0, 0x6B80, 0xAB41, 0x6900, 0xA9C1, 0xA881, 0x6840, 0x7800, 0xB8C1,
-	 0xB981, 0x7940, 0xBB01, 0x7BC0, 0x7A80, 0xBA41, 0xBE01, 0x7EC0, 0x7F80,
-	 0xBF41, 0x7D00, 0xBDC1, 0xBC81, 0x7C40, 0xB401, 0x74C0, 0x7580, 0xB541,
-	 0x7700, 0xB7C1, 0xB681, 0x7640, 0x7200, 0xB2C1, 0xB381, 0x7340, 0xB101,
-	 0x71C0, 0x7080, 0xB041, 0x5000, 0x90C1, 0x9181, 0x5140, 0x9301, 0x53C0,
-	 0x5280, 0x9241, 0x9601, 0x56C0, 0x5780, 0x9741, 0x5500, 0x95C1, 0x9481,
-	 0x5440, 0x9C01, 0x5CC0, 0x5D80, 0x9D41, 0x5F00, 0x9FC1, 0x9E81, 0x5E40,
-	 0x5A00, 0x9AC1, 0x9B81, 0x5B40, 0x9901, 0x59C0, 0x5880, 0x9841, 0x8801,
-	 0x48C0, 0x4980, 0x8941, 0x4B00, 0x8BC1, 0x8A81, 0x4A40, 0x4E00, 0x8EC1,
-	 0x8F81, 0x4F40, 0x8D01, 0x4DC0, 0x4C80, 0x8C41, 0x4400, 0x84C1, 0x8581,
-	 0x4540, 0x8701, 0x47C0, 0x4680, 0x8641, 0x8201, 0x42C0, 0x4380, 0x8341,
-	 0x4100, 0x81C1, 0x8081, 0x4040};
-
-uint16_t ModbusSerial::calcCRC(const uint8_t *pData, size_t len) const
-{
-	uint8_t temp;
-	uint16_t CRCWord = CRC_INIT_VAL;
-	while (len--)
-	{
-		temp = *pData++ ^ CRCWord;
-		CRCWord >>= 8;
-		CRCWord ^= CRC16Table[temp];
-	}
-	return (uint16_t)CRCWord;
+//*****************************************************************************
+//! Count of bytes waiting in hardware RX FIFO (not yet taken by the driver)
+//*****************************************************************************
+static inline uint32_t RxFifoLen(void)
+{
+	return (READ_PERI_REG(UART_STATUS_REG(RS485_SERIAL_PORT)) & UART_RXFIFO_CNT_M) >> UART_RXFIFO_CNT_S;
 }
 
-
-void frameReceive(void)
+//*****************************************************************************
+//! Set baudrate and frame timing, RX timeout of UART is T1.5 in symbols.
+//! Timeout counts whole symbols, T1.5 is rounded up, so a gap at most one
+//! symbol longer than T1.5 is still taken as inter-character gap (e.g. 781 us
+//! instead of 750 us at 38400 Bd). Rounding down would discard valid frames
+//! with gap just below T1.5. T3.5 is kept exact, silenceUs covers the rest.
+//*****************************************************************************
+void ModbusSerial::SetBaud(uint32_t bd)
 {
-	if (digitalRead(DE485))
-	{
-		digitalWrite(DE485, 0);
-		Rs485.flush(false);
-		TxEvent = true;
-	}
-	else
-	{
-		RxEvent = true;
-	}
-	xSemaphoreGive(MdbSem);
+	uint32_t byteUs = BYTE_TIME_US(bd);
+	uint32_t tout = (MODBUS_T15_US(bd) + byteUs - 1) / byteUs;
+	tout = std::max((uint32_t)1, std::min(tout, (uint32_t)126));
+
+	uart_set_baudrate(MODBUS_UART, bd);
+	uart_set_rx_timeout(MODBUS_UART, tout);
+	silenceUs = (MODBUS_T35_US(bd) > tout * byteUs) ? (MODBUS_T35_US(bd) - tout * byteUs) : 0;
 }
 
+void ModbusSerial::OnBaudChanged(Register &reg, void *arg)
+{
+	((ModbusSerial *)arg)->baudChanged = true;
+}
 
 void ModbusSerial::initdll(void)
 {
-	Rs485.setRxBufferSize(MODBUS_BUFFERSIZE);
-	Rs485.begin(RS485_BAUDRATE, SERIAL_8N1, RXD485, TXD485);
-	Rs485.setRxTimeout(2);
-	Rs485.onReceive(frameReceive, true);
+	uart_config_t cfg;
+	memset(&cfg, 0, sizeof(cfg));
+	cfg.baud_rate = MdbBaudRate.Get();
+	cfg.data_bits = UART_DATA_8_BITS;
+	cfg.parity = UART_PARITY_DISABLE;
+	cfg.stop_bits = UART_STOP_BITS_1;
+	cfg.flow_ctrl = UART_HW_FLOWCTRL_DISABLE;
 
-	pinMode(DE485, OUTPUT);
-	digitalWrite(DE485, 0);
+	uart_driver_install(MODBUS_UART, 2 * MODBUS_BUFFERSIZE, 2 * MODBUS_BUFFERSIZE, MODBUS_UART_QUEUE_LEN, &uartQueue, 0);
+	uart_param_config(MODBUS_UART, &cfg);
+	/*DE pin je RTS, v RS485 half duplex rezimu jej ridi UART behem vysilani*/
+	uart_set_pin(MODBUS_UART, TXD485, RXD485, DE485, UART_PIN_NO_CHANGE);
+	uart_set_mode(MODBUS_UART, UART_MODE_RS485_HALF_DUPLEX);
+	SetBaud(cfg.baud_rate);
+	if (!MdbBaudRate.Subscribe(OnBaudChanged, this))
+	{ /*nova rychlost se projevi az po restartu*/
+		SystemLog::PutLog("Modbus: odber zmen rychlosti selhal", v_error);
+	}
+
+	esp_timer_create_args_t targs;
+	memset(&targs, 0, sizeof(targs));
+	targs.callback = OnSilence;
+	targs.arg = this;
+	targs.dispatch_method = ESP_TIMER_TASK;
+	targs.name = "mdbT35";
+	esp_timer_create(&targs, &silenceTimer);
 
 	Address = DEF_ADDR;
 
@@ -114,111 +102,259 @@ void ModbusSerial::Run(void)
 void ModbusSerial::sendPDU(void)
 {
 	BufferOut[0] = Address; /*put slave address before pdu data*/
-	uint16_t len = outLen;
-
-	uint16_t crc = calcCRC(BufferOut, len);
-	BufferOut[len] = crc & 0xFF;
-	BufferOut[len + 1] = crc >> 8;
-	TxEvent = false;
-	digitalWrite(DE485, 1);
-	delayMicroseconds(100); /*wait for DE pin to be stable*/
-	Rs485.write(BufferOut, len + 2);
+	size_t len = ModbusRtuCodec::Seal(BufferOut, outLen);
+	Diag.Latency(esp_timer_get_time() - rxDoneUs);
+	uart_write_bytes(MODBUS_UART, BufferOut, len);
 
 	State = PDUTransmit;
 }
 
-void ModbusSerial::TxEnd(void)
-{
-	digitalWrite(DE485, 0);
-}
-
 void ModbusSerial::receivePDU(void)
 {
+	RxSilenceCancel();
+	inpLen = 0;
+	frameErr = false;
 	State = PDUReceive;
 }
 
-void ModbusSerial::RxEnd(bool bytime)
+//*****************************************************************************
+//! Move received bytes from driver into frame buffer
+//*****************************************************************************
+void ModbusSerial::RxData(size_t size)
 {
-	if (State == PDUReceive)
+	size_t n = std::min(size, (size_t)(MODBUS_BUFFERSIZE - inpLen));
+	int rd = uart_read_bytes(MODBUS_UART, BufferIn + inpLen, n, 0);
+	if (rd > 0)
 	{
-		if (BufferIn[0] == Address)
-		{
-			State = PDUUnicast;
-		}
-		else
-		{
+		inpLen += rd;
+	}
+	lastRxUs = esp_timer_get_time();
+	if (n < size)
+	{ /*ramec je delsi nez buffer*/
+		Diag.Count(MdbDiag_Overrun);
+		uart_flush_input(MODBUS_UART);
+		frameErr = true;
+	}
+}
 
-		}
+//*****************************************************************************
+//! Called after RX timeout (T1.5), starts wait for rest of T3.5. Returns true
+//! if there is nothing to wait for, otherwise frame is completed by
+//! MODBUS_SILENCE_EVENT in RxWait.
+//*****************************************************************************
+bool ModbusSerial::RxFrameEnd(void)
+{
+	if (silenceUs == 0)
+	{
+		return true;
 	}
-	else
+	silenceGen++;
+	silencePending = true;
+	esp_timer_start_once(silenceTimer, silenceUs);
+	return false;
+}
+
+void ModbusSerial::RxSilenceCancel(void)
+{
+	if (silencePending)
 	{
+		esp_timer_stop(silenceTimer);
+		silencePending = false;
+	}
+}
+
+//*****************************************************************************
+//! End of T3.5 (esp_timer task). Bytes still in hardware FIFO are not yet
+//! reported by the driver, they are passed in timeout_flag as broken silence.
+//*****************************************************************************
+void ModbusSerial::OnSilence(void *arg)
+{
+	ModbusSerial *dll = (ModbusSerial *)arg;
+	uart_event_t event;
+	memset(&event, 0, sizeof(event));
+	event.type = MODBUS_SILENCE_EVENT;
+	event.size = dll->silenceGen;
+	event.timeout_flag = RxFifoLen() > 0;
+	xQueueSend(dll->uartQueue, &event, 0);
+}
 
+//*****************************************************************************
+//! Check address and CRC of complete frame, frame is kept in BufferIn
+//! for ModbusSlave only when it is addressed to this slave
+//*****************************************************************************
+PduStatus_t ModbusSerial::RxFrameCheck(void)
+{
+	PduStatus_t retstate = PDUReceive;
+
+	Diag.Count(MdbDiag_BusMsg);
+	switch (frameErr ? RtuFrame_Short : ModbusRtuCodec::Check(BufferIn, inpLen, Address))
+	{
+	case RtuFrame_Ok:
+		rxDoneUs = esp_timer_get_time();
+		State = PDUUnicast;
+		return PDUUnicast;
+	case RtuFrame_Short:
+		Diag.Count(MdbDiag_BusCommErr);
+		TimeoutError.Inc();
+		break;
+	case RtuFrame_Crc:
+		retstate = PDUInvalid;
+		Diag.Count(MdbDiag_BusCommErr);
+		CRCError.Inc();
+		break;
+	default:
+		break;
 	}
+
+	/*ramec neni pro toto zarizeni nebo je vadny, prijima se dalsi*/
+	inpLen = 0;
+	frameErr = false;
+	return retstate;
 }
 
-void ModbusSerial::RxErr(void)
+void ModbusSerial::RxErr(bool overrun)
 {
-	State = PDUInvalid;
+	if (overrun)
+	{
+		Diag.Count(MdbDiag_Overrun);
+	}
+	RxSilenceCancel();
+	uart_flush_input(MODBUS_UART);
+	xQueueReset(uartQueue);
+	frameErr = true;
 }
 
 PduStatus_t ModbusSerial::getstatus(void)
 {
-	xSemaphoreTake(MdbSem,pdMS_TO_TICKS(2000));
-	PduStatus_t retstate = State;
+	if (baudChanged.exchange(false))
+	{
+		uart_wait_tx_done(MODBUS_UART, pdMS_TO_TICKS(MODBUS_TX_TIMEOUT_MS));
+		SetBaud(MdbBaudRate.Get());
+	}
 
-	if (RxEvent)
+	if (State == PDUTransmit)
 	{
-		size_t i = Rs485.available();
-		if (i > 3)
-		{
-			if (i < MODBUS_BUFFERSIZE)
-			{
-				Rs485.readBytes(BufferIn, i);
-				inpLen = i;
-				if (BufferIn[0] == Address)
-				{
-					retstate = PDUUnicast;
-				}
-				Rs485.flush(false);
-			}
-			else
-			{
-				Rs485.flush(false);
-			}
+		uart_wait_tx_done(MODBUS_UART, pdMS_TO_TICKS(MODBUS_TX_TIMEOUT_MS));
+		State = PDUIdle;
+		return State;
+	}
+
+	if ((State == PDUReceive) && RxWait(pdMS_TO_TICKS(MODBUS_RX_WAIT_MS)))
+	{
+		return RxFrameCheck();
+	}
+	return State;
+}
+
+//*****************************************************************************
+//! Handle one event of UART driver, returns true when complete frame is in
+//! BufferIn (not yet checked)
+//*****************************************************************************
+bool ModbusSerial::RxWait(TickType_t wait)
+{
+	uart_event_t event;
+	if (xQueueReceive(uartQueue, &event, wait) != pdTRUE)
+	{
+		return false;
+	}
+
+	switch (event.type)
+	{
+	case UART_DATA:
+		if (silencePending)
+		{ /*znak mezi T1.5 a T3.5, ramec je poskozen*/
+			RxSilenceCancel();
+			frameErr = true;
+		}
+		RxData(event.size);
+		return event.timeout_flag && RxFrameEnd();
+
+	case MODBUS_SILENCE_EVENT:
+		if (!silencePending || (event.size != silenceGen))
+		{ /*udalost zruseneho okna*/
+			break;
 		}
-		else
+		silencePending = false;
+		if (event.timeout_flag)
 		{
-			TimeoutError.Set(TimeoutError.Get() + 1);
+			frameErr = true;
+			break;
 		}
-		RxEvent = false;
+		return true;
+
+	case UART_FIFO_OVF:
+	case UART_BUFFER_FULL:
+		RxErr(true);
+		break;
+	case UART_FRAME_ERR:
+	case UART_PARITY_ERR:
+		RxErr(false);
+		break;
+
+	default:
+		break;
+	}
+	return false;
+}
+
+//*****************************************************************************
+//! Bus is free for master request, no slave frame is being received and
+//! line has been silent at least idleMs
+//*****************************************************************************
+bool ModbusSerial::BusIdle(uint32_t idleMs) const
+{
+	return (State == PDUReceive) && (inpLen == 0) && (uxQueueMessagesWaiting(uartQueue) == 0) &&
+		   ((esp_timer_get_time() - lastRxUs) >= (int64_t)idleMs * 1000);
+}
+
+//*****************************************************************************
+//! Master transaction, sends request pdu to slave adr and waits for response.
+//! Must be called from task running getstatus(), only when BusIdle().
+//! Frame of other origin received during the wait goes to the slave engine:
+//! request for this device is kept in BufferIn (PDUUnicast) and the wait
+//! ends, because the slave has to answer it, other frames are dropped.
+//! Returns length of response pdu, 0 on timeout or corrupted response.
+//*****************************************************************************
+size_t ModbusSerial::Transaction(uint8_t adr, const uint8_t *pdu, size_t len, uint8_t *rsp, size_t maxLen, uint32_t toutMs)
+{
+	if ((len + 3) > MODBUS_BUFFERSIZE)
+	{
+		return 0;
 	}
 
-	switch (retstate)
+	BufferOut[0] = adr;
+	memcpy(BufferOut + 1, pdu, len);
+	uart_write_bytes(MODBUS_UART, BufferOut, ModbusRtuCodec::Seal(BufferOut, len + 1));
+	uart_wait_tx_done(MODBUS_UART, pdMS_TO_TICKS(MODBUS_TX_TIMEOUT_MS));
+
+	size_t rspLen = 0;
+	int64_t deadline = esp_timer_get_time() + (int64_t)toutMs * 1000;
+	inpLen = 0;
+	frameErr = false;
+	while (esp_timer_get_time() < deadline)
 	{
-	case PDUUnicast:
-		/*Modbus frame is available in buffer*/
-		/* Process received frame */
+		TickType_t wait = pdMS_TO_TICKS((deadline - esp_timer_get_time()) / 1000) + 1;
+		if (!RxWait(wait))
 		{
-			uint16_t len = inpLen - 2;
-			if (len > 0)
+			continue;
+		}
+
+		if ((inpLen > 0) && (BufferIn[0] == adr))
+		{ /*odpoved dotazovaneho slave, vadna se zahodi*/
+			if (!frameErr && (ModbusRtuCodec::Check(BufferIn, inpLen, adr) == RtuFrame_Ok))
 			{
-				/*crc je v ramci little endian*/
-				uint16_t crc = (uint16_t)BufferIn[len] | (uint16_t)BufferIn[len + 1] << 8;
-				if (crc != calcCRC(BufferIn, len))
-				{
-					retstate = PDUInvalid;
-					TxEvent = false;
-					RxEvent = false;
-					CRCError.Set(CRCError.Get() + 1);
-				}
+				rspLen = std::min((size_t)(inpLen - 3), maxLen);
+				memcpy(rsp, BufferIn + 1, rspLen);
 			}
+			break;
 		}
+		if (RxFrameCheck() == PDUUnicast)
+		{ /*dotaz jineho mastera na toto zarizeni, zpracuje jej ModbusSlave*/
+			return 0;
+		}
+	}
 
-		break;
-	default:
-		/*there is no operation in progress- idle state*/
-		break;
-	};
-
-	return retstate;
+	/*slave rezim pokracuje prijmem noveho ramce*/
+	receivePDU();
+	return rspLen;
 }
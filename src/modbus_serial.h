@@ -8,15 +8,23 @@
  *     over a serial interface. The file defines constants for buffer
  *     sizes and timing, and includes methods for managing PDU data,
  *     reading and writing Modbus registers, and calculating CRC.
+ *     Frames are delimited by the ESP-IDF UART driver (RX timeout
+ *     event) and RS485 direction is driven by UART in half duplex mode.
  *
  ***********************************************************************/
 
 
 #pragma once
+#include <atomic>
 #include "common.h"
 #include "modbus_slave.h"
+#include "modbus_rtu_codec.h"
+#include "driver/uart.h"
+#include "esp_timer.h"
 
-#define MODBUS_BUFFERSIZE (256)
+class Register;
+
+#define MODBUS_BUFFERSIZE (MODBUS_RTU_ADU_MAX)
 
 #define DEF_ADDR 1
 #define DEF_RATE 38400
@@ -27,6 +35,15 @@
 #define MIN_INTERBYTE_TIME_US 750
 #define MIN_INTERFRAME_TIME_US 1750
 #define BYTE_TIME_US(bd) ((uint32_t)(MODBUS_NMR_BITS * 1000000UL) / (bd))
+/*T1.5 a T3.5 jsou nad 19200 Bd pevne, jinak odvozene od delky znaku*/
+#define MODBUS_T15_US(bd) (((bd) > 19200) ? MIN_INTERBYTE_TIME_US : (BYTE_TIME_US(bd) * 3 / 2))
+#define MODBUS_T35_US(bd) (((bd) > 19200) ? MIN_INTERFRAME_TIME_US : (BYTE_TIME_US(bd) * 7 / 2))
+
+#define MODBUS_UART ((uart_port_t)RS485_SERIAL_PORT)
+#define MODBUS_UART_QUEUE_LEN 16
+#define MODBUS_RX_WAIT_MS 10 /*kratke cekani, task obsluhuje i master*/
+#define MODBUS_TX_TIMEOUT_MS 200
+#define MODBUS_SILENCE_EVENT ((uart_event_type_t)(UART_EVENT_MAX + 1)) /*konec T3.5, vklada one-shot timer do fronty UARTu*/
 
 class ModbusSerial : public ModbusDll
 {
@@ -40,20 +57,40 @@ protected:
 	size_t outLen;
 	size_t inpLen;
 
-	void RxEnd(bool bytime);
-	void TxEnd(void);
-	void RxErr(void);
+	QueueHandle_t uartQueue;
+	esp_timer_handle_t silenceTimer;
+	uint32_t silenceUs; /*zbytek T3.5 po RX timeoutu UARTu (T1.5)*/
+	std::atomic<uint32_t> silenceGen; /*poradi okna T3.5, stara udalost timeru se ignoruje*/
+	bool silencePending;
+	bool frameErr;
+	int64_t lastRxUs; /*cas posledniho prijateho znaku*/
+	std::atomic<bool> baudChanged;
+
+	void SetBaud(uint32_t bd);
+	void RxData(size_t size);
+	bool RxFrameEnd(void);
+	void RxSilenceCancel(void);
+	bool RxWait(TickType_t wait);
+	PduStatus_t RxFrameCheck(void);
+	void RxErr(bool overrun);
+	static void OnBaudChanged(Register &reg, void *arg);
+	static void OnSilence(void *arg);
 
 public:
-	ModbusSerial() {}
+	ModbusSerial() : ModbusDll(ModbusDiag::Rtu), uartQueue(NULL), silenceTimer(NULL), silenceUs(0), silenceGen(0), silencePending(false), frameErr(false), lastRxUs(0), baudChanged(false) {}
 	void initdll(void);
 	void Run(void);
 	void sendPDU(void);
 	void receivePDU(void);
 	PduStatus_t getstatus(void);
+	/*virtualni kvuli simulovane sbernici v testech mastera*/
+	virtual bool BusIdle(uint32_t idleMs) const;
+	virtual size_t Transaction(uint8_t adr, const uint8_t *pdu, size_t len, uint8_t *rsp, size_t maxLen, uint32_t toutMs);
 	void setdeviceid(uint8_t adr) { Address = adr; }
+	uint8_t getdeviceid(void) const { return Address; }
+	bool SerialLine(void) { return true; }
 	// Buffer interface
-	void settxlenPDU(size_t len) { outLen = len + 3; outIdx = 1; }
+	void settxlenPDU(size_t len) { outLen = len + 1; outIdx = 1; } /*delka s adresou, bez crc*/
 	size_t getrxlenPDU(void) { return inpLen - 3; } /*delka bez adresy a crc*/
 	void writebPDU(size_t id, uint8_t val)
 	{
@@ -84,7 +121,6 @@ public:
 	}
 	size_t maxsizerxPDU(void) { return MODBUS_BUFFERSIZE; }
 	size_t maxsizetxPDU(void) { return MODBUS_BUFFERSIZE; }
-	uint16_t calcCRC(const uint8_t *pData, size_t len) const;
 
 	void writewPDU(uint16_t val)
 	{
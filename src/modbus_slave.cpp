@@ -10,6 +10,7 @@
 #include "Arduino.h"
 #include "modbus_slave.h"
 #include "parameters.h"
+#include "param_snapshot.h"
 #include "task.h"
 
 #define ExcFunFlag (0x80)
@@ -17,6 +18,12 @@
 
 #define ReadHRReqNmrMax ((Dll.maxsizerxPDU() - ReadHRReqLen) / 2)					/*Per Modbus specification 0x7D*/
 #define WriteMultipleHRNmrMax ((Dll.maxsizetxPDU() - WriteMultipleHRReqLenMin) / 2) /*Per Modbus specification 0x7C*/
+#define RangeNmrMax (0x7DU)																/*size of local register block buffer*/
+#define SlaveIDRunIndicator (0xFF)
+
+ModbusSlave::ModbusSlave(ModbusDll &Infc) : ModbusSlave(Infc, ExceptionError, CorrectPackets)
+{
+}
 
 ModbusExcCodes_t ModbusSlave::BroadcastProc(void)
 {
@@ -33,6 +40,7 @@ ModbusExcCodes_t ModbusSlave::UnicastProc(void)
 	ModbusExcCodes_t exc = MB_Exc_IllegalFunction;
 	if (Dll.getrxlenPDU() > 0)
 	{
+		Dll.Diag.Request(Dll.readbPDU(0));
 		// vTaskSuspendAll();
 		switch (Dll.readbPDU(0))
 		{
@@ -45,6 +53,24 @@ ModbusExcCodes_t ModbusSlave::UnicastProc(void)
 		case MbFun_WriteMultipleRegs:
 			exc = WriteMultipleRegs();
 			break;
+		case MbFun_Diagnostics:
+			exc = Diagnostics();
+			break;
+		case MbFun_ReadSlaveID:
+			exc = ReadSlaveID();
+			break;
+		case MbFun_ReadWriteMultipleRegs:
+			exc = ReadWriteMultipleRegs();
+			break;
+		case MbFun_ReadDefaultRegs:
+			exc = ReadDefaultRegs();
+			break;
+		case MbFun_WriteDefaultReg:
+			exc = WriteDefaultReg();
+			break;
+		case MbFun_ReadDefaultID:
+			exc = ReadDefaultID();
+			break;
 		default:
 			/*Unsupported function*/
 			break;
@@ -66,15 +92,14 @@ ModbusExcCodes_t ModbusSlave::ReadHoldingRegs(void)
 		Dll.settxlenPDU(0);
 		Dll.writebPDU(0, MbFun_ReadHoldingRegs);
 
-		if ((regnmr >= 1) && (regnmr <= ReadHRReqNmrMax))
+		if ((regnmr >= 1) && (regnmr <= ReadHRReqNmrMax) && (regnmr <= RangeNmrMax))
 		{
-			uint16_t reglast = regadr + regnmr - 1; /*last register going to be written*/
-			Dll.writebPDU(1, 2 * regnmr);			/*prepare byte count into response*/
-			for (uint16_t i = regadr; i <= reglast; i++)
+			int16_t regs[RangeNmrMax];
+			Dll.writebPDU(1, 2 * regnmr); /*prepare byte count into response*/
+			Register::ReadRange(regadr, regnmr, regs);
+			for (uint16_t i = 0; i < regnmr; i++)
 			{
-				int16_t regval;
-				Register::ReadReg(&regval, i);
-				Dll.writewPDU(regval);
+				Dll.writewPDU(regs[i]);
 			}
 			retexc = MB_No_Exc;
 		}
@@ -97,7 +122,8 @@ ModbusExcCodes_t ModbusSlave::WriteSingleReg(void)
 		{ /*Register exists*/
 			if (Register::IsWritable(regadr))
 			{
-				if (Register::WriteReg(regval, regadr) != 0)
+				RegCursor cur;
+				if (Register::WriteReg(regval, regadr, cur) != 0)
 				{ /*OK*/
 					exc = MB_No_Exc;
 					Dll.writewPDU(1, regadr);
@@ -125,40 +151,30 @@ ModbusExcCodes_t ModbusSlave::WriteMultipleRegs()
 		uint16_t regadr = Dll.readwPDU(1);
 		uint16_t regnmr = Dll.readwPDU(3);
 
-		if ((regnmr >= 1) && (regnmr <= WriteMultipleHRNmrMax))
+		if ((regnmr >= 1) && (regnmr <= WriteMultipleHRNmrMax) && (regnmr <= RangeNmrMax))
 		{ /*count of registers is within limits per standard*/
 			uint16_t bytecnt = Dll.readbPDU(5);
 			if ((Dll.getrxlenPDU() == (WriteMultipleHRReqLenMin + bytecnt)) && (bytecnt == (2 * regnmr)))
-			{											/*Count of values match to requested number bytes and registers*/
-				uint16_t reglast = regadr + regnmr - 1; /*last register going to be written*/
-				/*check if all register addresses exist*/
-				bool exist = true;
+			{ /*Count of values match to requested number bytes and registers*/
+				/*check if all register addresses exist and are writable*/
+				uint16_t valid = Register::CheckRange(regadr, regnmr, true);
 				exc = MB_No_Exc;
-				for (uint16_t i = regadr; i <= reglast; i++)
+				int16_t regs[RangeNmrMax];
+				for (uint16_t i = 0; i < regnmr; i++)
 				{
-					if (!Register::IsReg(i))
-					{
-						exist = false;
-						exc = MB_Exc_IllegalDataAddress;
-						break;
-					}
-					if (!Register::IsWritable(i))
-					{
-						exist = false;
-						exc = MB_Exc_AccessLvlFailure;
-						break;
-					}
+					regs[i] = Dll.readwPDU(6 + 2 * i);
 				}
-
-				if (exist)
+				if (valid < regnmr)
+				{
+					exc = Register::IsReg(regadr + valid) ? MB_Exc_AccessLvlFailure : MB_Exc_IllegalDataAddress;
+				}
+				else if (!Register::CheckRangeVals(regadr, regnmr, regs))
+				{ /*some value is out of limits, nothing is written*/
+					exc = MB_Exc_IllegalDataValue;
+				}
+				else
 				{ /*writing value into registers*/
-					uint16_t written = 0;
-					int j = 6;
-					for (uint16_t i = regadr; i <= reglast; i++)
-					{
-						written += Register::WriteReg(Dll.readwPDU(j), i);
-						j += 2;
-					}
+					uint16_t written = Register::WriteRange(regadr, regnmr, regs);
 					if (written == regnmr)
 					{ /*requested number of register has been written*/
 						Dll.settxlenPDU(0);
@@ -177,6 +193,251 @@ ModbusExcCodes_t ModbusSlave::WriteMultipleRegs()
 	return exc;
 }
 
+//*****************************************************************************
+//! FC23, write block and read block in one request. Addresses, access level
+//! and limits of all values are validated before first write, so exception
+//! response means that nothing was written.
+//*****************************************************************************
+ModbusExcCodes_t ModbusSlave::ReadWriteMultipleRegs()
+{
+	if (Dll.getrxlenPDU() < ReadWriteMultipleHRReqLenMin)
+	{
+		return MB_Exc_IllegalDataValue;
+	}
+
+	uint16_t rdadr = Dll.readwPDU(1);
+	uint16_t rdnmr = Dll.readwPDU(3);
+	uint16_t wradr = Dll.readwPDU(5);
+	uint16_t wrnmr = Dll.readwPDU(7);
+	uint16_t bytecnt = Dll.readbPDU(9);
+
+	if ((rdnmr < 1) || (rdnmr > ReadWriteHRReadNmrMax) || (rdnmr > ReadHRReqNmrMax) ||
+		(wrnmr < 1) || (wrnmr > ReadWriteHRWriteNmrMax) || (bytecnt != (2 * wrnmr)) ||
+		(Dll.getrxlenPDU() != (ReadWriteMultipleHRReqLenMin + bytecnt)))
+	{ /*pocty registru nebo delka ramce neodpovidaji*/
+		return MB_Exc_IllegalDataValue;
+	}
+
+	uint16_t valid = Register::CheckRange(wradr, wrnmr, true);
+	if (valid < wrnmr)
+	{
+		return Register::IsReg(wradr + valid) ? MB_Exc_AccessLvlFailure : MB_Exc_IllegalDataAddress;
+	}
+
+	int16_t regs[RangeNmrMax];
+	for (uint16_t i = 0; i < wrnmr; i++)
+	{
+		regs[i] = Dll.readwPDU(ReadWriteMultipleHRReqLenMin + 2 * i);
+	}
+	if (!Register::CheckRangeVals(wradr, wrnmr, regs))
+	{ /*hodnota mimo meze, nic se nezapise*/
+		return MB_Exc_IllegalDataValue;
+	}
+
+	/*zapis probehne pred ctenim, jak pozaduje specifikace*/
+	if (Register::WriteRange(wradr, wrnmr, regs) != wrnmr)
+	{
+		return MB_Exc_IllegalDataValue;
+	}
+
+	Register::ReadRange(rdadr, rdnmr, regs);
+	Dll.settxlenPDU(0);
+	Dll.writebPDU(0, MbFun_ReadWriteMultipleRegs);
+	Dll.writebPDU(1, 2 * rdnmr);
+	for (uint16_t i = 0; i < rdnmr; i++)
+	{
+		Dll.writewPDU(regs[i]);
+	}
+	return MB_No_Exc;
+}
+
+//*****************************************************************************
+//! FC17, slave ID is main revision, additional data is hostname
+//*****************************************************************************
+ModbusExcCodes_t ModbusSlave::ReadSlaveID()
+{
+	if (Dll.getrxlenPDU() != ReadSlaveIDReqLen)
+	{
+		return MB_Exc_IllegalDataValue;
+	}
+
+	char name[ReadSlaveIDRspLen - 4 + 1];
+	size_t len = WiFihostname.Get(name);
+
+	Dll.settxlenPDU(0);
+	Dll.writebPDU(0, MbFun_ReadSlaveID);
+	Dll.writebPDU(1, 2 + len);
+	Dll.writebPDU(2, (uint8_t)MainRev.Get());
+	Dll.writebPDU(3, SlaveIDRunIndicator);
+	for (size_t i = 0; i < len; i++)
+	{
+		Dll.writebPDU(4 + i, name[i]);
+	}
+	return MB_No_Exc;
+}
+
+//*****************************************************************************
+//! FC70, same as FC3 but returns default values of parameter table
+//*****************************************************************************
+ModbusExcCodes_t ModbusSlave::ReadDefaultRegs()
+{
+	if (Dll.getrxlenPDU() != ReadDefaultHRReqLen)
+	{
+		return MB_Exc_IllegalDataValue;
+	}
+
+	uint16_t regadr = Dll.readwPDU(1);
+	uint16_t regnmr = Dll.readwPDU(3);
+	if ((regnmr < 1) || (regnmr > ReadHRReqNmrMax) || (regnmr > RangeNmrMax))
+	{
+		return MB_Exc_IllegalDataValue;
+	}
+
+	int16_t regs[RangeNmrMax];
+	Register::ReadDefaults(regadr, regnmr, regs);
+	Dll.settxlenPDU(0);
+	Dll.writebPDU(0, MbFun_ReadDefaultRegs);
+	Dll.writebPDU(1, 2 * regnmr);
+	for (uint16_t i = 0; i < regnmr; i++)
+	{
+		Dll.writewPDU(regs[i]);
+	}
+	return MB_No_Exc;
+}
+
+//*****************************************************************************
+//! FC71, restore default value of parameter occupying given register through
+//! its own default path, multi-register parameters are restored whole, events
+//! and computed values have no default
+//*****************************************************************************
+ModbusExcCodes_t ModbusSlave::WriteDefaultReg()
+{
+	if (Dll.getrxlenPDU() != WriteDefaultHRReqLen)
+	{
+		return MB_Exc_IllegalDataValue;
+	}
+
+	uint16_t regadr = Dll.readwPDU(1);
+	Register *pReg = Register::GetPar(regadr);
+	if (pReg == NULL)
+	{
+		return MB_Exc_IllegalDataAddress;
+	}
+	if (!pReg->IsWritable())
+	{
+		return MB_Exc_AccessLvlFailure;
+	}
+	if (pReg->IsComputed() || !pReg->SetDefault())
+	{
+		return MB_Exc_IllegalDataAddress;
+	}
+
+	/*odpoved nese obnovenou hodnotu pozadovaneho slova*/
+	int16_t val;
+	Register::ReadRange(regadr, 1, &val);
+	Dll.settxlenPDU(0);
+	Dll.writebPDU(0, MbFun_WriteDefaultReg);
+	Dll.writewPDU(1, regadr);
+	Dll.writewPDU(3, val);
+	return MB_No_Exc;
+}
+
+//*****************************************************************************
+//! FC72, identification of default parameter table (revision and layout hash),
+//! master uses it to check validity of cached defaults
+//*****************************************************************************
+ModbusExcCodes_t ModbusSlave::ReadDefaultID()
+{
+	if (Dll.getrxlenPDU() != ReadDefaultIDReqLen)
+	{
+		return MB_Exc_IllegalDataValue;
+	}
+
+	uint32_t hash = ParamSnapshot::TableHash();
+	Dll.settxlenPDU(0);
+	Dll.writebPDU(0, MbFun_ReadDefaultID);
+	Dll.writebPDU(1, ReadDefaultIDRspLen - 2);
+	Dll.writewPDU(MainRev.Get());
+	Dll.writewPDU(hash >> 16);
+	Dll.writewPDU(hash & 0xFFFF);
+	return MB_No_Exc;
+}
+
+bool ModbusSlave::IsRestartRequest(void)
+{
+	return (Dll.getrxlenPDU() >= DiagnosticReqLenMin) && (Dll.readbPDU(0) == MbFun_Diagnostics) &&
+		   (Dll.readwPDU(1) == MbDiag_RestartComm);
+}
+
+//*****************************************************************************
+//! FC8 Diagnostics, counters are kept by ModbusDiag of the interface
+//*****************************************************************************
+ModbusExcCodes_t ModbusSlave::Diagnostics()
+{
+	size_t len = Dll.getrxlenPDU();
+	if ((len < DiagnosticReqLenMin) || ((len & 1) == 0))
+	{ /*subfunkce + cele datove slovo*/
+		return MB_Exc_IllegalDataValue;
+	}
+
+	uint16_t sub = Dll.readwPDU(1);
+	uint16_t data = Dll.readwPDU(3);
+	if ((data != 0) && (sub != MbDiag_ReturnQueryData) && (sub != MbDiag_RestartComm))
+	{ /*ostatni subfunkce maji data 0x0000*/
+		return MB_Exc_IllegalDataValue;
+	}
+
+	/*odpoved je ve vetsine pripadu echo pozadavku*/
+	Dll.settxlenPDU(0);
+	Dll.writebPDU(0, MbFun_Diagnostics);
+	Dll.writewPDU(1, sub);
+	Dll.writewPDU(3, data);
+
+	switch (sub)
+	{
+	case MbDiag_ReturnQueryData:
+		for (size_t i = 5; i < len; i++)
+		{
+			Dll.writebPDU(i, Dll.readbPDU(i));
+		}
+		break;
+	case MbDiag_RestartComm:
+		if ((data != 0x0000) && (data != 0xFF00))
+		{
+			return MB_Exc_IllegalDataValue;
+		}
+		Dll.Diag.Clear();
+		Dll.Diag.SetListenOnly(false);
+		break;
+	case MbDiag_ReturnDiagReg:
+		Dll.writewPDU(3, Dll.Diag.GetDiagReg());
+		break;
+	case MbDiag_ForceListenOnly:
+		if (!Dll.SerialLine())
+		{ /*TCP spojeni by zustalo bez odpovedi, jen RTU*/
+			return MB_Exc_IllegalFunction;
+		}
+		Dll.Diag.SetListenOnly(true);
+		Silent = true; /*na tento pozadavek se jiz neodpovida*/
+		break;
+	case MbDiag_ClearCounters:
+		Dll.Diag.Clear();
+		break;
+	case MbDiag_ClearOverrun:
+		Dll.Diag.ClearOverrun();
+		break;
+	default:
+		if ((sub >= MbDiag_BusMsgCnt) && (sub <= MbDiag_OverrunCnt))
+		{
+			Dll.writewPDU(3, Dll.Diag.Get((mdbdiagcnt_t)(sub - MbDiag_BusMsgCnt)));
+			break;
+		}
+		return MB_Exc_IllegalFunction;
+	}
+
+	return MB_No_Exc;
+}
+
 void ModbusSlave::Init(void)
 {
 	Dll.initdll();
@@ -192,7 +453,22 @@ void ModbusSlave::Run(void)
 	switch (rcvstatus)
 	{
 	case PDUUnicast: /*Correct message for this slave has been received*/
+		Dll.Diag.Count(MdbDiag_SlaveMsg);
+		Silent = Dll.Diag.ListenOnly();
+		if (Silent && !IsRestartRequest())
+		{ /*v listen only rezimu se zpracuje jen restart komunikace*/
+			Dll.Diag.Count(MdbDiag_NoRsp);
+			Dll.receivePDU();
+			break;
+		}
+
 		exc = UnicastProc();
+		if (Silent)
+		{
+			Dll.Diag.Count(MdbDiag_NoRsp);
+			Dll.receivePDU();
+			break;
+		}
 		if (exc != MB_No_Exc)
 		{
 			ErrorProc(exc);
@@ -201,32 +477,35 @@ void ModbusSlave::Run(void)
 			Dll.writebPDU(1, exc);
 			Dll.settxlenPDU(2);
 
-			ExceptionError.Set(ExceptionError.Get() + 1);
+			Dll.Diag.Exception(exc);
+			ExcCnt.IncQuiet();
 		}
 		else
 		{
-			CorrectPackets.Set(CorrectPackets.Get() + 1);
+			OkCnt.IncQuiet();
 		}
 		/*start response transmitting*/
 		Dll.sendPDU();
 		break;
 
 	case PDUBroadcast: /*Correct message for all slaves has been received*/
+		Dll.Diag.Count(MdbDiag_SlaveMsg);
+		Dll.Diag.Count(MdbDiag_NoRsp);
 		exc = BroadcastProc();
 		if ((exc != MB_No_Exc))
 		{
 			ErrorProc(exc);
-			ExceptionError.Set(ExceptionError.Get() + 1);
+			ExcCnt.IncQuiet();
 		}
 		else
 		{
-			CorrectPackets.Set(CorrectPackets.Get() + 1);
+			OkCnt.IncQuiet();
 		}
 		Dll.receivePDU();
 		break;
 	case PDUInvalid: /*Corrupted message received*/
 		ErrorProc(MB_No_Exc);
-		ExceptionError.Set(ExceptionError.Get() + 1);
+		ExcCnt.IncQuiet();
 		break;
 	case PDUIdle: /*idle state*/
 		Dll.receivePDU();
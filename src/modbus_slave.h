@@ -14,6 +14,7 @@
 
 #pragma once
 #include "common.h"
+#include "modbus_diag.h"
 
 #define ReadHRReqLen (5)	 /*Function code+Regadr(2)+Regnmr(2)*/
 #define ReadHRRspLenMin (2U) /*Function code+byte#+.....*/
@@ -27,13 +28,24 @@
 #define WriteMultipleHRReqLenMin (6U) /*Function code+Regadr(2)+Regnmr(2)+ count bytes...*/
 #define WriteMultipleHRRspLen (5U)	  /*Function code+Regadr(2)+Regnmr(2)*/
 
-#define ReadWriteMultipleHRReqLenMin (10U)
-#define ReadWriteMultipleHRRspLenMin (2U)
+#define ReadWriteMultipleHRReqLenMin (10U) /*Function code+Readadr(2)+Readnmr(2)+Writeadr(2)+Writenmr(2)+byte#+...*/
+#define ReadWriteMultipleHRRspLenMin (2U)  /*Function code+byte#+.....*/
+#define ReadWriteHRReadNmrMax (0x7DU)	   /*Per Modbus specification*/
+#define ReadWriteHRWriteNmrMax (0x79U)	   /*Per Modbus specification*/
+
+#define ReadDefaultHRReqLen (5U)	/*Function code+Regadr(2)+Regnmr(2)*/
+#define WriteDefaultHRReqLen (3U)	/*Function code+Regadr(2)*/
+#define WriteDefaultHRRspLen (5U)	/*Function code+Regadr(2)+Regval(2)*/
+#define ReadDefaultIDReqLen (1U)
+#define ReadDefaultIDRspLen (8U)	/*Function code+byte#+revize(2)+hash tabulky(4)*/
+
+#define DiagnosticReqLenMin (5U) /*Function code+Subfunction(2)+Data(2)...*/
 
 typedef enum
 {
 	MbFun_ReadHoldingRegs = 3,
 	MbFun_WriteSingleReg = 6,
+	MbFun_Diagnostics = 8,
 	MbFun_WriteMultipleRegs = 16,
 	MbFun_ReadSlaveID = 17,
 	MbFun_ReadWriteMultipleRegs = 23,
@@ -49,10 +61,24 @@ typedef enum
 	MB_Exc_IllegalDataAddress = 2,
 	MB_Exc_IllegalDataValue = 3,
 	MB_Exc_SlaveDeviceFailure = 4,
+	MB_Exc_SlaveDeviceBusy = 6,
 	// Residoe specific codes
 	MB_Exc_AccessLvlFailure = 0x11 /*invalid access level for register*/
 } ModbusExcCodes_t;
 
+/*FC8 subfunkce*/
+typedef enum
+{
+	MbDiag_ReturnQueryData = 0x00,
+	MbDiag_RestartComm = 0x01,
+	MbDiag_ReturnDiagReg = 0x02,
+	MbDiag_ForceListenOnly = 0x04,
+	MbDiag_ClearCounters = 0x0A,
+	MbDiag_BusMsgCnt = 0x0B,	/*0x0B..0x12 vraci pocitadla MdbDiag_BusMsg..MdbDiag_Overrun*/
+	MbDiag_OverrunCnt = 0x12,
+	MbDiag_ClearOverrun = 0x14
+} MbDiagSubFun_t;
+
 typedef enum PduStatus_t
 {
 	PDUIdle,	  /*no PDU data available*/
@@ -68,8 +94,11 @@ class ModbusDll
 {
 protected:
 	volatile PduStatus_t State;
+	int64_t rxDoneUs; /*cas dokonceni prijmu pozadavku, pro mereni latence odpovedi*/
 
 public:
+	ModbusDiag &Diag;
+	ModbusDll(ModbusDiag &diag) : State(PDUIdle), rxDoneUs(0), Diag(diag) {}
 	virtual PduStatus_t getstatus(void) = 0;
 	virtual void setdeviceid(uint8_t adr) = 0;
 	virtual void initdll(void) = 0;
@@ -85,11 +114,17 @@ public:
 	virtual uint8_t readbPDU(size_t id) = 0;
 	virtual uint16_t readwPDU(size_t id) = 0;
 	virtual uint16_t readwPDU(void) = 0;
+	virtual bool SerialLine(void) { return false; } /*sdilena seriova linka, jen zde ma smysl listen only*/
 };
 
+class uint16_reg;
+
 class ModbusSlave
 {
 private:
+	uint16_reg &ExcCnt; /*pocitadlo chybovych odpovedi*/
+	uint16_reg &OkCnt;	/*pocitadlo spravnych ramcu*/
+
 protected:
 	ModbusExcCodes_t UnicastProc(void);
 	ModbusExcCodes_t BroadcastProc(void);
@@ -97,10 +132,19 @@ protected:
 	ModbusExcCodes_t WriteMultipleRegs();
 	ModbusExcCodes_t WriteSingleReg();
 	ModbusExcCodes_t ReadHoldingRegs();
+	ModbusExcCodes_t ReadWriteMultipleRegs();
+	ModbusExcCodes_t ReadSlaveID();
+	ModbusExcCodes_t ReadDefaultRegs();
+	ModbusExcCodes_t WriteDefaultReg();
+	ModbusExcCodes_t ReadDefaultID();
+	ModbusExcCodes_t Diagnostics();
+	bool IsRestartRequest(void);
+	bool Silent; /*pozadavek se zpracuje bez odpovedi (listen only)*/
 
 public:
 	ModbusDll &Dll;
-	ModbusSlave(ModbusDll &Infc) : Dll(Infc)
+	ModbusSlave(ModbusDll &Infc);
+	ModbusSlave(ModbusDll &Infc, uint16_reg &excCnt, uint16_reg &okCnt) : ExcCnt(excCnt), OkCnt(okCnt), Silent(false), Dll(Infc)
 	{
 	}
 	void Init(void);
@@ -0,0 +1,246 @@
+/***********************************************************************
+ * Filename: modbus_tcp.cpp
+ * Author: agent
+ * Date: 2026-10-17
+ * Description:
+ *     Implements the ModbusTcp class. AsyncTCP callbacks only copy data
+ *     and never wait for the Modbus engine, requests are passed through
+ *     a FreeRTOS queue so several clients (and several pipelined
+ *     transactions of one client) are served in order of arrival.
+ *
+ ***********************************************************************/
+
+#include "Arduino.h"
+#include "modbus_tcp.h"
+#include "parameters.h"
+
+#define MBAP_PROTOCOL_ID 0
+
+static inline uint16_t GetBE16(const uint8_t *p)
+{
+	return (uint16_t)p[0] << 8 | p[1];
+}
+
+static inline void PutBE16(uint8_t *p, uint16_t val)
+{
+	p[0] = (uint8_t)(val >> 8);
+	p[1] = (uint8_t)(val & 0xFF);
+}
+
+ModbusTcp::ModbusTcp(uint16_t port) : ModbusDll(ModbusDiag::Tcp), server(port), reqQueue(NULL), inIdx(0), outIdx(0), outLen(0)
+{
+	for (uint8_t i = 0; i < MODBUS_TCP_MAX_CLIENTS; i++)
+	{
+		conn[i].owner = this;
+		conn[i].client = NULL;
+		conn[i].gen = 0;
+		conn[i].rxLen = 0;
+	}
+	memset(&req, 0, sizeof(req));
+}
+
+void ModbusTcp::initdll(void)
+{
+	reqQueue = xQueueCreate(MODBUS_TCP_QUEUE_LEN, sizeof(mbtcpreq_t));
+	server.onClient(OnClient, this);
+	server.setNoDelay(true);
+	server.begin();
+
+	State = PDUIdle;
+}
+
+//*****************************************************************************
+//! New client, it gets free slot or it is refused
+//*****************************************************************************
+void ModbusTcp::OnClient(void *arg, AsyncClient *client)
+{
+	ModbusTcp *self = (ModbusTcp *)arg;
+	mbtcpconn_t *c = NULL;
+	{
+		std::lock_guard<std::mutex> lock(self->mutex);
+		for (uint8_t i = 0; i < MODBUS_TCP_MAX_CLIENTS; i++)
+		{
+			if (self->conn[i].client == NULL)
+			{
+				c = &self->conn[i];
+				c->client = client;
+				c->rxLen = 0;
+				break;
+			}
+		}
+	}
+
+	if (c == NULL)
+	{ /*neni volny slot*/
+		client->onDisconnect([](void *arg, AsyncClient *client)
+							 { delete client; });
+		client->close(true);
+		return;
+	}
+
+	client->setNoDelay(true);
+	client->setRxTimeout(MODBUS_TCP_IDLE_S);
+	client->onData(OnData, c);
+	client->onDisconnect(OnDisconnect, c);
+	TcpClients.Inc();
+}
+
+void ModbusTcp::OnDisconnect(void *arg, AsyncClient *client)
+{
+	mbtcpconn_t *c = (mbtcpconn_t *)arg;
+	{
+		std::lock_guard<std::mutex> lock(c->owner->mutex);
+		c->client = NULL;
+		c->gen++;
+		c->rxLen = 0;
+	}
+	TcpClients.Dec();
+	delete client;
+}
+
+//*****************************************************************************
+//! Data from client, TCP stream is split to ADUs, one segment may carry
+//! several requests and one request may come in several segments
+//*****************************************************************************
+void ModbusTcp::OnData(void *arg, AsyncClient *client, void *data, size_t len)
+{
+	mbtcpconn_t *c = (mbtcpconn_t *)arg;
+	ModbusTcp *self = c->owner;
+	const uint8_t *p = (const uint8_t *)data;
+	bool valid = true;
+
+	{
+		std::lock_guard<std::mutex> lock(self->mutex);
+		uint8_t slot = c - self->conn;
+		while ((len > 0) && valid)
+		{
+			size_t n = std::min(len, (size_t)(MODBUS_TCP_ADU_MAX - c->rxLen));
+			memcpy(c->rx + c->rxLen, p, n);
+			c->rxLen += n;
+			p += n;
+			len -= n;
+			valid = self->Parse(*c, slot);
+		}
+	}
+
+	if (!valid)
+	{ /*poruseny MBAP, spojeni se podle specifikace uzavre*/
+		self->Diag.Count(MdbDiag_BusCommErr);
+		TcpFrameError.Inc();
+		client->close();
+	}
+}
+
+//*****************************************************************************
+//! Queue all complete ADUs of rx buffer, returns false on invalid header
+//*****************************************************************************
+bool ModbusTcp::Parse(mbtcpconn_t &c, uint8_t slot)
+{
+	uint16_t pos = 0;
+	while ((c.rxLen - pos) >= MODBUS_TCP_MBAP_LEN)
+	{
+		const uint8_t *adu = c.rx + pos;
+		uint16_t len = GetBE16(adu + 4); /*unit + PDU*/
+		if ((GetBE16(adu + 2) != MBAP_PROTOCOL_ID) || (len < 2) || (len > (MODBUS_TCP_PDU_MAX + 1)))
+		{
+			c.rxLen = 0;
+			return false;
+		}
+		if ((c.rxLen - pos) < (MODBUS_TCP_MBAP_LEN - 1 + len))
+		{ /*zbytek ADU prijde v dalsim segmentu*/
+			break;
+		}
+
+		mbtcpreq_t r;
+		r.slot = slot;
+		r.gen = c.gen;
+		r.tid = GetBE16(adu);
+		r.unit = adu[6];
+		r.len = len - 1;
+		r.rxUs = esp_timer_get_time();
+		memcpy(r.pdu, adu + MODBUS_TCP_MBAP_LEN, r.len);
+		if (xQueueSend(reqQueue, &r, 0) != pdTRUE)
+		{
+			SendBusy(c, slot, r.tid, r.unit, r.pdu[0]);
+		}
+		pos += MODBUS_TCP_MBAP_LEN - 1 + len;
+	}
+
+	if (pos > 0)
+	{
+		memmove(c.rx, c.rx + pos, c.rxLen - pos);
+		c.rxLen -= pos;
+	}
+	return true;
+}
+
+//*****************************************************************************
+//! Queue is full, exception is sent directly from AsyncTCP task
+//*****************************************************************************
+void ModbusTcp::SendBusy(mbtcpconn_t &c, uint8_t slot, uint16_t tid, uint8_t unit, uint8_t fun)
+{
+	uint8_t adu[MODBUS_TCP_MBAP_LEN + 2];
+	PutBE16(adu, tid);
+	PutBE16(adu + 2, MBAP_PROTOCOL_ID);
+	PutBE16(adu + 4, 3);
+	adu[6] = unit;
+	adu[7] = fun | 0x80;
+	adu[8] = MB_Exc_SlaveDeviceBusy;
+	if (c.client->space() >= sizeof(adu))
+	{
+		c.client->add((const char *)adu, sizeof(adu));
+		c.client->send();
+	}
+	Diag.Count(MdbDiag_Busy);
+	TcpBusyError.Inc();
+}
+
+//*****************************************************************************
+//! Send ADU to client, dropped when client disconnected meanwhile
+//*****************************************************************************
+bool ModbusTcp::Send(uint8_t slot, uint32_t gen, size_t len)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	mbtcpconn_t &c = conn[slot];
+	if ((c.client == NULL) || (c.gen != gen) || (c.client->space() < len))
+	{
+		return false;
+	}
+	c.client->add((const char *)BufferOut, len);
+	return c.client->send();
+}
+
+void ModbusTcp::sendPDU(void)
+{
+	PutBE16(BufferOut, req.tid);
+	PutBE16(BufferOut + 2, MBAP_PROTOCOL_ID);
+	PutBE16(BufferOut + 4, outLen + 1);
+	BufferOut[6] = req.unit;
+	Diag.Latency(esp_timer_get_time() - rxDoneUs);
+	Send(req.slot, req.gen, MODBUS_TCP_MBAP_LEN + outLen);
+
+	State = PDUIdle;
+}
+
+void ModbusTcp::receivePDU(void)
+{
+	State = PDUReceive;
+}
+
+PduStatus_t ModbusTcp::getstatus(void)
+{
+	if (State != PDUReceive)
+	{
+		return State;
+	}
+	if (xQueueReceive(reqQueue, &req, pdMS_TO_TICKS(MODBUS_TCP_RX_WAIT_MS)) == pdTRUE)
+	{
+		Diag.Count(MdbDiag_BusMsg);
+		rxDoneUs = req.rxUs;
+		inIdx = 0;
+		outLen = 0;
+		outIdx = 0;
+		return PDUUnicast;
+	}
+	return PDUReceive;
+}
@@ -0,0 +1,116 @@
+/***********************************************************************
+ * Filename: modbus_tcp.h
+ * Author: agent
+ * Date: 2026-10-17
+ * Description:
+ *     Declares the ModbusTcp class, a ModbusDll implementation for
+ *     Modbus TCP (MBAP) on top of AsyncTCP. Requests of all connected
+ *     clients are reassembled in the AsyncTCP task and queued, the
+ *     ModbusSlave engine takes them from the queue in its own task and
+ *     the response is sent back with the transaction ID of the request.
+ *
+ ***********************************************************************/
+
+
+#pragma once
+#include <mutex>
+#include "common.h"
+#include "modbus_slave.h"
+#include "AsyncTCP.h"
+
+#define MODBUS_TCP_PORT 502
+#define MODBUS_TCP_MAX_CLIENTS 4
+#define MODBUS_TCP_QUEUE_LEN 8		   /*pocet rozpracovanych pozadavku vsech klientu*/
+#define MODBUS_TCP_RX_WAIT_MS 2000
+#define MODBUS_TCP_IDLE_S 120		   /*odpojeni neaktivniho klienta*/
+#define MODBUS_TCP_MBAP_LEN 7		   /*TID(2)+protokol(2)+delka(2)+unit*/
+#define MODBUS_TCP_PDU_MAX 253
+#define MODBUS_TCP_ADU_MAX (MODBUS_TCP_MBAP_LEN + MODBUS_TCP_PDU_MAX)
+
+class ModbusTcp;
+
+typedef struct
+{
+	ModbusTcp *owner;
+	AsyncClient *client; /*NULL = volny slot*/
+	uint32_t gen;		 /*zvysuje se pri kazdem odpojeni, odpoved starymu spojeni se zahodi*/
+	uint16_t rxLen;
+	uint8_t rx[MODBUS_TCP_ADU_MAX];
+} mbtcpconn_t;
+
+typedef struct
+{
+	uint8_t slot;
+	uint32_t gen;
+	uint16_t tid;
+	uint8_t unit;
+	uint8_t len;
+	int64_t rxUs; /*cas prijeti ADU*/
+	uint8_t pdu[MODBUS_TCP_PDU_MAX];
+} mbtcpreq_t;
+
+class ModbusTcp : public ModbusDll
+{
+protected:
+	AsyncServer server;
+	mbtcpconn_t conn[MODBUS_TCP_MAX_CLIENTS];
+	std::mutex mutex; /*chrani conn[], drzi se jen pri kopirovani dat*/
+	QueueHandle_t reqQueue;
+
+	mbtcpreq_t req; /*zpracovavany pozadavek*/
+	size_t inIdx;
+	uint8_t BufferOut[MODBUS_TCP_MBAP_LEN + MODBUS_TCP_PDU_MAX];
+	size_t outIdx;
+	size_t outLen;
+
+	bool Parse(mbtcpconn_t &c, uint8_t slot);
+	bool Send(uint8_t slot, uint32_t gen, size_t len);
+	void SendBusy(mbtcpconn_t &c, uint8_t slot, uint16_t tid, uint8_t unit, uint8_t fun);
+
+	static void OnClient(void *arg, AsyncClient *client);
+	static void OnData(void *arg, AsyncClient *client, void *data, size_t len);
+	static void OnDisconnect(void *arg, AsyncClient *client);
+
+public:
+	ModbusTcp(uint16_t port = MODBUS_TCP_PORT);
+	void initdll(void);
+	void sendPDU(void);
+	void receivePDU(void);
+	PduStatus_t getstatus(void);
+	void setdeviceid(uint8_t adr) {}
+	// Buffer interface, indexy jsou v ramci PDU
+	void settxlenPDU(size_t len) { outLen = len; outIdx = 0; }
+	size_t getrxlenPDU(void) { return req.len; }
+	size_t maxsizerxPDU(void) { return MODBUS_TCP_PDU_MAX; }
+	size_t maxsizetxPDU(void) { return MODBUS_TCP_PDU_MAX; }
+	void writebPDU(size_t id, uint8_t val)
+	{
+		BufferOut[MODBUS_TCP_MBAP_LEN + id] = val;
+		outIdx = id + 1;
+		outLen = std::max(outLen, outIdx);
+	}
+	void writewPDU(size_t id, uint16_t val)
+	{
+		BufferOut[MODBUS_TCP_MBAP_LEN + id] = (uint8_t)(val >> 8);
+		BufferOut[MODBUS_TCP_MBAP_LEN + id + 1] = (uint8_t)(val & 0xFF);
+		outIdx = id + 2;
+		outLen = std::max(outLen, outIdx);
+	}
+	void writewPDU(uint16_t val)
+	{
+		writewPDU(outIdx, val);
+	}
+	uint8_t readbPDU(size_t id)
+	{
+		return (id < req.len) ? req.pdu[id] : 0;
+	}
+	uint16_t readwPDU(size_t id)
+	{
+		return (uint16_t)readbPDU(id) << 8 | (uint16_t)readbPDU(id + 1);
+	}
+	uint16_t readwPDU(void)
+	{
+		inIdx += 2;
+		return readwPDU(inIdx - 2);
+	}
+};
@@ -14,19 +14,23 @@
 WiFiClient MQTT::espClient;
 PubSubClient MQTT::client(espClient);
 uint32_t MQTT::lastSend;
+uint32_t MQTT::lastVersion;
+std::atomic<bool> MQTT::changePending(false);
 
-String MQTT::buildTopic(const String &parName, uint16_t id)
+String MQTT::buildTopic(const char *parName, uint16_t id)
 {
-    String baseTopic = MQTTbase.Get();
+    char baseTopic[STRING_REG_MAX_LEN + 1];
+    size_t len = MQTTbase.Get(baseTopic);
     String topic;
+    topic.reserve(len + strlen(parName) + 24);
+    topic = baseTopic;
     if (id != UINT16_MAX)
     {
-        topic = baseTopic + "/devices/" + String(id) + "/state/" + parName;
-    }
-    else
-    {
-        topic = baseTopic + "/state/" + parName;
+        topic += "/devices/";
+        topic += id;
     }
+    topic += "/state/";
+    topic += parName;
     return topic;
 }
 
@@ -55,26 +59,60 @@ void MQTT::publishParameter(const String &name, uint16_t id, bool mtx_locked)
     {
         JsonDocument doc;
         doc["value"] = tmpDoc[name];
+        publishJson(buildTopic(name.c_str(), id), doc);
+    }
+}
 
-        size_t json_size = measureJson(doc);
-        if (json_size > 200)
-        {
+void MQTT::publishRegister(uint16_t idx)
+{
+    JsonDocument doc;
+    if (Register::JsonReadIdx(idx, doc["value"].to<JsonVariant>()))
+    {
+        publishJson(buildTopic(Register::ParDef[idx].ptxt), doc);
+    }
+}
 
-            client.beginPublish(buildTopic(name, id).c_str(), json_size, false);
-            BufferingPrint bufferedClient(client, 64);
-            serializeJson(doc, bufferedClient);
-            bufferedClient.flush();
-            client.endPublish();
-        }
-        else
+void MQTT::publishChanges(void)
+{
+    uint32_t since = lastVersion;
+    lastVersion = Register::GetVersion();
+    for (uint16_t i = 0; i < Register::NmrParameters; i++)
+    {
+        if ((Register::ParDef[i].dsc & Par_MQTT) && (Register::GetParByIdx(i)->GetSeq() > since))
         {
-            char buffer[250];
-            size_t n = serializeJson(doc, buffer);
-            client.publish(buildTopic(name, id).c_str(), buffer, n);
+            publishRegister(i);
         }
     }
 }
 
+void MQTT::onParChanged(Register &reg, void *arg)
+{
+    if (reg.def.dsc & Par_MQTT)
+    {
+        changePending = true;
+    }
+}
+
+void MQTT::publishJson(const String &topic, JsonDocument &doc)
+{
+    size_t json_size = measureJson(doc);
+    if (json_size > 200)
+    {
+
+        client.beginPublish(topic.c_str(), json_size, false);
+        BufferingPrint bufferedClient(client, 64);
+        serializeJson(doc, bufferedClient);
+        bufferedClient.flush();
+        client.endPublish();
+    }
+    else
+    {
+        char buffer[250];
+        size_t n = serializeJson(doc, buffer);
+        client.publish(topic.c_str(), buffer, n);
+    }
+}
+
 void MQTT::handleMessage(char *topic, uint8_t *payload, unsigned int length)
 {
     JsonDocument doc;
@@ -155,11 +193,13 @@ void MQTT::handleMessage(char *topic, uint8_t *payload, unsigned int length)
 
 void MQTT::subscribe(void)
 {
-    String baseTopic = MQTTbase.Get();
-    String mainDeviceSetTopic = baseTopic + "/set/+";
-    String subDeviceSetTopic = baseTopic + "/devices/+/set/+";
-    client.subscribe(mainDeviceSetTopic.c_str());
-    client.subscribe(subDeviceSetTopic.c_str());
+    char baseTopic[STRING_REG_MAX_LEN + 1];
+    char topic[STRING_REG_MAX_LEN + 24];
+    MQTTbase.Get(baseTopic);
+    snprintf(topic, sizeof(topic), "%s/set/+", baseTopic);
+    client.subscribe(topic);
+    snprintf(topic, sizeof(topic), "%s/devices/+/set/+", baseTopic);
+    client.subscribe(topic);
 }
 
 bool MQTT::checkConnection()
@@ -178,12 +218,15 @@ bool MQTT::checkConnection()
 
             Serial.print("Attempting MQTT connection...");
 
-            String base = MQTTbase.Get();
-            String name = MQTTJmeno.Get();
-            String pwd = MQTTHeslo.Get();
+            char base[STRING_REG_MAX_LEN + 1];
+            char name[STRING_REG_MAX_LEN + 1];
+            char pwd[STRING_REG_MAX_LEN + 1];
+            MQTTbase.Get(base);
+            size_t nameLen = MQTTJmeno.Get(name);
+            size_t pwdLen = MQTTHeslo.Get(pwd);
             client.setServer(BrokerAdresa.GetIP(), BrokerPort.Get());
 
-            if (client.connect(base.c_str(), name.isEmpty() ? NULL : name.c_str(), pwd.isEmpty() ? NULL : pwd.c_str()))
+            if (client.connect(base, nameLen == 0 ? NULL : name, pwdLen == 0 ? NULL : pwd))
             {
                 MQTTStatus.Set(mqtt_pripojeno);
                 res = true;
@@ -215,13 +258,18 @@ bool MQTT::checkConnection()
 
 void MQTT::Init(void)
 {
-    if (MQTTbase.Get().isEmpty())
+    if (MQTTbase.IsEmpty())
     {
         MQTTbase.Set("Dvirka");
     }
     MQTTStatus.Set(mqtt_vypnuto);
     client.setCallback(handleMessage);
     lastSend = 0;
+    lastVersion = 0;
+    if (!Register::SubscribeAll(onParChanged))
+    { /*zmeny se odeslou az s periodickym odeslanim*/
+        SystemLog::PutLog("MQTT: odber zmen parametru selhal", v_error);
+    }
 }
 
 void MQTT::Task(void)
@@ -232,13 +280,14 @@ void MQTT::Task(void)
         if ((lastSend == 0) || ((millis() - lastSend) > (MQTTInterval_S.Get() * 1000)))
         {
             lastSend = millis();
+            changePending = false;
+            lastVersion = Register::GetVersion();
 
-            for (int i = 0; i < Register::NmrParameters; i++)
+            for (uint16_t i = 0; i < Register::NmrParameters; i++)
             {
-                Register *reg = Register::GetParByIdx(i);
-                if (reg && (reg->def.dsc & Par_MQTT))
+                if (Register::ParDef[i].dsc & Par_MQTT)
                 {
-                    publishParameter(String(reg->def.ptxt));
+                    publishRegister(i);
                 }
             }
             {
@@ -259,5 +308,9 @@ void MQTT::Task(void)
                 }
             }
         }
+        else if (changePending.exchange(false))
+        { /*zmenene parametry se publikuji hned, ne az v dalsim intervalu*/
+            publishChanges();
+        }
     }
 }
\ No newline at end of file
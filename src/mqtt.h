@@ -29,11 +29,21 @@ private:
     static WiFiClient espClient;
     static PubSubClient client;
     static uint32_t lastSend;
+    static uint32_t lastVersion;
+    static std::atomic<bool> changePending;
 
-    static String buildTopic(const String &parName, uint16_t id = UINT16_MAX);
+    static String buildTopic(const char *parName, uint16_t id = UINT16_MAX);
 
     static void publishParameter(const String &name, uint16_t id = UINT16_MAX, bool mtx_locked = false);
 
+    static void publishRegister(uint16_t idx);
+
+    static void publishJson(const String &topic, JsonDocument &doc);
+
+    static void publishChanges(void);
+
+    static void onParChanged(Register &reg, void *arg);
+
     static void handleMessage(char *topic, uint8_t *payload, unsigned int length);
 
     static void subscribe(void);
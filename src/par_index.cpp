@@ -0,0 +1,75 @@
+/***********************************************************************
+ * Filename: par_index.cpp
+ * Author: agent
+ * Date: 2026-10-17
+ * Description:
+ *     Implements the ParIndex class. Tables are filled by Register
+ *     at startup and only sorted and searched here.
+ *
+ ***********************************************************************/
+
+
+#include <algorithm>
+#include <string.h>
+#include "par_index.h"
+
+void ParIndex::SortSpans(regspan_t *map, uint16_t cnt)
+{
+	std::sort(map, map + cnt, [](const regspan_t &a, const regspan_t &b)
+			  { return a.first < b.first; });
+}
+
+//*****************************************************************************
+//! Index of first span ending at or above requested address (cnt if none)
+//*****************************************************************************
+uint16_t ParIndex::FindSpan(const regspan_t *map, uint16_t cnt, uint16_t adr)
+{
+	uint16_t lo = 0;
+	uint16_t hi = cnt;
+	while (lo < hi)
+	{
+		uint16_t mid = (lo + hi) / 2;
+		if (map[mid].last < adr)
+		{
+			lo = mid + 1;
+		}
+		else
+		{
+			hi = mid;
+		}
+	}
+	return lo;
+}
+
+void ParIndex::SortNames(uint16_t *map, uint16_t cnt, parname_t name)
+{
+	std::sort(map, map + cnt, [name](uint16_t a, uint16_t b)
+			  { return strcmp(name(a), name(b)) < 0; });
+}
+
+//*****************************************************************************
+//! Table index of parameter named key, PAR_INDEX_NONE if there is none
+//*****************************************************************************
+uint16_t ParIndex::FindName(const uint16_t *map, uint16_t cnt, parname_t name, const char *key)
+{
+	uint16_t lo = 0;
+	uint16_t hi = cnt;
+	while (lo < hi)
+	{
+		uint16_t mid = (lo + hi) / 2;
+		int cmp = strcmp(key, name(map[mid]));
+		if (cmp == 0)
+		{
+			return map[mid];
+		}
+		else if (cmp < 0)
+		{
+			hi = mid;
+		}
+		else
+		{
+			lo = mid + 1;
+		}
+	}
+	return PAR_INDEX_NONE;
+}
@@ -0,0 +1,41 @@
+/***********************************************************************
+ * Filename: par_index.h
+ * Author: agent
+ * Date: 2026-10-17
+ * Description:
+ *     Declares the ParIndex class, lookup tables of the parameter
+ *     table: register address spans sorted by address for binary
+ *     search of the parameter occupying a register and parameter
+ *     indexes sorted by name for search by name. It uses only the
+ *     C++ standard library, so it builds natively as well as on
+ *     target.
+ *
+ ***********************************************************************/
+
+
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+//*****************************************************************************
+//! register address span of one parameter, used for address lookups
+//*****************************************************************************
+typedef struct
+{
+	uint16_t first; /*first register address*/
+	uint16_t last;	/*last register address occupied by parameter*/
+	uint16_t idx;	/*index into ParDef[] and ParSet[]*/
+} regspan_t;
+
+#define PAR_INDEX_NONE 0xFFFF
+
+typedef const char *(*parname_t)(uint16_t idx); /*jmeno parametru podle indexu v tabulce*/
+
+class ParIndex
+{
+public:
+	static void SortSpans(regspan_t *map, uint16_t cnt);
+	static uint16_t FindSpan(const regspan_t *map, uint16_t cnt, uint16_t adr);
+	static void SortNames(uint16_t *map, uint16_t cnt, parname_t name);
+	static uint16_t FindName(const uint16_t *map, uint16_t cnt, parname_t name, const char *key);
+};
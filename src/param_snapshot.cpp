@@ -0,0 +1,331 @@
+/***********************************************************************
+ * Filename: param_snapshot.cpp
+ * Author: agent
+ * Date: 2026-10-17
+ * Description:
+ *     Implements the ParamSnapshot class. Snapshot for export is built
+ *     once into PSRAM and streamed from that copy, received snapshot is
+ *     buffered in PSRAM and applied to NV parameters in one burst, so
+ *     that NV writes are merged into a single commit. Snapshot of a
+ *     different parameter table (tableHash) is not imported.
+ *
+ ***********************************************************************/
+
+
+#include "param_snapshot.h"
+#include "log.h"
+
+uint8_t *ParamSnapshot::rxBuf = NULL;
+size_t ParamSnapshot::rxSize = 0;
+size_t ParamSnapshot::rxLen = 0;
+std::mutex ParamSnapshot::mutex;
+
+bool ParamSnapshot::IsExported(uint16_t idx)
+{
+    Register *reg = Register::GetParByIdx(idx);
+    return (reg != NULL) && reg->IsReadable() && (reg->def.adr != INVALID_REGADR) && (reg->GetSize() <= SNAPSHOT_ENTRY_MAX_WORDS);
+}
+
+size_t ParamSnapshot::EntrySize(uint16_t idx)
+{
+    return sizeof(SnapshotEntry_t) + 2 * Register::GetParByIdx(idx)->GetSize();
+}
+
+size_t ParamSnapshot::EncodeEntry(uint16_t idx, uint8_t *buf)
+{
+    Register *reg = Register::GetParByIdx(idx);
+    SnapshotEntry_t entry;
+    int16_t words[SNAPSHOT_ENTRY_MAX_WORDS];
+
+    entry.adr = reg->def.adr;
+    entry.type = (reg->def.dsc >> 8) & 0xFF;
+    entry.nmr = reg->GetSize();
+    Register::ReadRange(entry.adr, entry.nmr, words);
+
+    memcpy(buf, &entry, sizeof(entry));
+    memcpy(buf + sizeof(entry), words, 2 * entry.nmr);
+    return sizeof(entry) + 2 * entry.nmr;
+}
+
+//*****************************************************************************
+//! FNV-1a hash of parameter table layout (address, type, size and name)
+//*****************************************************************************
+uint32_t ParamSnapshot::TableHash(void)
+{
+    uint32_t hash = 2166136261UL;
+    auto add = [&hash](const void *data, size_t len)
+    {
+        const uint8_t *p = (const uint8_t *)data;
+        for (size_t i = 0; i < len; i++)
+        {
+            hash = (hash ^ p[i]) * 16777619UL;
+        }
+    };
+
+    for (uint16_t i = 0; i < Register::NmrParameters; i++)
+    {
+        const pardef_t &pd = Register::ParDef[i];
+        uint8_t type = (pd.dsc >> 8) & 0xFF;
+        uint16_t size = Register::GetParByIdx(i)->GetSize();
+        add(&pd.adr, sizeof(pd.adr));
+        add(&type, sizeof(type));
+        add(&size, sizeof(size));
+        add(pd.ptxt, strlen(pd.ptxt));
+    }
+    return hash;
+}
+
+size_t ParamSnapshot::Size(void)
+{
+    size_t size = sizeof(SnapshotHeader_t);
+    for (uint16_t i = 0; i < Register::NmrParameters; i++)
+    {
+        if (IsExported(i))
+        {
+            size += EntrySize(i);
+        }
+    }
+    return size;
+}
+
+//*****************************************************************************
+//! Encode current snapshot into buf at once, values of all entries are taken
+//! in one pass. Returns length of snapshot, 0 when buf is too small.
+//*****************************************************************************
+size_t ParamSnapshot::Build(uint8_t *buf, size_t maxLen)
+{
+    SnapshotHeader_t hdr;
+    if (maxLen < sizeof(hdr))
+    {
+        return 0;
+    }
+    hdr.magic = SNAPSHOT_MAGIC;
+    hdr.version = SNAPSHOT_VERSION;
+    hdr.count = 0;
+    hdr.tableHash = TableHash();
+    hdr.length = 0;
+
+    size_t pos = sizeof(hdr);
+    for (uint16_t i = 0; i < Register::NmrParameters; i++)
+    {
+        if (IsExported(i))
+        {
+            if (pos + EntrySize(i) > maxLen)
+            {
+                return 0;
+            }
+            pos += EncodeEntry(i, buf + pos);
+            hdr.count++;
+        }
+    }
+    hdr.length = pos - sizeof(hdr);
+    memcpy(buf, &hdr, sizeof(hdr));
+    return pos;
+}
+
+//*****************************************************************************
+//! Validate header and entry framing of snapshot
+//*****************************************************************************
+bool ParamSnapshot::Check(const uint8_t *data, size_t len)
+{
+    SnapshotHeader_t hdr;
+    if ((data == NULL) || (len < sizeof(hdr)))
+    {
+        return false;
+    }
+    memcpy(&hdr, data, sizeof(hdr));
+    if ((hdr.magic != SNAPSHOT_MAGIC) || (hdr.version != SNAPSHOT_VERSION) || (hdr.length != (len - sizeof(hdr))))
+    {
+        return false;
+    }
+
+    size_t pos = sizeof(hdr);
+    uint16_t count = 0;
+    while (pos + sizeof(SnapshotEntry_t) <= len)
+    {
+        SnapshotEntry_t entry;
+        memcpy(&entry, data + pos, sizeof(entry));
+        pos += sizeof(entry) + 2 * entry.nmr;
+        count++;
+    }
+    return (pos == len) && (count == hdr.count);
+}
+
+const SnapshotEntry_t *ParamSnapshot::FindEntry(const uint8_t *data, size_t len, uint16_t adr)
+{
+    size_t pos = sizeof(SnapshotHeader_t);
+    while (pos + sizeof(SnapshotEntry_t) <= len)
+    {
+        const SnapshotEntry_t *entry = (const SnapshotEntry_t *)(data + pos);
+        if (entry->adr == adr)
+        {
+            return entry;
+        }
+        pos += sizeof(SnapshotEntry_t) + 2 * entry->nmr;
+    }
+    return NULL;
+}
+
+//*****************************************************************************
+//! Compare two valid snapshots, cb is called for address of every parameter
+//! which differs or exists only in one of them, returns count of differences
+//*****************************************************************************
+size_t ParamSnapshot::Diff(const uint8_t *a, size_t alen, const uint8_t *b, size_t blen, SnapshotDiffCb_t cb, void *arg)
+{
+    size_t cnt = 0;
+    size_t pos = sizeof(SnapshotHeader_t);
+    while (pos + sizeof(SnapshotEntry_t) <= alen)
+    {
+        const SnapshotEntry_t *ea = (const SnapshotEntry_t *)(a + pos);
+        const SnapshotEntry_t *eb = FindEntry(b, blen, ea->adr);
+        size_t len = sizeof(SnapshotEntry_t) + 2 * ea->nmr;
+        if ((eb == NULL) || (memcmp(ea, eb, len) != 0))
+        {
+            cnt++;
+            if (cb)
+            {
+                cb(ea->adr, arg);
+            }
+        }
+        pos += len;
+    }
+
+    pos = sizeof(SnapshotHeader_t);
+    while (pos + sizeof(SnapshotEntry_t) <= blen)
+    {
+        const SnapshotEntry_t *eb = (const SnapshotEntry_t *)(b + pos);
+        if (FindEntry(a, alen, eb->adr) == NULL)
+        {
+            cnt++;
+            if (cb)
+            {
+                cb(eb->adr, arg);
+            }
+        }
+        pos += sizeof(SnapshotEntry_t) + 2 * eb->nmr;
+    }
+    return cnt;
+}
+
+bool ParamSnapshot::ReceiveBegin(size_t len)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (rxBuf != NULL)
+    { /*previous transfer was not finished*/
+        free(rxBuf);
+        rxBuf = NULL;
+    }
+    if ((len < sizeof(SnapshotHeader_t)) || (len > SNAPSHOT_MAX_SIZE))
+    {
+        return false;
+    }
+    rxBuf = (uint8_t *)ps_malloc(len);
+    rxSize = len;
+    rxLen = 0;
+    return rxBuf != NULL;
+}
+
+bool ParamSnapshot::ReceiveWrite(size_t index, const uint8_t *data, size_t len)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if ((rxBuf == NULL) || (index != rxLen) || (index + len > rxSize))
+    {
+        return false;
+    }
+    memcpy(rxBuf + index, data, len);
+    rxLen += len;
+    return true;
+}
+
+bool ParamSnapshot::SameTable(const uint8_t *data)
+{
+    SnapshotHeader_t hdr;
+    memcpy(&hdr, data, sizeof(hdr));
+    return hdr.tableHash == TableHash();
+}
+
+//*****************************************************************************
+//! Apply received snapshot to writable NV parameters, returns count of
+//! applied parameters, SNAPSHOT_INVALID or SNAPSHOT_OTHER_TABLE (snapshot of
+//! different parameter table is not applied)
+//*****************************************************************************
+int ParamSnapshot::Import(void)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!Check(rxBuf, rxLen))
+    {
+        return SNAPSHOT_INVALID;
+    }
+    if (!SameTable(rxBuf))
+    {
+        return SNAPSHOT_OTHER_TABLE;
+    }
+
+    int applied = 0;
+    size_t pos = sizeof(SnapshotHeader_t);
+    while (pos < rxLen)
+    {
+        SnapshotEntry_t entry;
+        int16_t words[SNAPSHOT_ENTRY_MAX_WORDS];
+        memcpy(&entry, rxBuf + pos, sizeof(entry));
+        memcpy(words, rxBuf + pos + sizeof(entry), 2 * entry.nmr);
+        pos += sizeof(entry) + 2 * entry.nmr;
+
+        /*entry is applied only to parameter of same address, type and size*/
+        Register *reg = Register::GetPar(entry.adr);
+        if ((reg == NULL) || (reg->def.adr != entry.adr) || (((reg->def.dsc >> 8) & 0xFF) != entry.type) ||
+            (reg->GetSize() != entry.nmr) || !reg->isNV() || !reg->IsWritable())
+        {
+            continue;
+        }
+        if (Register::WriteRange(entry.adr, entry.nmr, words) == entry.nmr)
+        {
+            applied++;
+        }
+    }
+    return applied;
+}
+
+void ParamSnapshot::AddDiffName(uint16_t adr, void *arg)
+{
+    Register *reg = Register::GetPar(adr);
+    if (reg != NULL)
+    {
+        ((JsonArray *)arg)->add(reg->def.ptxt);
+    }
+}
+
+//*****************************************************************************
+//! Compare received snapshot with current values, names of differing
+//! parameters are added into arr, sameTable reports whether the snapshot
+//! comes from the same parameter table. Returns count or SNAPSHOT_INVALID.
+//*****************************************************************************
+int ParamSnapshot::DiffReceived(JsonArray arr, bool &sameTable)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!Check(rxBuf, rxLen))
+    {
+        return SNAPSHOT_INVALID;
+    }
+    sameTable = SameTable(rxBuf);
+
+    size_t size = Size();
+    uint8_t *current = (uint8_t *)ps_malloc(size);
+    if (current == NULL)
+    {
+        return SNAPSHOT_INVALID;
+    }
+    size = Build(current, size);
+    int cnt = Diff(rxBuf, rxLen, current, size, AddDiffName, &arr);
+    free(current);
+    return cnt;
+}
+
+void ParamSnapshot::ReceiveEnd(void)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    free(rxBuf);
+    rxBuf = NULL;
+    rxSize = 0;
+    rxLen = 0;
+}
@@ -0,0 +1,78 @@
+/***********************************************************************
+ * Filename: param_snapshot.h
+ * Author: agent
+ * Date: 2026-10-17
+ * Description:
+ *     Declares the ParamSnapshot class, which exports all parameters
+ *     into a compact binary snapshot, imports snapshots back into
+ *     NV parameters and compares two snapshots.
+ *
+ *     Snapshot layout (little endian):
+ *       SnapshotHeader_t
+ *       SnapshotEntry_t + nmr * int16_t register words, repeated
+ *
+ ***********************************************************************/
+
+
+#pragma once
+
+#include <mutex>
+#include "Arduino.h"
+#include "ArduinoJson.h"
+#include "parameters.h"
+
+#define SNAPSHOT_MAGIC 0x504E5350UL /*"PSNP"*/
+#define SNAPSHOT_VERSION 1
+#define SNAPSHOT_MAX_SIZE (16 * 1024)
+#define SNAPSHOT_ENTRY_MAX_WORDS 255
+
+/*navratove kody Import/DiffReceived*/
+#define SNAPSHOT_INVALID (-1)
+#define SNAPSHOT_OTHER_TABLE (-2)
+
+typedef struct
+{
+    uint32_t magic;
+    uint16_t version;
+    uint16_t count;     /*number of entries*/
+    uint32_t tableHash; /*hash of parameter table layout*/
+    uint32_t length;    /*length of entries in bytes*/
+} __attribute__((packed)) SnapshotHeader_t;
+
+typedef struct
+{
+    uint16_t adr; /*register address of parameter*/
+    uint8_t type; /*parameter type, (dsc >> 8) of pardef_t*/
+    uint8_t nmr;  /*number of register words following*/
+} __attribute__((packed)) SnapshotEntry_t;
+
+typedef void (*SnapshotDiffCb_t)(uint16_t adr, void *arg);
+
+class ParamSnapshot
+{
+private:
+    static uint8_t *rxBuf;
+    static size_t rxSize;
+    static size_t rxLen;
+    static std::mutex mutex;
+
+    static bool IsExported(uint16_t idx);
+    static size_t EntrySize(uint16_t idx);
+    static size_t EncodeEntry(uint16_t idx, uint8_t *buf);
+    static const SnapshotEntry_t *FindEntry(const uint8_t *data, size_t len, uint16_t adr);
+    static void AddDiffName(uint16_t adr, void *arg);
+    static bool SameTable(const uint8_t *data);
+
+public:
+    static uint32_t TableHash(void);
+    static size_t Size(void);
+    static size_t Build(uint8_t *buf, size_t maxLen);
+    static bool Check(const uint8_t *data, size_t len);
+    static size_t Diff(const uint8_t *a, size_t alen, const uint8_t *b, size_t blen, SnapshotDiffCb_t cb, void *arg);
+
+    static bool ReceiveBegin(size_t len);
+    static bool ReceiveWrite(size_t index, const uint8_t *data, size_t len);
+    static int Import(void);
+    static int DiffReceived(JsonArray arr, bool &sameTable);
+    static void ReceiveEnd(void);
+};
@@ -17,6 +17,7 @@
 #define COMM_PERIOD_FLAG 0x02
 #define CHART_FLAG 0x04
 #define FW_VERSION_FLAG 0x08
+#define BATCH_WRITE_FLAG 0x10 /*zarizeni prijima MSG_WRITE_PARAMS_REQUEST*/
 
 #define ERR_HISTORY_CNT 16
 
@@ -13,6 +13,8 @@
 #include "common.h"
 #include "parameters.h"
 #include "Preferences.h"
+#include "esp_system.h"
+#include <algorithm>
 
 #define PAR_DEF_INCLUDES
 #include "parameters_table.h"
@@ -136,37 +138,261 @@ Register *const Register::ParSet[] =
 #include "parameters_table.h"
 };
 
-size_t Register::ActiveIdx = nmr_parameters;
 uint8_t Register::ActiveLevel = Par_Public;
-uint16_t Register::ActiveRegAdr = INVALID_REGADR;
-String Register::writeString;
 const uint16_t Register::NmrParameters = nmr_parameters;
 
-Register *Register::GetPar(uint16_t Radr)
+regspan_t Register::AdrMap[nmr_parameters];
+uint16_t Register::AdrMapCnt = 0;
+
+//*****************************************************************************
+//! Build table of register spans sorted by address for binary search in GetPar
+//*****************************************************************************
+void Register::BuildAdrMap(void)
+{
+	for (uint16_t i = 0; i < nmr_parameters; i++)
+	{
+		AdrMap[i].first = ParDef[i].adr;
+		AdrMap[i].last = ParDef[i].adr + ParSet[i]->GetSize() - 1;
+		AdrMap[i].idx = i;
+	}
+	ParIndex::SortSpans(AdrMap, nmr_parameters);
+	AdrMapCnt = nmr_parameters;
+}
+
+const char *Register::ParName(uint16_t idx)
+{
+	return ParDef[idx].ptxt;
+}
+
+uint16_t Register::NameMap[nmr_parameters];
+uint16_t Register::NameMapCnt = 0;
+
+//*****************************************************************************
+//! Build table of parameter indexes sorted by name for binary search in ParameterSearch
+//*****************************************************************************
+void Register::BuildNameMap(void)
 {
+	for (uint16_t i = 0; i < nmr_parameters; i++)
+	{
+		NameMap[i] = i;
+	}
+	ParIndex::SortNames(NameMap, nmr_parameters, ParName);
+	NameMapCnt = nmr_parameters;
+}
+
+#define NV_DIRTY_WORDS ((nmr_parameters + 31) / 32)
 
+char Register::NvKeys[nmr_parameters][6];
+std::atomic<uint32_t> Register::NvDirty[NV_DIRTY_WORDS];
+std::atomic<uint32_t> Register::NvDirtyTime(0);
+std::mutex Register::NvMutex;
+
+//*****************************************************************************
+//! Precompute NVS keys (register address as text) of all parameters
+//*****************************************************************************
+void Register::BuildNvKeys(void)
+{
 	for (uint16_t i = 0; i < nmr_parameters; i++)
 	{
-		if (ActiveIdx >= nmr_parameters)
+		snprintf(NvKeys[i], sizeof(NvKeys[i]), "%u", ParDef[i].adr);
+	}
+}
+
+const char *Register::NvKey(void) const
+{
+	return NvKeys[&def - ParDef];
+}
+
+//*****************************************************************************
+//! Mark parameter for write-behind to NVS, first change arms the flush deadline
+//*****************************************************************************
+void Register::SetNvDirty(void)
+{
+	size_t idx = &def - ParDef;
+	NvDirty[idx / 32] |= (1UL << (idx % 32));
+
+	uint32_t none = 0;
+	NvDirtyTime.compare_exchange_strong(none, millis() | 1);
+}
+
+//*****************************************************************************
+//! Write all dirty parameters to NVS with a single commit
+//*****************************************************************************
+void Register::NvFlush(void)
+{
+	std::lock_guard<std::mutex> lock(NvMutex);
+	nvs_handle_t nvh;
+	if (nvs_open(NV_NAMESPACE, NVS_READWRITE, &nvh) != ESP_OK)
+	{
+		return;
+	}
+
+	bool written = false;
+	for (size_t w = 0; w < NV_DIRTY_WORDS; w++)
+	{
+		uint32_t bits = NvDirty[w].exchange(0);
+		while (bits)
 		{
-			ActiveIdx = 0;
+			size_t idx = w * 32 + __builtin_ctz(bits);
+			bits &= bits - 1;
+			ParSet[idx]->StoreNv(nvh);
+			written = true;
 		}
-		uint16_t hr = ParDef[ActiveIdx].adr;
-		if (hr == Radr)
+	}
+
+	if (written)
+	{
+		nvs_commit(nvh);
+		NvCommits.Inc();
+	}
+	nvs_close(nvh);
+}
+
+void Register::NvTask(void)
+{
+	uint32_t t = NvDirtyTime;
+	if ((t != 0) && ((millis() - t) >= NV_WRITE_DELAY_MS))
+	{
+		NvDirtyTime = 0;
+		NvFlush();
+	}
+}
+
+/*journal entry: sequence number (24 bits) and parameter index (8 bits)*/
+#define CHANGE_JOURNAL_LEN 64
+#define CHANGE_ENTRY(_seq_, _idx_) (((uint32_t)(_seq_) << 8) | (uint8_t)(_idx_))
+#define CHANGE_ENTRY_SEQ(_entry_) ((_entry_) >> 8)
+#define CHANGE_ENTRY_IDX(_entry_) ((_entry_) & 0xFF)
+#define CHANGE_SEQ_MASK 0xFFFFFFUL
+static_assert(nmr_parameters <= 0x100, "parameter index does not fit into change journal entry");
+
+std::atomic<uint32_t> Register::ChangeSeq(0);
+std::atomic<uint32_t> Register::DevChangeSeq(0);
+std::atomic<uint32_t> Register::ChangeJournal[CHANGE_JOURNAL_LEN];
+
+bool Register::IsTablePar(void) const
+{
+	return (&def >= ParDef) && (&def < (ParDef + nmr_parameters));
+}
+
+//*****************************************************************************
+//! Record effective change of value into change journal
+//*****************************************************************************
+void Register::Changed(void)
+{
+	if (IsTablePar())
+	{
+		uint32_t s = ++ChangeSeq;
+		seq = s;
+		ChangeJournal[s % CHANGE_JOURNAL_LEN] = CHANGE_ENTRY(s, &def - ParDef);
+	}
+	else
+	{ /*registry prislusenstvi nejsou v zurnalu, poradi ChangeSeq by v nem nechalo mezeru*/
+		seq = ++DevChangeSeq;
+	}
+	Notify();
+}
+
+#define PAR_SUBS_MAX 16
+
+parsub_t Register::Subs[PAR_SUBS_MAX];
+std::atomic<uint8_t> Register::SubsCnt(0);
+std::mutex Register::SubsMutex;
+
+//*****************************************************************************
+//! Register observer of one parameter (reg) or of all parameters (reg == NULL)
+//*****************************************************************************
+bool Register::AddSub(Register *reg, ParObserver_t cb, void *arg)
+{
+	std::lock_guard<std::mutex> lock(SubsMutex);
+	uint8_t cnt = SubsCnt.load(std::memory_order_relaxed);
+	if ((cb == NULL) || (cnt >= PAR_SUBS_MAX))
+	{
+		return false;
+	}
+	Subs[cnt].reg = reg;
+	Subs[cnt].cb = cb;
+	Subs[cnt].arg = arg;
+	/*zaznam je viditelny az po uplnem vyplneni*/
+	SubsCnt.store(cnt + 1, std::memory_order_release);
+	return true;
+}
+
+//*****************************************************************************
+//! Call observers of this parameter, must be called without holding value lock
+//*****************************************************************************
+void Register::Notify(void)
+{
+	uint8_t cnt = SubsCnt.load(std::memory_order_acquire);
+	for (uint8_t i = 0; i < cnt; i++)
+	{
+		if ((Subs[i].reg == this) || (Subs[i].reg == NULL))
 		{
-			ActiveRegAdr = Radr;
-			return ParSet[ActiveIdx];
+			Subs[i].cb(*this, Subs[i].arg);
 		}
+	}
+}
+
+void Register::NotifyTask(Register &reg, void *arg)
+{
+	xTaskNotifyGive((TaskHandle_t)arg);
+}
+
+//*****************************************************************************
+//! Get indexes of parameters changed after version 'since'
+//! returns false when journal no longer holds all changes (full read needed)
+//*****************************************************************************
+bool Register::GetChanges(uint32_t since, uint32_t &version, uint16_t *idx, size_t &cnt)
+{
+	uint32_t current = ChangeSeq;
+	uint32_t listed[(nmr_parameters + 31) / 32] = {0};
+	cnt = 0;
+	version = current;
 
-		if ((Radr > hr) && (Radr < (hr + ParSet[ActiveIdx]->GetSize())))
+	if ((current - since) > CHANGE_JOURNAL_LEN)
+	{
+		return false;
+	}
+
+	for (uint32_t s = since + 1; (s - since) <= (current - since); s++)
+	{
+		uint32_t entry = ChangeJournal[s % CHANGE_JOURNAL_LEN];
+		if (CHANGE_ENTRY_SEQ(entry) != (s & CHANGE_SEQ_MASK))
 		{
-			ActiveRegAdr = Radr;
-			return ParSet[ActiveIdx];
+			if ((ChangeSeq - s) >= CHANGE_JOURNAL_LEN)
+			{
+				/*entry already overwritten*/
+				return false;
+			}
+			/*entry not yet written, report changes up to previous one*/
+			version = s - 1;
+			break;
 		}
-		ActiveIdx++;
+		uint16_t i = CHANGE_ENTRY_IDX(entry);
+		if (!(listed[i / 32] & (1UL << (i % 32))))
+		{
+			listed[i / 32] |= (1UL << (i % 32));
+			idx[cnt++] = i;
+		}
+	}
+	return true;
+}
+
+//*****************************************************************************
+//! Index of first span ending at or above requested address (AdrMapCnt if none)
+//*****************************************************************************
+uint16_t Register::FindSpan(uint16_t adr)
+{
+	return ParIndex::FindSpan(AdrMap, AdrMapCnt, adr);
+}
+
+Register *Register::GetPar(uint16_t Radr)
+{
+	uint16_t s = FindSpan(Radr);
+	if ((s < AdrMapCnt) && (AdrMap[s].first <= Radr))
+	{
+		return ParSet[AdrMap[s].idx];
 	}
-	ActiveIdx = nmr_parameters;
-	ActiveRegAdr = INVALID_REGADR;
 	return NULL;
 }
 
@@ -179,15 +405,13 @@ Register *Register::GetParByIdx(uint16_t idx)
 	return NULL;
 }
 
-uint8_t Register::ReadReg(int16_t *out, size_t adr)
+uint8_t Register::ReadReg(int16_t *out, size_t adr, RegCursor &cur)
 {
 	uint8_t nmr = 0;
 	Register *pReg = GetPar(adr);
 	if (pReg != NULL && pReg->IsReadable())
 	{
-		ActiveRegAdr = adr;
-		nmr = pReg->GetRegVal(out);
-		ActiveRegAdr = INVALID_REGADR;
+		nmr = pReg->GetRegVal(out, adr, cur);
 	}
 	else
 	{
@@ -196,32 +420,254 @@ uint8_t Register::ReadReg(int16_t *out, size_t adr)
 	return nmr;
 }
 
-Register *const Register::ParameterSearch(const String &name)
+//*****************************************************************************
+//! Read block of registers, each parameter is resolved and read once,
+//! holes and unreadable parameters are filled with NONDEF_REG_VAL
+//*****************************************************************************
+uint16_t Register::ReadRange(uint16_t start, uint16_t count, int16_t *out)
+{
+	uint16_t nmr = 0;
+	uint32_t adr = start;
+	uint32_t end = (uint32_t)start + count;
+	uint16_t s = FindSpan(start);
+
+	while (adr < end)
+	{
+		uint32_t next = (s < AdrMapCnt) ? AdrMap[s].first : end;
+		if (next > adr)
+		{ /*hole up to next parameter*/
+			uint32_t n = std::min(next, end) - adr;
+			for (uint32_t i = 0; i < n; i++)
+			{
+				out[adr - start + i] = NONDEF_REG_VAL;
+			}
+			adr += n;
+			continue;
+		}
+
+		Register *pReg = ParSet[AdrMap[s].idx];
+		uint16_t n = std::min((uint32_t)AdrMap[s].last + 1, end) - adr;
+		if (pReg->IsReadable())
+		{
+			nmr += pReg->GetRegVals(&out[adr - start], adr, n);
+		}
+		else
+		{
+			for (uint16_t i = 0; i < n; i++)
+			{
+				out[adr - start + i] = NONDEF_REG_VAL;
+			}
+		}
+		adr += n;
+		s++;
+	}
+	return nmr;
+}
+
+//*****************************************************************************
+//! Write block of registers, each parameter is resolved and written once,
+//! returns count of written words (holes and read-only words are skipped)
+//*****************************************************************************
+uint16_t Register::WriteRange(uint16_t start, uint16_t count, const int16_t *inp)
 {
-	Register *retval = NULL;
-	size_t n = sizeof(ParDef) / sizeof(pardef_t);
-	for (int i = 0; i < n; i++)
+	uint16_t nmr = 0;
+	uint32_t adr = start;
+	uint32_t end = (uint32_t)start + count;
+	uint16_t s = FindSpan(start);
+
+	while ((adr < end) && (s < AdrMapCnt) && (AdrMap[s].first < end))
 	{
-		if (!name.compareTo(ParDef[i].ptxt))
+		adr = std::max(adr, (uint32_t)AdrMap[s].first);
+		Register *pReg = ParSet[AdrMap[s].idx];
+		uint16_t n = std::min((uint32_t)AdrMap[s].last + 1, end) - adr;
+		if (pReg->IsWritable())
+		{
+			nmr += pReg->SetRegVals(&inp[adr - start], adr, n);
+		}
+		adr += n;
+		s++;
+	}
+	return nmr;
+}
+
+//*****************************************************************************
+//! Count of leading words of the block that exist and are readable/writable
+//*****************************************************************************
+uint16_t Register::CheckRange(uint16_t start, uint16_t count, bool write)
+{
+	uint32_t adr = start;
+	uint32_t end = (uint32_t)start + count;
+	uint16_t s = FindSpan(start);
+
+	while ((adr < end) && (s < AdrMapCnt) && (AdrMap[s].first <= adr))
+	{
+		Register *pReg = ParSet[AdrMap[s].idx];
+		if (write ? !pReg->IsWritable() : !pReg->IsReadable())
 		{
-			retval = ParSet[i];
 			break;
 		}
+		adr = (uint32_t)AdrMap[s].last + 1;
+		s++;
 	}
-	return retval;
+	return std::min(adr, end) - start;
+}
+
+//*****************************************************************************
+//! Dry run of WriteRange, true if every writable parameter of the block
+//! accepts its new value, nothing is written
+//*****************************************************************************
+bool Register::CheckRangeVals(uint16_t start, uint16_t count, const int16_t *inp)
+{
+	uint32_t adr = start;
+	uint32_t end = (uint32_t)start + count;
+	uint16_t s = FindSpan(start);
+
+	while ((adr < end) && (s < AdrMapCnt) && (AdrMap[s].first < end))
+	{
+		adr = std::max(adr, (uint32_t)AdrMap[s].first);
+		Register *pReg = ParSet[AdrMap[s].idx];
+		uint16_t n = std::min((uint32_t)AdrMap[s].last + 1, end) - adr;
+		if (pReg->IsWritable() && !pReg->CheckRegVals(&inp[adr - start], adr, n))
+		{
+			return false;
+		}
+		adr += n;
+		s++;
+	}
+	return true;
+}
+
+//*****************************************************************************
+//! Read block of default values, S16 and S32 parameters return def of table,
+//! strings and holes return NONDEF_REG_VAL
+//*****************************************************************************
+uint16_t Register::ReadDefaults(uint16_t start, uint16_t count, int16_t *out)
+{
+	uint16_t nmr = 0;
+	for (uint16_t i = 0; i < count; i++)
+	{
+		out[i] = NONDEF_REG_VAL;
+	}
+
+	uint32_t end = (uint32_t)start + count;
+	for (uint16_t s = FindSpan(start); (s < AdrMapCnt) && (AdrMap[s].first < end); s++)
+	{
+		const regspan_t &sp = AdrMap[s];
+		uint32_t val = (uint32_t)ParDef[sp.idx].def;
+		uint16_t size = sp.last - sp.first + 1;
+		for (uint32_t adr = std::max((uint32_t)sp.first, (uint32_t)start); adr <= std::min((uint32_t)sp.last, end - 1); adr++)
+		{
+			if (size == 1)
+			{
+				out[adr - start] = (int16_t)val;
+			}
+			else if (size == 2)
+			{ /*S32 je v registrech big endian jako hodnota*/
+				out[adr - start] = (adr == sp.first) ? (int16_t)(val >> 16) : (int16_t)(val & 0xffff);
+			}
+			nmr++;
+		}
+	}
+	return nmr;
+}
+
+//*****************************************************************************
+//! JSON value of parameter by table index, no name lookup
+//*****************************************************************************
+bool Register::JsonReadIdx(uint16_t idx, JsonVariant json_val)
+{
+	if ((idx >= nmr_parameters) || !ParSet[idx]->IsReadable())
+	{
+		return false;
+	}
+
+	ParSet[idx]->GetJsonVal(json_val);
+	return true;
+}
+
+uint16_t Register::GetRegVals(int16_t *out, uint16_t addr, uint16_t nmr)
+{
+	uint16_t cnt = 0;
+	RegCursor cur;
+	for (uint16_t i = 0; i < nmr; i++)
+	{
+		cnt += this->GetRegVal(&out[i], addr + i, cur);
+	}
+	return cnt;
+}
+
+uint16_t Register::SetRegVals(const int16_t *inp, uint16_t addr, uint16_t nmr)
+{
+	uint16_t cnt = 0;
+	RegCursor cur;
+	for (uint16_t i = 0; i < nmr; i++)
+	{
+		cnt += this->SetRegVal(inp[i], addr + i, cur);
+	}
+	return cnt;
+}
+
+Register *const Register::ParameterSearch(const String &name)
+{
+	return ParameterSearch(name.c_str());
+}
+
+Register *const Register::ParameterSearch(const char *name)
+{
+	uint16_t idx = ParIndex::FindName(NameMap, NameMapCnt, ParName, name);
+	return (idx != PAR_INDEX_NONE) ? ParSet[idx] : NULL;
 }
 
 bool Register::JsonRead(const String &name, JsonObject doc)
 {
-	Register *reg = ParameterSearch(name);
+	Register *reg = ParameterSearch(name.c_str());
 	if (reg != NULL && reg->IsReadable())
 	{
-		reg->GetJsonVal(doc[name].to<JsonVariant>());
-		return true;
+		return JsonReadIdx(&reg->def - ParDef, doc[name].to<JsonVariant>());
 	}
 	return false;
 }
 
+//*****************************************************************************
+//! Read values of parameters changed after version 'since', returns current version
+//*****************************************************************************
+uint32_t Register::JsonReadChanges(uint32_t since, JsonObject doc, bool &full)
+{
+	uint16_t idx[nmr_parameters];
+	size_t cnt = 0;
+	uint32_t version;
+
+	full = (since == 0) || !GetChanges(since, version, idx, cnt);
+	if (full)
+	{
+		version = ChangeSeq;
+		cnt = 0;
+		for (uint16_t i = 0; i < nmr_parameters; i++)
+		{
+			idx[cnt++] = i;
+		}
+	}
+	else
+	{
+		for (uint16_t i = 0; i < nmr_parameters; i++)
+		{
+			if (ParSet[i]->IsComputed())
+			{
+				idx[cnt++] = i;
+			}
+		}
+	}
+
+	for (size_t i = 0; i < cnt; i++)
+	{
+		if (ParSet[idx[i]]->IsReadable())
+		{
+			JsonReadIdx(idx[i], doc[ParDef[idx[i]].ptxt].to<JsonVariant>());
+		}
+	}
+	return version;
+}
+
 bool Register::JsonWrite(JsonPair pair)
 {
 	Register *reg = ParameterSearch(pair.key().c_str());
@@ -271,20 +717,25 @@ bool Register::IsReadable(size_t adr)
 	return retval;
 }
 
-uint8_t Register::WriteReg(int16_t out, size_t adr)
+uint8_t Register::WriteReg(int16_t out, size_t adr, RegCursor &cur)
 {
 	uint8_t nmr = 0;
 	Register *pReg = GetPar(adr);
-	if (pReg->IsWritable())
+	if (pReg != NULL && pReg->IsWritable())
 	{
-		nmr = pReg->SetRegVal(out);
+		nmr = pReg->SetRegVal(out, adr, cur);
 	}
 	return nmr;
 }
 
 void Register::InitAll(void)
 {
-	nv_data.begin("nv_data", false);
+	nv_data.begin(NV_NAMESPACE, false);
+	BuildAdrMap();
+	BuildNameMap();
+	BuildNvKeys();
+	esp_register_shutdown_handler([]()
+								  { Register::NvFlush(); });
 	for (size_t i = 0; i < nmr_parameters; i++)
 	{
 		ParSet[i]->ResetVal();
@@ -318,6 +769,7 @@ bool int16_reg::Set(int32_t v)
 	{
 		retval = true;
 		value = tmp;
+		Changed();
 	}
 	return retval;
 }
@@ -336,13 +788,16 @@ uint8_t int16_reg::SetRegVal(int16_t inp)
 	return 0;
 }
 
-uint8_t int16_reg::GetRegVal(int16_t *out, uint16_t addr)
-{
-	return this->GetRegVal(out);
-}
-uint8_t int16_reg::SetRegVal(int16_t inp, uint16_t addr)
+bool int16_reg::CheckRegVals(const int16_t *inp, uint16_t addr, uint16_t nmr)
 {
-	return this->SetRegVal(inp);
+	for (uint16_t i = 0; i < nmr; i++)
+	{
+		if (!this->CheckLimits((int32_t)inp[i]))
+		{
+			return false;
+		}
+	}
+	return true;
 }
 
 bool int16_reg::SetLimit(int32_t v)
@@ -363,18 +818,28 @@ void int16_reg::ResetVal(void)
 	value = (int16_t)def.def;
 }
 
+bool int16_reg::SetDefault(void)
+{
+	this->Set(def.def);
+	return true;
+}
+
 bool int16_reg_nv::Set(int32_t v)
 {
 	bool retval = int16_reg::Set(v);
 	if (retval)
 	{
-		nv_data.putShort(String(def.adr).c_str(), (int16_t)value);
+		SetNvDirty();
 	}
 	return retval;
 }
 void int16_reg_nv::ResetVal(void)
 {
-	value = nv_data.getShort(String(def.adr).c_str(), (int16_t)def.def);
+	value = nv_data.getShort(NvKey(), (int16_t)def.def);
+}
+void int16_reg_nv::StoreNv(nvs_handle_t nvh)
+{
+	nvs_set_i16(nvh, NvKey(), (int16_t)value);
 }
 
 bool uint16_reg_nv::Set(int32_t v)
@@ -382,13 +847,17 @@ bool uint16_reg_nv::Set(int32_t v)
 	bool retval = uint16_reg::Set(v);
 	if (retval)
 	{
-		nv_data.putUShort(String(def.adr).c_str(), (uint16_t)value);
+		SetNvDirty();
 	}
 	return retval;
 }
 void uint16_reg_nv::ResetVal(void)
 {
-	value = nv_data.getUShort(String(def.adr).c_str(), (uint16_t)def.def);
+	value = nv_data.getUShort(NvKey(), (uint16_t)def.def);
+}
+void uint16_reg_nv::StoreNv(nvs_handle_t nvh)
+{
+	nvs_set_u16(nvh, NvKey(), (uint16_t)value);
 }
 
 //*****************************************************************************
@@ -404,67 +873,62 @@ bool int32_reg::Set(int32_t v)
 	if (retval)
 	{
 		value = v;
+		Changed();
 	}
 	return retval;
 }
 uint8_t int32_reg::GetRegVal(int16_t *out)
 {
-	size_t idx = getidx();
-	static int32_t tmpVal;
-	if (idx == 0)
-	{
-		tmpVal = value;
-		*out = (int16_t)((uint32_t)tmpVal >> 16);
-	}
-	else if (idx == 1)
-	{
-		*out = (int16_t)((uint32_t)tmpVal & 0xffff);
-	}
-	return 1;
+	RegCursor cur;
+	return this->GetRegVal(out, def.adr, cur);
 }
 uint8_t int32_reg::SetRegVal(int16_t inp)
 {
-	static uint16_t highReg = 0;
-	size_t idx = getidx();
-	if (idx == 0)
-	{
-		highReg = (uint16_t)inp;
-	}
-	else if (idx == 1)
-	{
-		int32_t tmp = (int32_t)(((uint32_t)highReg << 16) | (uint32_t)((uint16_t)inp));
-		if (this->CheckLimits(tmp))
-		{
-			this->Set(tmp);
-		}
-	}
-	return 1;
+	RegCursor cur;
+	return this->SetRegVal(inp, def.adr, cur);
 }
 
-uint8_t int32_reg::GetRegVal(int16_t *out, uint16_t addr)
+uint8_t int32_reg::GetRegVal(int16_t *out, uint16_t addr, RegCursor &cur)
 {
 	size_t idx = getidx(addr);
-	int32_t tmpVal = value;
+	if ((idx == 0) || (cur.reg != this))
+	{
+		/*both words of one read come from the same value*/
+		cur.reg = this;
+		cur.val = value;
+	}
 	if (idx == 0)
 	{
-		*out = (int16_t)((uint32_t)tmpVal >> 16);
+		*out = (int16_t)((uint32_t)cur.val >> 16);
 	}
 	else if (idx == 1)
 	{
-		*out = (int16_t)((uint32_t)tmpVal & 0xffff);
+		*out = (int16_t)((uint32_t)cur.val & 0xffff);
 	}
 	return 1;
 }
-uint8_t int32_reg::SetRegVal(int16_t inp, uint16_t addr)
+uint16_t int32_reg::GetRegVals(int16_t *out, uint16_t addr, uint16_t nmr)
+{
+	uint32_t val = (uint32_t)value.load();
+	for (uint16_t i = 0; i < nmr; i++)
+	{
+		out[i] = (getidx(addr + i) == 0) ? (int16_t)(val >> 16) : (int16_t)(val & 0xffff);
+	}
+	return nmr;
+}
+uint8_t int32_reg::SetRegVal(int16_t inp, uint16_t addr, RegCursor &cur)
 {
 	size_t idx = getidx(addr);
 	if (idx == 0)
 	{
-		tmp_high_reg = (uint16_t)inp;
+		cur.reg = this;
+		cur.val = (uint16_t)inp;
 	}
 	else if (idx == 1)
 	{
-		int32_t tmp = (int32_t)(((uint32_t)tmp_high_reg << 16) | (uint32_t)((uint16_t)inp));
+		uint32_t high = (cur.reg == this) ? (uint32_t)cur.val : ((uint32_t)value >> 16);
+		int32_t tmp = (int32_t)((high << 16) | (uint32_t)((uint16_t)inp));
+		cur.reg = NULL;
 		if (this->CheckLimits(tmp))
 		{
 			this->Set(tmp);
@@ -473,6 +937,18 @@ uint8_t int32_reg::SetRegVal(int16_t inp, uint16_t addr)
 	return 1;
 }
 
+bool int32_reg::CheckRegVals(const int16_t *inp, uint16_t addr, uint16_t nmr)
+{
+	size_t idx = getidx(addr);
+	if (idx + nmr < 2)
+	{ /*samotne horni slovo, hodnota se sklada az s dolnim*/
+		return true;
+	}
+	uint32_t high = (idx == 0) ? (uint32_t)((uint16_t)inp[0]) : ((uint32_t)value >> 16);
+	int32_t tmp = (int32_t)((high << 16) | (uint32_t)((uint16_t)inp[1 - idx]));
+	return this->CheckLimits(tmp);
+}
+
 bool int32_reg::SetLimit(int32_t v)
 {
 	if (v > def.max)
@@ -490,6 +966,12 @@ void int32_reg::ResetVal(void)
 	value = def.def;
 }
 
+bool int32_reg::SetDefault(void)
+{
+	this->Set(def.def);
+	return true;
+}
+
 //*****************************************************************************
 //! \odvozena trida parametru typu S32- registru
 //*****************************************************************************
@@ -499,14 +981,19 @@ bool int32_reg_nv::Set(int32_t v)
 	bool retval = int32_reg::Set(v);
 	if (retval)
 	{
-		nv_data.putLong(String(def.adr).c_str(), value);
+		SetNvDirty();
 	}
 	return retval;
 }
 
 void int32_reg_nv::ResetVal(void)
 {
-	value = nv_data.getLong(String(def.adr).c_str(), def.def);
+	value = nv_data.getLong(NvKey(), def.def);
+}
+
+void int32_reg_nv::StoreNv(nvs_handle_t nvh)
+{
+	nvs_set_i32(nvh, NvKey(), value);
 }
 
 //*****************************************************************************
@@ -515,10 +1002,24 @@ void int32_reg_nv::ResetVal(void)
 
 uint8_t log_reg::GetRegVal(int16_t *out)
 {
-	size_t idx = getidx();
-	*out = history[idx];
+	*out = history[0];
+	return 1;
+}
+uint8_t log_reg::GetRegVal(int16_t *out, uint16_t addr, RegCursor &cur)
+{
+	size_t idx = getidx(addr);
+	*out = (idx < ERR_HISTORY_CNT) ? history[idx] : NONDEF_REG_VAL;
 	return 1;
 }
+uint16_t log_reg::GetRegVals(int16_t *out, uint16_t addr, uint16_t nmr)
+{
+	size_t idx = getidx(addr);
+	for (uint16_t i = 0; i < nmr; i++, idx++)
+	{
+		out[i] = (idx < ERR_HISTORY_CNT) ? history[idx] : NONDEF_REG_VAL;
+	}
+	return nmr;
+}
 uint8_t log_reg::SetRegVal(int16_t inp)
 {
 	return 0;
@@ -526,19 +1027,25 @@ uint8_t log_reg::SetRegVal(int16_t inp)
 
 void log_reg::ResetVal(void)
 {
-	if (!nv_data.getBytes(String(def.adr).c_str(), history, sizeof(history)))
+	if (!nv_data.getBytes(NvKey(), history, sizeof(history)))
 	{
 		memset(history, 0, sizeof(history));
 	}
 }
 
+void log_reg::StoreNv(nvs_handle_t nvh)
+{
+	nvs_set_blob(nvh, NvKey(), history, sizeof(history));
+}
+
 void log_reg::Set(ErrorState_t err)
 {
 	if (err)
 	{
 		memmove(&history[1], history, (ERR_HISTORY_CNT - 1) * sizeof(ErrorState_t));
 		history[0] = err;
-		nv_data.putBytes(String(def.adr).c_str(), history, sizeof(history));
+		Changed();
+		SetNvDirty();
 	}
 }
 
@@ -574,81 +1081,68 @@ int16_t temp_reg::Get(void)
 //! \odvozena trida parametru typu STRING
 //*****************************************************************************
 
+string_reg::string_reg(const pardef_t &pd, size_t capacity) : Register(pd), gen(0), cap(capacity), change(false)
+{
+	/*dva buffery pevne velikosti, zapis probiha do neaktivniho*/
+	buf[0] = new char[cap * 2];
+	buf[1] = buf[0] + cap;
+	buf[0][0] = '\0';
+	buf[1][0] = '\0';
+}
+
 uint8_t string_reg::GetRegVal(int16_t *out)
 {
-	size_t idx = getidx() * 2;
-	if (idx == 0)
-	{
-		std::lock_guard<std::mutex> lock(mutex);
-		writeString = val;
-	}
-	*out = (int16_t)((uint16_t)writeString.charAt(idx + 1) << 8 | (uint16_t)writeString.charAt(idx));
-	return 1;
+	RegCursor cur;
+	return this->GetRegVal(out, def.adr, cur);
 }
 
 uint8_t string_reg::SetRegVal(int16_t inp)
 {
-	size_t idx = getidx();
-	if (idx < GetSize())
-	{
-		if (idx == 0)
-		{
-			writeString.clear();
-		}
-
-		bool end = (idx * 2 > writeString.length());
-
-		if (!end)
-		{
-			bool save = false;
-			char tc = ((uint16_t)inp) & 0xFF;
-			save |= tc == '\0';
-
-			if (!save)
-				writeString += tc;
-
-			tc = ((uint16_t)inp >> 8) & 0xFF;
-			save |= tc == '\0';
-
-			if (!save)
-				writeString += tc;
-
-			change = true;
-			save |= (idx == (GetSize() - 1));
-
-			if (save)
-			{
-				this->Set(writeString);
-			}
-		}
+	RegCursor cur;
+	return this->SetRegVal(inp, def.adr, cur);
+}
 
-		return 1;
+uint8_t string_reg::GetRegVal(int16_t *out, uint16_t addr, RegCursor &cur)
+{
+	size_t idx = getidx(addr) * 2;
+	if ((idx == 0) || (cur.reg != this))
+	{
+		/*all words of one read come from the same string*/
+		cur.reg = this;
+		cur.len = Get(cur.str);
 	}
-	return 0;
+	uint16_t lo = (idx < cur.len) ? (uint8_t)cur.str[idx] : 0;
+	uint16_t hi = (idx + 1 < cur.len) ? (uint8_t)cur.str[idx + 1] : 0;
+	*out = (int16_t)(hi << 8 | lo);
+	return 1;
 }
 
-uint8_t string_reg::GetRegVal(int16_t *out, uint16_t addr)
+uint16_t string_reg::GetRegVals(int16_t *out, uint16_t addr, uint16_t nmr)
 {
+	char tmp[STRING_REG_MAX_LEN + 1];
+	size_t len = Get(tmp);
 	size_t idx = getidx(addr) * 2;
-	if (idx == 0)
+	for (uint16_t i = 0; i < nmr; i++, idx += 2)
 	{
-		std::lock_guard<std::mutex> lock(mutex);
-		tmpString = val;
+		uint16_t lo = (idx < len) ? (uint8_t)tmp[idx] : 0;
+		uint16_t hi = (idx + 1 < len) ? (uint8_t)tmp[idx + 1] : 0;
+		out[i] = (int16_t)(hi << 8 | lo);
 	}
-	*out = (int16_t)((uint16_t)tmpString.charAt(idx + 1) << 8 | (uint16_t)tmpString.charAt(idx));
-	return 1;
+	return nmr;
 }
-uint8_t string_reg::SetRegVal(int16_t inp, uint16_t addr)
+
+uint8_t string_reg::SetRegVal(int16_t inp, uint16_t addr, RegCursor &cur)
 {
 	size_t idx = getidx(addr);
 	if (idx < GetSize())
 	{
 		if (idx == 0)
 		{
-			tmpString.clear();
+			cur.reg = this;
+			cur.len = 0;
 		}
 
-		bool end = (idx * 2 > tmpString.length());
+		bool end = (cur.reg != this) || (idx * 2 > cur.len);
 
 		if (!end)
 		{
@@ -656,21 +1150,23 @@ uint8_t string_reg::SetRegVal(int16_t inp, uint16_t addr)
 			char tc = ((uint16_t)inp) & 0xFF;
 			save |= tc == '\0';
 
-			if (!save)
-				tmpString += tc;
+			if (!save && (cur.len < STRING_REG_MAX_LEN))
+				cur.str[cur.len++] = tc;
 
 			tc = ((uint16_t)inp >> 8) & 0xFF;
 			save |= tc == '\0';
 
-			if (!save)
-				tmpString += tc;
+			if (!save && (cur.len < STRING_REG_MAX_LEN))
+				cur.str[cur.len++] = tc;
 
 			change = true;
 			save |= (idx == (GetSize() - 1));
 
 			if (save)
 			{
-				this->Set(tmpString);
+				cur.reg = NULL;
+				cur.str[cur.len] = '\0';
+				this->Set(cur.str);
 			}
 		}
 
@@ -681,31 +1177,92 @@ uint8_t string_reg::SetRegVal(int16_t inp, uint16_t addr)
 
 void string_reg::ResetVal(void)
 {
-	val = "";
+	Store("");
 }
 
-bool string_reg::Set(String &txt)
+bool string_reg::SetDefault(void)
+{
+	this->Set("");
+	return true;
+}
+
+//*****************************************************************************
+//! Publish new value into the inactive buffer, returns true if it differs
+//*****************************************************************************
+bool string_reg::Store(const char *txt)
 {
 	std::lock_guard<std::mutex> lock(mutex);
+	uint32_t g = gen.load(std::memory_order_relaxed);
+	const char *act = buf[g & 1];
+	size_t len = strnlen(txt, cap - 1);
 
-	bool retval = val.compareTo(txt);
+	if ((strncmp(act, txt, len) == 0) && (act[len] == '\0'))
+	{
+		return false;
+	}
+
+	char *dst = buf[(g + 1) & 1];
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	memcpy(dst, txt, len);
+	dst[len] = '\0';
+	gen.store(g + 1, std::memory_order_release);
+	return true;
+}
+
+bool string_reg::Set(const char *txt)
+{
+	bool retval = Store(txt);
 	if (retval)
 	{
-		val = txt;
+		Changed();
 	}
 	return retval;
 }
 
-bool string_reg::Set(const char *txt)
+//*****************************************************************************
+//! Copy value into caller buffer without locking, returns string length
+//*****************************************************************************
+size_t string_reg::Get(char *out, size_t size)
 {
-	String tmp = String(txt);
-	return this->Set(tmp);
+	uint32_t g;
+	size_t len;
+
+	if (size == 0)
+	{
+		return 0;
+	}
+
+	do
+	{
+		/*seqlock: zapis do druheho bufferu behem kopie vynuti opakovani*/
+		g = gen.load(std::memory_order_acquire);
+		const char *src = buf[g & 1];
+		len = strnlen(src, std::min(cap, size) - 1);
+		memcpy(out, src, len);
+		std::atomic_thread_fence(std::memory_order_acquire);
+	} while (g != gen.load(std::memory_order_relaxed));
+
+	out[len] = '\0';
+	return len;
 }
 
 String string_reg::Get(void)
 {
-	std::lock_guard<std::mutex> lock(mutex);
-	return val;
+	char tmp[STRING_REG_MAX_LEN + 1];
+	Get(tmp);
+	return String(tmp);
+}
+
+bool string_reg::Equals(const char *txt)
+{
+	char tmp[STRING_REG_MAX_LEN + 1];
+	Get(tmp);
+	return strcmp(tmp, txt) == 0;
+}
+
+bool string_reg::IsEmpty(void)
+{
+	return buf[gen.load(std::memory_order_acquire) & 1][0] == '\0';
 }
 
 //*****************************************************************************
@@ -715,17 +1272,27 @@ String string_reg::Get(void)
 void string_reg_nv::ResetVal(void)
 {
 	string_reg::ResetVal();
-	val = nv_data.getString(String(def.adr).c_str(), val);
+	char tmp[STRING_REG_MAX_LEN + 1];
+	if (nv_data.getString(NvKey(), tmp, sizeof(tmp)) > 0)
+	{
+		Store(tmp);
+	}
+}
+
+void string_reg_nv::StoreNv(nvs_handle_t nvh)
+{
+	char tmp[STRING_REG_MAX_LEN + 1];
+	Get(tmp);
+	nvs_set_str(nvh, NvKey(), tmp);
 }
 
 // bool ischange(void);
-bool string_reg_nv::Set(String &txt)
+bool string_reg_nv::Set(const char *txt)
 {
 	bool retval = string_reg::Set(txt);
 	if (retval)
 	{
-		std::lock_guard<std::mutex> lock(mutex);
-		nv_data.putString(String(def.adr).c_str(), val);
+		SetNvDirty();
 	}
 	return retval;
 }
@@ -736,32 +1303,24 @@ bool string_reg_nv::Set(String &txt)
 
 void ipv4_reg_nv::ResetVal(void)
 {
-	IPAddress tmp((uint32_t)def.def);
-	val = tmp.toString();
+	char tmp[IPV4_STR_LEN];
+	Store(Ipv4Str((uint32_t)def.def, tmp));
 
 	string_reg_nv::ResetVal();
 }
 
-bool ipv4_reg_nv::Set(String &txt)
+bool ipv4_reg_nv::Set(const char *txt)
 {
 	IPAddress tmp;
-	bool retval = tmp.fromString(txt);
-	if (retval)
-	{
-		String temp = tmp.toString();
-		retval = string_reg_nv::Set(temp);
-	}
-
-	return retval;
+	return tmp.fromString(txt) && Set((uint32_t)tmp);
 }
 
 IPAddress ipv4_reg_nv::GetIP()
 {
+	char tmp[STRING_REG_MAX_LEN + 1];
 	IPAddress ip;
-	{
-		std::lock_guard<std::mutex> lock(mutex);
-		ip.fromString(val);
-	}
+	Get(tmp);
+	ip.fromString(tmp);
 	return ip;
 }
 
@@ -861,14 +1420,18 @@ uint8_t statusbits_reg::SetRegVal(int16_t inp)
 //*****************************************************************************
 void time_reg_nv::ResetVal(void)
 {
-	time_reg::Set(nv_data.getLong(String(def.adr).c_str(), def.def));
+	time_reg::Set(nv_data.getLong(NvKey(), def.def));
 }
-bool time_reg_nv::Set(String &txt)
+void time_reg_nv::StoreNv(nvs_handle_t nvh)
+{
+	nvs_set_i32(nvh, NvKey(), t_val);
+}
+bool time_reg_nv::Set(const char *txt)
 {
 	bool retval = time_reg::Set(txt);
 	if (retval)
 	{
-		nv_data.putLong(String(def.adr).c_str(), t_val);
+		SetNvDirty();
 	}
 	return retval;
 }
@@ -877,11 +1440,121 @@ bool time_reg_nv::Set(time_t v)
 	bool retval = time_reg::Set(v);
 	if (retval)
 	{
-		nv_data.putLong(String(def.adr).c_str(), t_val);
+		SetNvDirty();
 	}
 	return retval;
 }
 
+//*****************************************************************************
+//! \odvozena trida parametru pro zaznam grafu
+//*****************************************************************************
+uint16_t chart_base::ReadSamples(chartcursor_t &cur, int32_t *out, uint16_t n)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return series.RawRead(cur, out, n);
+}
+
+//*****************************************************************************
+//! Raw samples from newest, the lock is held only while a block is copied
+//*****************************************************************************
+void chart_base::GetJsonSamples(JsonArray arr)
+{
+	chartcursor_t cur;
+	int32_t vals[CHART_STREAM_BLOCK];
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		series.RawCursor(cur);
+	}
+
+	bool dup = (cur.cnt == 1);
+	uint16_t n;
+	while ((n = ReadSamples(cur, vals, CHART_STREAM_BLOCK)) > 0)
+	{
+		for (uint16_t i = 0; i < n; i++)
+		{
+			for (int k = 0; k < (dup ? 2 : 1); k++)
+			{
+				if (vals[i] == CHART_NO_DATA)
+				{
+					arr.add(nullptr);
+				}
+				else
+				{
+					arr.add(vals[i]);
+				}
+			}
+		}
+	}
+}
+
+//*****************************************************************************
+//! Raw samples reduced to at most 'points', "vals" from newest and "age" with
+//! position of every value in raw series (0 = newest, "per" seconds apart)
+//*****************************************************************************
+void chart_base::GetJsonReduced(JsonObject obj, uint16_t points, chartreduce_t mode)
+{
+	chartcursor_t cur;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		series.RawCursor(cur);
+		obj["per"] = series.RawPeriod();
+	}
+	JsonArray arrVals = obj["vals"].to<JsonArray>();
+	JsonArray arrAge = obj["age"].to<JsonArray>();
+
+	points = std::max(points, (uint16_t)CHART_MIN_POINTS);
+	int32_t *vals = (int32_t *)ps_malloc(cur.cnt * sizeof(int32_t));
+	uint32_t *idx = (uint32_t *)ps_malloc(points * sizeof(uint32_t));
+	if ((vals != NULL) && (idx != NULL))
+	{
+		uint16_t n = 0;
+		while (n < cur.cnt)
+		{
+			n += ReadSamples(cur, &vals[n], CHART_STREAM_BLOCK);
+		}
+		uint16_t cnt = ChartReduce::Reduce(mode, vals, n, points, idx);
+		for (uint16_t k = 0; k < cnt; k++)
+		{
+			if (vals[idx[k]] == CHART_NO_DATA)
+			{
+				arrVals.add(nullptr);
+			}
+			else
+			{
+				arrVals.add(vals[idx[k]]);
+			}
+			arrAge.add(idx[k]);
+		}
+	}
+	free(vals);
+	free(idx);
+}
+
+void chart_base::JsonStreamText(bool suffix, char *txt, size_t len)
+{
+	snprintf(txt, len, suffix ? "]" : "[");
+}
+
+void chart_base::JsonStreamBegin(chart_stream &st)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		series.RawCursor(st.cur);
+	}
+	st.chart = this;
+	st.Begin(st.cur.cnt == 1);
+}
+
+uint16_t chart_stream::ReadBlock(int32_t *out, uint16_t n)
+{
+	return chart->ReadSamples(cur, out, n);
+}
+
+void chart_stream::Text(bool suffix, char *txt, size_t len)
+{
+	chart->JsonStreamText(suffix, txt, len);
+}
+
 bool pwd_reg::Set(int32_t v)
 {
 	bool retval = int16_reg::Set(v);
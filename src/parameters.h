@@ -19,6 +19,10 @@
 #define INVALID_REGADR 0xFFFF
 #define NONDEF_REG_VAL 0
 
+#define NV_NAMESPACE "nv_data"
+#define NV_WRITE_DELAY_MS 1000 /*zmeny NV parametru se slucuji do jednoho zapisu*/
+#define NV_TASK_PERIOD_MS 100
+
 #define DefPar_Ext(_name_,_regadr_,_def_,_min_, _max_,_type_,_dir_)
 
 
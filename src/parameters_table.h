@@ -215,8 +215,8 @@ DefPar_Ext(LogHistory, 525, NeniChyba, NeniChyba, MAX_ERROR, U16_, Par_R)
 DefPar_Ext(LogHistory, 526, NeniChyba, NeniChyba, MAX_ERROR, U16_, Par_R)
 DefPar_Ext(LogHistory, 527, NeniChyba, NeniChyba, MAX_ERROR, U16_, Par_R)
 
-DefPar_Fun(Teplota24H, 600, 0, -100, 100, S16_, Par_R, Par_Public, FLAGS_NONE, chart_reg<int16_t>)
-DefPar_Fun(Svetlo24H, 601, 0, 0, 100, U16_, Par_R, Par_Public, FLAGS_NONE, chart_reg<uint16_t>)
+DefPar_Fun(Teplota24H, 600, 0, -100, 100, S16_, Par_R, Par_Public, CHART_FLAG, chart_reg<int16_t>)
+DefPar_Fun(Svetlo24H, 601, 0, 0, 100, U16_, Par_R, Par_Public, CHART_FLAG, chart_reg<uint16_t>)
 DefPar_Nv(TeplotaKorekce, 602, -6, -100, 100, S16_, Par_RW, Par_Public, FLAGS_NONE)
 
 /*
@@ -269,6 +269,53 @@ DefPar_Ram(APPUsed, 1035, 0, 0, 300, U16_, Par_R, Par_Public, FLAGS_NONE)
 DefPar_Ram(FSSize, 1036, 0, 0, 300, U16_, Par_R, Par_Public, FLAGS_NONE)
 DefPar_Ram(FSUsed, 1037, 0, 0, 300, U16_, Par_R, Par_Public, FLAGS_NONE)
 DefPar_Ram(Uptime, 1038, 0, 0, 300, S32_, Par_R, Par_Public, FLAGS_NONE)
+/*prijem ESP-NOW: zahozene ramce (plny pool, chybna delka) a max. obsazenost poolu*/
+DefPar_Ram(EspNowRxDrop, 1040, 0, 0, INT32_MAX, S32_, Par_R, Par_Public, FLAGS_NONE)
+DefPar_Ram(EspNowRxInvalid, 1042, 0, 0, INT32_MAX, S32_, Par_R, Par_Public, FLAGS_NONE)
+DefPar_Ram(EspNowRxPeak, 1044, 0, 0, UINT8_MAX, U16_, Par_R, Par_Public, FLAGS_NONE)
+
+
+
+/*
+-----------------------------------------------------------------------------------------------------------
+  @ Modbus RTU
+
+-----------------------------------------------------------------------------------------------------------
+*/
+DefPar_Nv(MdbBaudRate, 1100, 38400, 1200, 115200, S32_, Par_RW, Par_Installer, FLAGS_NONE)
+DefPar_Nv(MdbPollIdle, 1102, 20, 5, 1000, U16_, Par_RW, Par_Installer, FLAGS_NONE)
+DefPar_Nv(MdbPollTimeout, 1103, 100, 20, 1000, U16_, Par_RW, Par_Installer, FLAGS_NONE)
+/*dotazovani seznamu zarizeni v mezerach slave provozu, vypnuto = jen slave*/
+DefPar_Nv(MdbMaster, 1104, vypnuto, vypnuto, povoleno, U16_, Par_RW, Par_Installer, BOOL_FLAG)
+
+/*seznam dotazovanych zarizeni (master), adresa slave 0 = polozka vypnuta*/
+DefPar_Nv(MdbPoll1Slave, 1110, 0, 0, 247, U16_, Par_RW, Par_Installer, FLAGS_NONE)
+DefPar_Nv(MdbPoll1Reg, 1111, 0, 0, UINT16_MAX, U16_, Par_RW, Par_Installer, FLAGS_NONE)
+DefPar_Nv(MdbPoll1Cnt, 1112, 1, 1, 8, U16_, Par_RW, Par_Installer, FLAGS_NONE)
+DefPar_Nv(MdbPoll1Perioda, 1113, 10, 1, 3600, U16_, Par_RW, Par_Installer, FLAGS_NONE)
+DefPar_Nv(MdbPoll2Slave, 1114, 0, 0, 247, U16_, Par_RW, Par_Installer, FLAGS_NONE)
+DefPar_Nv(MdbPoll2Reg, 1115, 0, 0, UINT16_MAX, U16_, Par_RW, Par_Installer, FLAGS_NONE)
+DefPar_Nv(MdbPoll2Cnt, 1116, 1, 1, 8, U16_, Par_RW, Par_Installer, FLAGS_NONE)
+DefPar_Nv(MdbPoll2Perioda, 1117, 10, 1, 3600, U16_, Par_RW, Par_Installer, FLAGS_NONE)
+DefPar_Nv(MdbPoll3Slave, 1118, 0, 0, 247, U16_, Par_RW, Par_Installer, FLAGS_NONE)
+DefPar_Nv(MdbPoll3Reg, 1119, 0, 0, UINT16_MAX, U16_, Par_RW, Par_Installer, FLAGS_NONE)
+DefPar_Nv(MdbPoll3Cnt, 1120, 1, 1, 8, U16_, Par_RW, Par_Installer, FLAGS_NONE)
+DefPar_Nv(MdbPoll3Perioda, 1121, 10, 1, 3600, U16_, Par_RW, Par_Installer, FLAGS_NONE)
+DefPar_Nv(MdbPoll4Slave, 1122, 0, 0, 247, U16_, Par_RW, Par_Installer, FLAGS_NONE)
+DefPar_Nv(MdbPoll4Reg, 1123, 0, 0, UINT16_MAX, U16_, Par_RW, Par_Installer, FLAGS_NONE)
+DefPar_Nv(MdbPoll4Cnt, 1124, 1, 1, 8, U16_, Par_RW, Par_Installer, FLAGS_NONE)
+DefPar_Nv(MdbPoll4Perioda, 1125, 10, 1, 3600, U16_, Par_RW, Par_Installer, FLAGS_NONE)
+
+/*hodnoty nactene z externich zarizeni, polozky seznamu se plni postupne*/
+DefPar_Ram(MdbExt1, 1130, 0, INT16_MIN, INT16_MAX, S16_, Par_R, Par_Public | Par_MQTT, FLAGS_NONE)
+DefPar_Ram(MdbExt2, 1131, 0, INT16_MIN, INT16_MAX, S16_, Par_R, Par_Public | Par_MQTT, FLAGS_NONE)
+DefPar_Ram(MdbExt3, 1132, 0, INT16_MIN, INT16_MAX, S16_, Par_R, Par_Public | Par_MQTT, FLAGS_NONE)
+DefPar_Ram(MdbExt4, 1133, 0, INT16_MIN, INT16_MAX, S16_, Par_R, Par_Public | Par_MQTT, FLAGS_NONE)
+DefPar_Ram(MdbExt5, 1134, 0, INT16_MIN, INT16_MAX, S16_, Par_R, Par_Public | Par_MQTT, FLAGS_NONE)
+DefPar_Ram(MdbExt6, 1135, 0, INT16_MIN, INT16_MAX, S16_, Par_R, Par_Public | Par_MQTT, FLAGS_NONE)
+DefPar_Ram(MdbExt7, 1136, 0, INT16_MIN, INT16_MAX, S16_, Par_R, Par_Public | Par_MQTT, FLAGS_NONE)
+DefPar_Ram(MdbExt8, 1137, 0, INT16_MIN, INT16_MAX, S16_, Par_R, Par_Public | Par_MQTT, FLAGS_NONE)
+DefPar_Ram(MdbPollStav, 1138, 0, 0, 0x0F, U16_, Par_R, Par_Public | Par_MQTT, FLAGS_NONE)
 
 
 
@@ -282,6 +329,17 @@ DefPar_Ram(CRCError, 2000, 0, 0, 1000, U16_, Par_R, Par_Public, FLAGS_NONE)
 DefPar_Ram(TimeoutError, 2001, 0, 0, 1000, U16_, Par_R, Par_Public, FLAGS_NONE)
 DefPar_Ram(ExceptionError, 2002, 0, 0, 1000, U16_, Par_R, Par_Public, FLAGS_NONE)
 DefPar_Ram(CorrectPackets, 2003, 0, 0, 1000, U16_, Par_R, Par_Public, FLAGS_NONE)
+DefPar_Ram(NvCommits, 2004, 0, 0, UINT16_MAX, U16_, Par_R, Par_Public, FLAGS_NONE)
+DefPar_Ram(TcpFrameError, 2010, 0, 0, 1000, U16_, Par_R, Par_Public, FLAGS_NONE)
+DefPar_Ram(TcpExceptionError, 2011, 0, 0, 1000, U16_, Par_R, Par_Public, FLAGS_NONE)
+DefPar_Ram(TcpCorrectPackets, 2012, 0, 0, 1000, U16_, Par_R, Par_Public, FLAGS_NONE)
+DefPar_Ram(TcpBusyError, 2013, 0, 0, 1000, U16_, Par_R, Par_Public, FLAGS_NONE)
+DefPar_Ram(TcpClients, 2014, 0, 0, 16, U16_, Par_R, Par_Public, FLAGS_NONE)
+DefPar_Ram(MdbPollOk, 2020, 0, 0, UINT16_MAX, U16_, Par_R, Par_Public, FLAGS_NONE)
+DefPar_Ram(MdbPollError, 2021, 0, 0, UINT16_MAX, U16_, Par_R, Par_Public, FLAGS_NONE)
+/*bloky diagnostiky Modbus (FC8 pocitadla, funkce, vyjimky, histogram latence), MDB_DIAG_REGS registru*/
+DefPar_Fun(MdbDiagRtu, 2100, 0, 0, 0, U16_, Par_R, Par_Public, FLAGS_NONE, mdbdiag_rtu_reg)
+DefPar_Fun(MdbDiagTcp, 2140, 0, 0, 0, U16_, Par_R, Par_Public, FLAGS_NONE, mdbdiag_tcp_reg)
 
 #endif /*PAR_DEF_INCLUDES*/
 
@@ -25,6 +25,14 @@
 #include <mutex>
 #include "common.h"
 #include "ArduinoJson.h"
+#include "nvs.h"
+#include "chart_series.h"
+#include "chart_stream.h"
+#include "modbus_diag.h"
+#include "par_index.h"
+#include <type_traits>
+
+#define STRING_REG_MAX_LEN 64 /*max. delka retezce STRING registru*/
 
 typedef enum
 {
@@ -59,6 +67,32 @@ typedef struct
 	const char *ptxt;
 } pardef_t;
 
+class Register;
+
+/*callback volany po efektivni zmene hodnoty, v kontextu tasku ktery hodnotu zapsal*/
+typedef void (*ParObserver_t)(Register &reg, void *arg);
+
+typedef struct
+{
+	Register *reg;	  /*observed parameter, NULL for all parameters*/
+	ParObserver_t cb; /*called after effective Set*/
+	void *arg;		  /*user argument of callback*/
+} parsub_t;
+
+//*****************************************************************************
+//! state of one caller's access to multi-register values (S32, STRING)
+//*****************************************************************************
+class RegCursor
+{
+public:
+	Register *reg;						/*register the held value belongs to*/
+	int32_t val;						/*snapshot of S32 value or pending high word*/
+	size_t len;							/*length of held string*/
+	char str[STRING_REG_MAX_LEN + 1]; /*snapshot of string value or pending string*/
+
+	RegCursor() : reg(NULL), val(0), len(0) { str[0] = '\0'; }
+};
+
 //*****************************************************************************
 //! base class of parameter- register
 //*****************************************************************************
@@ -66,23 +100,54 @@ class Register
 {
 protected:
 	static Register *const ParSet[];
-	static String writeString;
+	static regspan_t AdrMap[];
+	static uint16_t AdrMapCnt;
+	static void BuildAdrMap(void);
+	static uint16_t FindSpan(uint16_t adr);
+	static uint16_t NameMap[];
+	static uint16_t NameMapCnt;
+	static void BuildNameMap(void);
+	static const char *ParName(uint16_t idx);
+	static char NvKeys[][6];
+	static std::atomic<uint32_t> NvDirty[];
+	static std::atomic<uint32_t> NvDirtyTime;
+	static std::mutex NvMutex;
+	static void BuildNvKeys(void);
+	const char *NvKey(void) const;
+	void SetNvDirty(void);
+	static std::atomic<uint32_t> ChangeSeq;
+	static std::atomic<uint32_t> DevChangeSeq; /*poradi zmen registru mimo tabulku (prislusenstvi)*/
+	static std::atomic<uint32_t> ChangeJournal[];
+	std::atomic<uint32_t> seq;
+	bool IsTablePar(void) const;
+	void Changed(void);
+	static parsub_t Subs[];
+	static std::atomic<uint8_t> SubsCnt;
+	static std::mutex SubsMutex;
+	static bool AddSub(Register *reg, ParObserver_t cb, void *arg);
+	void Notify(void);
 
 public:
 	static uint8_t ActiveLevel;
-	static uint16_t ActiveRegAdr;
 	static Register *GetPar(uint16_t RAdr);
 	static Register *GetParByIdx(uint16_t idx);
-	static size_t ActiveIdx;
 	static const uint16_t NmrParameters;
 	static const pardef_t ParDef[];
 	const pardef_t &def;
-	Register(const pardef_t &pd) : def(pd) {}
+	Register(const pardef_t &pd) : def(pd), seq(0) {}
 	virtual bool CheckLimits(int32_t vl) { return vl >= def.min && vl <= def.max; }
-	static uint8_t ReadReg(int16_t *out, size_t adr);
-	static uint8_t WriteReg(int16_t out, size_t adr);
+	static uint8_t ReadReg(int16_t *out, size_t adr, RegCursor &cur);
+	static uint8_t WriteReg(int16_t out, size_t adr, RegCursor &cur);
+	static uint16_t ReadRange(uint16_t start, uint16_t count, int16_t *out);
+	static uint16_t WriteRange(uint16_t start, uint16_t count, const int16_t *inp);
+	static uint16_t CheckRange(uint16_t start, uint16_t count, bool write);
+	static bool CheckRangeVals(uint16_t start, uint16_t count, const int16_t *inp);
+	static uint16_t ReadDefaults(uint16_t start, uint16_t count, int16_t *out);
 	static Register *const ParameterSearch(const String &name);
+	static Register *const ParameterSearch(const char *name);
 	static bool JsonRead(const String &name, JsonObject doc);
+	static bool JsonReadIdx(uint16_t idx, JsonVariant json_val);
+	static uint32_t JsonReadChanges(uint32_t since, JsonObject doc, bool &full);
 	static bool JsonWrite(JsonPair pair);
 	static bool JsonWrite(const String &key, JsonVariant value);
 
@@ -90,6 +155,10 @@ public:
 	static bool IsWritable(size_t adr);
 	static bool IsReadable(size_t adr);
 	static void InitAll(void);
+	static void NvFlush(void);
+	static void NvTask(void);
+	static uint32_t GetVersion(void) { return ChangeSeq; }
+	static bool GetChanges(uint32_t since, uint32_t &version, uint16_t *idx, size_t &cnt);
 
 	int32_t getDefault(void)
 	{
@@ -106,11 +175,6 @@ public:
 		return def.min;
 	}
 
-	size_t getidx(void)
-	{
-		return (ActiveRegAdr - Register::ParDef[ActiveIdx].adr);
-	}
-
 	size_t getidx(uint16_t addr)
 	{
 		return (addr - def.adr);
@@ -132,14 +196,27 @@ public:
 	virtual uint8_t GetRegVal(int16_t *out) = 0;
 	virtual uint8_t SetRegVal(int16_t inp) = 0;
 
-	virtual uint8_t GetRegVal(int16_t *out, uint16_t addr) { return 0; }
-	virtual uint8_t SetRegVal(int16_t inp, uint16_t addr) { return 0; }
+	virtual uint8_t GetRegVal(int16_t *out, uint16_t addr, RegCursor &cur) { return this->GetRegVal(out); }
+	virtual uint8_t SetRegVal(int16_t inp, uint16_t addr, RegCursor &cur) { return this->SetRegVal(inp); }
+
+	/*souvisly blok slov jednoho parametru od adresy addr*/
+	virtual uint16_t GetRegVals(int16_t *out, uint16_t addr, uint16_t nmr);
+	virtual uint16_t SetRegVals(const int16_t *inp, uint16_t addr, uint16_t nmr);
+	virtual bool CheckRegVals(const int16_t *inp, uint16_t addr, uint16_t nmr) { return true; } /*zkouska zapisu bez zmeny hodnoty*/
 
 	virtual void GetJsonVal(JsonVariant json_val) {}
 	virtual bool SetJsonVal(JsonVariant json_val) { return false; }
 
 	virtual size_t GetSize(void) { return 1; } /*pocet okupovanych registru*/
 	virtual void ResetVal(void) = 0;
+	virtual bool SetDefault(void) { return false; } /*zapis vychozi hodnoty, false pokud ji parametr nema*/
+	virtual void StoreNv(nvs_handle_t nvh) {} /*zapis hodnoty do NVS pri NvFlush*/
+	virtual bool IsComputed(void) { return false; } /*hodnota se pocita pri cteni, neni v zurnalu zmen*/
+	uint32_t GetSeq(void) const { return seq; }
+
+	bool Subscribe(ParObserver_t cb, void *arg = NULL) { return AddSub(this, cb, arg); }
+	static bool SubscribeAll(ParObserver_t cb, void *arg = NULL) { return AddSub(NULL, cb, arg); }
+	static void NotifyTask(Register &reg, void *arg); /*observer waking task given as arg*/
 };
 
 //*****************************************************************************
@@ -156,10 +233,10 @@ public:
 	virtual bool Set(int32_t v);
 	uint8_t GetRegVal(int16_t *out);
 	uint8_t SetRegVal(int16_t inp);
-	virtual uint8_t GetRegVal(int16_t *out, uint16_t addr);
-	virtual uint8_t SetRegVal(int16_t inp, uint16_t addr);
+	bool CheckRegVals(const int16_t *inp, uint16_t addr, uint16_t nmr);
 	bool SetLimit(int32_t v);
 	void ResetVal(void);
+	bool SetDefault(void);
 
 	virtual void GetJsonVal(JsonVariant json_val)
 	{
@@ -242,9 +319,37 @@ public:
 		{
 			retval = true;
 			value = tmp;
+			Changed();
 		}
 		return retval;
 	}
+	/*atomicky inkrement pocitadla, po UINT16_MAX pokracuje od 0*/
+	void Inc(void)
+	{
+		IncQuiet();
+		Changed();
+	}
+	/*inkrement bez zapisu do zurnalu zmen a notifikace observeru, jen pro
+	  pocitadla menena s kazdym ramcem (ctou se periodicky)*/
+	void IncQuiet(void)
+	{
+		int32_t v = value.load();
+		while (!value.compare_exchange_weak(v, (v < UINT16_MAX) ? v + 1 : 0))
+		{
+		}
+	}
+	void Dec(void)
+	{
+		int32_t v = value.load();
+		while (v > 0)
+		{
+			if (value.compare_exchange_weak(v, v - 1))
+			{
+				Changed();
+				break;
+			}
+		}
+	}
 	operator const uint16_t()
 	{
 		return (uint16_t)value;
@@ -266,6 +371,7 @@ public:
 	uint16_reg_nv(const pardef_t &pd) : uint16_reg(pd) {}
 	bool Set(int32_t v);
 	void ResetVal(void);
+	void StoreNv(nvs_handle_t nvh);
 	operator const uint16_t()
 	{
 		return value;
@@ -287,6 +393,7 @@ public:
 	int16_reg_nv(const pardef_t &pd) : int16_reg(pd) {}
 	bool Set(int32_t v);
 	void ResetVal(void);
+	void StoreNv(nvs_handle_t nvh);
 	operator const int16_t()
 	{
 		return value;
@@ -306,7 +413,6 @@ class int32_reg : public Register
 {
 protected:
 	std::atomic<int32_t> value;
-	uint16_t tmp_high_reg;
 
 public:
 	int32_reg(const pardef_t &pd) : Register(pd) {}
@@ -315,10 +421,13 @@ public:
 	virtual bool Set(int32_t v);
 	uint8_t GetRegVal(int16_t *out);
 	uint8_t SetRegVal(int16_t inp);
-	virtual uint8_t GetRegVal(int16_t *out, uint16_t addr);
-	virtual uint8_t SetRegVal(int16_t inp, uint16_t addr);
+	virtual uint8_t GetRegVal(int16_t *out, uint16_t addr, RegCursor &cur);
+	virtual uint8_t SetRegVal(int16_t inp, uint16_t addr, RegCursor &cur);
+	virtual uint16_t GetRegVals(int16_t *out, uint16_t addr, uint16_t nmr);
+	bool CheckRegVals(const int16_t *inp, uint16_t addr, uint16_t nmr);
 	bool SetLimit(int32_t v);
 	void ResetVal(void);
+	bool SetDefault(void);
 
 	virtual void GetJsonVal(JsonVariant json_val)
 	{
@@ -368,6 +477,7 @@ public:
 	int32_reg_nv(const pardef_t &pd) : int32_reg(pd) {}
 	virtual bool Set(int32_t v);
 	void ResetVal(void);
+	void StoreNv(nvs_handle_t nvh);
 	operator const int32_t()
 	{
 		return value;
@@ -393,7 +503,10 @@ public:
 	size_t GetSize(void) { return ERR_HISTORY_CNT; }
 	uint8_t GetRegVal(int16_t *out);
 	uint8_t SetRegVal(int16_t inp);
+	virtual uint8_t GetRegVal(int16_t *out, uint16_t addr, RegCursor &cur);
+	virtual uint16_t GetRegVals(int16_t *out, uint16_t addr, uint16_t nmr);
 	void ResetVal(void);
+	void StoreNv(nvs_handle_t nvh);
 	void Set(ErrorState_t err);
 };
 
@@ -411,6 +524,7 @@ public:
 	}
 	uint8_t SetRegVal(int16_t inp) { return 0; }
 	void ResetVal(void){};
+	bool IsComputed(void) { return true; }
 	int16_t Get(void);
 
 	virtual void GetJsonVal(JsonVariant json_val)
@@ -426,6 +540,7 @@ class enc_reg : public Register
 {
 public:
 	enc_reg(const pardef_t &pd) : Register(pd) {}
+	bool IsComputed(void) { return true; }
 	int16_t Get(void);
 	uint8_t GetRegVal(int16_t *out);
 	uint8_t SetRegVal(int16_t inp);
@@ -444,36 +559,55 @@ public:
 class string_reg : public Register
 {
 protected:
-	std::mutex mutex;
-	String val;
-	String tmpString;
+	std::mutex mutex;			   /*serializes writers only*/
+	std::atomic<uint32_t> gen; /*generation of published buffer, buf[gen & 1]*/
+	char *buf[2];
+	size_t cap;
 	bool change;
 
+	bool Store(const char *txt);
+	string_reg(const pardef_t &pd, size_t capacity);
+
 public:
-	string_reg(const pardef_t &pd) : Register(pd) { val.reserve(def.max); }
+	string_reg(const pardef_t &pd) : string_reg(pd, std::min((size_t)((pd.max + 1) / 2) * 2, (size_t)STRING_REG_MAX_LEN) + 1) {}
+	~string_reg() { delete[] buf[0]; }
+	string_reg(const string_reg &) = delete;
+	string_reg &operator=(const string_reg &) = delete;
 	size_t GetSize(void) { return (def.max + 1) / 2; }
 	uint8_t GetRegVal(int16_t *out);
 	uint8_t SetRegVal(int16_t inp);
-	virtual uint8_t GetRegVal(int16_t *out, uint16_t addr);
-	virtual uint8_t SetRegVal(int16_t inp, uint16_t addr);
+	virtual uint8_t GetRegVal(int16_t *out, uint16_t addr, RegCursor &cur);
+	virtual uint8_t SetRegVal(int16_t inp, uint16_t addr, RegCursor &cur);
+	virtual uint16_t GetRegVals(int16_t *out, uint16_t addr, uint16_t nmr);
 	void ResetVal(void);
+	bool SetDefault(void);
 	bool ischange(void);
-	virtual bool Set(String &txt);
+	bool Set(String &txt) { return this->Set(txt.c_str()); }
 	virtual bool Set(const char *txt);
 	String Get(void);
+	size_t Get(char *out, size_t size);
+	template <size_t N>
+	size_t Get(char (&out)[N])
+	{
+		return Get(out, N);
+	}
+	bool Equals(const char *txt);
+	bool IsEmpty(void);
 
 	virtual void GetJsonVal(JsonVariant json_val)
 	{
-		json_val.set(this->Get());
+		char tmp[STRING_REG_MAX_LEN + 1];
+		Get(tmp);
+		json_val.set(tmp);
 	}
 
 	virtual bool SetJsonVal(JsonVariant json_val)
 	{
 		bool retval = false;
-		if (json_val.is<String>())
+		if (json_val.is<const char *>())
 		{
-			String tmp = json_val.as<String>();
-			if (tmp.length() < def.max)
+			const char *tmp = json_val.as<const char *>();
+			if (strlen(tmp) < def.max)
 			{
 				this->Set(tmp);
 				return true;
@@ -492,13 +626,23 @@ class string_reg_nv : public string_reg
 public:
 	string_reg_nv(const pardef_t &pd) : string_reg(pd) {}
 	void ResetVal(void);
-	virtual bool Set(String &txt);
-	virtual bool Set(const char *txt)
-	{
-		return string_reg::Set(txt);
-	}
+	void StoreNv(nvs_handle_t nvh);
+	using string_reg::Set;
+	bool Set(const char *txt);
 };
 
+#define IPV4_STR_LEN 16 /*"255.255.255.255" vcetne '\0'*/
+
+//*****************************************************************************
+//! Text form of IPv4 address into caller buffer, without heap String
+//*****************************************************************************
+static inline const char *Ipv4Str(uint32_t v, char (&out)[IPV4_STR_LEN])
+{
+	IPAddress ip(v);
+	snprintf(out, IPV4_STR_LEN, "%u.%u.%u.%u", ip[0], ip[1], ip[2], ip[3]);
+	return out;
+}
+
 //*****************************************************************************
 //! derived class of parameter type STRING - for storing IP address
 //*****************************************************************************
@@ -509,36 +653,35 @@ public:
 
 	void ResetVal(void)
 	{
-		IPAddress tmp((uint32_t)def.def);
-		val = tmp.toString();
+		char tmp[IPV4_STR_LEN];
+		Store(Ipv4Str((uint32_t)def.def, tmp));
+	}
+
+	bool SetDefault(void)
+	{
+		this->Set((uint32_t)def.def);
+		return true;
 	}
 
-	virtual bool Set(String &txt)
+	using string_reg::Set;
+	bool Set(const char *txt)
 	{
 		IPAddress tmp;
-		bool retval = tmp.fromString(txt);
-		if (retval)
-		{
-			String temp = tmp.toString();
-			retval = string_reg::Set(temp);
-		}
-		return retval;
+		return tmp.fromString(txt) && Set((uint32_t)tmp);
 	}
 
 	bool Set(uint32_t v)
 	{
-		IPAddress temp(v);
-		String tmpTxt = temp.toString();
-		return string_reg::Set(tmpTxt);
+		char tmp[IPV4_STR_LEN];
+		return string_reg::Set(Ipv4Str(v, tmp));
 	}
 
 	IPAddress GetIP()
 	{
+		char tmp[STRING_REG_MAX_LEN + 1];
 		IPAddress ip;
-		{
-			std::lock_guard<std::mutex> lock(mutex);
-			ip.fromString(val);
-		}
+		Get(tmp);
+		ip.fromString(tmp);
 		return ip;
 	}
 };
@@ -551,12 +694,17 @@ class ipv4_reg_nv : public string_reg_nv
 public:
 	ipv4_reg_nv(const pardef_t &pd) : string_reg_nv(pd) {}
 	void ResetVal(void);
-	bool Set(String &txt);
+	bool SetDefault(void)
+	{
+		this->Set((uint32_t)def.def);
+		return true;
+	}
+	using string_reg_nv::Set;
+	bool Set(const char *txt);
 	bool Set(uint32_t v)
 	{
-		IPAddress temp(v);
-		String tmpTxt = temp.toString();
-		return string_reg_nv::Set(tmpTxt);
+		char tmp[IPV4_STR_LEN];
+		return string_reg_nv::Set(Ipv4Str(v, tmp));
 	}
 	IPAddress GetIP();
 };
@@ -572,6 +720,8 @@ public:
 	}
 
 	uint8_t SetRegVal(int16_t inp);
+	bool CheckRegVals(const int16_t *inp, uint16_t addr, uint16_t nmr) { return true; } /*neplatna udalost se ignoruje*/
+	bool SetDefault(void) { return false; } /*udalost nema vychozi hodnotu*/
 
 	bool Set(int32_t v);
 };
@@ -588,6 +738,7 @@ public:
 
 uint8_t GetRegVal(int16_t *out);
 uint8_t SetRegVal(int16_t inp);
+bool IsComputed(void) { return true; }
 
 };
 
@@ -604,22 +755,27 @@ public:
 	void ResetVal(void)
 	{
 		t_val = 0;
-		val = "--:--";
+		Store("--:--");
+	}
+	bool SetDefault(void)
+	{
+		this->Set((time_t)def.def);
+		return true;
 	}
-	bool Set(String &txt)
+	using string_reg::Set;
+	bool Set(const char *txt)
 	{
-		bool retval = val.compareTo(txt);
+		bool retval = !Equals(txt);
 		if (retval)
 		{
 			struct tm tm = GetTime();
 
-			if (strptime(txt.c_str(), "%H:%M", &tm))
+			if (strptime(txt, "%H:%M", &tm))
 			{
 				if (tm.tm_hour < 24 && tm.tm_hour >= 0 && tm.tm_min >= 0 && tm.tm_min < 60)
 				{
 					t_val = mktime(&tm);
-					std::lock_guard<std::mutex> lock(mutex);
-					val = txt;
+					Store(txt);
 				}
 				else
 				{
@@ -628,11 +784,10 @@ public:
 			}
 			else
 			{
-				if (txt == "--:--")
+				if (strcmp(txt, "--:--") == 0)
 				{
 					t_val = 0;
-					std::lock_guard<std::mutex> lock(mutex);
-					val = txt;
+					Store(txt);
 					retval = true;
 				}
 				else
@@ -641,6 +796,10 @@ public:
 				}
 			}
 		}
+		if (retval)
+		{
+			Changed();
+		}
 		return retval;
 	}
 	bool Set(time_t v)
@@ -648,16 +807,14 @@ public:
 		t_val = v;
 		if (v == 0)
 		{
-			String tmp_str = "--:--";
-			return string_reg::Set(tmp_str);
+			return string_reg::Set("--:--");
 		}
 		char timeString[8];
 		struct tm tmp;
 		localtime_r(&v, &tmp);
 		strftime(timeString, 8, "%H:%M", &tmp);
-		String tmp_str = timeString;
 
-		return string_reg::Set(tmp_str);
+		return string_reg::Set(timeString);
 	}
 	time_t Get()
 	{
@@ -673,110 +830,162 @@ class time_reg_nv : public time_reg
 public:
 	time_reg_nv(const pardef_t &pd) : time_reg(pd) {}
 	void ResetVal(void);
-	bool Set(String &txt);
+	bool SetDefault(void)
+	{
+		this->Set((time_t)def.def);
+		return true;
+	}
+	void StoreNv(nvs_handle_t nvh);
+	using time_reg::Set;
+	bool Set(const char *txt);
 	bool Set(time_t v);
 };
 
 //*****************************************************************************
-//! Template class for recording chart data
+//! Read only block of Modbus diagnostic counters, see ModbusDiag
 //*****************************************************************************
-template <typename T = int16_t>
-class chart_reg : public Register
+class mdbdiag_reg : public Register
+{
+protected:
+	ModbusDiag &diag;
+
+public:
+	mdbdiag_reg(const pardef_t &pd, ModbusDiag &d) : Register(pd), diag(d) {}
+	size_t GetSize(void) { return MDB_DIAG_REGS; }
+	uint8_t GetRegVal(int16_t *out);
+	uint8_t SetRegVal(int16_t inp) { return 0; }
+	uint8_t GetRegVal(int16_t *out, uint16_t addr, RegCursor &cur);
+	uint16_t GetRegVals(int16_t *out, uint16_t addr, uint16_t nmr);
+	void GetJsonVal(JsonVariant json_val);
+	void ResetVal(void) {}
+	bool IsComputed(void) { return true; }
+};
+
+class mdbdiag_rtu_reg : public mdbdiag_reg
+{
+public:
+	mdbdiag_rtu_reg(const pardef_t &pd) : mdbdiag_reg(pd, ModbusDiag::Rtu) {}
+};
+
+class mdbdiag_tcp_reg : public mdbdiag_reg
+{
+public:
+	mdbdiag_tcp_reg(const pardef_t &pd) : mdbdiag_reg(pd, ModbusDiag::Tcp) {}
+};
+
+class chart_base;
+
+//*****************************************************************************
+//! Chart JSON serialized in chunks directly into response buffer, samples
+//! are read from the raw series of the chart parameter
+//*****************************************************************************
+class chart_stream : public ChartStream
+{
+protected:
+	chart_base *chart;
+	chartcursor_t cur;
+
+	uint16_t ReadBlock(int32_t *out, uint16_t n);
+	void Text(bool suffix, char *txt, size_t len);
+
+	friend class chart_base;
+};
+
+//*****************************************************************************
+//! Base class of chart parameters, samples are stored in multi-resolution
+//! series which can be persisted to storage partition
+//*****************************************************************************
+class chart_base : public Register
 {
 protected:
-	size_t maxSamples;
-	size_t nmrSamples;
-	size_t headIdx;
-	size_t tailIdx;
-	T *valBuf;
-	size_t newSamples;
+	ChartSeries series;
 	std::mutex mutex;
 
+	uint16_t ReadSamples(chartcursor_t &cur, int32_t *out, uint16_t n);
+	void GetJsonSamples(JsonArray arr);
+	void GetJsonReduced(JsonObject obj, uint16_t points, chartreduce_t mode);
+	virtual void JsonStreamText(bool suffix, char *txt, size_t len);
+
+	friend class chart_stream;
+
 public:
-	chart_reg(const pardef_t &pd) : Register(pd)
+	chart_base(const pardef_t &pd, bool sgn) : Register(pd), series(sgn) {}
+
+	void Open(uint16_t rawSamples, uint32_t rawPeriod, const char *fname)
 	{
-		maxSamples = 0;
-		nmrSamples = 0;
-		headIdx = 0;
-		tailIdx = 0;
-		newSamples = 0;
+		std::lock_guard<std::mutex> lock(mutex);
+		series.Init(rawSamples, rawPeriod);
+		series.Open(fname);
 	}
 
-	~chart_reg()
+	void Save(void)
 	{
-		if (maxSamples > 0)
-		{
-			delete[] valBuf;
-		}
+		std::lock_guard<std::mutex> lock(mutex);
+		series.Save();
 	}
 
-	void SetSize(uint16_t sz)
+	void Remove(void)
 	{
 		std::lock_guard<std::mutex> lock(mutex);
-		if (maxSamples > 0)
-		{
-			delete[] valBuf;
-		}
-		if (sz > 0)
-		{
-			valBuf = new T[sz];
-			maxSamples = sz;
-			nmrSamples = 0;
-			headIdx = 0;
-			tailIdx = 0;
-			this->ResetVal();
-		}
-		else
-		{
-			nmrSamples = 0;
-			headIdx = 0;
-			tailIdx = 0;
-		}
+		series.Remove();
 	}
 
-	T Get(void)
+	void Query(const chartquery_t &q, JsonObject obj)
 	{
 		std::lock_guard<std::mutex> lock(mutex);
+		series.Query(q, obj);
+	}
 
-		return valBuf[tailIdx];
+	virtual void GetJsonValReduced(JsonVariant json_val, uint16_t points, chartreduce_t mode)
+	{
+		GetJsonReduced(json_val.to<JsonObject>(), points, mode);
 	}
 
-	bool Set(T val)
+	static bool IsChart(const pardef_t &pd)
 	{
-		bool retval = false;
+		return (pd.atr & CHART_FLAG) != 0;
+	}
+
+	void JsonStreamBegin(chart_stream &st);
+};
+
+//*****************************************************************************
+//! Template class for recording chart data
+//*****************************************************************************
+template <typename T = int16_t>
+class chart_reg : public chart_base
+{
+public:
+	chart_reg(const pardef_t &pd) : chart_base(pd, std::is_signed<T>::value) {}
 
+	void SetSize(uint16_t sz)
+	{
 		std::lock_guard<std::mutex> lock(mutex);
+		series.Init(sz, series.RawPeriod());
+	}
 
-		valBuf[headIdx] = val;
-		headIdx++;
-		retval = true;
+	T Get(void)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		int32_t v = series.Last();
+		return (v == CHART_NO_DATA) ? (T)def.def : (T)v;
+	}
 
-		if (headIdx >= maxSamples)
-		{
-			headIdx = 0;
-			if (tailIdx == 0)
-			{
-				tailIdx++;
-			}
-		}
-		if (tailIdx == headIdx)
+	bool Set(T val, time_t t)
+	{
 		{
-			if (tailIdx == (maxSamples - 1))
-			{
-				tailIdx = 0;
-			}
-			else
-			{
-				tailIdx++;
-			}
+			std::lock_guard<std::mutex> lock(mutex);
+			series.Add(val, t);
 		}
+		this->Changed();
+		return true;
+	}
 
-		if (nmrSamples < maxSamples)
-		{
-			nmrSamples++;
-		}
-		return retval;
+	bool Set(T val)
+	{
+		return Set(val, Now());
 	}
+
 	bool SetLimit(T newVal)
 	{
 		if (newVal > def.max)
@@ -787,48 +996,18 @@ public:
 		{
 			newVal = def.min;
 		}
-
-		bool retval = this->Set(newVal);
-		if (retval)
-		{
-			if (newSamples < maxSamples)
-			{
-				newSamples++;
-			}
-		}
-		return retval;
+		return this->Set(newVal);
 	}
 
 	virtual void GetJsonVal(JsonVariant json_val)
 	{
-		std::lock_guard<std::mutex> lock(mutex);
-
-		JsonArray arr = json_val.to<JsonArray>();
-		size_t index = headIdx;
-		for (int i = 0; i < nmrSamples; i++)
-		{
-			if (index == 0)
-			{
-				index = maxSamples - 1;
-			}
-			else
-			{
-				index--;
-			}
-			arr.add(valBuf[index]);
-			if (nmrSamples == 1)
-			{
-				arr.add(valBuf[index]);
-			}
-		}
+		GetJsonSamples(json_val.to<JsonArray>());
 	}
 
 	virtual void ResetVal(void)
 	{
-		for (int i = 0; i < maxSamples; i++)
-		{
-			valBuf[i] = def.def;
-		}
+		std::lock_guard<std::mutex> lock(mutex);
+		series.Clear();
 	}
 
 	virtual uint8_t GetRegVal(int16_t *out)
@@ -856,10 +1035,10 @@ protected:
 public:
 	chart_reg_dev(const pardef_t &pd) : chart_reg<T>(pd), lastVal(pd.def), lastUpdateTime(0)
 	{
-		this->SetSize(pd.max);
+		this->series.Init(pd.max, pd.min * 60);
 	}
 
-	virtual uint8_t SetRegVal(int16_t inp, uint16_t addr)
+	virtual uint8_t SetRegVal(int16_t inp, uint16_t addr, RegCursor &cur)
 	{
 
 		lastVal = (T)inp;
@@ -877,15 +1056,11 @@ public:
 			else
 			{
 				unsigned long elapsed = currentTime - lastUpdateTime;
-				int intervalsPassed = elapsed / interval;
-
-				for (int i = 0; i < intervalsPassed; ++i)
-				{
-					this->Set(lastVal);
-				}
+				unsigned long intervalsPassed = elapsed / interval;
 
 				if (intervalsPassed > 0)
-				{
+				{ /*jeden vzorek s aktualnim casem, zmeskane intervaly doplni serie jako chybejici*/
+					this->Set(lastVal, Now());
 					lastUpdateTime += intervalsPassed * interval;
 				}
 			}
@@ -895,30 +1070,32 @@ public:
 
 	virtual void GetJsonVal(JsonVariant json_val)
 	{
-		std::lock_guard<std::mutex> lock(this->mutex);
+		JsonObject obj = json_val.to<JsonObject>();
+		this->GetJsonSamples(obj["vals"].to<JsonArray>());
+		obj["curr"] = lastVal;
+		obj["mins"] = this->def.min;
+	}
 
+	virtual void GetJsonValReduced(JsonVariant json_val, uint16_t points, chartreduce_t mode)
+	{
 		JsonObject obj = json_val.to<JsonObject>();
-		JsonArray arr = obj["vals"].to<JsonArray>();
-		size_t index = this->headIdx;
-		for (int i = 0; i < this->nmrSamples; i++)
-		{
-			if (index == 0)
-			{
-				index = this->maxSamples - 1;
-			}
-			else
-			{
-				index--;
-			}
-			arr.add(this->valBuf[index]);
-			if (this->nmrSamples == 1)
-			{
-				arr.add(this->valBuf[index]);
-			}
-		}
+		this->GetJsonReduced(obj, points, mode);
 		obj["curr"] = lastVal;
 		obj["mins"] = this->def.min;
 	}
+
+protected:
+	virtual void JsonStreamText(bool suffix, char *txt, size_t len)
+	{
+		if (suffix)
+		{
+			snprintf(txt, len, "],\"curr\":%d,\"mins\":%d}", (int)lastVal, (int)this->def.min);
+		}
+		else
+		{
+			snprintf(txt, len, "{\"vals\":[");
+		}
+	}
 };
 
 //*****************************************************************************
@@ -929,5 +1106,6 @@ class pwd_reg : public int16_reg
 public:
 	pwd_reg(const pardef_t &pd) : int16_reg(pd){};
 	bool Set(int32_t v);
+	bool SetDefault(void) { return false; } /*zapis hesla meni uroven pristupu*/
 	bool CheckLimits(int32_t vl);
-};
\ No newline at end of file
+};
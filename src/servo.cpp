@@ -12,6 +12,7 @@
 #include "servo.h"
 #include "pin_map.h"
 #include "parameters.h"
+#include "log.h"
 
 #define R_UP 10.0f
 #define VCC 3280.0f
@@ -245,11 +246,38 @@ void Servo::Init(void)
 	sensor.Init();
 	InitMotorCtrl();
 	sensor.SensorPwr(true);
-	PidSpeed.Setparam(PIDRychlostP.Get(), PIDRychlostI.Get());
 	PidSpeed.Outrange(-MAX_SPEED_CONST, MAX_SPEED_CONST, -45, 50);
+	ApplyCtrlParams();
+
+	static bool subscribed = false;
+	if (!subscribed)
+	{
+		subscribed = true;
+		bool ok = PIDRychlostP.Subscribe(OnCtrlParChanged, this);
+		ok &= PIDRychlostI.Subscribe(OnCtrlParChanged, this);
+		ok &= PIDPolohaP.Subscribe(OnCtrlParChanged, this);
+		ok &= MaxRychlost.Subscribe(OnCtrlParChanged, this);
+		ok &= MinRychlost.Subscribe(OnCtrlParChanged, this);
+		if (!ok)
+		{
+			pollParams = true;
+			SystemLog::PutLog("Servo: odber zmen parametru selhal, parametry se ctou v kazdem cyklu", v_error);
+		}
+	}
+	MotorPWR(true);
+}
+
+void Servo::ApplyCtrlParams(void)
+{
+	paramsChanged = false;
+	PidSpeed.Setparam(PIDRychlostP.Get(), PIDRychlostI.Get());
 	PidPosition.Setparam(PIDPolohaP.Get(), 0);
 	PidPosition.Outrange(-MaxRychlost.Get(), MaxRychlost.Get(), -MinRychlost.Get(), MinRychlost.Get());
-	MotorPWR(true);
+}
+
+void Servo::OnCtrlParChanged(Register &reg, void *arg)
+{
+	((Servo *)arg)->paramsChanged = true;
 }
 
 void Servo::MotorPWR(bool enable)
@@ -259,9 +287,10 @@ void Servo::MotorPWR(bool enable)
 
 void Servo::Ctrl(void)
 {
-	PidPosition.Setparam(PIDPolohaP.Get(), 0);
-	PidSpeed.Setparam(PIDRychlostP.Get(), PIDRychlostI.Get());
-	PidPosition.Outrange(-MaxRychlost.Get(), MaxRychlost.Get(), -MinRychlost.Get(), MinRychlost.Get());
+	if (paramsChanged || pollParams)
+	{
+		ApplyCtrlParams();
+	}
 
 	PositionCtrl();
 	SpeedCtrl();
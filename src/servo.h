@@ -107,13 +107,17 @@ private:
 	Encoder &sensor;
 
 	bool isStopped;
+	std::atomic<bool> paramsChanged; /*zmena PID konstant nebo limitu rychlosti*/
+	bool pollParams;				 /*odber zmen se nepodaril, parametry se nacitaji v kazdem cyklu*/
 
 	void InitMotorCtrl(void);
+	void ApplyCtrlParams(void);
+	static void OnCtrlParChanged(Register &reg, void *arg);
 
 public:
 	std::atomic<int16_t> speedCtrlPWM;
 
-	Servo(Motor &mot, Encoder &enc) : motor(mot), sensor(enc), current(16), temp_mv(8){};
+	Servo(Motor &mot, Encoder &enc) : motor(mot), sensor(enc), current(16), temp_mv(8), paramsChanged(false), pollParams(false){};
 
 	void IsOverCurrentUp(int16_t current_ma);
 	void IsOverCurrentDown(int16_t current_ma);
@@ -20,6 +20,7 @@
 #include <Update.h>
 #include <ESPmDNS.h>
 #include "device_manager.h"
+#include "param_snapshot.h"
 
 DNSServer WebServer::dnsServer;
 AsyncWebServer WebServer::server(80);
@@ -53,6 +54,13 @@ const char WebRescue[] PROGMEM =
 
     "</body></html>";
 
+bool isMdnsHost(const String &host)
+{
+    char hostname[STRING_REG_MAX_LEN + 1];
+    size_t len = WiFihostname.Get(hostname);
+    return (host.length() == len + 6) && (strncasecmp(host.c_str(), hostname, len) == 0) && (strcasecmp(host.c_str() + len, ".local") == 0);
+}
+
 bool isIpAddress(String str)
 {
     int numDots = 0;
@@ -112,21 +120,195 @@ void WebServer::InitDNSServer()
               { request->redirect(LOCAL_IP_URL); });
 }
 
+//*****************************************************************************
+//! Requested reduction of chart samples: [points] max. count of points,
+//! [reduce] lttb (default) or minmax, returns 0 when no reduction is wanted
+//*****************************************************************************
+static uint16_t ChartPoints(AsyncWebServerRequest *request, chartreduce_t &mode)
+{
+    AsyncWebParameter *pPoints = request->getParam("points");
+    AsyncWebParameter *pReduce = request->getParam("reduce");
+    mode = ChartReduce::Parse((pReduce != NULL) ? pReduce->value().c_str() : NULL);
+    return (pPoints != NULL) ? (uint16_t)std::min(strtoul(pPoints->value().c_str(), NULL, 10), 0xFFFFUL) : 0;
+}
+
+static bool IsChartOption(const String &name)
+{
+    return (name == "points") || (name == "reduce");
+}
+
+//*****************************************************************************
+//! State of chunked get_params response, chart parameters are streamed
+//! straight from their ring buffer, others are serialized one by one
+//*****************************************************************************
+typedef struct
+{
+    std::vector<uint16_t> idx;
+    uint16_t points;
+    chartreduce_t mode;
+    size_t next;
+    String text;
+    size_t textPos;
+    chart_base *chart;
+    chart_stream chartSt;
+    bool closed;
+} ParamsStream_t;
+
+static size_t ParamsStreamRead(ParamsStream_t &st, uint8_t *buf, size_t maxLen)
+{
+    size_t out = 0;
+    while (out < maxLen)
+    {
+        if (st.textPos < st.text.length())
+        {
+            size_t n = std::min(maxLen - out, st.text.length() - st.textPos);
+            memcpy(buf + out, st.text.c_str() + st.textPos, n);
+            st.textPos += n;
+            out += n;
+        }
+        else if (st.chart != NULL)
+        {
+            out += st.chartSt.Read((char *)buf + out, maxLen - out);
+            if (st.chartSt.Done())
+            {
+                st.chart = NULL;
+            }
+        }
+        else if (st.next < st.idx.size())
+        {
+            uint16_t i = st.idx[st.next];
+            Register *reg = Register::GetParByIdx(i);
+            st.text = String((st.next == 0) ? "{\"" : ",\"") + Register::ParDef[i].ptxt + "\":";
+            st.textPos = 0;
+            if (chart_base::IsChart(reg->def) && (st.points == 0))
+            {
+                st.chart = static_cast<chart_base *>(reg);
+                st.chart->JsonStreamBegin(st.chartSt);
+            }
+            else
+            { /*redukovany graf ma jen nekolik bodu, serializuje se cely*/
+                JsonDocument doc;
+                String val;
+                if (chart_base::IsChart(reg->def))
+                {
+                    static_cast<chart_base *>(reg)->GetJsonValReduced(doc.to<JsonVariant>(), st.points, st.mode);
+                }
+                else
+                {
+                    Register::JsonReadIdx(i, doc.to<JsonVariant>());
+                }
+                serializeJson(doc, val);
+                st.text += val;
+            }
+            st.next++;
+        }
+        else if (!st.closed)
+        {
+            st.text = st.idx.empty() ? "{}" : "}";
+            st.textPos = 0;
+            st.closed = true;
+        }
+        else
+        {
+            break;
+        }
+    }
+    return out;
+}
+
 void WebServer::GetParamsHandler(AsyncWebServerRequest *request)
 {
-    int paramsNr = request->params();
-    AsyncJsonResponse *response = new AsyncJsonResponse(false);
-    JsonObject root = response->getRoot();
+    std::shared_ptr<ParamsStream_t> st = std::make_shared<ParamsStream_t>();
+    st->next = 0;
+    st->textPos = 0;
+    st->chart = NULL;
+    st->closed = false;
+    st->points = ChartPoints(request, st->mode);
 
+    int paramsNr = request->params();
     for (int i = 0; i < paramsNr; i++)
     {
         AsyncWebParameter *par = request->getParam(i);
-        if (par)
+        Register *reg = (par != NULL) ? Register::ParameterSearch(par->name()) : NULL;
+        if ((reg != NULL) && reg->IsReadable())
         {
-            Register::JsonRead(par->name(), root);
+            st->idx.push_back(&reg->def - Register::ParDef);
         }
     }
 
+    AsyncWebServerResponse *response = request->beginChunkedResponse("application/json", [st](uint8_t *buffer, size_t maxLen, size_t index) -> size_t
+                                                                     { return ParamsStreamRead(*st, buffer, maxLen); });
+    request->send(response);
+}
+
+void WebServer::GetChangesHandler(AsyncWebServerRequest *request)
+{
+    uint32_t since = 0;
+    AsyncWebParameter *p = request->getParam("since");
+    if (p != NULL)
+    {
+        since = strtoul(p->value().c_str(), NULL, 10);
+    }
+
+    AsyncJsonResponse *response = new AsyncJsonResponse(false, &allocator);
+    JsonObject root = response->getRoot();
+    bool full;
+    uint32_t version = Register::JsonReadChanges(since, root["vals"].to<JsonObject>(), full);
+    root["ver"] = version;
+    root["full"] = full;
+
+    response->setLength();
+    request->send(response);
+}
+
+//*****************************************************************************
+//! Chart query: name, [id] of device, [res] raw/hour/day, [from], [to] unix
+//! time, without 'from' last 24 hours are returned
+//*****************************************************************************
+void WebServer::GetChartHandler(AsyncWebServerRequest *request)
+{
+    AsyncWebParameter *p = request->getParam("name");
+    if (p == NULL)
+    {
+        request->send(400, "text/plain", "Chart name is missing");
+        return;
+    }
+    String name = p->value();
+
+    AsyncWebParameter *pRes = request->getParam("res");
+    AsyncWebParameter *pFrom = request->getParam("from");
+    AsyncWebParameter *pTo = request->getParam("to");
+    chartquery_t q;
+    q.res = ChartSeries::ParseRes((pRes != NULL) ? pRes->value().c_str() : NULL);
+    q.to = (pTo != NULL) ? (time_t)strtoul(pTo->value().c_str(), NULL, 10) : 0;
+    q.from = (pFrom != NULL) ? (time_t)strtoul(pFrom->value().c_str(), NULL, 10) : (Now() - 24 * 3600);
+    q.points = ChartPoints(request, q.mode);
+
+    AsyncJsonResponse *response = new AsyncJsonResponse(false, &allocator);
+    JsonObject root = response->getRoot();
+    bool found = false;
+
+    AsyncWebParameter *pId = request->getParam("id");
+    if (pId != NULL)
+    {
+        found = DeviceManager::GetDeviceChart(atoi(pId->value().c_str()), name, q, root);
+    }
+    else
+    {
+        Register *reg = Register::ParameterSearch(name);
+        if ((reg != NULL) && chart_base::IsChart(reg->def) && reg->IsReadable())
+        {
+            static_cast<chart_base *>(reg)->Query(q, root);
+            found = true;
+        }
+    }
+
+    if (!found)
+    {
+        delete response;
+        request->send(404, "text/plain", "Chart not found");
+        return;
+    }
     response->setLength();
     request->send(response);
 }
@@ -183,6 +365,9 @@ void WebServer::GetDeviceParamsHandler(AsyncWebServerRequest *request)
     }
     int deviceId = atoi(p->value().c_str());
 
+    chartreduce_t mode;
+    uint16_t points = ChartPoints(request, mode);
+
     int paramsNr = request->params();
     AsyncJsonResponse *response = new AsyncJsonResponse(false);
     JsonObject root = response->getRoot();
@@ -190,9 +375,9 @@ void WebServer::GetDeviceParamsHandler(AsyncWebServerRequest *request)
     for (int i = 0; i < paramsNr; i++)
     {
         AsyncWebParameter *par = request->getParam(i);
-        if (par && par->name() != "id")
+        if (par && par->name() != "id" && !IsChartOption(par->name()))
         {
-            DeviceManager::GetDeviceParameter(deviceId, par->name(), root);
+            DeviceManager::GetDeviceParameter(deviceId, par->name(), root, points, mode);
         }
     }
 
@@ -454,9 +639,128 @@ void WebServer::DeviceFWUpdateHandler(AsyncWebServerRequest *request, const Stri
     }
 }
 
+//*****************************************************************************
+//! Snapshot is built once when the export starts, chunks are copied from it,
+//! buffer is freed together with the response
+//*****************************************************************************
+void WebServer::ConfigExportHandler(AsyncWebServerRequest *request)
+{
+    size_t size = ParamSnapshot::Size();
+    std::shared_ptr<uint8_t> snap((uint8_t *)ps_malloc(size), free);
+    if (!snap || (ParamSnapshot::Build(snap.get(), size) != size))
+    {
+        request->send(500, "text/plain", "Not enough memory");
+        return;
+    }
+
+    AsyncWebServerResponse *response = request->beginResponse("application/octet-stream", size, [snap, size](uint8_t *buffer, size_t maxLen, size_t index) -> size_t
+                                                              {
+                                                                  size_t n = (index < size) ? std::min(maxLen, size - index) : 0;
+                                                                  memcpy(buffer, snap.get() + index, n);
+                                                                  return n; });
+    response->addHeader("Content-Disposition", "attachment; filename=\"config.bin\"");
+    request->send(response);
+}
+
+//*****************************************************************************
+//! Upload of configuration failed in earlier chunk, response is already sent.
+//! Mark is malloc'ed, destructor of request frees _tempObject.
+//*****************************************************************************
+static bool ConfigUploadFailed(AsyncWebServerRequest *request)
+{
+    return request->_tempObject != NULL;
+}
+
+static void ConfigUploadFail(AsyncWebServerRequest *request, const char *msg)
+{
+    request->_tempObject = malloc(1);
+    request->send(400, "text/plain", msg);
+}
+
+//*****************************************************************************
+//! Chunk of uploaded configuration, returns false when upload is not going on
+//*****************************************************************************
+static bool ConfigUploadChunk(AsyncWebServerRequest *request, size_t index, uint8_t *data, size_t len)
+{
+    if (ConfigUploadFailed(request))
+    {
+        return false;
+    }
+
+    if (!index && !ParamSnapshot::ReceiveBegin(request->contentLength()))
+    {
+        ConfigUploadFail(request, "Invalid configuration size");
+        return false;
+    }
+
+    if (!ParamSnapshot::ReceiveWrite(index, data, len))
+    {
+        ParamSnapshot::ReceiveEnd();
+        ConfigUploadFail(request, "Error occured during upload");
+        return false;
+    }
+    return true;
+}
+
+void WebServer::ConfigImportHandler(AsyncWebServerRequest *request, const String &filename, size_t index, uint8_t *data, size_t len, bool final)
+{
+    if (!ConfigUploadChunk(request, index, data, len))
+    {
+        return;
+    }
+
+    if (final)
+    {
+        int applied = ParamSnapshot::Import();
+        ParamSnapshot::ReceiveEnd();
+        if (applied == SNAPSHOT_OTHER_TABLE)
+        {
+            request->send(409, "text/plain", "Configuration of different parameter table");
+            return;
+        }
+        if (applied < 0)
+        {
+            request->send(400, "text/plain", "Invalid configuration file");
+            return;
+        }
+        SystemLog::PutLog("Import konfigurace, zmeneno parametru: " + String(applied), v_info);
+
+        AsyncJsonResponse *response = new AsyncJsonResponse(false);
+        response->getRoot()["applied"] = applied;
+        response->setLength();
+        request->send(response);
+    }
+}
+
+void WebServer::ConfigDiffHandler(AsyncWebServerRequest *request, const String &filename, size_t index, uint8_t *data, size_t len, bool final)
+{
+    if (!ConfigUploadChunk(request, index, data, len))
+    {
+        return;
+    }
+
+    if (final)
+    {
+        AsyncJsonResponse *response = new AsyncJsonResponse(false, &allocator);
+        JsonObject root = response->getRoot();
+        bool sameTable = false;
+        int cnt = ParamSnapshot::DiffReceived(root["diff"].to<JsonArray>(), sameTable);
+        ParamSnapshot::ReceiveEnd();
+        if (cnt < 0)
+        {
+            delete response;
+            request->send(400, "text/plain", "Invalid configuration file");
+            return;
+        }
+        root["sameTable"] = sameTable;
+        response->setLength();
+        request->send(response);
+    }
+}
+
 bool WebServer::redirectmDNS(AsyncWebServerRequest *request)
 {
-    if (request->host().equalsIgnoreCase(WiFihostname.Get() + ".local"))
+    if (isMdnsHost(request->host()))
     {
         IPAddress localIP;
         if (request->client()->localIP() == WiFi.softAPIP())
@@ -503,6 +807,10 @@ void WebServer::Init(bool useCaptivePortal)
 
     server.on("/api/get_params", HTTP_GET, GetParamsHandler);
 
+    server.on("/api/get_changes", HTTP_GET, GetChangesHandler);
+
+    server.on("/api/get_chart", HTTP_GET, GetChartHandler);
+
     server.addHandler(new AsyncCallbackJsonWebHandler(
         "/api/set_params", SetParamsHandler));
 
@@ -549,6 +857,22 @@ void WebServer::Init(bool useCaptivePortal)
         [](AsyncWebServerRequest *request, const String &filename, size_t index, uint8_t *data, size_t len, bool final)
         { DeviceFWUpdateHandler(request, filename, index, data, len, final); });
 
+    server.on("/api/config_export", HTTP_GET, ConfigExportHandler);
+
+    server.on(
+        "/api/config_import", HTTP_POST,
+        [](AsyncWebServerRequest *request) {
+        },
+        [](AsyncWebServerRequest *request, const String &filename, size_t index, uint8_t *data, size_t len, bool final)
+        { ConfigImportHandler(request, filename, index, data, len, final); });
+
+    server.on(
+        "/api/config_diff", HTTP_POST,
+        [](AsyncWebServerRequest *request) {
+        },
+        [](AsyncWebServerRequest *request, const String &filename, size_t index, uint8_t *data, size_t len, bool final)
+        { ConfigDiffHandler(request, filename, index, data, len, final); });
+
     server.on("/rescue", HTTP_GET, [](AsyncWebServerRequest *request)
               { request->send_P(200, "text/html", WebRescue); });
 
@@ -560,7 +884,7 @@ void WebServer::Init(bool useCaptivePortal)
     server.onNotFound([](AsyncWebServerRequest *request)
                       {
 
-  if (captivePortal && !isIpAddress(request->host()) && !request->host().equalsIgnoreCase(WiFihostname.Get()+".local")) {
+  if (captivePortal && !isIpAddress(request->host()) && !isMdnsHost(request->host())) {
         request->redirect(String("http://") + request->client()->localIP().toString());
         return;
   }
@@ -35,6 +35,8 @@ static void InitDNSServer(void);
 
 static bool redirectmDNS(AsyncWebServerRequest *request);
 static void GetParamsHandler(AsyncWebServerRequest *request);
+static void GetChangesHandler(AsyncWebServerRequest *request);
+static void GetChartHandler(AsyncWebServerRequest *request);
 static void SetParamsHandler(AsyncWebServerRequest *request, JsonVariant &json);
 static void GetSystemLogHandler(AsyncWebServerRequest *request);
 static void GetDevicesHandler(AsyncWebServerRequest *request);
@@ -47,6 +49,9 @@ static void FWUpdateHandler(AsyncWebServerRequest *request, const String &filena
 static void FSUpdateHandler(AsyncWebServerRequest *request, const String &filename, size_t index, uint8_t *data, size_t len, bool final);
 static void DeviceFWUpdateHandler(AsyncWebServerRequest *request, const String &filename, size_t index, uint8_t *data, size_t len, bool final);
 static void PairDeviceHandler(AsyncWebServerRequest *request, JsonVariant &json);
+static void ConfigExportHandler(AsyncWebServerRequest *request);
+static void ConfigImportHandler(AsyncWebServerRequest *request, const String &filename, size_t index, uint8_t *data, size_t len, bool final);
+static void ConfigDiffHandler(AsyncWebServerRequest *request, const String &filename, size_t index, uint8_t *data, size_t len, bool final);
 static void DeleteDeviceHandler(AsyncWebServerRequest *request);
 static void GetDeviceSystemLogHandler(AsyncWebServerRequest *request);
 
@@ -151,7 +151,7 @@ void WiFiCtrl::Task(void)
     }
     if (WiFiSTAOn.Get())
     {
-        if ((WiFiStatus.Get() == wifi_vypnuto) && !WiFiSSID.Get().isEmpty())
+        if ((WiFiStatus.Get() == wifi_vypnuto) && !WiFiSSID.IsEmpty())
         {
             WiFiStatus.Set(wifi_pripojovani);
 
@@ -0,0 +1,109 @@
+/***********************************************************************
+ * Filename: mdb_mem_dll.h
+ * Author: agent
+ * Date: 2026-10-17
+ * Description:
+ *     In-memory ModbusDll for unit tests. The test puts a request PDU
+ *     with unit address, runs ModbusSlave::Run() and takes the response
+ *     PDU, no UART or socket is involved. Shared by the Modbus tests
+ *     of the embedded group.
+ *
+ ***********************************************************************/
+
+
+#pragma once
+#include <string.h>
+#include "modbus_slave.h"
+
+#define MDB_MEM_PDU_MAX 253
+
+class MdbMemDll : public ModbusDll
+{
+protected:
+	uint8_t adr;
+	bool serial;
+	uint8_t rx[MDB_MEM_PDU_MAX];
+	size_t rxLen;
+	size_t inIdx;
+	uint8_t tx[MDB_MEM_PDU_MAX];
+	size_t txLen;
+	size_t outIdx;
+
+public:
+	uint32_t sent; /*pocet odeslanych odpovedi*/
+
+	MdbMemDll(ModbusDiag &diag, uint8_t id = 1, bool serialLine = true)
+		: ModbusDll(diag), adr(id), serial(serialLine), rxLen(0), inIdx(0), txLen(0), outIdx(0), sent(0) {}
+
+	PduStatus_t getstatus(void) { return State; }
+	void setdeviceid(uint8_t id) { adr = id; }
+	void initdll(void) { State = PDUIdle; }
+	void settxlenPDU(size_t len) { txLen = len; outIdx = 0; }
+	size_t getrxlenPDU(void) { return rxLen; }
+	size_t maxsizerxPDU(void) { return MDB_MEM_PDU_MAX; }
+	size_t maxsizetxPDU(void) { return MDB_MEM_PDU_MAX; }
+	void sendPDU(void)
+	{
+		sent++;
+		State = PDUIdle;
+	}
+	void receivePDU(void) { State = PDUReceive; }
+	void writebPDU(size_t id, uint8_t val)
+	{
+		if (id < MDB_MEM_PDU_MAX)
+		{
+			tx[id] = val;
+		}
+		outIdx = id + 1;
+		txLen = std::max(txLen, outIdx);
+	}
+	void writewPDU(size_t id, uint16_t val)
+	{
+		writebPDU(id, (uint8_t)(val >> 8));
+		writebPDU(id + 1, (uint8_t)(val & 0xFF));
+	}
+	void writewPDU(uint16_t val) { writewPDU(outIdx, val); }
+	uint8_t readbPDU(size_t id) { return (id < rxLen) ? rx[id] : 0; }
+	uint16_t readwPDU(size_t id) { return (uint16_t)readbPDU(id) << 8 | (uint16_t)readbPDU(id + 1); }
+	uint16_t readwPDU(void)
+	{
+		inIdx += 2;
+		return readwPDU(inIdx - 2);
+	}
+	bool SerialLine(void) { return serial; }
+
+	//*************************************************************************
+	//! Hand request to the slave as if it was received for unit address
+	//*************************************************************************
+	void Put(uint8_t unit, const uint8_t *pdu, size_t len)
+	{
+		rxLen = std::min(len, (size_t)MDB_MEM_PDU_MAX);
+		memcpy(rx, pdu, rxLen);
+		inIdx = 0;
+		txLen = 0;
+		outIdx = 0;
+		State = (unit == 0) ? PDUBroadcast : (unit == adr) ? PDUUnicast : PDUStrange;
+	}
+
+	//*************************************************************************
+	//! One request -> response through slave, returns response length
+	//! requested by the slave (may exceed the buffer, only MDB_MEM_PDU_MAX
+	//! bytes are copied), 0 when the slave did not answer
+	//*************************************************************************
+	size_t Transact(ModbusSlave &slave, uint8_t unit, const uint8_t *pdu, size_t len, uint8_t *rsp)
+	{
+		uint32_t before = sent;
+		Put(unit, pdu, len);
+		slave.Run();
+		if (State == PDUStrange)
+		{ /*ramec pro jineho slave se zahodi*/
+			State = PDUIdle;
+		}
+		if (sent == before)
+		{
+			return 0;
+		}
+		memcpy(rsp, tx, std::min(txLen, (size_t)MDB_MEM_PDU_MAX));
+		return txLen;
+	}
+};
@@ -0,0 +1,163 @@
+/***********************************************************************
+ * Filename: mdb_sim_bus.h
+ * Author: agent
+ * Date: 2026-10-17
+ * Description:
+ *     Simulated RS-485 bus for tests of the Modbus master. SimBus
+ *     replaces the UART part of ModbusSerial: requests are framed and
+ *     checked by ModbusRtuCodec like on the wire and answered by
+ *     simulated slaves with a table of holding registers. A slave can
+ *     be muted (timeout) and the next response can be corrupted. Every
+ *     request is logged and bus time is accounted from frame lengths.
+ *
+ ***********************************************************************/
+
+
+#pragma once
+#include <string.h>
+#include "modbus_serial.h"
+
+#define SIM_BUS_SLAVES 4
+#define SIM_BUS_REGS 32
+#define SIM_BUS_LOG 16
+#define SIM_BUS_BAUD 38400
+#define SIM_BUS_TURNAROUND_US 2000 /*zpracovani dotazu ve slave*/
+
+typedef struct
+{
+	uint8_t adr;
+	uint16_t base; /*prvni registr tabulky*/
+	uint16_t regs[SIM_BUS_REGS];
+	bool mute;	   /*neodpovida, master ceka timeout*/
+} simslave_t;
+
+typedef struct
+{
+	uint8_t adr;
+	uint16_t reg;
+	uint16_t cnt;
+} simbusreq_t;
+
+class SimBus : public ModbusSerial
+{
+protected:
+	simslave_t slaves[SIM_BUS_SLAVES];
+	uint8_t slaveCnt;
+
+	//*************************************************************************
+	//! FC3 of simulated slave, returns response pdu length
+	//*************************************************************************
+	size_t Answer(simslave_t &s, const uint8_t *pdu, size_t len, uint8_t *rsp)
+	{
+		uint16_t reg = ModbusRtuCodec::GetWord(pdu + 1);
+		uint16_t cnt = ModbusRtuCodec::GetWord(pdu + 3);
+		rsp[0] = pdu[0];
+		if ((len != ReadHRReqLen) || (pdu[0] != MbFun_ReadHoldingRegs))
+		{
+			rsp[0] |= 0x80;
+			rsp[1] = MB_Exc_IllegalFunction;
+			return 2;
+		}
+		if ((cnt == 0) || (reg < s.base) || (((uint32_t)reg + cnt) > ((uint32_t)s.base + SIM_BUS_REGS)))
+		{
+			rsp[0] |= 0x80;
+			rsp[1] = MB_Exc_IllegalDataAddress;
+			return 2;
+		}
+		rsp[1] = cnt * 2;
+		for (uint16_t i = 0; i < cnt; i++)
+		{
+			ModbusRtuCodec::PutWord(rsp + 2 + 2 * i, s.regs[reg - s.base + i]);
+		}
+		return 2 + 2 * cnt;
+	}
+
+	static uint32_t FrameUs(size_t adu)
+	{
+		return adu * BYTE_TIME_US(SIM_BUS_BAUD) + MODBUS_T35_US(SIM_BUS_BAUD);
+	}
+
+public:
+	simbusreq_t log[SIM_BUS_LOG];
+	uint32_t requests;
+	uint32_t busUs;		/*simulovany cas obsazeni sbernice*/
+	bool corruptNext;	/*dalsi odpoved dorazi s chybnym CRC*/
+
+	SimBus() : slaveCnt(0), requests(0), busUs(0), corruptNext(false)
+	{
+		setdeviceid(DEF_ADDR);
+		State = PDUReceive;
+	}
+
+	simslave_t &Attach(uint8_t adr, uint16_t base)
+	{
+		simslave_t &s = slaves[slaveCnt++];
+		s.adr = adr;
+		s.base = base;
+		s.mute = false;
+		for (uint16_t i = 0; i < SIM_BUS_REGS; i++)
+		{
+			s.regs[i] = adr * 1000 + base + i; /*hodnota prozradi slave i registr*/
+		}
+		return s;
+	}
+
+	void Clear(void)
+	{
+		requests = 0;
+		busUs = 0;
+		corruptNext = false;
+	}
+
+	PduStatus_t getstatus(void) { return State; }
+	void receivePDU(void) { State = PDUReceive; }
+	bool BusIdle(uint32_t idleMs) const { return State == PDUReceive; }
+
+	size_t Transaction(uint8_t adr, const uint8_t *pdu, size_t len, uint8_t *rsp, size_t maxLen, uint32_t toutMs)
+	{
+		uint8_t adu[MODBUS_BUFFERSIZE];
+		if ((len + 3) > sizeof(adu))
+		{
+			return 0;
+		}
+		adu[0] = adr;
+		memcpy(adu + 1, pdu, len);
+		size_t aduLen = ModbusRtuCodec::Seal(adu, len + 1);
+		busUs += FrameUs(aduLen);
+		if (requests < SIM_BUS_LOG)
+		{
+			log[requests] = {adr, ModbusRtuCodec::GetWord(pdu + 1), ModbusRtuCodec::GetWord(pdu + 3)};
+		}
+		requests++;
+
+		simslave_t *s = NULL;
+		for (uint8_t i = 0; i < slaveCnt; i++)
+		{
+			if ((slaves[i].adr == adr) && !slaves[i].mute && (ModbusRtuCodec::Check(adu, aduLen, adr) == RtuFrame_Ok))
+			{
+				s = &slaves[i];
+			}
+		}
+		if (s == NULL)
+		{ /*nikdo neodpovi*/
+			busUs += toutMs * 1000;
+			return 0;
+		}
+
+		size_t n = Answer(*s, adu + 1, aduLen - 3, adu + 1);
+		aduLen = ModbusRtuCodec::Seal(adu, n + 1);
+		busUs += SIM_BUS_TURNAROUND_US + FrameUs(aduLen);
+		if (corruptNext)
+		{
+			adu[2] ^= 0x01;
+			corruptNext = false;
+		}
+		if (ModbusRtuCodec::Check(adu, aduLen, adr) != RtuFrame_Ok)
+		{
+			return 0;
+		}
+		n = std::min(n, maxLen);
+		memcpy(rsp, adu + 1, n);
+		return n;
+	}
+};
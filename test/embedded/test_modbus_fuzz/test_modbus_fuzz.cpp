@@ -0,0 +1,347 @@
+/***********************************************************************
+ * Filename: test_modbus_fuzz.cpp
+ * Author: agent
+ * Date: 2026-10-17
+ * Description:
+ *     Structured fuzzing of ModbusSlave::UnicastProc through the
+ *     in-memory ModbusDll and a frames per second benchmark of
+ *     decode (ModbusRtuCodec::Check) -> dispatch (ModbusSlave::Run) ->
+ *     encode (ModbusRtuCodec::Seal). Requests are generated from
+ *     a fixed seed: valid, truncated and overlong PDUs of all supported
+ *     functions and random function codes. Writing functions address
+ *     only the sandbox 440..447 (two RW RAM parameters and read only
+ *     strings), reads cover the whole address space.
+ *     Checked for every request:
+ *      - response fits the PDU buffer, exception response is 2 bytes
+ *        with the function code | 0x80, normal response echoes it
+ *      - no response only in listen only mode
+ *      - rejected write leaves the sandbox unchanged
+ *     and after the run no writable parameter outside the sandbox
+ *     differs from the snapshot taken before.
+ *     Run: pio test -e esp32s3-n16r8v -f embedded/test_modbus_fuzz
+ *
+ ***********************************************************************/
+
+#include <Arduino.h>
+#include <unity.h>
+#include "parameters.h"
+#include "param_snapshot.h"
+#include "modbus_rtu_codec.h"
+#include "../mdb_mem_dll.h"
+
+#define SLAVE_ID 7
+#define FUZZ_SEED 0x4D425553UL
+#define FUZZ_ITER 50000
+#define SANDBOX_FIRST 440
+#define SANDBOX_END 448 /*za poslednim registrem*/
+#define BENCH_FRAMES 5000
+
+static ModbusDiag diag;
+static MdbMemDll dll(diag, SLAVE_ID);
+static ModbusSlave slave(dll);
+static uint32_t rng = FUZZ_SEED;
+
+void setUp(void) {}
+void tearDown(void) {}
+
+static uint32_t Rnd(void)
+{ /*xorshift32*/
+	rng ^= rng << 13;
+	rng ^= rng >> 17;
+	rng ^= rng << 5;
+	return rng;
+}
+
+static uint32_t Rnd(uint32_t n)
+{
+	return Rnd() % n;
+}
+
+static uint16_t FuzzCount(uint16_t max)
+{
+	switch (Rnd(8))
+	{
+	case 0:
+		return 0;
+	case 1:
+		return max + 1 + Rnd(8);
+	case 2:
+		return Rnd() & 0xFFFF;
+	default:
+		return 1 + Rnd(max);
+	}
+}
+
+static uint16_t FuzzValue(void)
+{ /*vetsinou v rozsahu souradnic, aby zapisy i prochazely*/
+	return Rnd(2) ? (uint16_t)(Rnd(181) - 90) : (uint16_t)Rnd();
+}
+
+static uint16_t SandboxAdr(void)
+{
+	return SANDBOX_FIRST + Rnd(SANDBOX_END - SANDBOX_FIRST);
+}
+
+static size_t PutData(uint8_t *pdu, size_t pos, uint16_t cnt)
+{
+	for (uint16_t i = 0; (i < cnt) && ((pos + 2) <= MDB_MEM_PDU_MAX); i++)
+	{
+		ModbusRtuCodec::PutWord(pdu + pos, FuzzValue());
+		pos += 2;
+	}
+	return pos;
+}
+
+//*****************************************************************************
+//! Damage length of generated pdu: truncate, append garbage or keep
+//*****************************************************************************
+static size_t Mangle(uint8_t *pdu, size_t len)
+{
+	switch (Rnd(10))
+	{
+	case 0:
+		return Rnd(len + 1);
+	case 1:
+		while ((len < MDB_MEM_PDU_MAX) && Rnd(4))
+		{
+			pdu[len++] = Rnd();
+		}
+		return len;
+	default:
+		return len;
+	}
+}
+
+//*****************************************************************************
+//! Generate request, writing requests never reach outside the sandbox
+//*****************************************************************************
+static size_t Generate(uint8_t *pdu, bool &write)
+{
+	static const uint8_t funs[] = {MbFun_ReadHoldingRegs, MbFun_WriteSingleReg, MbFun_Diagnostics, MbFun_WriteMultipleRegs,
+								   MbFun_ReadSlaveID, MbFun_ReadWriteMultipleRegs, MbFun_ReadDefaultRegs, MbFun_WriteDefaultReg,
+								   MbFun_ReadDefaultID, 0};
+	uint8_t fun = funs[Rnd(sizeof(funs))];
+	size_t len = 0;
+	write = false;
+	pdu[len++] = fun;
+
+	switch (fun)
+	{
+	case MbFun_ReadHoldingRegs:
+	case MbFun_ReadDefaultRegs:
+		ModbusRtuCodec::PutWord(pdu + 1, Rnd());
+		ModbusRtuCodec::PutWord(pdu + 3, FuzzCount(0x7D));
+		len = 5;
+		break;
+	case MbFun_WriteSingleReg:
+		write = true;
+		ModbusRtuCodec::PutWord(pdu + 1, SandboxAdr());
+		ModbusRtuCodec::PutWord(pdu + 3, FuzzValue());
+		len = 5;
+		break;
+	case MbFun_WriteDefaultReg:
+		write = true;
+		ModbusRtuCodec::PutWord(pdu + 1, SandboxAdr());
+		len = 3;
+		break;
+	case MbFun_WriteMultipleRegs:
+	{
+		write = true;
+		uint16_t adr = SandboxAdr();
+		uint16_t cnt = Rnd(4) ? 1 + Rnd(SANDBOX_END - adr) : FuzzCount(0x7B);
+		ModbusRtuCodec::PutWord(pdu + 1, adr);
+		ModbusRtuCodec::PutWord(pdu + 3, cnt);
+		pdu[5] = Rnd(8) ? (uint8_t)(2 * cnt) : (uint8_t)Rnd();
+		len = PutData(pdu, 6, cnt);
+		break;
+	}
+	case MbFun_ReadWriteMultipleRegs:
+	{
+		write = true;
+		uint16_t adr = SandboxAdr();
+		uint16_t cnt = Rnd(4) ? 1 + Rnd(SANDBOX_END - adr) : FuzzCount(0x79);
+		ModbusRtuCodec::PutWord(pdu + 1, Rnd());
+		ModbusRtuCodec::PutWord(pdu + 3, FuzzCount(0x7D));
+		ModbusRtuCodec::PutWord(pdu + 5, adr);
+		ModbusRtuCodec::PutWord(pdu + 7, cnt);
+		pdu[9] = Rnd(8) ? (uint8_t)(2 * cnt) : (uint8_t)Rnd();
+		len = PutData(pdu, 10, cnt);
+		break;
+	}
+	case MbFun_Diagnostics:
+	{
+		static const uint16_t subs[] = {MbDiag_ReturnQueryData, MbDiag_RestartComm, MbDiag_ReturnDiagReg, MbDiag_ForceListenOnly,
+										MbDiag_ClearCounters, MbDiag_BusMsgCnt, MbDiag_OverrunCnt, MbDiag_ClearOverrun, 0x0013, 0xFFFF};
+		ModbusRtuCodec::PutWord(pdu + 1, subs[Rnd(sizeof(subs) / sizeof(subs[0]))]);
+		ModbusRtuCodec::PutWord(pdu + 3, Rnd(2) ? 0 : (uint16_t)Rnd());
+		len = 5;
+		break;
+	}
+	case 0:
+	{ /*nahodna funkce, ktera nic nezapisuje*/
+		do
+		{
+			fun = Rnd();
+		} while ((fun == MbFun_WriteSingleReg) || (fun == MbFun_WriteMultipleRegs) ||
+				 (fun == MbFun_ReadWriteMultipleRegs) || (fun == MbFun_WriteDefaultReg));
+		pdu[0] = fun;
+		len = 1 + Rnd(MDB_MEM_PDU_MAX);
+		for (size_t i = 1; i < len; i++)
+		{
+			pdu[i] = Rnd();
+		}
+		return len;
+	}
+	default:
+		break;
+	}
+	return Mangle(pdu, len);
+}
+
+static void CollectDiff(uint16_t adr, void *arg)
+{
+	uint32_t &cnt = *(uint32_t *)arg;
+	Register *reg = Register::GetPar(adr);
+	if ((reg != NULL) && (reg->def.dsc & Par_W) && ((adr < SANDBOX_FIRST) || (adr >= SANDBOX_END)))
+	{
+		char msg[48];
+		snprintf(msg, sizeof(msg), "write outside sandbox: %u", adr);
+		TEST_MESSAGE(msg);
+		cnt++;
+	}
+}
+
+static void test_fuzz_unicast(void)
+{
+	size_t snapSize = ParamSnapshot::Size();
+	uint8_t *before = (uint8_t *)malloc(snapSize);
+	uint8_t *after = (uint8_t *)malloc(snapSize);
+	TEST_ASSERT_NOT_NULL(before);
+	TEST_ASSERT_NOT_NULL(after);
+	TEST_ASSERT_EQUAL(snapSize, ParamSnapshot::Build(before, snapSize));
+
+	int16_t lat = ZemepisnaSirka.Get();
+	int16_t lon = ZemepisnaDelka.Get();
+	uint8_t pdu[MDB_MEM_PDU_MAX];
+	uint8_t rsp[MDB_MEM_PDU_MAX];
+	uint32_t exc = 0;
+	uint32_t silent = 0;
+	char msg[96];
+
+	diag.Clear();
+	diag.SetListenOnly(false);
+	for (uint32_t i = 0; i < FUZZ_ITER; i++)
+	{
+		bool write;
+		size_t len = Generate(pdu, write);
+		int16_t sandLat = ZemepisnaSirka.Get();
+		int16_t sandLon = ZemepisnaDelka.Get();
+		bool listenOnly = diag.ListenOnly();
+		size_t n = dll.Transact(slave, SLAVE_ID, pdu, len, rsp);
+
+		uint8_t fun = (len > 0) ? pdu[0] : 0; /*prazdne PDU cte funkci 0*/
+		snprintf(msg, sizeof(msg), "iter %u fun %u len %u", (unsigned)i, fun, (unsigned)len);
+		TEST_ASSERT_LESS_OR_EQUAL_MESSAGE(MDB_MEM_PDU_MAX, n, msg);
+		if (n == 0)
+		{ /*bez odpovedi jen v listen only (i pozadavek, ktery ho zapnul)*/
+			TEST_ASSERT_TRUE_MESSAGE(listenOnly || diag.ListenOnly(), msg);
+			silent++;
+			continue;
+		}
+		if (rsp[0] & 0x80)
+		{
+			TEST_ASSERT_EQUAL_MESSAGE(2, n, msg);
+			TEST_ASSERT_EQUAL_HEX8_MESSAGE(fun | 0x80, rsp[0], msg);
+			TEST_ASSERT_NOT_EQUAL_MESSAGE(MB_No_Exc, rsp[1], msg);
+			if (write)
+			{ /*odmitnuty zapis nesmi nic zmenit*/
+				TEST_ASSERT_EQUAL_INT16_MESSAGE(sandLat, ZemepisnaSirka.Get(), msg);
+				TEST_ASSERT_EQUAL_INT16_MESSAGE(sandLon, ZemepisnaDelka.Get(), msg);
+			}
+			exc++;
+			continue;
+		}
+		TEST_ASSERT_EQUAL_HEX8_MESSAGE(fun, rsp[0], msg);
+	}
+	snprintf(msg, sizeof(msg), "%u requests: %u exceptions, %u without response", FUZZ_ITER, (unsigned)exc, (unsigned)silent);
+	TEST_MESSAGE(msg);
+
+	uint32_t outside = 0;
+	TEST_ASSERT_EQUAL(snapSize, ParamSnapshot::Build(after, snapSize));
+	ParamSnapshot::Diff(before, snapSize, after, snapSize, CollectDiff, &outside);
+	TEST_ASSERT_EQUAL(0, outside);
+
+	free(before);
+	free(after);
+	diag.SetListenOnly(false);
+	ZemepisnaSirka.Set(lat);
+	ZemepisnaDelka.Set(lon);
+}
+
+//*****************************************************************************
+//! Frames per second of one request ADU through decode -> dispatch -> encode
+//*****************************************************************************
+static uint32_t Bench(const uint8_t *pdu, size_t len, size_t &rspLen)
+{
+	uint8_t req[MODBUS_RTU_ADU_MAX];
+	uint8_t adu[MODBUS_RTU_ADU_MAX];
+	req[0] = SLAVE_ID;
+	memcpy(req + 1, pdu, len);
+	size_t reqLen = ModbusRtuCodec::Seal(req, len + 1);
+
+	rspLen = 0;
+	int64_t t0 = esp_timer_get_time();
+	for (uint32_t i = 0; i < BENCH_FRAMES; i++)
+	{
+		if (ModbusRtuCodec::Check(req, reqLen, SLAVE_ID) != RtuFrame_Ok)
+		{
+			return 0;
+		}
+		size_t n = dll.Transact(slave, req[0], req + 1, reqLen - 3, adu + 1);
+		adu[0] = SLAVE_ID;
+		rspLen = ModbusRtuCodec::Seal(adu, n + 1);
+	}
+	int64_t us = esp_timer_get_time() - t0;
+	return (uint32_t)(BENCH_FRAMES * 1000000LL / std::max(us, (int64_t)1));
+}
+
+static void test_bench_frames(void)
+{
+	/*FC3 400..441 (NTPServer..ZemepisnaDelka), FC6 440, FC16 440..441*/
+	const uint8_t read[] = {MbFun_ReadHoldingRegs, 0x01, 0x90, 0x00, 42};
+	const uint8_t write[] = {MbFun_WriteSingleReg, 0x01, 0xB8, 0x00, 12};
+	const uint8_t multi[] = {MbFun_WriteMultipleRegs, 0x01, 0xB8, 0x00, 2, 4, 0x00, 12, 0x00, 34};
+	const struct
+	{
+		const char *name;
+		const uint8_t *pdu;
+		size_t len;
+	} cases[] = {{"FC3 42 regs", read, sizeof(read)}, {"FC6", write, sizeof(write)}, {"FC16 2 regs", multi, sizeof(multi)}};
+
+	diag.SetListenOnly(false);
+	char msg[96];
+	for (const auto &c : cases)
+	{
+		size_t rspLen;
+		uint32_t fps = Bench(c.pdu, c.len, rspLen);
+		snprintf(msg, sizeof(msg), "%s: %u frames/s, response %u B", c.name, (unsigned)fps, (unsigned)rspLen);
+		TEST_MESSAGE(msg);
+		TEST_ASSERT_GREATER_THAN_UINT32(0, fps);
+		TEST_ASSERT_GREATER_THAN(4, rspLen); /*ne vyjimka*/
+	}
+}
+
+void setup()
+{
+	delay(2000); /*cas na pripojeni monitoru*/
+	Register::InitAll();
+
+	UNITY_BEGIN();
+	RUN_TEST(test_fuzz_unicast);
+	RUN_TEST(test_bench_frames);
+	UNITY_END();
+}
+
+void loop()
+{
+}
@@ -0,0 +1,219 @@
+/***********************************************************************
+ * Filename: test_modbus_master.cpp
+ * Author: agent
+ * Date: 2026-10-17
+ * Description:
+ *     Unit tests of the Modbus master poller on a simulated bus:
+ *     coalescing of the poll list into FC3 requests, mapping of the
+ *     results into MdbExt parameters and handling of exception, timeout
+ *     and CRC error. Bus time of merged requests is compared with one
+ *     request per poll entry. The poller reads the poll list from NV
+ *     parameters, so the test runs on the board.
+ *     Run: pio test -e esp32s3-n16r8v -f embedded/test_modbus_master
+ *
+ ***********************************************************************/
+
+#include <Arduino.h>
+#include <unity.h>
+#include "parameters.h"
+#include "modbus_master.h"
+#include "../mdb_sim_bus.h"
+
+static uint16_reg *const Slave[MDB_POLL_ENTRIES] = {&MdbPoll1Slave, &MdbPoll2Slave, &MdbPoll3Slave, &MdbPoll4Slave};
+static uint16_reg *const Reg[MDB_POLL_ENTRIES] = {&MdbPoll1Reg, &MdbPoll2Reg, &MdbPoll3Reg, &MdbPoll4Reg};
+static uint16_reg *const Cnt[MDB_POLL_ENTRIES] = {&MdbPoll1Cnt, &MdbPoll2Cnt, &MdbPoll3Cnt, &MdbPoll4Cnt};
+static uint16_reg *const Period[MDB_POLL_ENTRIES] = {&MdbPoll1Perioda, &MdbPoll2Perioda, &MdbPoll3Perioda, &MdbPoll4Perioda};
+static int16_reg *const Ext[MDB_POLL_VALUES] = {&MdbExt1, &MdbExt2, &MdbExt3, &MdbExt4, &MdbExt5, &MdbExt6, &MdbExt7, &MdbExt8};
+
+/*slave 2: 100..101, 103 (mezera 1 -> jeden dotaz) a 120..121; slave 3: 10..12*/
+static const mdbpoll_t List[MDB_POLL_ENTRIES] = {
+	{2, 100, 2, 0, 10000},
+	{3, 10, 3, 0, 10000},
+	{2, 103, 1, 0, 10000},
+	{2, 120, 2, 0, 10000},
+};
+
+void setUp(void) {}
+void tearDown(void) {}
+
+static void SetList(const mdbpoll_t *list)
+{
+	for (uint8_t i = 0; i < MDB_POLL_ENTRIES; i++)
+	{
+		Slave[i]->Set(list[i].slave);
+		Reg[i]->Set(list[i].reg);
+		Cnt[i]->Set(list[i].cnt);
+		Period[i]->Set(list[i].periodMs / 1000);
+	}
+	for (uint8_t i = 0; i < MDB_POLL_VALUES; i++)
+	{
+		Ext[i]->Set(0);
+	}
+	MdbPollStav.Set(0);
+}
+
+//*****************************************************************************
+//! One poll round, returns number of requests put on the bus
+//*****************************************************************************
+static uint32_t Round(ModbusMaster &master, SimBus &bus)
+{
+	uint32_t before = bus.requests;
+	master.Init();
+	for (uint8_t i = 0; i <= MDB_POLL_ENTRIES; i++)
+	{
+		master.Run();
+	}
+	return bus.requests - before;
+}
+
+static void test_coalesce(void)
+{
+	mdbpollreq_t req[MDB_POLL_ENTRIES];
+	TEST_ASSERT_EQUAL(3, ModbusMaster::Coalesce(List, MDB_POLL_ENTRIES, 0x0F, req));
+	TEST_ASSERT_EQUAL(2, req[0].slave);
+	TEST_ASSERT_EQUAL(100, req[0].reg);
+	TEST_ASSERT_EQUAL(4, req[0].cnt);
+	TEST_ASSERT_EQUAL_HEX8(0x05, req[0].entries);
+	TEST_ASSERT_EQUAL(2, req[1].slave);
+	TEST_ASSERT_EQUAL(120, req[1].reg);
+	TEST_ASSERT_EQUAL_HEX8(0x08, req[1].entries);
+	TEST_ASSERT_EQUAL(3, req[2].slave);
+	TEST_ASSERT_EQUAL(3, req[2].cnt);
+
+	/*jen splatne polozky*/
+	TEST_ASSERT_EQUAL(1, ModbusMaster::Coalesce(List, MDB_POLL_ENTRIES, 0x04, req));
+	TEST_ASSERT_EQUAL(103, req[0].reg);
+	TEST_ASSERT_EQUAL(1, req[0].cnt);
+
+	/*mezera nad MDB_POLL_GAP_MAX se nesluci*/
+	mdbpoll_t far[2] = {{2, 100, 1, 0, 1000}, {2, 101 + MDB_POLL_GAP_MAX + 1, 1, 0, 1000}};
+	TEST_ASSERT_EQUAL(2, ModbusMaster::Coalesce(far, 2, 0x03, req));
+	far[1].reg = 101 + MDB_POLL_GAP_MAX;
+	TEST_ASSERT_EQUAL(1, ModbusMaster::Coalesce(far, 2, 0x03, req));
+
+	/*slouceny dotaz nejvyse MDB_POLL_REGS_MAX registru*/
+	far[0].cnt = MDB_POLL_REGS_MAX - 1;
+	far[1].reg = 100 + MDB_POLL_REGS_MAX;
+	TEST_ASSERT_EQUAL(2, ModbusMaster::Coalesce(far, 2, 0x03, req));
+	far[1].reg = 100 + MDB_POLL_REGS_MAX - 1;
+	TEST_ASSERT_EQUAL(1, ModbusMaster::Coalesce(far, 2, 0x03, req));
+	TEST_ASSERT_EQUAL(MDB_POLL_REGS_MAX, req[0].cnt);
+}
+
+static void test_poll_maps(void)
+{
+	SimBus bus;
+	bus.Attach(2, 100);
+	bus.Attach(3, 0);
+	ModbusMaster master(bus);
+	SetList(List);
+
+	TEST_ASSERT_EQUAL(3, Round(master, bus));
+	TEST_ASSERT_EQUAL(2, bus.log[0].adr);
+	TEST_ASSERT_EQUAL(100, bus.log[0].reg);
+	TEST_ASSERT_EQUAL(4, bus.log[0].cnt);
+
+	/*MdbExt se plni v poradi polozek seznamu*/
+	TEST_ASSERT_EQUAL(2100, Ext[0]->Get());
+	TEST_ASSERT_EQUAL(2101, Ext[1]->Get());
+	TEST_ASSERT_EQUAL(3010, Ext[2]->Get());
+	TEST_ASSERT_EQUAL(3011, Ext[3]->Get());
+	TEST_ASSERT_EQUAL(3012, Ext[4]->Get());
+	TEST_ASSERT_EQUAL(2103, Ext[5]->Get());
+	TEST_ASSERT_EQUAL(2120, Ext[6]->Get());
+	TEST_ASSERT_EQUAL(2121, Ext[7]->Get());
+	TEST_ASSERT_EQUAL_HEX16(0x0F, MdbPollStav.Get());
+
+	/*perioda jeste neubehla, dalsi Run nic neposle*/
+	uint32_t before = bus.requests;
+	master.Run();
+	TEST_ASSERT_EQUAL(before, bus.requests);
+}
+
+static void test_poll_errors(void)
+{
+	SimBus bus;
+	bus.Attach(2, 100);
+	simslave_t &s3 = bus.Attach(3, 0);
+	ModbusMaster master(bus);
+	SetList(List);
+	TEST_ASSERT_EQUAL(3, Round(master, bus));
+	TEST_ASSERT_EQUAL_HEX16(0x0F, MdbPollStav.Get());
+
+	/*timeout: polozka 2 (slave 3) je neplatna, hodnoty zustavaji*/
+	uint16_t err = MdbPollError.Get();
+	s3.mute = true;
+	s3.regs[10] = 7;
+	TEST_ASSERT_EQUAL(3, Round(master, bus));
+	TEST_ASSERT_EQUAL_HEX16(0x0D, MdbPollStav.Get());
+	TEST_ASSERT_EQUAL(3010, Ext[2]->Get());
+	TEST_ASSERT_EQUAL(err + 1, MdbPollError.Get());
+	s3.mute = false;
+
+	/*vyjimka: registr mimo tabulku slave*/
+	mdbpoll_t list[MDB_POLL_ENTRIES];
+	memcpy(list, List, sizeof(list));
+	list[3].reg = 100 + SIM_BUS_REGS;
+	SetList(list);
+	TEST_ASSERT_EQUAL(3, Round(master, bus));
+	TEST_ASSERT_EQUAL_HEX16(0x07, MdbPollStav.Get());
+	TEST_ASSERT_EQUAL(7, Ext[2]->Get());
+
+	/*chybne CRC prvni odpovedi (slave 2, polozky 1 a 3)*/
+	SetList(List);
+	bus.corruptNext = true;
+	TEST_ASSERT_EQUAL(3, Round(master, bus));
+	TEST_ASSERT_EQUAL_HEX16(0x0A, MdbPollStav.Get());
+	TEST_ASSERT_EQUAL(0, Ext[0]->Get());
+	TEST_ASSERT_EQUAL(7, Ext[2]->Get());
+}
+
+static void test_bus_time(void)
+{
+	SimBus bus;
+	bus.Attach(2, 100);
+	bus.Attach(3, 0);
+	ModbusMaster master(bus);
+	SetList(List);
+	Round(master, bus);
+	uint32_t merged = bus.busUs;
+
+	/*jedna polozka na dotaz: kazdou polozku zvlast jako splatnou*/
+	bus.Clear();
+	mdbpollreq_t req[MDB_POLL_ENTRIES];
+	uint8_t pdu[ReadHRReqLen];
+	uint8_t rsp[MODBUS_BUFFERSIZE];
+	for (uint8_t i = 0; i < MDB_POLL_ENTRIES; i++)
+	{
+		ModbusMaster::Coalesce(List, MDB_POLL_ENTRIES, 1 << i, req);
+		size_t len = ModbusRtuCodec::ReadRegsReq(pdu, MbFun_ReadHoldingRegs, req[0].reg, req[0].cnt);
+		TEST_ASSERT_EQUAL(2 + 2 * req[0].cnt, bus.Transaction(req[0].slave, pdu, len, rsp, sizeof(rsp), 100));
+	}
+	char msg[96];
+	snprintf(msg, sizeof(msg), "bus time at %u Bd: merged %u us, per entry %u us", SIM_BUS_BAUD, (unsigned)merged, (unsigned)bus.busUs);
+	TEST_MESSAGE(msg);
+	TEST_ASSERT_LESS_THAN_UINT32(bus.busUs, merged);
+}
+
+void setup()
+{
+	delay(2000); /*cas na pripojeni monitoru*/
+	Register::InitAll();
+
+	UNITY_BEGIN();
+	RUN_TEST(test_coalesce);
+	RUN_TEST(test_poll_maps);
+	RUN_TEST(test_poll_errors);
+	RUN_TEST(test_bus_time);
+	UNITY_END();
+
+	/*seznam je v NV, vraci se vychozi (vypnuto)*/
+	for (uint8_t i = 0; i < MDB_POLL_ENTRIES; i++)
+	{
+		Slave[i]->Set(0);
+	}
+}
+
+void loop()
+{
+}
@@ -0,0 +1,256 @@
+/***********************************************************************
+ * Filename: test_modbus_rtu_timing.cpp
+ * Author: agent
+ * Date: 2026-10-17
+ * Description:
+ *     Tests of ModbusSerial timing on the real UART in internal
+ *     loopback at 115200 Bd: response-start latency (end of request on
+ *     the line to start of response transmission) and frame delimiting
+ *     by T1.5 and T3.5. The slave runs in its own task like ModbusTask,
+ *     the test task puts requests on the line with exact gaps. RS485
+ *     half duplex mode disables receiver while transmitting, so the
+ *     loopback runs in plain UART mode, DE is driven by hardware in
+ *     both modes and does not add to the latency. Run with the RS485
+ *     line disconnected, the transceiver may drive the bus.
+ *     Run: pio test -e esp32s3-n16r8v -f embedded/test_modbus_rtu_timing
+ *
+ ***********************************************************************/
+
+#include <Arduino.h>
+#include <unity.h>
+#include <atomic>
+#include "parameters.h"
+#include "pin_map.h"
+#include "modbus_serial.h"
+
+#define TEST_BAUD 115200
+#define SLAVE_ID 5
+#define OTHER_ID 6
+#define REG_LAT 440		   /*ZemepisnaSirka, RAM S16*/
+#define LAT_RUNS 50
+#define RSP_WAIT_MS 30
+#define SPLIT_AT 3		   /*pozice mezery v dotazu*/
+#define GAP_MARGIN_US 300  /*rezerva na zpozdeni tasku a timeru*/
+#define RSP_START_MAX_US 1000 /*zpracovani dotazu po T3.5*/
+
+#define BYTE_US BYTE_TIME_US(TEST_BAUD)
+#define T15_US MODBUS_T15_US(TEST_BAUD)
+#define T35_US MODBUS_T35_US(TEST_BAUD)
+
+//*****************************************************************************
+//! ModbusSerial in loopback, own response comes back on RX and is dropped
+//*****************************************************************************
+class LoopSerial : public ModbusSerial
+{
+protected:
+	size_t echoLen;
+
+public:
+	std::atomic<int64_t> txStartUs;
+	std::atomic<int64_t> echoUs;
+	std::atomic<uint32_t> responses;
+
+	LoopSerial() : echoLen(0), txStartUs(0), echoUs(0), responses(0) {}
+
+	void initdll(void)
+	{
+		ModbusSerial::initdll();
+		uart_set_mode(MODBUS_UART, UART_MODE_UART);
+		uart_set_loop_back(MODBUS_UART, true);
+		SetBaud(TEST_BAUD);
+	}
+
+	void sendPDU(void)
+	{
+		txStartUs = esp_timer_get_time();
+		ModbusSerial::sendPDU();
+		echoLen = outLen + 2;
+		responses++;
+	}
+
+	PduStatus_t getstatus(void)
+	{
+		PduStatus_t st = ModbusSerial::getstatus();
+		if ((st == PDUUnicast) && (echoLen > 0) && (inpLen == echoLen) && (memcmp(BufferIn, BufferOut, inpLen) == 0))
+		{ /*vlastni odpoved ze smycky*/
+			echoUs = lastRxUs;
+			echoLen = 0;
+			receivePDU();
+			return PDUReceive;
+		}
+		return st;
+	}
+};
+
+static LoopSerial dll;
+static ModbusSlave slave(dll);
+static uint8_t req[MODBUS_BUFFERSIZE];
+static size_t reqLen;
+static uint8_t other[MODBUS_BUFFERSIZE];
+static size_t otherLen;
+
+static void SlaveTask(void *arg)
+{
+	for (;;)
+	{
+		slave.Run();
+	}
+}
+
+void setUp(void)
+{
+	ModbusDiag::Rtu.Clear();
+}
+
+void tearDown(void)
+{
+	delay(RSP_WAIT_MS); /*dobehnuti odpovedi a jeji ozveny*/
+}
+
+static size_t ReadReq(uint8_t *buf, uint8_t adr)
+{
+	buf[0] = adr;
+	buf[1] = 0x03;
+	buf[2] = REG_LAT >> 8;
+	buf[3] = REG_LAT & 0xFF;
+	buf[4] = 0;
+	buf[5] = 1;
+	return ModbusRtuCodec::Seal(buf, 6);
+}
+
+//*****************************************************************************
+//! Put bytes on the line, returns time when the last stop bit is sent
+//*****************************************************************************
+static int64_t Send(const uint8_t *buf, size_t len)
+{
+	uart_write_bytes(MODBUS_UART, buf, len);
+	uart_wait_tx_done(MODBUS_UART, pdMS_TO_TICKS(MODBUS_TX_TIMEOUT_MS));
+	return esp_timer_get_time();
+}
+
+static void WaitUntil(int64_t us)
+{
+	while (esp_timer_get_time() < us)
+	{
+	}
+}
+
+static bool Answered(uint32_t before)
+{
+	for (int i = 0; (i < RSP_WAIT_MS) && (dll.responses == before); i++)
+	{
+		delay(1);
+	}
+	return dll.responses != before;
+}
+
+//*****************************************************************************
+//! Request split at SPLIT_AT with gap of gapUs, returns true if answered
+//*****************************************************************************
+static bool SplitRequest(uint32_t gapUs)
+{
+	uint32_t before = dll.responses;
+	int64_t t = Send(req, SPLIT_AT);
+	WaitUntil(t + gapUs);
+	Send(req + SPLIT_AT, reqLen - SPLIT_AT);
+	return Answered(before);
+}
+
+//*****************************************************************************
+//! Frame for other slave and after gapUs request for this one
+//*****************************************************************************
+static bool AfterOther(uint32_t gapUs)
+{
+	uint32_t before = dll.responses;
+	int64_t t = Send(other, otherLen);
+	WaitUntil(t + gapUs);
+	Send(req, reqLen);
+	return Answered(before);
+}
+
+static void test_response_latency(void)
+{
+	char msg[160];
+	uint32_t latMin = UINT32_MAX;
+	uint32_t latMax = 0;
+	uint64_t latSum = 0;
+
+	for (int r = 0; r < LAT_RUNS; r++)
+	{
+		uint32_t before = dll.responses;
+		int64_t reqEnd = Send(req, reqLen);
+		TEST_ASSERT_TRUE(Answered(before));
+		uint32_t lat = (uint32_t)(dll.txStartUs - reqEnd);
+		latMin = std::min(latMin, lat);
+		latMax = std::max(latMax, lat);
+		latSum += lat;
+
+		delay(RSP_WAIT_MS);
+		/*odpoved 7 B opravdu prosla linkou*/
+		TEST_ASSERT_GREATER_OR_EQUAL_INT32((int32_t)(7 * BYTE_US), (int32_t)(dll.echoUs - dll.txStartUs));
+	}
+	TEST_ASSERT_EQUAL(LAT_RUNS, ModbusDiag::Rtu.Get(MdbDiag_SlaveMsg));
+	TEST_ASSERT_EQUAL(0, ModbusDiag::Rtu.Get(MdbDiag_BusCommErr));
+
+	uint32_t latAvg = (uint32_t)(latSum / LAT_RUNS);
+	snprintf(msg, sizeof(msg), "%u Bd, T1.5 %u us, T3.5 %u us: response start %u/%u/%u us (min/avg/max), %d/%d/%d us after T3.5",
+			 TEST_BAUD, (unsigned)T15_US, (unsigned)T35_US, (unsigned)latMin, (unsigned)latAvg, (unsigned)latMax,
+			 (int)(latMin - T35_US), (int)(latAvg - T35_US), (int)(latMax - T35_US));
+	TEST_MESSAGE(msg);
+	/*pred koncem T3.5 nesmi odpoved zacit, rezerva jednoho znaku na zaokrouhleni*/
+	TEST_ASSERT_GREATER_OR_EQUAL(T35_US - BYTE_US, latMin);
+	TEST_ASSERT_LESS_THAN(T35_US + RSP_START_MAX_US, latMax);
+}
+
+static void test_t15_gap_inside_frame(void)
+{
+	TEST_ASSERT_TRUE(SplitRequest(T15_US / 3));
+	TEST_ASSERT_EQUAL(0, ModbusDiag::Rtu.Get(MdbDiag_BusCommErr));
+}
+
+static void test_t15_t35_gap_discards_frame(void)
+{
+	/*mezera mezi T1.5 a T3.5: ramec je poskozen a zahodi se*/
+	TEST_ASSERT_FALSE(SplitRequest((T15_US + T35_US) / 2));
+	TEST_ASSERT_EQUAL(0, ModbusDiag::Rtu.Get(MdbDiag_SlaveMsg));
+	TEST_ASSERT_GREATER_THAN(0, ModbusDiag::Rtu.Get(MdbDiag_BusCommErr));
+}
+
+static void test_t35_separates_frames(void)
+{
+	TEST_ASSERT_TRUE(AfterOther(T35_US + GAP_MARGIN_US));
+	TEST_ASSERT_EQUAL(1, ModbusDiag::Rtu.Get(MdbDiag_SlaveMsg));
+	TEST_ASSERT_EQUAL(0, ModbusDiag::Rtu.Get(MdbDiag_BusCommErr));
+}
+
+static void test_below_t35_joins_frames(void)
+{
+	/*dotaz zacal pred koncem T3.5 po cizim ramci, oba se zahodi*/
+	TEST_ASSERT_FALSE(AfterOther(T35_US - GAP_MARGIN_US));
+	TEST_ASSERT_EQUAL(0, ModbusDiag::Rtu.Get(MdbDiag_SlaveMsg));
+	TEST_ASSERT_GREATER_THAN(0, ModbusDiag::Rtu.Get(MdbDiag_BusCommErr));
+}
+
+void setup()
+{
+	delay(2000); /*cas na pripojeni monitoru*/
+	Register::InitAll();
+	reqLen = ReadReq(req, SLAVE_ID);
+	otherLen = ReadReq(other, OTHER_ID);
+	slave.Init();
+	dll.setdeviceid(SLAVE_ID);
+	xTaskCreatePinnedToCore(SlaveTask, "mdbSlave", 4096, NULL, 5, NULL, 0);
+	delay(10);
+
+	UNITY_BEGIN();
+	RUN_TEST(test_response_latency);
+	RUN_TEST(test_t15_gap_inside_frame);
+	RUN_TEST(test_t15_t35_gap_discards_frame);
+	RUN_TEST(test_t35_separates_frames);
+	RUN_TEST(test_below_t35_joins_frames);
+	UNITY_END();
+}
+
+void loop()
+{
+}
@@ -0,0 +1,221 @@
+/***********************************************************************
+ * Filename: test_modbus_slave.cpp
+ * Author: agent
+ * Date: 2026-10-17
+ * Description:
+ *     Unit tests of ModbusSlave driven through the in-memory ModbusDll
+ *     (mdb_mem_dll.h): FC3, FC6, FC16, FC23 with validation before
+ *     write, FC17, default register functions 70/71/72, exceptions,
+ *     broadcast and FC8 listen only. Requests go to the real parameter
+ *     table, which needs NVS, so the test runs on the board.
+ *     Run: pio test -e esp32s3-n16r8v -f embedded/test_modbus_slave
+ *
+ ***********************************************************************/
+
+#include <Arduino.h>
+#include <unity.h>
+#include "parameters.h"
+#include "param_snapshot.h"
+#include "../mdb_mem_dll.h"
+
+#define SLAVE_ID 5
+#define REG_LAT 440 /*ZemepisnaSirka, RAM S16 RW -90..90, vychozi 49*/
+#define REG_LON 441 /*ZemepisnaDelka, RAM S16 RW -180..180, vychozi 16*/
+#define REG_RO 1	/*StavDvirka, jen cteni*/
+#define REG_NONE 5000
+
+static ModbusDiag diag;
+static MdbMemDll dll(diag, SLAVE_ID);
+static ModbusSlave slave(dll);
+static uint8_t rsp[MDB_MEM_PDU_MAX];
+
+void setUp(void)
+{
+	ZemepisnaSirka.Set(10);
+	ZemepisnaDelka.Set(20);
+	diag.Clear();
+	diag.SetListenOnly(false);
+}
+
+void tearDown(void) {}
+
+static size_t Req(const uint8_t *pdu, size_t len)
+{
+	return dll.Transact(slave, SLAVE_ID, pdu, len, rsp);
+}
+
+static void AssertExc(size_t len, uint8_t fun, ModbusExcCodes_t exc)
+{
+	TEST_ASSERT_EQUAL(2, len);
+	TEST_ASSERT_EQUAL_HEX8(fun | 0x80, rsp[0]);
+	TEST_ASSERT_EQUAL_HEX8(exc, rsp[1]);
+}
+
+static int16_t Word(size_t id)
+{
+	return (int16_t)((uint16_t)rsp[id] << 8 | rsp[id + 1]);
+}
+
+static void test_fc3_read(void)
+{
+	const uint8_t req[] = {3, REG_LAT >> 8, REG_LAT & 0xFF, 0, 2};
+	TEST_ASSERT_EQUAL(6, Req(req, sizeof(req)));
+	TEST_ASSERT_EQUAL_HEX8(3, rsp[0]);
+	TEST_ASSERT_EQUAL(4, rsp[1]);
+	TEST_ASSERT_EQUAL_INT16(10, Word(2));
+	TEST_ASSERT_EQUAL_INT16(20, Word(4));
+
+	const uint8_t zero[] = {3, 0, 1, 0, 0};
+	AssertExc(Req(zero, sizeof(zero)), 3, MB_Exc_IllegalDataValue);
+	const uint8_t shortReq[] = {3, 0, 1, 0};
+	AssertExc(Req(shortReq, sizeof(shortReq)), 3, MB_Exc_IllegalDataValue);
+}
+
+static void test_fc6_write(void)
+{
+	const uint8_t req[] = {6, REG_LAT >> 8, REG_LAT & 0xFF, 0xFF, 0xEC}; /*-20*/
+	TEST_ASSERT_EQUAL(5, Req(req, sizeof(req)));
+	TEST_ASSERT_EQUAL_UINT8_ARRAY(req, rsp, sizeof(req));
+	TEST_ASSERT_EQUAL_INT16(-20, ZemepisnaSirka.Get());
+
+	const uint8_t ro[] = {6, 0, REG_RO, 0, 1};
+	AssertExc(Req(ro, sizeof(ro)), 6, MB_Exc_AccessLvlFailure);
+	const uint8_t none[] = {6, REG_NONE >> 8, REG_NONE & 0xFF, 0, 1};
+	AssertExc(Req(none, sizeof(none)), 6, MB_Exc_IllegalDataAddress);
+}
+
+static void test_fc16_write(void)
+{
+	const uint8_t req[] = {16, REG_LAT >> 8, REG_LAT & 0xFF, 0, 2, 4, 0, 33, 0xFF, 0x9C}; /*33, -100*/
+	TEST_ASSERT_EQUAL(5, Req(req, sizeof(req)));
+	TEST_ASSERT_EQUAL_UINT8_ARRAY(req, rsp, 5);
+	TEST_ASSERT_EQUAL_INT16(33, ZemepisnaSirka.Get());
+	TEST_ASSERT_EQUAL_INT16(-100, ZemepisnaDelka.Get());
+
+	/*druha hodnota mimo meze: vyjimka a nezapise se ani prvni*/
+	const uint8_t bad[] = {16, REG_LAT >> 8, REG_LAT & 0xFF, 0, 2, 4, 0, 1, 0x7F, 0xFF};
+	AssertExc(Req(bad, sizeof(bad)), 16, MB_Exc_IllegalDataValue);
+	TEST_ASSERT_EQUAL_INT16(33, ZemepisnaSirka.Get());
+	TEST_ASSERT_EQUAL_INT16(-100, ZemepisnaDelka.Get());
+
+	const uint8_t cnt[] = {16, REG_LAT >> 8, REG_LAT & 0xFF, 0, 2, 3, 0, 1, 0};
+	AssertExc(Req(cnt, sizeof(cnt)), 16, MB_Exc_IllegalDataValue);
+	const uint8_t ro[] = {16, 0, REG_RO, 0, 1, 2, 0, 1};
+	AssertExc(Req(ro, sizeof(ro)), 16, MB_Exc_AccessLvlFailure);
+}
+
+static void test_fc23_read_write(void)
+{
+	/*zapis 440..441 a cteni 440..441 v jednom pozadavku, cte se po zapisu*/
+	const uint8_t req[] = {23, REG_LAT >> 8, REG_LAT & 0xFF, 0, 2, REG_LAT >> 8, REG_LAT & 0xFF, 0, 2, 4, 0, 7, 0, 8};
+	TEST_ASSERT_EQUAL(6, Req(req, sizeof(req)));
+	TEST_ASSERT_EQUAL_HEX8(23, rsp[0]);
+	TEST_ASSERT_EQUAL(4, rsp[1]);
+	TEST_ASSERT_EQUAL_INT16(7, Word(2));
+	TEST_ASSERT_EQUAL_INT16(8, Word(4));
+
+	const uint8_t bad[] = {23, REG_LAT >> 8, REG_LAT & 0xFF, 0, 2, REG_LAT >> 8, REG_LAT & 0xFF, 0, 2, 4, 0, 9, 0x03, 0xE8};
+	AssertExc(Req(bad, sizeof(bad)), 23, MB_Exc_IllegalDataValue);
+	TEST_ASSERT_EQUAL_INT16(7, ZemepisnaSirka.Get());
+
+	const uint8_t ro[] = {23, REG_LAT >> 8, REG_LAT & 0xFF, 0, 1, 0, REG_RO, 0, 1, 2, 0, 1};
+	AssertExc(Req(ro, sizeof(ro)), 23, MB_Exc_AccessLvlFailure);
+	const uint8_t len[] = {23, REG_LAT >> 8, REG_LAT & 0xFF, 0, 1, REG_LAT >> 8, REG_LAT & 0xFF, 0, 1, 2, 0};
+	AssertExc(Req(len, sizeof(len)), 23, MB_Exc_IllegalDataValue);
+}
+
+static void test_fc17_slave_id(void)
+{
+	char name[STRING_REG_MAX_LEN + 1];
+	size_t nameLen = WiFihostname.Get(name);
+	const uint8_t req[] = {17};
+	TEST_ASSERT_EQUAL(4 + nameLen, Req(req, sizeof(req)));
+	TEST_ASSERT_EQUAL_HEX8(17, rsp[0]);
+	TEST_ASSERT_EQUAL(2 + nameLen, rsp[1]);
+	TEST_ASSERT_EQUAL((uint8_t)MainRev.Get(), rsp[2]);
+	TEST_ASSERT_EQUAL_HEX8(0xFF, rsp[3]);
+	TEST_ASSERT_TRUE(memcmp(name, rsp + 4, nameLen) == 0);
+}
+
+static void test_fc70_71_72_defaults(void)
+{
+	const uint8_t rd[] = {70, REG_LAT >> 8, REG_LAT & 0xFF, 0, 2};
+	TEST_ASSERT_EQUAL(6, Req(rd, sizeof(rd)));
+	TEST_ASSERT_EQUAL_INT16(49, Word(2));
+	TEST_ASSERT_EQUAL_INT16(16, Word(4));
+
+	const uint8_t wr[] = {71, REG_LAT >> 8, REG_LAT & 0xFF};
+	TEST_ASSERT_EQUAL(5, Req(wr, sizeof(wr)));
+	TEST_ASSERT_EQUAL_INT16(REG_LAT, Word(1));
+	TEST_ASSERT_EQUAL_INT16(49, Word(3));
+	TEST_ASSERT_EQUAL_INT16(49, ZemepisnaSirka.Get());
+	TEST_ASSERT_EQUAL_INT16(20, ZemepisnaDelka.Get());
+
+	const uint8_t ro[] = {71, 0, REG_RO};
+	AssertExc(Req(ro, sizeof(ro)), 71, MB_Exc_AccessLvlFailure);
+	const uint8_t ev[] = {71, 0, 27}; /*Command, udalost nema vychozi hodnotu*/
+	AssertExc(Req(ev, sizeof(ev)), 71, MB_Exc_IllegalDataAddress);
+	const uint8_t none[] = {71, REG_NONE >> 8, REG_NONE & 0xFF};
+	AssertExc(Req(none, sizeof(none)), 71, MB_Exc_IllegalDataAddress);
+
+	const uint8_t id[] = {72};
+	uint32_t hash = ParamSnapshot::TableHash();
+	TEST_ASSERT_EQUAL(ReadDefaultIDRspLen, Req(id, sizeof(id)));
+	TEST_ASSERT_EQUAL(ReadDefaultIDRspLen - 2, rsp[1]);
+	TEST_ASSERT_EQUAL_HEX16(MainRev.Get(), (uint16_t)Word(2));
+	TEST_ASSERT_EQUAL_HEX16(hash >> 16, (uint16_t)Word(4));
+	TEST_ASSERT_EQUAL_HEX16(hash & 0xFFFF, (uint16_t)Word(6));
+}
+
+static void test_addressing(void)
+{
+	const uint8_t unknown[] = {0x2B, 0x0E, 0x01, 0x00};
+	AssertExc(Req(unknown, sizeof(unknown)), 0x2B, MB_Exc_IllegalFunction);
+
+	const uint8_t wr[] = {6, REG_LAT >> 8, REG_LAT & 0xFF, 0, 3};
+	TEST_ASSERT_EQUAL(0, dll.Transact(slave, SLAVE_ID + 1, wr, sizeof(wr), rsp));
+	TEST_ASSERT_EQUAL_INT16(10, ZemepisnaSirka.Get());
+	TEST_ASSERT_EQUAL(0, dll.Transact(slave, 0, wr, sizeof(wr), rsp)); /*broadcast bez odpovedi*/
+}
+
+static void test_fc8_listen_only(void)
+{
+	const uint8_t listen[] = {8, 0, MbDiag_ForceListenOnly, 0, 0};
+	const uint8_t rd[] = {3, REG_LAT >> 8, REG_LAT & 0xFF, 0, 1};
+	const uint8_t restart[] = {8, 0, MbDiag_RestartComm, 0, 0};
+
+	TEST_ASSERT_EQUAL(0, Req(listen, sizeof(listen)));
+	TEST_ASSERT_TRUE(diag.ListenOnly());
+	TEST_ASSERT_EQUAL(0, Req(rd, sizeof(rd)));
+	TEST_ASSERT_EQUAL(0, Req(restart, sizeof(restart))); /*restart v listen only je bez odpovedi*/
+	TEST_ASSERT_FALSE(diag.ListenOnly());
+	TEST_ASSERT_EQUAL(4, Req(rd, sizeof(rd)));
+
+	/*mimo seriovou linku se listen only odmitne*/
+	ModbusDiag tcpDiag;
+	MdbMemDll tcp(tcpDiag, SLAVE_ID, false);
+	ModbusSlave tcpSlave(tcp);
+	AssertExc(tcp.Transact(tcpSlave, SLAVE_ID, listen, sizeof(listen), rsp), 8, MB_Exc_IllegalFunction);
+	TEST_ASSERT_FALSE(tcpDiag.ListenOnly());
+}
+
+void setup()
+{
+	delay(2000); /*cas na pripojeni monitoru*/
+	Register::InitAll();
+	slave.Init();
+	UNITY_BEGIN();
+	RUN_TEST(test_fc3_read);
+	RUN_TEST(test_fc6_write);
+	RUN_TEST(test_fc16_write);
+	RUN_TEST(test_fc23_read_write);
+	RUN_TEST(test_fc17_slave_id);
+	RUN_TEST(test_fc70_71_72_defaults);
+	RUN_TEST(test_addressing);
+	RUN_TEST(test_fc8_listen_only);
+	UNITY_END();
+}
+
+void loop()
+{
+}
@@ -0,0 +1,306 @@
+/***********************************************************************
+ * Filename: test_modbus_tcp.cpp
+ * Author: agent
+ * Date: 2026-10-17
+ * Description:
+ *     Loopback tests of the Modbus TCP server: ModbusTcp + ModbusSlave
+ *     on a test port, clients are lwIP sockets connected to 127.0.0.1
+ *     of the same board. Checks MBAP framing, pipelined transaction
+ *     IDs, several concurrent clients, refused client over limit and
+ *     separate counters, then measures transactions per second for 1
+ *     and MODBUS_TCP_MAX_CLIENTS clients with pipeline depth 1 and 4.
+ *     AsyncTCP and lwIP exist only on target, so the test runs on the
+ *     board.
+ *     Run: pio test -e esp32s3-n16r8v -f embedded/test_modbus_tcp
+ *
+ ***********************************************************************/
+
+#include <Arduino.h>
+#include <WiFi.h>
+#include <atomic>
+#include <lwip/sockets.h>
+#include <unity.h>
+#include "parameters.h"
+#include "modbus_tcp.h"
+
+#define TEST_PORT 15020
+#define TEST_REG 440 /*ZemepisnaSirka*/
+#define TPS_MS 3000
+#define TPS_STACK 4096
+
+static ModbusTcp tcp(TEST_PORT);
+static ModbusSlave tcpSlave(tcp, TcpExceptionError, TcpCorrectPackets);
+
+static std::atomic<bool> tpsRun;
+static std::atomic<uint32_t> tpsCnt;
+static std::atomic<uint32_t> tpsErr;
+static std::atomic<uint8_t> tpsDone;
+
+void setUp(void) {}
+void tearDown(void) {}
+
+static void SlaveTask(void *arg)
+{
+	while (true)
+	{
+		tcpSlave.Run();
+	}
+}
+
+static int Connect(void)
+{
+	int s = socket(AF_INET, SOCK_STREAM, 0);
+	if (s < 0)
+	{
+		return -1;
+	}
+	struct sockaddr_in adr = {};
+	adr.sin_family = AF_INET;
+	adr.sin_port = htons(TEST_PORT);
+	adr.sin_addr.s_addr = inet_addr("127.0.0.1");
+	int one = 1;
+	setsockopt(s, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+	struct timeval tv = {2, 0};
+	setsockopt(s, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+	if (connect(s, (struct sockaddr *)&adr, sizeof(adr)) != 0)
+	{
+		close(s);
+		return -1;
+	}
+	return s;
+}
+
+static bool RecvAll(int s, uint8_t *buf, size_t len)
+{
+	while (len > 0)
+	{
+		int n = recv(s, buf, len, 0);
+		if (n <= 0)
+		{
+			return false;
+		}
+		buf += n;
+		len -= n;
+	}
+	return true;
+}
+
+//*****************************************************************************
+//! FC3 request for 'cnt' registers from TEST_REG with transaction ID tid
+//*****************************************************************************
+static size_t ReadReq(uint8_t *adu, uint16_t tid, uint8_t unit, uint16_t cnt)
+{
+	const uint8_t req[] = {(uint8_t)(tid >> 8), (uint8_t)tid, 0, 0, 0, 6, unit,
+						   3, TEST_REG >> 8, TEST_REG & 0xFF, (uint8_t)(cnt >> 8), (uint8_t)cnt};
+	memcpy(adu, req, sizeof(req));
+	return sizeof(req);
+}
+
+//*****************************************************************************
+//! Receive one response ADU, returns PDU length or 0
+//*****************************************************************************
+static size_t RecvRsp(int s, uint16_t &tid, uint8_t &unit, uint8_t *pdu)
+{
+	uint8_t mbap[MODBUS_TCP_MBAP_LEN];
+	if (!RecvAll(s, mbap, sizeof(mbap)))
+	{
+		return 0;
+	}
+	uint16_t len = (uint16_t)mbap[4] << 8 | mbap[5];
+	if ((mbap[2] != 0) || (mbap[3] != 0) || (len < 2) || (len > MODBUS_TCP_PDU_MAX + 1) || !RecvAll(s, pdu, len - 1))
+	{
+		return 0;
+	}
+	tid = (uint16_t)mbap[0] << 8 | mbap[1];
+	unit = mbap[6];
+	return len - 1;
+}
+
+static void test_single(void)
+{
+	int s = Connect();
+	TEST_ASSERT_GREATER_OR_EQUAL(0, s);
+	uint8_t adu[MODBUS_TCP_ADU_MAX];
+	size_t len = ReadReq(adu, 0x1234, 0x11, 2);
+	TEST_ASSERT_EQUAL((int)len, send(s, adu, len, 0));
+
+	uint16_t tid;
+	uint8_t unit;
+	TEST_ASSERT_EQUAL(6, RecvRsp(s, tid, unit, adu));
+	TEST_ASSERT_EQUAL_HEX16(0x1234, tid);
+	TEST_ASSERT_EQUAL_HEX8(0x11, unit);
+	TEST_ASSERT_EQUAL_HEX8(3, adu[0]);
+	TEST_ASSERT_EQUAL(4, adu[1]);
+	TEST_ASSERT_EQUAL_INT16(ZemepisnaSirka.Get(), (int16_t)((uint16_t)adu[2] << 8 | adu[3]));
+	close(s);
+}
+
+static void test_pipelined(void)
+{
+	int s = Connect();
+	TEST_ASSERT_GREATER_OR_EQUAL(0, s);
+
+	/*4 pozadavky v jednom segmentu, odpovedi v poradi s vlastnim TID*/
+	uint8_t adu[4 * 12];
+	size_t len = 0;
+	for (uint16_t i = 0; i < 4; i++)
+	{
+		len += ReadReq(adu + len, 0xA000 + i, 1, 1 + i);
+	}
+	TEST_ASSERT_EQUAL((int)len, send(s, adu, len, 0));
+
+	uint8_t pdu[MODBUS_TCP_PDU_MAX];
+	for (uint16_t i = 0; i < 4; i++)
+	{
+		uint16_t tid;
+		uint8_t unit;
+		TEST_ASSERT_EQUAL(2 + 2 * (1 + i), RecvRsp(s, tid, unit, pdu));
+		TEST_ASSERT_EQUAL_HEX16(0xA000 + i, tid);
+	}
+	close(s);
+}
+
+static void test_clients(void)
+{
+	int s[MODBUS_TCP_MAX_CLIENTS + 1];
+	uint8_t adu[MODBUS_TCP_ADU_MAX];
+	uint16_t tid;
+	uint8_t unit;
+
+	uint16_t okBefore = TcpCorrectPackets.Get();
+	uint16_t rtuBefore = CorrectPackets.Get();
+	for (uint8_t i = 0; i < MODBUS_TCP_MAX_CLIENTS; i++)
+	{
+		s[i] = Connect();
+		TEST_ASSERT_GREATER_OR_EQUAL(0, s[i]);
+	}
+	for (uint8_t i = 0; i < MODBUS_TCP_MAX_CLIENTS; i++)
+	{
+		size_t len = ReadReq(adu, i, 1, 1);
+		TEST_ASSERT_EQUAL((int)len, send(s[i], adu, len, 0));
+	}
+	for (uint8_t i = 0; i < MODBUS_TCP_MAX_CLIENTS; i++)
+	{
+		TEST_ASSERT_EQUAL(4, RecvRsp(s[i], tid, unit, adu));
+		TEST_ASSERT_EQUAL(i, tid);
+	}
+	TEST_ASSERT_EQUAL(MODBUS_TCP_MAX_CLIENTS, TcpClients.Get());
+	TEST_ASSERT_EQUAL(okBefore + MODBUS_TCP_MAX_CLIENTS, TcpCorrectPackets.Get());
+	TEST_ASSERT_EQUAL(rtuBefore, CorrectPackets.Get());
+
+	/*klient nad limit je odmitnut*/
+	s[MODBUS_TCP_MAX_CLIENTS] = Connect();
+	if (s[MODBUS_TCP_MAX_CLIENTS] >= 0)
+	{
+		size_t len = ReadReq(adu, 99, 1, 1);
+		send(s[MODBUS_TCP_MAX_CLIENTS], adu, len, 0);
+		TEST_ASSERT_EQUAL(0, RecvRsp(s[MODBUS_TCP_MAX_CLIENTS], tid, unit, adu));
+		close(s[MODBUS_TCP_MAX_CLIENTS]);
+	}
+
+	/*vyjimka se pocita zvlast*/
+	uint16_t excBefore = TcpExceptionError.Get();
+	const uint8_t bad[] = {0, 7, 0, 0, 0, 2, 1, 0x2B};
+	TEST_ASSERT_EQUAL((int)sizeof(bad), send(s[0], bad, sizeof(bad), 0));
+	TEST_ASSERT_EQUAL(2, RecvRsp(s[0], tid, unit, adu));
+	TEST_ASSERT_EQUAL_HEX8(0xAB, adu[0]);
+	TEST_ASSERT_EQUAL(excBefore + 1, TcpExceptionError.Get());
+
+	for (uint8_t i = 0; i < MODBUS_TCP_MAX_CLIENTS; i++)
+	{
+		close(s[i]);
+	}
+	delay(100);
+	TEST_ASSERT_EQUAL(0, TcpClients.Get());
+}
+
+//*****************************************************************************
+//! Closed loop client, arg = pipeline depth (requests in flight)
+//*****************************************************************************
+static void TpsClient(void *arg)
+{
+	uint8_t depth = (uint8_t)(uintptr_t)arg;
+	uint8_t adu[MODBUS_TCP_ADU_MAX];
+	uint16_t tid = 0;
+	uint16_t rxTid;
+	uint8_t unit;
+	int s = Connect();
+
+	for (uint8_t i = 0; (s >= 0) && (i < depth); i++)
+	{
+		size_t len = ReadReq(adu, tid++, 1, 10);
+		send(s, adu, len, 0);
+	}
+	uint16_t expect = 0;
+	while ((s >= 0) && tpsRun)
+	{
+		if ((RecvRsp(s, rxTid, unit, adu) != 22) || (rxTid != expect++))
+		{
+			tpsErr++;
+			break;
+		}
+		tpsCnt++;
+		size_t len = ReadReq(adu, tid++, 1, 10);
+		send(s, adu, len, 0);
+	}
+	if (s >= 0)
+	{
+		close(s);
+	}
+	tpsDone++;
+	vTaskDelete(NULL);
+}
+
+static void test_tps(void)
+{
+	char msg[96];
+	for (uint8_t clients : {1, MODBUS_TCP_MAX_CLIENTS})
+	{
+		for (uint8_t depth : {1, 4})
+		{
+			if (clients * depth > MODBUS_TCP_QUEUE_LEN)
+			{ /*vic pozadavku nez fronta vede na SlaveDeviceBusy*/
+				continue;
+			}
+			tpsRun = true;
+			tpsCnt = 0;
+			tpsErr = 0;
+			tpsDone = 0;
+			for (uint8_t c = 0; c < clients; c++)
+			{
+				xTaskCreatePinnedToCore(TpsClient, "tpsCli", TPS_STACK, (void *)(uintptr_t)depth, 1, NULL, c & 1);
+			}
+			delay(TPS_MS);
+			uint32_t cnt = tpsCnt;
+			tpsRun = false;
+			while (tpsDone < clients)
+			{
+				delay(10);
+			}
+			snprintf(msg, sizeof(msg), "%u clients, depth %u: %u transactions/s", clients, depth, (unsigned)(cnt * 1000 / TPS_MS));
+			TEST_MESSAGE(msg);
+			TEST_ASSERT_EQUAL_UINT32(0, tpsErr.load());
+			TEST_ASSERT_GREATER_THAN_UINT32(0, cnt);
+		}
+	}
+}
+
+void setup()
+{
+	delay(2000); /*cas na pripojeni monitoru*/
+	Register::InitAll();
+	WiFi.mode(WIFI_STA); /*spusti TCP/IP stack, loopback nepotrebuje spojeni*/
+	tcpSlave.Init();
+	xTaskCreateUniversal(SlaveTask, "mdbTcpTest", getArduinoLoopTaskStackSize(), NULL, 2, NULL, -1);
+
+	UNITY_BEGIN();
+	RUN_TEST(test_single);
+	RUN_TEST(test_pipelined);
+	RUN_TEST(test_clients);
+	RUN_TEST(test_tps);
+	UNITY_END();
+}
+
+void loop()
+{
+}
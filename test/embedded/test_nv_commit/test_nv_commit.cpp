@@ -0,0 +1,148 @@
+/***********************************************************************
+ * Filename: test_nv_commit.cpp
+ * Author: agent
+ * Date: 2026-10-17
+ * Description:
+ *     Saving of a settings form with 15 NV parameters, written through
+ *     Register::JsonWrite like /api/set_params. Write-behind (Set only
+ *     marks the parameter, NvTask commits after NV_WRITE_DELAY_MS) is
+ *     compared with a commit after every Set, which is what the former
+ *     synchronous Set did. NvCommits and Set() latency are reported.
+ *     Original values are written back at the end.
+ *     Run: pio test -e esp32s3-n16r8v -f embedded/test_nv_commit
+ *
+ ***********************************************************************/
+
+#include <Arduino.h>
+#include <unity.h>
+#include "parameters.h"
+
+#define FORM_PARAMS 15
+
+typedef struct
+{
+	Register *reg;
+	int16_t orig;
+	int16_t val;
+} formpar_t;
+
+static formpar_t form[FORM_PARAMS];
+static uint8_t formCnt = 0;
+
+void setUp(void) {}
+void tearDown(void) {}
+
+//*****************************************************************************
+//! Writable single register NV parameters, new value differs from current
+//*****************************************************************************
+static void PickForm(void)
+{
+	for (uint16_t i = 0; (i < Register::NmrParameters) && (formCnt < FORM_PARAMS); i++)
+	{
+		Register *reg = Register::GetParByIdx(i);
+		uint32_t type = reg->def.dsc & 0xFF00;
+		if (!reg->isNV() || !reg->IsWritable() || (reg->GetSize() != 1) || ((type != Par_U16) && (type != Par_S16)) ||
+			(reg->def.min >= reg->def.max))
+		{
+			continue;
+		}
+		formpar_t &p = form[formCnt++];
+		p.reg = reg;
+		reg->GetRegVal(&p.orig);
+		int32_t v = (type == Par_U16) ? (uint16_t)p.orig : p.orig;
+		p.val = (int16_t)((v < reg->def.max) ? v + 1 : v - 1);
+	}
+}
+
+static bool WriteForm(bool orig, uint32_t &maxUs, uint32_t &sumUs, bool commitEach)
+{
+	JsonDocument doc;
+	bool ok = true;
+	maxUs = 0;
+	sumUs = 0;
+	for (uint8_t i = 0; i < formCnt; i++)
+	{
+		uint32_t type = form[i].reg->def.dsc & 0xFF00;
+		int16_t v = orig ? form[i].orig : form[i].val;
+		doc[form[i].reg->def.ptxt] = (type == Par_U16) ? (int32_t)(uint16_t)v : (int32_t)v;
+	}
+
+	for (JsonPair kvp : doc.as<JsonObject>())
+	{
+		int64_t t0 = esp_timer_get_time();
+		ok &= Register::JsonWrite(kvp);
+		if (commitEach)
+		{
+			Register::NvFlush();
+		}
+		uint32_t us = esp_timer_get_time() - t0;
+		maxUs = std::max(maxUs, us);
+		sumUs += us;
+	}
+	return ok;
+}
+
+//*****************************************************************************
+//! Run NvTask like the NV task of the application until the burst is written
+//*****************************************************************************
+static uint32_t WaitCommit(uint16_t commits)
+{
+	uint32_t t0 = millis();
+	while ((NvCommits.Get() == commits) && ((millis() - t0) < 3 * NV_WRITE_DELAY_MS))
+	{
+		Register::NvTask();
+		delay(10);
+	}
+	return millis() - t0;
+}
+
+static void test_form_write_behind(void)
+{
+	char msg[112];
+	uint32_t maxUs, sumUs;
+	TEST_ASSERT_EQUAL(FORM_PARAMS, formCnt);
+
+	/*zapis na pozadi, jeden commit za formular*/
+	uint16_t commits = NvCommits.Get();
+	TEST_ASSERT_TRUE(WriteForm(false, maxUs, sumUs, false));
+	uint32_t waitMs = WaitCommit(commits);
+	uint16_t wbCommits = NvCommits.Get() - commits;
+	snprintf(msg, sizeof(msg), "write-behind: %u commits, Set avg %u us max %u us, form %u us, in NVS after %u ms",
+			 wbCommits, (unsigned)(sumUs / formCnt), (unsigned)maxUs, (unsigned)sumUs, (unsigned)waitMs);
+	TEST_MESSAGE(msg);
+	TEST_ASSERT_EQUAL(1, wbCommits);
+	uint32_t wbMax = maxUs;
+
+	/*commit po kazdem Set (puvodni synchronni zapis)*/
+	commits = NvCommits.Get();
+	TEST_ASSERT_TRUE(WriteForm(true, maxUs, sumUs, true));
+	uint16_t syncCommits = NvCommits.Get() - commits;
+	snprintf(msg, sizeof(msg), "commit per Set: %u commits, Set avg %u us max %u us, form %u us",
+			 syncCommits, (unsigned)(sumUs / formCnt), (unsigned)maxUs, (unsigned)sumUs);
+	TEST_MESSAGE(msg);
+	TEST_ASSERT_EQUAL(FORM_PARAMS, syncCommits);
+	TEST_ASSERT_TRUE(wbMax < sumUs / formCnt);
+}
+
+void setup()
+{
+	delay(2000); /*cas na pripojeni monitoru*/
+	Register::InitAll();
+	uint8_t level = Register::ActiveLevel;
+	Register::ActiveLevel = Par_Installer;
+	PickForm();
+
+	UNITY_BEGIN();
+	RUN_TEST(test_form_write_behind);
+	UNITY_END();
+
+	/*puvodni hodnoty zustanou v NVS*/
+	uint32_t maxUs, sumUs;
+	WriteForm(true, maxUs, sumUs, false);
+	Register::NvFlush();
+	Register::ActiveLevel = level;
+}
+
+void loop()
+{
+}
@@ -0,0 +1,283 @@
+/***********************************************************************
+ * Filename: test_par_notify.cpp
+ * Author: agent
+ * Date: 2026-10-17
+ * Description:
+ *     Wake-ups and CPU load of parameter consumers, polling against
+ *     change notifications. Consumers run on core 0:
+ *       - door state: poll StavDvirka every LED_CTRL_TIME_MS, or block
+ *         until Register::NotifyTask style notification,
+ *       - control gains: re-apply five parameters every control cycle
+ *         (former Servo::Ctrl), or only after the change callback.
+ *     The test task changes StavDvirka every second and a gain every
+ *     2.5 s for WINDOW_MS. Reported are wake-ups, reactions, reaction
+ *     latency, busy time per task and CPU load of core 0 derived from
+ *     idle hook calls against an idle window without consumers.
+ *     Run: pio test -e esp32s3-n16r8v -f embedded/test_par_notify
+ *
+ ***********************************************************************/
+
+#include <Arduino.h>
+#include <unity.h>
+#include <atomic>
+#include "esp_freertos_hooks.h"
+#include "parameters.h"
+#include "led.h"
+#include "door_ctrl.h"
+
+#define WINDOW_MS 10000
+#define STATE_PERIOD_MS 1000
+#define GAIN_PERIOD_MS 2500
+#define CONSUMER_CORE 0
+
+typedef struct
+{
+	const char *name;
+	TaskHandle_t task;
+	uint32_t wakes;
+	uint32_t work;	   /*obslouzene zmeny, resp. aplikace parametru*/
+	uint64_t busyUs;
+	uint32_t latMaxUs; /*od zmeny po reakci*/
+	std::atomic<bool> run;
+} consumer_t;
+
+static std::atomic<uint32_t> idleCalls(0);
+static std::atomic<int64_t> changeUs(0);
+static std::atomic<bool> gainsChanged(false);
+static std::atomic<TaskHandle_t> stateTask(NULL);
+static volatile int32_t gainSink;
+
+void setUp(void) {}
+void tearDown(void) {}
+
+static bool IdleHook(void)
+{
+	idleCalls++;
+	return false; /*volat znovu, pocet volani meri volny cas jadra*/
+}
+
+//*****************************************************************************
+//! Observers stay registered after the test, they check the target first
+//*****************************************************************************
+static void OnState(Register &reg, void *arg)
+{
+	TaskHandle_t h = stateTask;
+	if (h != NULL)
+	{
+		xTaskNotifyGive(h);
+	}
+}
+
+static void OnGain(Register &reg, void *arg)
+{
+	gainsChanged = true;
+}
+
+static void ApplyGains(void)
+{ /*jako Servo::ApplyCtrlParams*/
+	gainSink = PIDRychlostP.Get() + PIDRychlostI.Get() + PIDPolohaP.Get() + MaxRychlost.Get() + MinRychlost.Get();
+}
+
+static void Latency(consumer_t &c)
+{
+	uint32_t lat = esp_timer_get_time() - changeUs;
+	c.latMaxUs = std::max(c.latMaxUs, lat);
+}
+
+static void PollStateTask(void *arg)
+{
+	consumer_t &c = *(consumer_t *)arg;
+	uint16_t last = StavDvirka.Get();
+	while (c.run)
+	{
+		vTaskDelay(pdMS_TO_TICKS(LED_CTRL_TIME_MS));
+		int64_t t0 = esp_timer_get_time();
+		c.wakes++;
+		if (StavDvirka.Get() != last)
+		{
+			last = StavDvirka.Get();
+			c.work++;
+			Latency(c);
+		}
+		c.busyUs += esp_timer_get_time() - t0;
+	}
+	c.task = NULL;
+	vTaskDelete(NULL);
+}
+
+static void NotifiedStateTask(void *arg)
+{
+	consumer_t &c = *(consumer_t *)arg;
+	stateTask = xTaskGetCurrentTaskHandle();
+	while (c.run)
+	{
+		if (ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(WINDOW_MS)) == 0)
+		{
+			continue;
+		}
+		int64_t t0 = esp_timer_get_time();
+		c.wakes++;
+		c.work++;
+		Latency(c);
+		c.busyUs += esp_timer_get_time() - t0;
+	}
+	stateTask = NULL;
+	c.task = NULL;
+	vTaskDelete(NULL);
+}
+
+static void PollGainsTask(void *arg)
+{
+	consumer_t &c = *(consumer_t *)arg;
+	while (c.run)
+	{
+		vTaskDelay(pdMS_TO_TICKS(CONTROL_TASK_PERIOD_MS));
+		int64_t t0 = esp_timer_get_time();
+		c.wakes++;
+		c.work++;
+		ApplyGains();
+		c.busyUs += esp_timer_get_time() - t0;
+	}
+	c.task = NULL;
+	vTaskDelete(NULL);
+}
+
+static void FlagGainsTask(void *arg)
+{
+	consumer_t &c = *(consumer_t *)arg;
+	while (c.run)
+	{
+		vTaskDelay(pdMS_TO_TICKS(CONTROL_TASK_PERIOD_MS));
+		int64_t t0 = esp_timer_get_time();
+		c.wakes++;
+		if (gainsChanged.exchange(false))
+		{
+			c.work++;
+			ApplyGains();
+		}
+		c.busyUs += esp_timer_get_time() - t0;
+	}
+	c.task = NULL;
+	vTaskDelete(NULL);
+}
+
+//*****************************************************************************
+//! Producer of changes for WINDOW_MS, returns idle hook calls of the window
+//*****************************************************************************
+static uint32_t RunWindow(bool changes)
+{
+	uint16_t state = Otevreno;
+	int16_t gain = PIDRychlostP.Get();
+	idleCalls = 0;
+	uint32_t t0 = millis();
+	uint32_t nextState = STATE_PERIOD_MS;
+	uint32_t nextGain = GAIN_PERIOD_MS;
+	while ((millis() - t0) < WINDOW_MS)
+	{
+		uint32_t t = millis() - t0;
+		if (changes && (t >= nextState))
+		{
+			nextState += STATE_PERIOD_MS;
+			state = (state == Otevreno) ? Zavreno : Otevreno;
+			changeUs = esp_timer_get_time();
+			StavDvirka.Set(state);
+		}
+		if (changes && (t >= nextGain))
+		{
+			nextGain += GAIN_PERIOD_MS;
+			gain = (gain > 0) ? gain - 1 : gain + 1;
+			PIDRychlostP.Set(gain);
+		}
+		delay(10);
+	}
+	return idleCalls;
+}
+
+static void Start(consumer_t &c, TaskFunction_t fn)
+{
+	c.wakes = 0;
+	c.work = 0;
+	c.busyUs = 0;
+	c.latMaxUs = 0;
+	c.run = true;
+	xTaskCreatePinnedToCore(fn, c.name, 4096, &c, 2, &c.task, CONSUMER_CORE);
+}
+
+static void Stop(consumer_t &c)
+{
+	c.run = false;
+	if (c.task == stateTask)
+	{
+		xTaskNotifyGive(c.task);
+	}
+	while (c.task != NULL)
+	{
+		delay(10);
+	}
+}
+
+static void Report(const consumer_t &c)
+{
+	char msg[112];
+	snprintf(msg, sizeof(msg), "%-14s: %4u wake-ups, %3u reactions, latency max %6u us, busy %5u us",
+			 c.name, (unsigned)c.wakes, (unsigned)c.work, (unsigned)c.latMaxUs, (unsigned)c.busyUs);
+	TEST_MESSAGE(msg);
+}
+
+static void test_poll_vs_notify(void)
+{
+	static consumer_t state[2] = {{"state poll"}, {"state notify"}};
+	static consumer_t gains[2] = {{"gains poll"}, {"gains notify"}};
+	char msg[112];
+
+	TEST_ASSERT_TRUE(esp_register_freertos_idle_hook_for_cpu(IdleHook, CONSUMER_CORE) == ESP_OK);
+	TEST_ASSERT_TRUE(StavDvirka.Subscribe(OnState));
+	TEST_ASSERT_TRUE(PIDRychlostP.Subscribe(OnGain));
+	uint16_t origState = StavDvirka.Get();
+	int16_t origGain = PIDRychlostP.Get();
+
+	uint32_t idle = RunWindow(false);
+	TEST_ASSERT_TRUE(idle > 0);
+
+	for (uint8_t mode = 0; mode < 2; mode++)
+	{
+		Start(state[mode], (mode == 0) ? PollStateTask : NotifiedStateTask);
+		Start(gains[mode], (mode == 0) ? PollGainsTask : FlagGainsTask);
+		delay(100);
+		gainsChanged = false;
+		uint32_t busyIdle = RunWindow(true);
+		Stop(state[mode]);
+		Stop(gains[mode]);
+		Report(state[mode]);
+		Report(gains[mode]);
+		snprintf(msg, sizeof(msg), "%s: core %u load %.3f %%", (mode == 0) ? "polling" : "notifications", CONSUMER_CORE,
+				 100.0 * (1.0 - (double)busyIdle / idle));
+		TEST_MESSAGE(msg);
+	}
+
+	esp_deregister_freertos_idle_hook_for_cpu(IdleHook, CONSUMER_CORE);
+	StavDvirka.Set(origState);
+	PIDRychlostP.Set(origGain);
+
+	const uint32_t changes = WINDOW_MS / STATE_PERIOD_MS;
+	TEST_ASSERT_UINT32_WITHIN(1, changes, state[0].work);
+	TEST_ASSERT_UINT32_WITHIN(1, changes, state[1].work);
+	TEST_ASSERT_TRUE(state[1].wakes < state[0].wakes);
+	TEST_ASSERT_TRUE(state[1].latMaxUs < state[0].latMaxUs);
+	TEST_ASSERT_UINT32_WITHIN(1, WINDOW_MS / GAIN_PERIOD_MS, gains[1].work);
+	TEST_ASSERT_TRUE(gains[1].work < gains[0].work);
+}
+
+void setup()
+{
+	delay(2000); /*cas na pripojeni monitoru*/
+	Register::InitAll();
+
+	UNITY_BEGIN();
+	RUN_TEST(test_poll_vs_notify);
+	UNITY_END();
+}
+
+void loop()
+{
+}
@@ -0,0 +1,243 @@
+/***********************************************************************
+ * Filename: test_param_batch.cpp
+ * Author: agent
+ * Date: 2026-10-17
+ * Description:
+ *     Tests of Device::BuildParamFrames and a simulated radio wake
+ *     window. The accessory has 40 single register parameters, a 32
+ *     char string and an S32 value. For a random set of changed
+ *     parameters the frames must cover every changed parameter exactly
+ *     once, fit MAX_PAYLOAD_SIZE and carry the current values. The wake
+ *     window (writes + TRANSMIT_DONE, every frame waits for MAC ACK) is
+ *     then compared for one MSG_WRITE_PARAM_REQUEST per parameter and
+ *     for the batched MSG_WRITE_PARAMS_REQUEST frames.
+ *     Radio model: 1 Mbps ESP-NOW, 192 us preamble, 45 B MAC header and
+ *     vendor element, 622 us ACK and software hop, 5 % frame loss,
+ *     retry after 50 ms doubled up to 4 attempts, 1.5 ms handling of
+ *     a write frame in the accessory.
+ *     Device parameters use the register classes, so the test runs on
+ *     the board.
+ *     Run: pio test -e esp32s3-n16r8v -f embedded/test_param_batch
+ *
+ ***********************************************************************/
+
+#include <Arduino.h>
+#include <unity.h>
+#include "device_manager.h"
+
+#define SINGLE_PARAMS 40
+#define SINGLE_FIRST 100
+#define STRING_ADR 200
+#define STRING_LEN 32
+#define S32_ADR 216
+#define SIM_ROUNDS 2000
+#define LOSS_PERMILLE 50
+#define BACKOFF_US 50000
+#define ATTEMPTS 4
+#define PROC_US 1500
+
+static const uint8_t mac[6] = {0x02, 0x00, 0x00, 0x00, 0x00, 0x24};
+static Device *dev;
+static uint32_t rng = 0x24;
+
+void setUp(void) {}
+void tearDown(void) {}
+
+static uint32_t Rnd(void)
+{ /*xorshift32*/
+    rng ^= rng << 13;
+    rng ^= rng >> 17;
+    rng ^= rng << 5;
+    return rng;
+}
+
+static void AddParam(uint16_t adr, uint32_t type, int32_t max, const char *name)
+{
+    pardef_t_espnow pd = {};
+    pd.min = (type == Par_STRING) ? 0 : -1000;
+    pd.max = max;
+    pd.dsc = type | Par_RW;
+    pd.adr = adr;
+    pd.atr = BATCH_WRITE_FLAG;
+    strncpy(pd.ptxt, name, sizeof(pd.ptxt) - 1);
+    dev->addParameter(pd);
+}
+
+static uint32_t FrameUs(size_t payload)
+{
+    return 192 + (45 + payload) * 8 + 622;
+}
+
+//*****************************************************************************
+//! Time of sending frames one by one, each waits for ACK, lost frame is
+//! repeated after backoff
+//*****************************************************************************
+static uint32_t WakeUs(const std::vector<size_t> &frames)
+{
+    uint32_t t = 0;
+    for (size_t payload : frames)
+    {
+        uint32_t backoff = BACKOFF_US;
+        for (uint8_t a = 0; a < ATTEMPTS; a++)
+        {
+            t += FrameUs(payload);
+            if ((Rnd() % 1000) >= LOSS_PERMILLE)
+            {
+                break;
+            }
+            t += backoff;
+            backoff *= 2;
+        }
+        if (payload > 0)
+        {
+            t += PROC_US;
+        }
+    }
+    return t;
+}
+
+static void ChangeRandom(uint8_t n)
+{
+    for (auto &par : dev->parameters)
+    {
+        par->changed = false;
+    }
+    uint8_t cnt = dev->parameters.size();
+    for (uint8_t k = 0; k < n; k++)
+    {
+        uint8_t i;
+        do
+        {
+            i = Rnd() % cnt;
+        } while (dev->parameters[i]->changed);
+        ParameterWrapper *par = dev->parameters[i].get();
+        par->changed = true;
+        if (par->reg->GetSize() == 1)
+        { /*nova hodnota, ramec ji musi nest*/
+            par->reg->SetRegVal((int16_t)(Rnd() % 1000));
+        }
+    }
+}
+
+static void test_frames_cover_changes(void)
+{
+    for (uint32_t r = 0; r < 200; r++)
+    {
+        uint8_t n = 1 + Rnd() % dev->parameters.size();
+        ChangeRandom(n);
+        dev->BuildParamFrames();
+        TEST_ASSERT_FALSE(dev->paramFrames.empty());
+
+        for (auto &frame : dev->paramFrames)
+        {
+            TEST_ASSERT_EQUAL(MSG_WRITE_PARAMS_REQUEST, frame.messageType);
+            TEST_ASSERT_LESS_OR_EQUAL(MAX_PAYLOAD_SIZE, frame.payloadSize);
+
+            /*rozsahy nesou aktualni hodnoty a jen zmenene parametry*/
+            size_t pos = 0;
+            while (pos < frame.payloadSize)
+            {
+                WriteRangeHeader range;
+                memcpy(&range, frame.payload + pos, sizeof(range));
+                pos += sizeof(range);
+                TEST_ASSERT_LESS_OR_EQUAL(frame.payloadSize, pos + range.nmr * sizeof(int16_t));
+                int16_t vals[UINT8_MAX];
+                uint16_t done = 0;
+                while (done < range.nmr)
+                {
+                    ParameterWrapper *par = dev->getParameterRegister(range.regAddr + done);
+                    TEST_ASSERT_NOT_NULL(par);
+                    TEST_ASSERT_TRUE(par->changed);
+                    TEST_ASSERT_EQUAL(range.regAddr + done, par->pd.adr);
+                    par->reg->GetRegVals(vals + done, par->pd.adr, par->reg->GetSize());
+                    done += par->reg->GetSize();
+                }
+                TEST_ASSERT_EQUAL(range.nmr, done);
+                TEST_ASSERT_EQUAL_MEMORY(vals, frame.payload + pos, range.nmr * sizeof(int16_t));
+                pos += range.nmr * sizeof(int16_t);
+            }
+            TEST_ASSERT_EQUAL(frame.payloadSize, pos);
+            dev->MarkParamFrame(&frame, false);
+        }
+
+        /*kazdy zmeneny parametr byl v nekterem ramci*/
+        for (auto &par : dev->parameters)
+        {
+            TEST_ASSERT_FALSE(par->changed);
+        }
+    }
+}
+
+static void test_wake_window(void)
+{
+    const uint8_t cases[] = {1, 3, 5, 10, 20, SINGLE_PARAMS + 2};
+    char msg[112];
+    for (uint8_t n : cases)
+    {
+        uint64_t frames[2] = {0, 0};
+        uint64_t wakeUs[2] = {0, 0};
+        uint32_t buildUs = 0;
+        for (uint32_t r = 0; r < SIM_ROUNDS; r++)
+        {
+            ChangeRandom(n);
+            std::vector<size_t> single;
+            for (auto &par : dev->parameters)
+            {
+                if (par->changed)
+                {
+                    single.push_back(4 + 2 * par->reg->GetSize());
+                }
+            }
+            int64_t t0 = esp_timer_get_time();
+            dev->BuildParamFrames();
+            buildUs = std::max(buildUs, (uint32_t)(esp_timer_get_time() - t0));
+            std::vector<size_t> batch;
+            for (auto &frame : dev->paramFrames)
+            {
+                batch.push_back(frame.payloadSize);
+            }
+            frames[0] += single.size();
+            frames[1] += batch.size();
+            single.push_back(0); /*MSG_TRANSMIT_DONE*/
+            batch.push_back(0);
+            wakeUs[0] += WakeUs(single);
+            wakeUs[1] += WakeUs(batch);
+        }
+        snprintf(msg, sizeof(msg), "%2u changed: frames %5.1f -> %4.1f, wake %6.2f ms -> %6.2f ms, build max %u us", n,
+                 (double)frames[0] / SIM_ROUNDS, (double)frames[1] / SIM_ROUNDS,
+                 (double)wakeUs[0] / SIM_ROUNDS / 1000, (double)wakeUs[1] / SIM_ROUNDS / 1000, (unsigned)buildUs);
+        TEST_MESSAGE(msg);
+        TEST_ASSERT_TRUE(frames[1] <= frames[0]);
+        if (n >= 3)
+        {
+            TEST_ASSERT_TRUE(wakeUs[1] < wakeUs[0]);
+        }
+    }
+}
+
+void setup()
+{
+    delay(2000); /*cas na pripojeni monitoru*/
+    Register::InitAll();
+
+    dev = new Device(DEVICE_TYPE_FEEDER, mac);
+    char name[16];
+    for (uint16_t i = 0; i < SINGLE_PARAMS; i++)
+    {
+        snprintf(name, sizeof(name), "Par%u", i);
+        AddParam(SINGLE_FIRST + i, Par_S16, 1000, name);
+    }
+    AddParam(STRING_ADR, Par_STRING, STRING_LEN, "Text");
+    AddParam(S32_ADR, Par_S32, 100000, "Pocet");
+
+    UNITY_BEGIN();
+    RUN_TEST(test_frames_cover_changes);
+    RUN_TEST(test_wake_window);
+    UNITY_END();
+
+    delete dev;
+}
+
+void loop()
+{
+}
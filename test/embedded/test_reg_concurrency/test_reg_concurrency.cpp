@@ -0,0 +1,245 @@
+/***********************************************************************
+ * Filename: test_reg_concurrency.cpp
+ * Author: agent
+ * Date: 2026-10-17
+ * Description:
+ *     Stress test of parallel register access: writer tasks change
+ *     S32 and STRING parameters (Set() and WriteRange() as Modbus
+ *     does) while reader tasks on both cores read them word by word
+ *     with own RegCursor, by ReadRange(), Get() and as JSON. Every
+ *     value read must be one of the written values, never a mix of
+ *     two. The registry needs NVS and FreeRTOS, so the test runs on
+ *     the board.
+ *     Run: pio test -e esp32s3-n16r8v -f embedded/test_reg_concurrency
+ *
+ ***********************************************************************/
+
+#include <Arduino.h>
+#include <atomic>
+#include <unity.h>
+#include "parameters.h"
+
+#define STRESS_MS 5000
+#define STRESS_STACK 6144
+
+/*S32 zapisovany z Modbus: slova se lisi, smichani dava jinou platnou hodnotu*/
+#define BAUD_A 0x00011000 /*69632*/
+#define BAUD_B 0x0000F000 /*61440, smichane 0x00001000 je v mezich*/
+
+/*ruzne delky, obe se vejdou do MacAdresa i WiFihostname*/
+static const char StrA[] = "AAAAAAAAAAAAAAAA";
+static const char StrB[] = "BBBBBBBBBBBB";
+
+static std::atomic<bool> running;
+static std::atomic<uint8_t> finished;
+static std::atomic<uint32_t> reads;
+static std::atomic<uint32_t> torn;
+
+void setUp(void) {}
+void tearDown(void) {}
+
+static bool StrOk(const char *txt, size_t len)
+{
+	size_t expect = (txt[0] == 'A') ? strlen(StrA) : (txt[0] == 'B') ? strlen(StrB) : 0;
+	if ((expect == 0) || (len != expect))
+	{
+		return false;
+	}
+	for (size_t i = 1; i < len; i++)
+	{
+		if (txt[i] != txt[0])
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+static bool S32Ok(uint32_t v)
+{
+	return (v >> 16) == (v & 0xFFFF);
+}
+
+static bool BaudOk(int32_t v)
+{
+	return (v == BAUD_A) || (v == BAUD_B);
+}
+
+//*****************************************************************************
+//! String from registers (2 characters per word, low byte first)
+//*****************************************************************************
+static size_t RegsToStr(const int16_t *regs, uint16_t nmr, char *out)
+{
+	size_t len = 0;
+	for (uint16_t i = 0; i < nmr; i++)
+	{
+		out[len++] = (uint16_t)regs[i] & 0xFF;
+		out[len++] = (uint16_t)regs[i] >> 8;
+	}
+	out[len] = '\0';
+	return strlen(out);
+}
+
+static void StrToRegs(const char *txt, uint16_t nmr, int16_t *regs)
+{
+	size_t len = strlen(txt);
+	for (uint16_t i = 0; i < nmr; i++)
+	{
+		size_t idx = 2 * (size_t)i;
+		uint16_t lo = (idx < len) ? (uint8_t)txt[idx] : 0;
+		uint16_t hi = (idx + 1 < len) ? (uint8_t)txt[idx + 1] : 0;
+		regs[i] = (int16_t)(hi << 8 | lo);
+	}
+}
+
+static void Done(void)
+{
+	finished++;
+	vTaskDelete(NULL);
+}
+
+static void SetWriter(void *arg)
+{
+	for (uint32_t k = 0; running; k++)
+	{
+		uint16_t w = k & 0x7FFF;
+		EspNowRxDrop.Set((int32_t)((uint32_t)w << 16 | w));
+		MacAdresa.Set((k & 1) ? StrA : StrB);
+		if ((k & 0xFF) == 0)
+		{
+			vTaskDelay(1);
+		}
+	}
+	Done();
+}
+
+//*****************************************************************************
+//! Modbus style writer, arg selects values, two such tasks write at once
+//*****************************************************************************
+static void RangeWriter(void *arg)
+{
+	bool a = (arg != NULL);
+	int16_t baud[2] = {(int16_t)((a ? BAUD_A : BAUD_B) >> 16), (int16_t)((a ? BAUD_A : BAUD_B) & 0xFFFF)};
+	uint16_t nmr = WiFihostname.GetSize();
+	int16_t str[STRING_REG_MAX_LEN / 2];
+	StrToRegs(a ? StrA : StrB, nmr, str);
+
+	for (uint32_t k = 0; running; k++)
+	{
+		Register::WriteRange(MdbBaudRate.def.adr, 2, baud);
+		Register::WriteRange(WiFihostname.def.adr, nmr, str);
+		if ((k & 0xFF) == 0)
+		{
+			vTaskDelay(1);
+		}
+	}
+	Done();
+}
+
+static void Reader(void *arg)
+{
+	int16_t regs[STRING_REG_MAX_LEN / 2];
+	char txt[STRING_REG_MAX_LEN + 1];
+	JsonDocument doc;
+
+	for (uint32_t k = 0; running; k++)
+	{
+		uint32_t bad = 0;
+
+		/*slovo po slovu s vlastnim kurzorem jako FC3 po jednom registru*/
+		RegCursor cur;
+		Register::ReadReg(&regs[0], EspNowRxDrop.def.adr, cur);
+		Register::ReadReg(&regs[1], EspNowRxDrop.def.adr + 1, cur);
+		bad += !S32Ok((uint32_t)(uint16_t)regs[0] << 16 | (uint16_t)regs[1]);
+
+		uint16_t nmr = MacAdresa.GetSize();
+		for (uint16_t i = 0; i < nmr; i++)
+		{
+			Register::ReadReg(&regs[i], MacAdresa.def.adr + i, cur);
+		}
+		bad += !StrOk(txt, RegsToStr(regs, nmr, txt));
+
+		/*blok jako FC3 a FC23*/
+		Register::ReadRange(MdbBaudRate.def.adr, 2, regs);
+		bad += !BaudOk((int32_t)((uint32_t)(uint16_t)regs[0] << 16 | (uint16_t)regs[1]));
+		nmr = WiFihostname.GetSize();
+		Register::ReadRange(WiFihostname.def.adr, nmr, regs);
+		bad += !StrOk(txt, RegsToStr(regs, nmr, txt));
+
+		/*web a MQTT*/
+		bad += !S32Ok((uint32_t)EspNowRxDrop.Get());
+		bad += !StrOk(txt, MacAdresa.Get(txt));
+		bad += !StrOk(txt, WiFihostname.Get(txt));
+		if ((k & 0x0F) == 0)
+		{
+			MdbBaudRate.GetJsonVal(doc.to<JsonVariant>());
+			bad += !BaudOk(doc.as<int32_t>());
+			WiFihostname.GetJsonVal(doc.to<JsonVariant>());
+			const char *s = doc.as<const char *>();
+			bad += (s == NULL) || !StrOk(s, strlen(s));
+		}
+
+		reads++;
+		torn += bad;
+		if ((k & 0xFF) == 0)
+		{
+			vTaskDelay(1);
+		}
+	}
+	Done();
+}
+
+static void test_no_tearing(void)
+{
+	char hostname[STRING_REG_MAX_LEN + 1];
+	WiFihostname.Get(hostname);
+	int32_t baud = MdbBaudRate.Get();
+	uint8_t level = Register::ActiveLevel;
+	Register::ActiveLevel = Par_Installer; /*MdbBaudRate zapisuje instalater*/
+
+	EspNowRxDrop.Set(0);
+	MacAdresa.Set(StrA);
+	MdbBaudRate.Set(BAUD_A);
+	WiFihostname.Set(StrA);
+
+	running = true;
+	finished = 0;
+	reads = 0;
+	torn = 0;
+	xTaskCreatePinnedToCore(SetWriter, "wrSet", STRESS_STACK, NULL, 1, NULL, 1);
+	xTaskCreatePinnedToCore(RangeWriter, "wrA", STRESS_STACK, (void *)1, 1, NULL, 0);
+	xTaskCreatePinnedToCore(RangeWriter, "wrB", STRESS_STACK, NULL, 1, NULL, 1);
+	xTaskCreatePinnedToCore(Reader, "rd0", STRESS_STACK, NULL, 1, NULL, 0);
+	xTaskCreatePinnedToCore(Reader, "rd1", STRESS_STACK, NULL, 1, NULL, 1);
+	delay(STRESS_MS);
+	running = false;
+	while (finished < 5)
+	{
+		delay(10);
+	}
+
+	Register::ActiveLevel = level;
+	MdbBaudRate.Set(baud);
+	WiFihostname.Set(hostname);
+	EspNowRxDrop.Set(0);
+	MacAdresa.Set("");
+
+	char msg[96];
+	snprintf(msg, sizeof(msg), "%u read rounds, %u torn values", (unsigned)reads.load(), (unsigned)torn.load());
+	TEST_MESSAGE(msg);
+	TEST_ASSERT_GREATER_THAN_UINT32(1000, reads.load());
+	TEST_ASSERT_EQUAL_UINT32(0, torn.load());
+}
+
+void setup()
+{
+	delay(2000); /*cas na pripojeni monitoru*/
+	Register::InitAll();
+	UNITY_BEGIN();
+	RUN_TEST(test_no_tearing);
+	UNITY_END();
+}
+
+void loop()
+{
+}
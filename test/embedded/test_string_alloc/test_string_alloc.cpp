@@ -0,0 +1,222 @@
+/***********************************************************************
+ * Filename: test_string_alloc.cpp
+ * Author: agent
+ * Date: 2026-10-17
+ * Description:
+ *     Heap allocations and time of string register reads. Allocations
+ *     are counted by wrappers of malloc/calloc/realloc/heap_caps_malloc,
+ *     which are linked only in env esp32s3-alloc (-Wl,--wrap), in other
+ *     environments the test is ignored. Compared are Get(buf) into a
+ *     caller buffer, Get() returning String (former read path), the
+ *     hostname check done on every web request and a get_params request
+ *     of all string parameters serialized into a fixed buffer.
+ *     Run: pio test -e esp32s3-alloc -f embedded/test_string_alloc
+ *
+ ***********************************************************************/
+
+#include <Arduino.h>
+#include <unity.h>
+#include <atomic>
+#include "parameters.h"
+
+#define READS 10000
+
+static string_reg *const strs[] = {&WiFihostname, &WiFiSSID, &NTPServer, &PopisCasu, &MQTTJmeno, &MQTTbase,
+								   &WiFiScanSSID1, &WiFiScanSSID2, &WiFiScanSSID3, &WiFiScanSSID4};
+#define STRS (sizeof(strs) / sizeof(strs[0]))
+
+static std::atomic<uint32_t> allocs(0);
+static volatile bool counting = false;
+
+extern "C"
+{
+	/*slaba reference, bez --wrap zustane NULL a wrappery se nevolaji*/
+	extern void *__real_malloc(size_t size) __attribute__((weak));
+	extern void *__real_calloc(size_t n, size_t size) __attribute__((weak));
+	extern void *__real_realloc(void *ptr, size_t size) __attribute__((weak));
+	extern void *__real_heap_caps_malloc(size_t size, uint32_t caps) __attribute__((weak));
+
+	void *__wrap_malloc(size_t size)
+	{
+		if (counting)
+		{
+			allocs++;
+		}
+		return __real_malloc(size);
+	}
+	void *__wrap_calloc(size_t n, size_t size)
+	{
+		if (counting)
+		{
+			allocs++;
+		}
+		return __real_calloc(n, size);
+	}
+	void *__wrap_realloc(void *ptr, size_t size)
+	{
+		if (counting)
+		{
+			allocs++;
+		}
+		return __real_realloc(ptr, size);
+	}
+	void *__wrap_heap_caps_malloc(size_t size, uint32_t caps)
+	{
+		if (counting)
+		{
+			allocs++;
+		}
+		return __real_heap_caps_malloc(size, caps);
+	}
+}
+
+void setUp(void)
+{
+	if (__real_malloc == NULL)
+	{
+		TEST_IGNORE_MESSAGE("allocations are counted only in env esp32s3-alloc");
+	}
+}
+void tearDown(void) {}
+
+static void CountBegin(void)
+{
+	allocs = 0;
+	counting = true;
+}
+
+static uint32_t CountEnd(void)
+{
+	counting = false;
+	return allocs;
+}
+
+static void Report(const char *name, uint32_t n, uint32_t cnt, uint32_t us)
+{
+	char msg[112];
+	snprintf(msg, sizeof(msg), "%-22s: %.2f allocations, %.2f us per call", name, (double)cnt / n, (double)us / n);
+	TEST_MESSAGE(msg);
+}
+
+static void test_get_buffer(void)
+{
+	char tmp[STRING_REG_MAX_LEN + 1];
+	uint32_t sink = 0;
+	CountBegin();
+	int64_t t0 = esp_timer_get_time();
+	for (uint32_t i = 0; i < READS; i++)
+	{
+		sink += strs[i % STRS]->Get(tmp);
+	}
+	uint32_t us = esp_timer_get_time() - t0;
+	uint32_t cnt = CountEnd();
+	Report("Get(buf)", READS, cnt, us);
+	TEST_ASSERT_NOT_EQUAL(0, sink);
+	TEST_ASSERT_EQUAL(0, cnt);
+}
+
+static void test_get_string(void)
+{
+	uint32_t sink = 0;
+	CountBegin();
+	int64_t t0 = esp_timer_get_time();
+	for (uint32_t i = 0; i < READS; i++)
+	{
+		sink += strs[i % STRS]->Get().length();
+	}
+	uint32_t us = esp_timer_get_time() - t0;
+	uint32_t cnt = CountEnd();
+	Report("Get() String", READS, cnt, us);
+	TEST_ASSERT_NOT_EQUAL(0, sink);
+	TEST_ASSERT_TRUE(cnt > 0);
+}
+
+static void test_request_hostname(void)
+{
+	/*isMdnsHost pri kazdem dotazu web serveru*/
+	char host[STRING_REG_MAX_LEN + 8];
+	WiFihostname.Get(host, sizeof(host));
+	strcat(host, ".local");
+	uint32_t sink = 0;
+	CountBegin();
+	int64_t t0 = esp_timer_get_time();
+	for (uint32_t i = 0; i < READS; i++)
+	{
+		char hostname[STRING_REG_MAX_LEN + 1];
+		size_t len = WiFihostname.Get(hostname);
+		sink += (strncasecmp(host, hostname, len) == 0) && (strcasecmp(host + len, ".local") == 0);
+	}
+	uint32_t us = esp_timer_get_time() - t0;
+	uint32_t cnt = CountEnd();
+	Report("request hostname", READS, cnt, us);
+	TEST_ASSERT_EQUAL(READS, sink);
+	TEST_ASSERT_EQUAL(0, cnt);
+}
+
+static void test_get_params_request(void)
+{
+	static char out[2048];
+	const uint32_t requests = 200;
+	size_t len = 0;
+	uint32_t jsonCnt = 0;
+
+	CountBegin();
+	int64_t t0 = esp_timer_get_time();
+	for (uint32_t r = 0; r < requests; r++)
+	{
+		JsonDocument doc;
+		for (string_reg *reg : strs)
+		{
+			Register::JsonReadIdx(&reg->def - Register::ParDef, doc[reg->def.ptxt].to<JsonVariant>());
+		}
+		len = serializeJson(doc, out, sizeof(out));
+	}
+	uint32_t us = esp_timer_get_time() - t0;
+	uint32_t cnt = CountEnd();
+	Report("get_params 10 strings", requests, cnt, us);
+
+	/*tytez hodnoty jako konstanty, rozdil pripada na cteni registru*/
+	static char vals[STRS][STRING_REG_MAX_LEN + 1];
+	for (uint8_t i = 0; i < STRS; i++)
+	{
+		strs[i]->Get(vals[i]);
+	}
+	CountBegin();
+	for (uint32_t r = 0; r < requests; r++)
+	{
+		JsonDocument doc;
+		for (uint8_t i = 0; i < STRS; i++)
+		{
+			doc[strs[i]->def.ptxt] = (char *)vals[i];
+		}
+		serializeJson(doc, out, sizeof(out));
+	}
+	jsonCnt = CountEnd();
+	Report("same JSON, no registers", requests, jsonCnt, 0);
+
+	TEST_ASSERT_TRUE(len > 0);
+	TEST_ASSERT_EQUAL(jsonCnt, cnt);
+}
+
+void setup()
+{
+	delay(2000); /*cas na pripojeni monitoru*/
+	Register::InitAll();
+
+	/*delsi nez SSO Stringu, aby puvodni cteni alokovalo*/
+	WiFiScanSSID1.Set("Kurnik-WiFi-2.4GHz-Dvur");
+	WiFiScanSSID2.Set("Sousedova-sit-5GHz-Extender");
+	WiFiScanSSID3.Set("Obecni-hotspot-pro-navstevy");
+	WiFiScanSSID4.Set("IoT-zahrada-a-sklenik-01");
+
+	UNITY_BEGIN();
+	RUN_TEST(test_get_buffer);
+	RUN_TEST(test_get_string);
+	RUN_TEST(test_request_hostname);
+	RUN_TEST(test_get_params_request);
+	UNITY_END();
+}
+
+void loop()
+{
+}
@@ -0,0 +1,187 @@
+/***********************************************************************
+ * Filename: test_chart_reduce.cpp
+ * Author: agent
+ * Date: 2026-10-17
+ * Description:
+ *     Native unit tests and benchmark of ChartReduce (LTTB and min/max
+ *     buckets) on a 10k-sample series with spikes and a gap of missing
+ *     samples. The benchmark reports time of one reduction and size of
+ *     the JSON array of values before and after.
+ *     Run: pio test -e native -f native/test_chart_reduce
+ *
+ ***********************************************************************/
+
+#include <algorithm>
+#include <chrono>
+#include <math.h>
+#include <stdio.h>
+#include <unity.h>
+#include "chart_reduce.h"
+
+#define SERIES_LEN 10000
+#define GAP_FROM 4000
+#define GAP_TO 4300
+#define SPIKE_AT 7777
+#define BENCH_RUNS 200
+
+static int32_t vals[SERIES_LEN];
+static uint32_t idx[SERIES_LEN];
+
+void setUp(void) {}
+void tearDown(void) {}
+
+static void FillSeries(void)
+{
+    for (uint32_t i = 0; i < SERIES_LEN; i++)
+    {
+        vals[i] = (int32_t)(1000 * sinf(i / 300.0f)) + (int32_t)((i * 2654435761U) >> 27) - 16; /*deterministicky sum*/
+    }
+    for (uint32_t i = GAP_FROM; i < GAP_TO; i++)
+    {
+        vals[i] = CHART_NO_DATA;
+    }
+    vals[SPIKE_AT] = 5000;
+    vals[SPIKE_AT + 1000] = -5000;
+}
+
+static void CheckOrder(uint16_t cnt, uint16_t points)
+{
+    TEST_ASSERT_GREATER_OR_EQUAL(CHART_MIN_POINTS, cnt);
+    TEST_ASSERT_LESS_OR_EQUAL(points, cnt);
+    for (uint16_t k = 1; k < cnt; k++)
+    {
+        TEST_ASSERT_GREATER_THAN_UINT32(idx[k - 1], idx[k]);
+    }
+    TEST_ASSERT_LESS_THAN_UINT32(SERIES_LEN, idx[cnt - 1]);
+}
+
+static bool Kept(uint16_t cnt, uint32_t i)
+{
+    for (uint16_t k = 0; k < cnt; k++)
+    {
+        if (idx[k] == i)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void test_passthrough(void)
+{
+    uint16_t cnt = ChartReduce::Reduce(ChartReduce_Lttb, vals, 150, 200, idx);
+    TEST_ASSERT_EQUAL(150, cnt);
+    TEST_ASSERT_EQUAL_UINT32(149, idx[149]);
+    cnt = ChartReduce::Reduce(ChartReduce_MinMax, vals, 500, 0, idx);
+    TEST_ASSERT_EQUAL(500, cnt);
+}
+
+static void test_lttb(void)
+{
+    for (uint16_t points : {CHART_MIN_POINTS, 50, 200, 1000})
+    {
+        uint16_t cnt = ChartReduce::Reduce(ChartReduce_Lttb, vals, SERIES_LEN, points, idx);
+        TEST_ASSERT_EQUAL(points, cnt);
+        CheckOrder(cnt, points);
+        TEST_ASSERT_EQUAL_UINT32(0, idx[0]);
+        TEST_ASSERT_EQUAL_UINT32(SERIES_LEN - 1, idx[cnt - 1]);
+    }
+
+    uint16_t cnt = ChartReduce::Reduce(ChartReduce_Lttb, vals, SERIES_LEN, 200, idx);
+    TEST_ASSERT_TRUE(Kept(cnt, SPIKE_AT));
+    TEST_ASSERT_TRUE(Kept(cnt, SPIKE_AT + 1000));
+    bool gap = false;
+    for (uint16_t k = 0; k < cnt; k++)
+    {
+        bool inGap = (idx[k] >= GAP_FROM) && (idx[k] < GAP_TO);
+        /*chybejici vzorek jen z kose bez dat, mezera zustane v grafu*/
+        TEST_ASSERT_TRUE(inGap || (vals[idx[k]] != CHART_NO_DATA));
+        gap |= inGap && (vals[idx[k]] == CHART_NO_DATA);
+    }
+    TEST_ASSERT_TRUE(gap);
+}
+
+static void test_minmax(void)
+{
+    uint16_t cnt = ChartReduce::Reduce(ChartReduce_MinMax, vals, SERIES_LEN, 200, idx);
+    CheckOrder(cnt, 200);
+    TEST_ASSERT_TRUE(Kept(cnt, SPIKE_AT));
+    TEST_ASSERT_TRUE(Kept(cnt, SPIKE_AT + 1000));
+
+    /*kazdy kos dava sve minimum i maximum*/
+    uint16_t buckets = 100;
+    for (uint16_t b = 0; b < buckets; b++)
+    {
+        uint32_t start = (uint64_t)b * SERIES_LEN / buckets;
+        uint32_t end = (uint64_t)(b + 1) * SERIES_LEN / buckets;
+        int32_t lo = INT32_MAX;
+        int32_t hi = CHART_NO_DATA;
+        for (uint32_t j = start; j < end; j++)
+        {
+            if (vals[j] != CHART_NO_DATA)
+            {
+                lo = std::min(lo, vals[j]);
+                hi = std::max(hi, vals[j]);
+            }
+        }
+        int32_t keptLo = INT32_MAX;
+        int32_t keptHi = CHART_NO_DATA;
+        for (uint16_t k = 0; k < cnt; k++)
+        {
+            if ((idx[k] >= start) && (idx[k] < end) && (vals[idx[k]] != CHART_NO_DATA))
+            {
+                keptLo = std::min(keptLo, vals[idx[k]]);
+                keptHi = std::max(keptHi, vals[idx[k]]);
+            }
+        }
+        TEST_ASSERT_EQUAL_INT32(lo, keptLo);
+        TEST_ASSERT_EQUAL_INT32(hi, keptHi);
+    }
+}
+
+static size_t JsonSize(uint16_t cnt, bool all)
+{ /*velikost serializovaneho pole hodnot, chybejici vzorek je null*/
+    char num[16];
+    size_t len = 2;
+    uint32_t n = all ? SERIES_LEN : cnt;
+    for (uint32_t k = 0; k < n; k++)
+    {
+        int32_t v = vals[all ? k : idx[k]];
+        len += (v == CHART_NO_DATA) ? 4 : snprintf(num, sizeof(num), "%d", (int)v);
+    }
+    return len + ((n > 0) ? n - 1 : 0);
+}
+
+static void test_bench(void)
+{
+    char msg[128];
+    size_t full = JsonSize(0, true);
+    for (chartreduce_t mode : {ChartReduce_Lttb, ChartReduce_MinMax})
+    {
+        for (uint16_t points : {200, 1000})
+        {
+            uint16_t cnt = 0;
+            auto t0 = std::chrono::steady_clock::now();
+            for (int r = 0; r < BENCH_RUNS; r++)
+            {
+                cnt = ChartReduce::Reduce(mode, vals, SERIES_LEN, points, idx);
+            }
+            double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - t0).count() / BENCH_RUNS;
+            snprintf(msg, sizeof(msg), "%s %u samples -> %u points: %.1f us, JSON %u -> %u B",
+                     (mode == ChartReduce_Lttb) ? "lttb" : "minmax", SERIES_LEN, cnt, us,
+                     (unsigned)full, (unsigned)JsonSize(cnt, false));
+            TEST_MESSAGE(msg);
+        }
+    }
+}
+
+int main(void)
+{
+    FillSeries();
+    UNITY_BEGIN();
+    RUN_TEST(test_passthrough);
+    RUN_TEST(test_lttb);
+    RUN_TEST(test_minmax);
+    RUN_TEST(test_bench);
+    return UNITY_END();
+}
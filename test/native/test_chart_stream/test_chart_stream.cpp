@@ -0,0 +1,232 @@
+/***********************************************************************
+ * Filename: test_chart_stream.cpp
+ * Author: agent
+ * Date: 2026-10-17
+ * Description:
+ *     Native unit tests and benchmark of ChartStream, chart samples
+ *     streamed in chunks of the response buffer, compared with the
+ *     former serialization through a JsonArray (JsonDocument filled
+ *     with all samples, then serializeJson into a string). Both give
+ *     the same text for any chunk size. The benchmark reports time of
+ *     one response and peak memory of both ways for a full raw series
+ *     (512 samples) and for a longer one.
+ *     Run: pio test -e native -f native/test_chart_stream
+ *
+ ***********************************************************************/
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <unity.h>
+#include <ArduinoJson.h>
+#include "chart_stream.h"
+
+#define SERIES_MAX 4096
+#define RAW_SAMPLES 512    /*= CHART_RAW_SAMPLES*/
+#define CHUNK_LEN 1436     /*= TCP MSS, velikost bufferu odpovedi*/
+#define BENCH_RUNS 2000
+
+static int32_t samples[SERIES_MAX];
+
+//*****************************************************************************
+//! Samples of an array, text around like chart_base (plain JSON array)
+//*****************************************************************************
+class ArrayStream : public ChartStream
+{
+protected:
+    uint32_t n;
+    uint32_t pos;
+
+    uint16_t ReadBlock(int32_t *out, uint16_t cnt)
+    {
+        uint16_t k = 0;
+        for (; (k < cnt) && (pos < n); k++)
+        {
+            out[k] = samples[pos++];
+        }
+        return k;
+    }
+
+    void Text(bool suffix, char *txt, size_t len)
+    {
+        snprintf(txt, len, suffix ? "]" : "[");
+    }
+
+public:
+    void Start(uint32_t cnt)
+    {
+        n = cnt;
+        pos = 0;
+        Begin(cnt == 1);
+    }
+};
+
+//*****************************************************************************
+//! JsonDocument allocator counting current and peak allocated bytes
+//*****************************************************************************
+class CountingAllocator : public ArduinoJson::Allocator
+{
+    static const size_t hdr = sizeof(std::max_align_t);
+
+public:
+    size_t cur = 0;
+    size_t peak = 0;
+
+    void *allocate(size_t size) override
+    {
+        uint8_t *p = (uint8_t *)malloc(size + hdr);
+        *(size_t *)p = size;
+        cur += size;
+        peak = std::max(peak, cur);
+        return p + hdr;
+    }
+
+    void deallocate(void *ptr) override
+    {
+        if (ptr != NULL)
+        {
+            uint8_t *p = (uint8_t *)ptr - hdr;
+            cur -= *(size_t *)p;
+            free(p);
+        }
+    }
+
+    void *reallocate(void *ptr, size_t newSize) override
+    {
+        uint8_t *p = (uint8_t *)ptr - hdr;
+        cur -= *(size_t *)p;
+        p = (uint8_t *)realloc(p, newSize + hdr);
+        *(size_t *)p = newSize;
+        cur += newSize;
+        peak = std::max(peak, cur);
+        return p + hdr;
+    }
+};
+
+void setUp(void) {}
+void tearDown(void) {}
+
+static void FillSeries(void)
+{
+    for (uint32_t i = 0; i < SERIES_MAX; i++)
+    {
+        samples[i] = (int32_t)(2000 * sinf(i / 40.0f)) + (int32_t)((i * 2654435761U) >> 26) - 32; /*deterministicky sum*/
+    }
+    for (uint32_t i = 100; i < 130; i++)
+    {
+        samples[i] = CHART_NO_DATA;
+    }
+    samples[0] = INT32_MAX;
+    samples[1] = CHART_NO_DATA + 1;
+}
+
+static std::string Streamed(ArrayStream &st, uint32_t n, size_t chunk)
+{
+    std::string out;
+    char buf[CHUNK_LEN];
+    size_t len;
+    st.Start(n);
+    while ((len = st.Read(buf, chunk)) > 0)
+    {
+        out.append(buf, len);
+    }
+    TEST_ASSERT_TRUE(st.Done());
+    return out;
+}
+
+static std::string Serialized(uint32_t n, size_t *peak = NULL)
+{
+    CountingAllocator alloc;
+    JsonDocument doc(&alloc);
+    JsonArray arr = doc.to<JsonArray>();
+    for (uint32_t i = 0; i < n; i++)
+    {
+        if (samples[i] == CHART_NO_DATA)
+        {
+            arr.add(nullptr);
+        }
+        else
+        {
+            arr.add(samples[i]);
+        }
+    }
+    std::string out;
+    serializeJson(doc, out);
+    if (peak != NULL)
+    { /*dokument i vystupni text jsou alokovany soucasne*/
+        *peak = alloc.peak + out.capacity();
+    }
+    return out;
+}
+
+static void test_same_text(void)
+{
+    ArrayStream st;
+    for (uint32_t n : {0, 2, 31, 32, 33, RAW_SAMPLES, SERIES_MAX})
+    {
+        std::string ref = Serialized(n);
+        for (size_t chunk : {1, 7, 64, CHUNK_LEN})
+        {
+            TEST_ASSERT_EQUAL_STRING(ref.c_str(), Streamed(st, n, chunk).c_str());
+        }
+    }
+}
+
+static void test_single_dup(void)
+{
+    ArrayStream st;
+    char txt[32];
+    snprintf(txt, sizeof(txt), "[%ld,%ld]", (long)samples[0], (long)samples[0]);
+    TEST_ASSERT_EQUAL_STRING(txt, Streamed(st, 1, 3).c_str());
+}
+
+static void test_bench(void)
+{
+    char msg[160];
+    for (uint32_t n : {RAW_SAMPLES, SERIES_MAX})
+    {
+        ArrayStream st;
+        size_t len = 0;
+        auto t0 = std::chrono::steady_clock::now();
+        for (int r = 0; r < BENCH_RUNS; r++)
+        { /*chunk se posila primo z bufferu odpovedi, nikam se nekopiruje*/
+            char buf[CHUNK_LEN];
+            size_t k;
+            st.Start(n);
+            while ((k = st.Read(buf, sizeof(buf))) > 0)
+            {
+                len += k;
+            }
+        }
+        double usStream = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - t0).count() / BENCH_RUNS;
+
+        size_t peak = 0;
+        t0 = std::chrono::steady_clock::now();
+        for (int r = 0; r < BENCH_RUNS; r++)
+        {
+            len -= Serialized(n, &peak).length();
+        }
+        double usJson = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - t0).count() / BENCH_RUNS;
+        TEST_ASSERT_EQUAL(0, len);
+
+        /*streamovani drzi jen stav a buffer odpovedi, ten ma server tak jako tak*/
+        snprintf(msg, sizeof(msg), "%u samples: stream %.1f us, %u B state; JsonArray %.1f us, %u B peak (x%.1f time)",
+                 (unsigned)n, usStream, (unsigned)sizeof(ArrayStream), usJson, (unsigned)peak, usJson / usStream);
+        TEST_MESSAGE(msg);
+        TEST_ASSERT_TRUE(sizeof(ArrayStream) < peak);
+    }
+}
+
+int main(void)
+{
+    FillSeries();
+    UNITY_BEGIN();
+    RUN_TEST(test_same_text);
+    RUN_TEST(test_single_dup);
+    RUN_TEST(test_bench);
+    return UNITY_END();
+}
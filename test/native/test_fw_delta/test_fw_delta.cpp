@@ -0,0 +1,230 @@
+/***********************************************************************
+ * Filename: test_fw_delta.cpp
+ * Author: agent
+ * Date: 2026-10-17
+ * Description:
+ *     Native unit tests of FwDelta: Diff -> Apply -> verify round trip
+ *     the way the accessory does it (base CRC32 from the header, CRC32
+ *     of the built target), including empty base and empty target,
+ *     rejection of a patch for other base and of damaged patches.
+ *     Sizes of the packed patch and of the packed full image are
+ *     reported for a typical firmware change.
+ *     Run: pio test -e native -f native/test_fw_delta
+ *
+ ***********************************************************************/
+
+#include <algorithm>
+#include <random>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include <unity.h>
+#include "fw_delta.h"
+#include "fw_pack.h"
+
+static std::mt19937 rng(23);
+
+void setUp(void) {}
+void tearDown(void) {}
+
+//*****************************************************************************
+//! CRC32 as esp_rom_crc32_le(0, data, len)
+//*****************************************************************************
+static uint32_t crc32(const std::vector<uint8_t> &data)
+{
+    uint32_t crc = 0xFFFFFFFF;
+    for (uint8_t b : data)
+    {
+        crc ^= b;
+        for (int k = 0; k < 8; k++)
+        {
+            crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+        }
+    }
+    return ~crc;
+}
+
+static std::vector<uint8_t> diff(const std::vector<uint8_t> &base, const std::vector<uint8_t> &target)
+{
+    std::vector<uint8_t> patch(sizeof(fwdeltahdr_t) + 2 * target.size() + 64);
+    size_t n = FwDelta::Diff(base.data(), base.size(), crc32(base), target.data(), target.size(), patch.data(), patch.size());
+    TEST_ASSERT_NOT_EQUAL(0, n);
+    patch.resize(n);
+    return patch;
+}
+
+//*****************************************************************************
+//! Accessory side: check base CRC, apply, check CRC of the result
+//*****************************************************************************
+static bool applyVerify(const std::vector<uint8_t> &base, const std::vector<uint8_t> &patch, uint32_t targetCrc, std::vector<uint8_t> &target)
+{
+    fwdeltahdr_t hdr;
+    if (patch.size() < sizeof(hdr))
+    {
+        return false;
+    }
+    memcpy(&hdr, patch.data(), sizeof(hdr));
+    if ((hdr.baseSize != base.size()) || (hdr.baseCrc != crc32(base)))
+    {
+        return false;
+    }
+    target.assign(hdr.targetSize, 0);
+    return FwDelta::Apply(base.data(), base.size(), patch.data(), patch.size(), target.data(), target.size()) &&
+           (crc32(target) == targetCrc);
+}
+
+static void roundTrip(const std::vector<uint8_t> &base, const std::vector<uint8_t> &target)
+{
+    std::vector<uint8_t> patch = diff(base, target);
+    std::vector<uint8_t> built;
+    TEST_ASSERT_TRUE(applyVerify(base, patch, crc32(target), built));
+    TEST_ASSERT_TRUE(built == target);
+}
+
+static std::vector<uint8_t> noise(size_t size)
+{
+    std::vector<uint8_t> data(size);
+    for (auto &b : data)
+    {
+        b = (uint8_t)rng();
+    }
+    return data;
+}
+
+//*****************************************************************************
+//! New firmware build: changed constants, inserted and removed code and
+//! shifted addresses in the rest of the image
+//*****************************************************************************
+static std::vector<uint8_t> mutate(const std::vector<uint8_t> &base, size_t edits)
+{
+    std::vector<uint8_t> t = base;
+    for (size_t k = 0; (k < edits) && !t.empty(); k++)
+    {
+        size_t p = rng() % t.size();
+        switch (rng() % 4)
+        {
+        case 0:
+            t[p] ^= (uint8_t)(1 + rng() % 255);
+            break;
+        case 1:
+        {
+            std::vector<uint8_t> ins = noise(1 + rng() % 200);
+            t.insert(t.begin() + p, ins.begin(), ins.end());
+            break;
+        }
+        case 2:
+            t.erase(t.begin() + p, t.begin() + std::min(t.size(), p + 1 + rng() % 200));
+            break;
+        default: /*posun adres v 32 bit slovech*/
+            for (size_t i = p & ~3UL; (i + 4) <= std::min(t.size(), p + 512); i += 4)
+            {
+                t[i] += 4;
+            }
+            break;
+        }
+    }
+    return t;
+}
+
+static void test_round_trip(void)
+{
+    for (int it = 0; it < 100; it++)
+    {
+        std::vector<uint8_t> base = noise(rng() % 65536);
+        roundTrip(base, mutate(base, 1 + base.size() / 2000));
+        roundTrip(base, noise(rng() % 1024));
+    }
+}
+
+static void test_empty(void)
+{
+    std::vector<uint8_t> empty;
+    std::vector<uint8_t> data = noise(1000);
+    roundTrip(data, empty);
+    roundTrip(empty, empty);
+    roundTrip(empty, data);
+
+    std::vector<uint8_t> patch = diff(data, empty);
+    TEST_ASSERT_EQUAL(sizeof(fwdeltahdr_t), patch.size());
+}
+
+static void test_other_base(void)
+{
+    std::vector<uint8_t> base = noise(20000);
+    std::vector<uint8_t> target = mutate(base, 10);
+    std::vector<uint8_t> patch = diff(base, target);
+    std::vector<uint8_t> built;
+
+    std::vector<uint8_t> shorter(base.begin(), base.end() - 1);
+    TEST_ASSERT_FALSE(applyVerify(shorter, patch, crc32(target), built));
+    TEST_ASSERT_FALSE(FwDelta::Apply(shorter.data(), shorter.size(), patch.data(), patch.size(), built.data(), built.size()));
+
+    std::vector<uint8_t> other = base;
+    other[base.size() / 2] ^= 0x55;
+    TEST_ASSERT_FALSE(applyVerify(other, patch, crc32(target), built));
+}
+
+static void test_damaged(void)
+{
+    std::vector<uint8_t> base = noise(20000);
+    std::vector<uint8_t> target = mutate(base, 20);
+    std::vector<uint8_t> patch = diff(base, target);
+    std::vector<uint8_t> built(target.size());
+
+    TEST_ASSERT_FALSE(FwDelta::Apply(base.data(), base.size(), patch.data(), patch.size(), built.data(), target.size() - 1));
+    for (size_t len = 0; len < patch.size(); len += 1 + len / 8)
+    {
+        TEST_ASSERT_FALSE(FwDelta::Apply(base.data(), base.size(), patch.data(), len, built.data(), built.size()));
+    }
+
+    /*poskozeny patch nesmi cist mimo base ani zapsat mimo target*/
+    for (int it = 0; it < 500; it++)
+    {
+        std::vector<uint8_t> bad = patch;
+        bad[sizeof(fwdeltahdr_t) + rng() % (bad.size() - sizeof(fwdeltahdr_t))] ^= 1 << (rng() % 8);
+        if (FwDelta::Apply(base.data(), base.size(), bad.data(), bad.size(), built.data(), built.size()))
+        {
+            TEST_ASSERT_TRUE((built == target) || (crc32(built) != crc32(target)));
+        }
+    }
+}
+
+static void test_small_cap(void)
+{
+    std::vector<uint8_t> base = noise(5000);
+    std::vector<uint8_t> target = noise(5000);
+    std::vector<uint8_t> patch(target.size());
+    TEST_ASSERT_EQUAL(0, FwDelta::Diff(base.data(), base.size(), 0, target.data(), target.size(), patch.data(), patch.size()));
+    TEST_ASSERT_EQUAL(0, FwDelta::Diff(base.data(), base.size(), 0, target.data(), target.size(), patch.data(), sizeof(fwdeltahdr_t) - 1));
+}
+
+static void test_packed_size(void)
+{
+    std::vector<uint8_t> base = noise(512 * 1024);
+    std::vector<uint8_t> target = mutate(base, 40);
+    std::vector<uint8_t> patch = diff(base, target);
+
+    std::vector<uint8_t> packed(FwPack::MaxSize(patch.size()));
+    size_t patchPacked = FwPack::Pack(patch.data(), patch.size(), packed.data(), packed.size());
+    packed.resize(FwPack::MaxSize(target.size()));
+    size_t imagePacked = FwPack::Pack(target.data(), target.size(), packed.data(), packed.size());
+    TEST_ASSERT_NOT_EQUAL(0, patchPacked);
+    TEST_ASSERT_LESS_THAN(imagePacked / 10, patchPacked);
+
+    char msg[160];
+    snprintf(msg, sizeof(msg), "image %u B: packed image %u B, packed patch %u B (%.2f %%)",
+             (unsigned)target.size(), (unsigned)imagePacked, (unsigned)patchPacked, 100.0 * patchPacked / imagePacked);
+    TEST_MESSAGE(msg);
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_round_trip);
+    RUN_TEST(test_empty);
+    RUN_TEST(test_other_base);
+    RUN_TEST(test_damaged);
+    RUN_TEST(test_small_cap);
+    RUN_TEST(test_packed_size);
+    return UNITY_END();
+}
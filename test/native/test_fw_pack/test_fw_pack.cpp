@@ -0,0 +1,213 @@
+/***********************************************************************
+ * Filename: test_fw_pack.cpp
+ * Author: agent
+ * Date: 2026-10-17
+ * Description:
+ *     Native unit tests of FwPack: round trip of random, repetitive and
+ *     empty images at block boundaries, damaged containers. The last
+ *     test is the compression benchmark: ratio and MB/s of Pack and
+ *     Unpack on firmware binaries. Images are taken from environment
+ *     variable FW_PACK_BENCH (paths separated by ':', e.g. the .bin
+ *     files from .pio/build), without it the test binary itself is
+ *     used as a sample of machine code.
+ *     Run: pio test -e native -f native/test_fw_pack
+ *
+ ***********************************************************************/
+
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <unity.h>
+#include "fw_pack.h"
+
+static std::mt19937 rng(22);
+
+void setUp(void) {}
+void tearDown(void) {}
+
+static std::vector<uint8_t> pack(const std::vector<uint8_t> &raw)
+{
+    std::vector<uint8_t> out(FwPack::MaxSize(raw.size()));
+    size_t n = FwPack::Pack(raw.data(), raw.size(), out.data(), out.size());
+    TEST_ASSERT_NOT_EQUAL(0, n);
+    out.resize(n);
+    return out;
+}
+
+static void roundTrip(const std::vector<uint8_t> &raw)
+{
+    std::vector<uint8_t> packed = pack(raw);
+    std::vector<uint8_t> back(raw.size() + 1, 0xA5);
+    TEST_ASSERT_TRUE(FwPack::Unpack(packed.data(), packed.size(), back.data(), raw.size()));
+    TEST_ASSERT_TRUE(std::equal(raw.begin(), raw.end(), back.begin()));
+    TEST_ASSERT_EQUAL_HEX8(0xA5, back[raw.size()]);
+}
+
+static std::vector<uint8_t> image(size_t size, int kind)
+{
+    std::vector<uint8_t> raw(size);
+    for (size_t i = 0; i < size; i++)
+    {
+        switch (kind)
+        {
+        case 0: /*nekomprimovatelne*/
+            raw[i] = (uint8_t)rng();
+            break;
+        case 1: /*vyplne 0xFF jako nezapsana flash*/
+            raw[i] = 0xFF;
+            break;
+        default: /*opakovane kratke sekvence s obcasnou zmenou*/
+            raw[i] = ((i > 16) && (rng() % 8)) ? raw[i - 1 - rng() % 16] : (uint8_t)rng();
+            break;
+        }
+    }
+    return raw;
+}
+
+static void test_round_trip(void)
+{
+    const size_t sizes[] = {0, 1, 2, 3, 17, FW_PACK_BLOCK - 1, FW_PACK_BLOCK, FW_PACK_BLOCK + 1, 5 * FW_PACK_BLOCK + 123};
+    for (size_t size : sizes)
+    {
+        for (int kind = 0; kind < 3; kind++)
+        {
+            roundTrip(image(size, kind));
+        }
+    }
+}
+
+static void test_incompressible_stored(void)
+{
+    std::vector<uint8_t> raw = image(3 * FW_PACK_BLOCK, 0);
+    std::vector<uint8_t> packed = pack(raw);
+    TEST_ASSERT_EQUAL(FwPack::MaxSize(raw.size()), packed.size());
+
+    std::vector<uint8_t> ff = image(3 * FW_PACK_BLOCK, 1);
+    TEST_ASSERT_LESS_THAN(ff.size() / 6, pack(ff).size());
+}
+
+static void test_small_cap(void)
+{
+    std::vector<uint8_t> raw = image(2 * FW_PACK_BLOCK, 0);
+    std::vector<uint8_t> out(FwPack::MaxSize(raw.size()));
+    TEST_ASSERT_EQUAL(0, FwPack::Pack(raw.data(), raw.size(), out.data(), out.size() - 1));
+    TEST_ASSERT_EQUAL(0, FwPack::Pack(raw.data(), raw.size(), out.data(), sizeof(fwpackhdr_t)));
+}
+
+static void test_damaged(void)
+{
+    std::vector<uint8_t> raw = image(4 * FW_PACK_BLOCK, 2);
+    std::vector<uint8_t> packed = pack(raw);
+    std::vector<uint8_t> back(raw.size());
+
+    TEST_ASSERT_FALSE(FwPack::Unpack(packed.data(), packed.size(), back.data(), raw.size() - 1));
+    for (size_t len = 0; len < packed.size(); len += 1 + len / 4)
+    {
+        TEST_ASSERT_FALSE(FwPack::Unpack(packed.data(), len, back.data(), raw.size()));
+    }
+    packed[0] ^= 1;
+    TEST_ASSERT_FALSE(FwPack::Unpack(packed.data(), packed.size(), back.data(), raw.size()));
+    packed[0] ^= 1;
+
+    /*poskozena data nesmi zapsat mimo raw ani cist mimo pack*/
+    for (int it = 0; it < 500; it++)
+    {
+        std::vector<uint8_t> bad = packed;
+        for (int k = 0; k < 4; k++)
+        {
+            bad[sizeof(fwpackhdr_t) + rng() % (bad.size() - sizeof(fwpackhdr_t))] ^= 1 << (rng() % 8);
+        }
+        FwPack::Unpack(bad.data(), bad.size(), back.data(), raw.size());
+    }
+}
+
+static bool readFile(const char *path, std::vector<uint8_t> &data)
+{
+    FILE *f = fopen(path, "rb");
+    if (f == NULL)
+    {
+        return false;
+    }
+    data.clear();
+    uint8_t buf[4096];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0)
+    {
+        data.insert(data.end(), buf, buf + n);
+    }
+    fclose(f);
+    return !data.empty();
+}
+
+static void bench(const char *path)
+{
+    std::vector<uint8_t> raw;
+    if (!readFile(path, raw))
+    {
+        char msg[160];
+        snprintf(msg, sizeof(msg), "%s: cannot read", path);
+        TEST_MESSAGE(msg);
+        return;
+    }
+
+    std::vector<uint8_t> out(FwPack::MaxSize(raw.size()));
+    auto t0 = std::chrono::steady_clock::now();
+    size_t n = FwPack::Pack(raw.data(), raw.size(), out.data(), out.size());
+    auto t1 = std::chrono::steady_clock::now();
+    TEST_ASSERT_NOT_EQUAL(0, n);
+
+    std::vector<uint8_t> back(raw.size());
+    auto t2 = std::chrono::steady_clock::now();
+    TEST_ASSERT_TRUE(FwPack::Unpack(out.data(), n, back.data(), raw.size()));
+    auto t3 = std::chrono::steady_clock::now();
+    TEST_ASSERT_TRUE(back == raw);
+
+    double mb = raw.size() / 1e6;
+    char msg[256];
+    snprintf(msg, sizeof(msg), "%s: %u -> %u B (%.1f %%), pack %.1f MB/s, unpack %.1f MB/s",
+             path, (unsigned)raw.size(), (unsigned)n, 100.0 * n / raw.size(),
+             mb / std::chrono::duration<double>(t1 - t0).count(),
+             mb / std::chrono::duration<double>(t3 - t2).count());
+    TEST_MESSAGE(msg);
+}
+
+static void test_bench(void)
+{
+    const char *env = getenv("FW_PACK_BENCH");
+    if (env == NULL)
+    {
+        bench("/proc/self/exe");
+        return;
+    }
+    std::string paths(env);
+    size_t start = 0;
+    while (start <= paths.size())
+    {
+        size_t end = paths.find(':', start);
+        if (end == std::string::npos)
+        {
+            end = paths.size();
+        }
+        if (end > start)
+        {
+            bench(paths.substr(start, end - start).c_str());
+        }
+        start = end + 1;
+    }
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_round_trip);
+    RUN_TEST(test_incompressible_stored);
+    RUN_TEST(test_small_cap);
+    RUN_TEST(test_damaged);
+    RUN_TEST(test_bench);
+    return UNITY_END();
+}
@@ -0,0 +1,267 @@
+/***********************************************************************
+ * Filename: test_fw_window.cpp
+ * Author: agent
+ * Date: 2026-10-17
+ * Description:
+ *     Native unit tests of FwWindow and simulation of the firmware
+ *     transfer over a lossy link at 0, 5 and 20 % frame loss. Each
+ *     data and ACK frame is lost independently, half of the lost data
+ *     frames are reported by missing MAC ACK (FwWindow::Lost). The
+ *     simulated time of the windowed transfer is compared with stop
+ *     and wait (one chunk, one ACK) over the same link.
+ *     Run: pio test -e native -f native/test_fw_window
+ *
+ ***********************************************************************/
+
+#include <deque>
+#include <random>
+#include <stdio.h>
+#include <vector>
+#include <unity.h>
+#include "fw_window.h"
+
+#define SIM_IMAGE_SIZE (1024 * 1024)
+#define SIM_FRAME_MS 2 /*vyslani bloku 250 B vcetne MAC ACK*/
+#define SIM_ACK_MS 6   /*od vyzadani ACK do jeho prijeti*/
+
+static std::mt19937 rng(21);
+
+typedef struct
+{
+    uint32_t at;
+    uint32_t base;
+    uint32_t bitmap;
+} simack_t;
+
+typedef struct
+{
+    uint32_t ms;
+    uint32_t frames;
+    bool done;
+} simres_t;
+
+void setUp(void) {}
+void tearDown(void) {}
+
+static bool lose(int lossPct)
+{
+    return (int)(rng() % 100) < lossPct;
+}
+
+//*****************************************************************************
+//! Accessory side: first missing chunk and bitmap of chunks received above it
+//*****************************************************************************
+static simack_t rxAck(const std::vector<bool> &rx, uint32_t at)
+{
+    simack_t a = {at, 0, 0};
+    while ((a.base < rx.size()) && rx[a.base])
+    {
+        a.base++;
+    }
+    for (uint32_t i = 0; i < 32; i++)
+    {
+        if ((a.base + 1 + i < rx.size()) && rx[a.base + 1 + i])
+        {
+            a.bitmap |= 1UL << i;
+        }
+    }
+    return a;
+}
+
+static simres_t simWindow(uint32_t size, int lossPct)
+{
+    FwWindow w;
+    uint32_t now = 0;
+    simres_t res = {0, 0, false};
+    std::deque<simack_t> acks;
+    w.Begin(size, now);
+    std::vector<bool> rx(w.Chunks(), false);
+
+    while (!w.Done() && !w.Failed() && (now < 3600000))
+    {
+        while (!acks.empty() && (acks.front().at <= now))
+        {
+            w.Ack(acks.front().base, acks.front().bitmap, acks.front().at);
+            acks.pop_front();
+        }
+
+        uint32_t chunk;
+        bool ackReq;
+        if (w.Next(chunk, ackReq))
+        {
+            TEST_ASSERT_LESS_THAN_UINT32(w.Chunks(), chunk);
+            now += SIM_FRAME_MS;
+            res.frames++;
+            if (lose(lossPct))
+            {
+                if (rng() & 1)
+                {
+                    w.Lost(chunk);
+                }
+                continue;
+            }
+            rx[chunk] = true;
+            if (ackReq && !lose(lossPct))
+            {
+                acks.push_back(rxAck(rx, now + SIM_ACK_MS));
+            }
+        }
+        else
+        {
+            now = acks.empty() ? now + 1 : acks.front().at;
+            w.Timeout(now);
+        }
+    }
+
+    for (uint32_t c = 0; c < rx.size(); c++)
+    {
+        TEST_ASSERT_TRUE(!w.Done() || rx[c]);
+    }
+    res.ms = now;
+    res.done = w.Done();
+    return res;
+}
+
+//*****************************************************************************
+//! One chunk per ACK, lost chunk reported by MAC is sent at once,
+//! otherwise after FW_ACK_TIMEOUT_MS
+//*****************************************************************************
+static simres_t simStopAndWait(uint32_t size, int lossPct)
+{
+    uint32_t chunks = (size + FW_CHUNK_SIZE - 1) / FW_CHUNK_SIZE;
+    simres_t res = {0, 0, true};
+    for (uint32_t c = 0; c < chunks;)
+    {
+        res.ms += SIM_FRAME_MS;
+        res.frames++;
+        if (lose(lossPct))
+        {
+            res.ms += (rng() & 1) ? 0 : FW_ACK_TIMEOUT_MS;
+        }
+        else if (lose(lossPct))
+        {
+            res.ms += FW_ACK_TIMEOUT_MS;
+        }
+        else
+        {
+            res.ms += SIM_ACK_MS;
+            c++;
+        }
+    }
+    return res;
+}
+
+static void test_begin(void)
+{
+    FwWindow w;
+    w.Begin(FW_CHUNK_SIZE * 3 + 10, 0);
+    TEST_ASSERT_EQUAL_UINT32(4, w.Chunks());
+    TEST_ASSERT_EQUAL(FW_CHUNK_SIZE, w.ChunkLen(0));
+    TEST_ASSERT_EQUAL(10, w.ChunkLen(3));
+    TEST_ASSERT_FALSE(w.NextVerify());
+
+    w.Begin(0, 0);
+    TEST_ASSERT_TRUE(w.Done());
+    TEST_ASSERT_TRUE(w.NextVerify());
+    TEST_ASSERT_FALSE(w.NextVerify());
+}
+
+static void test_window_limit(void)
+{
+    FwWindow w;
+    uint32_t chunk;
+    bool ackReq;
+    w.Begin(FW_CHUNK_SIZE * 100, 0);
+    for (uint32_t c = 0; c < FW_WINDOW_CHUNKS; c++)
+    {
+        TEST_ASSERT_TRUE(w.Next(chunk, ackReq));
+        TEST_ASSERT_EQUAL_UINT32(c, chunk);
+        TEST_ASSERT_EQUAL(((c + 1) % (FW_WINDOW_CHUNKS / 2)) == 0, ackReq);
+    }
+    TEST_ASSERT_FALSE(w.Next(chunk, ackReq));
+
+    w.Ack(4, 0, 10); /*0..3 prijato, okno se posune o 4*/
+    TEST_ASSERT_EQUAL_UINT32(4, w.Base());
+    for (uint32_t c = 0; c < 4; c++)
+    {
+        TEST_ASSERT_TRUE(w.Next(chunk, ackReq));
+        TEST_ASSERT_EQUAL_UINT32(FW_WINDOW_CHUNKS + c, chunk);
+    }
+    TEST_ASSERT_FALSE(w.Next(chunk, ackReq));
+}
+
+static void test_selective_repeat(void)
+{
+    FwWindow w;
+    uint32_t chunk;
+    bool ackReq;
+    w.Begin(FW_CHUNK_SIZE * 8, 0);
+    for (uint32_t c = 0; c < 8; c++)
+    {
+        TEST_ASSERT_TRUE(w.Next(chunk, ackReq));
+    }
+    TEST_ASSERT_TRUE(ackReq);
+
+    /*chybi 2 a 5: base 2, bitmapa bloky 3, 4, 6, 7*/
+    w.Ack(2, 0x01 | 0x02 | 0x08 | 0x10, 5);
+    TEST_ASSERT_EQUAL_UINT32(2, w.Base());
+    TEST_ASSERT_TRUE(w.Next(chunk, ackReq));
+    TEST_ASSERT_EQUAL_UINT32(2, chunk);
+    TEST_ASSERT_TRUE(w.Next(chunk, ackReq));
+    TEST_ASSERT_EQUAL_UINT32(5, chunk);
+    TEST_ASSERT_TRUE(ackReq);
+    TEST_ASSERT_FALSE(w.Next(chunk, ackReq));
+
+    w.Ack(8, 0, 10);
+    TEST_ASSERT_TRUE(w.Done());
+    TEST_ASSERT_TRUE(w.NextVerify());
+}
+
+static void test_timeout_probe(void)
+{
+    FwWindow w;
+    uint32_t chunk;
+    bool ackReq;
+    uint32_t now = 0;
+    w.Begin(FW_CHUNK_SIZE * 2, now);
+    TEST_ASSERT_TRUE(w.Next(chunk, ackReq));
+    TEST_ASSERT_FALSE(w.Timeout(FW_ACK_TIMEOUT_MS - 1));
+
+    for (int i = 0; i <= FW_PROBE_MAX; i++)
+    {
+        TEST_ASSERT_FALSE(w.Failed());
+        now += FW_ACK_TIMEOUT_MS;
+        TEST_ASSERT_TRUE(w.Timeout(now));
+        TEST_ASSERT_TRUE(w.Next(chunk, ackReq));
+        TEST_ASSERT_EQUAL_UINT32(0, chunk);
+        TEST_ASSERT_TRUE(ackReq);
+    }
+    TEST_ASSERT_TRUE(w.Failed());
+    TEST_ASSERT_FALSE(w.AckSeen());
+}
+
+static void test_lossy_link(void)
+{
+    char msg[160];
+    for (int loss : {0, 5, 20})
+    {
+        simres_t win = simWindow(SIM_IMAGE_SIZE, loss);
+        simres_t saw = simStopAndWait(SIM_IMAGE_SIZE, loss);
+        snprintf(msg, sizeof(msg), "loss %2d %%: window %6u ms %5u frames, stop and wait %7u ms %5u frames, x%.1f",
+                 loss, win.ms, win.frames, saw.ms, saw.frames, (double)saw.ms / win.ms);
+        TEST_MESSAGE(msg);
+        TEST_ASSERT_TRUE(win.done);
+        TEST_ASSERT_LESS_THAN_UINT32(saw.ms, win.ms);
+    }
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_begin);
+    RUN_TEST(test_window_limit);
+    RUN_TEST(test_selective_repeat);
+    RUN_TEST(test_timeout_probe);
+    RUN_TEST(test_lossy_link);
+    return UNITY_END();
+}
@@ -0,0 +1,159 @@
+/***********************************************************************
+ * Filename: test_modbus_rtu_codec.cpp
+ * Author: agent
+ * Date: 2026-10-17
+ * Description:
+ *     Native unit tests of ModbusRtuCodec: CRC16 against reference
+ *     values and the bytewise implementation, framing checks and
+ *     register request/response coding. The last test measures how
+ *     many frames per second seal + check handles.
+ *     Run: pio test -e native -f native/test_modbus_rtu_codec
+ *
+ ***********************************************************************/
+
+#include <chrono>
+#include <random>
+#include <stdio.h>
+#include <string.h>
+#include <unity.h>
+#include "modbus_rtu_codec.h"
+
+#define BENCH_FRAMES 200000
+
+static std::mt19937 rng(19);
+
+void setUp(void) {}
+void tearDown(void) {}
+
+static void test_crc_reference(void)
+{
+	const uint8_t check[] = "123456789";
+	TEST_ASSERT_EQUAL_HEX16(0x4B37, ModbusRtuCodec::Crc(check, 9));
+	TEST_ASSERT_EQUAL_HEX16(0x4B37, ModbusRtuCodec::CrcBytewise(check, 9));
+	TEST_ASSERT_EQUAL_HEX16(MODBUS_CRC_INIT, ModbusRtuCodec::Crc(check, 0));
+}
+
+static void test_crc_matches_bytewise(void)
+{
+	uint8_t buf[MODBUS_RTU_ADU_MAX + 3];
+	for (int it = 0; it < 2000; it++)
+	{
+		size_t len = rng() % MODBUS_RTU_ADU_MAX;
+		size_t ofs = rng() % 4; /*i nezarovnany zacatek*/
+		for (size_t i = 0; i < len; i++)
+		{
+			buf[ofs + i] = (uint8_t)rng();
+		}
+		TEST_ASSERT_EQUAL_HEX16(ModbusRtuCodec::CrcBytewise(buf + ofs, len), ModbusRtuCodec::Crc(buf + ofs, len));
+
+		size_t split = len ? rng() % len : 0;
+		uint16_t part = ModbusRtuCodec::Crc(buf + ofs, split);
+		TEST_ASSERT_EQUAL_HEX16(ModbusRtuCodec::Crc(buf + ofs, len), ModbusRtuCodec::Crc(buf + ofs + split, len - split, part));
+	}
+}
+
+static void test_seal_reference_frame(void)
+{
+	/*FC3, slave 1, 10 registru od 0: 01 03 00 00 00 0A C5 CD*/
+	uint8_t adu[MODBUS_RTU_ADU_MAX];
+	adu[0] = 1;
+	size_t len = ModbusRtuCodec::ReadRegsReq(adu + 1, 3, 0, 10) + 1;
+	TEST_ASSERT_EQUAL(6, len);
+	TEST_ASSERT_EQUAL(8, ModbusRtuCodec::Seal(adu, len));
+	const uint8_t ref[] = {0x01, 0x03, 0x00, 0x00, 0x00, 0x0A, 0xC5, 0xCD};
+	TEST_ASSERT_EQUAL_UINT8_ARRAY(ref, adu, sizeof(ref));
+}
+
+static void test_check(void)
+{
+	uint8_t adu[MODBUS_RTU_ADU_MAX];
+	for (size_t i = 0; i < 20; i++)
+	{
+		adu[i] = (uint8_t)(i * 37);
+	}
+	adu[0] = 7;
+	size_t len = ModbusRtuCodec::Seal(adu, 20);
+
+	TEST_ASSERT_EQUAL(RtuFrame_Ok, ModbusRtuCodec::Check(adu, len, 7));
+	TEST_ASSERT_EQUAL(RtuFrame_OtherAdr, ModbusRtuCodec::Check(adu, len, 8));
+	TEST_ASSERT_EQUAL(RtuFrame_Short, ModbusRtuCodec::Check(adu, MODBUS_RTU_ADU_MIN - 1, 7));
+	TEST_ASSERT_EQUAL(RtuFrame_Crc, ModbusRtuCodec::Check(adu, len - 1, 7));
+
+	/*kazda jednobitova chyba mimo adresu musi byt zachycena*/
+	for (size_t bit = 8; bit < len * 8; bit++)
+	{
+		adu[bit / 8] ^= 1 << (bit % 8);
+		TEST_ASSERT_EQUAL(RtuFrame_Crc, ModbusRtuCodec::Check(adu, len, 7));
+		adu[bit / 8] ^= 1 << (bit % 8);
+	}
+	TEST_ASSERT_EQUAL(RtuFrame_Ok, ModbusRtuCodec::Check(adu, len, 7));
+}
+
+static void test_read_regs_rsp(void)
+{
+	uint8_t pdu[2 + 2 * 4] = {3, 8, 0x00, 0x01, 0x12, 0x34, 0xFF, 0xFF, 0x80, 0x00};
+	uint16_t out[4];
+	TEST_ASSERT_TRUE(ModbusRtuCodec::ReadRegsRsp(pdu, sizeof(pdu), 3, 4, out));
+	TEST_ASSERT_EQUAL_HEX16(0x0001, out[0]);
+	TEST_ASSERT_EQUAL_HEX16(0x1234, out[1]);
+	TEST_ASSERT_EQUAL_HEX16(0xFFFF, out[2]);
+	TEST_ASSERT_EQUAL_HEX16(0x8000, out[3]);
+
+	TEST_ASSERT_FALSE(ModbusRtuCodec::ReadRegsRsp(pdu, sizeof(pdu) - 1, 3, 4, out));
+	TEST_ASSERT_FALSE(ModbusRtuCodec::ReadRegsRsp(pdu, sizeof(pdu), 3, 3, out));
+	TEST_ASSERT_FALSE(ModbusRtuCodec::ReadRegsRsp(pdu, sizeof(pdu), 70, 4, out));
+
+	const uint8_t exc[] = {0x83, 0x02}; /*vyjimka IllegalDataAddress*/
+	TEST_ASSERT_FALSE(ModbusRtuCodec::ReadRegsRsp(exc, sizeof(exc), 3, 4, out));
+}
+
+//*****************************************************************************
+//! Frames/s of seal + check: 8 B request, frames around MODBUS_CRC_SLICE_MIN
+//! and 255 B response (FC3, 125 reg.)
+//*****************************************************************************
+static double bench(uint16_t (*crc)(const uint8_t *, size_t, uint16_t), size_t len)
+{
+	uint8_t adu[MODBUS_RTU_ADU_MAX];
+	for (size_t i = 0; i < len; i++)
+	{
+		adu[i] = (uint8_t)rng();
+	}
+	volatile uint32_t sink = 0;
+	auto t0 = std::chrono::steady_clock::now();
+	for (int i = 0; i < BENCH_FRAMES; i++)
+	{
+		adu[1] = (uint8_t)i;
+		uint16_t c = crc(adu, len - 2, MODBUS_CRC_INIT);
+		adu[len - 2] = c & 0xFF;
+		adu[len - 1] = c >> 8;
+		sink += (crc(adu, len - 2, MODBUS_CRC_INIT) == c);
+	}
+	double s = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+	TEST_ASSERT_EQUAL(BENCH_FRAMES, sink);
+	return BENCH_FRAMES / s;
+}
+
+static void test_bench_frames_per_second(void)
+{
+	char msg[128];
+	for (size_t len : {(size_t)8, (size_t)16, (size_t)20, (size_t)64, (size_t)255})
+	{
+		double slice = bench(ModbusRtuCodec::Crc, len);
+		double bytewise = bench(ModbusRtuCodec::CrcBytewise, len);
+		snprintf(msg, sizeof(msg), "%u B frame: slice-by-4 %.0f frames/s, bytewise %.0f frames/s (x%.2f)",
+				 (unsigned)len, slice, bytewise, slice / bytewise);
+		TEST_MESSAGE(msg);
+	}
+}
+
+int main(void)
+{
+	UNITY_BEGIN();
+	RUN_TEST(test_crc_reference);
+	RUN_TEST(test_crc_matches_bytewise);
+	RUN_TEST(test_seal_reference_frame);
+	RUN_TEST(test_check);
+	RUN_TEST(test_read_regs_rsp);
+	RUN_TEST(test_bench_frames_per_second);
+	return UNITY_END();
+}
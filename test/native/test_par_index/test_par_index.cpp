@@ -0,0 +1,295 @@
+/***********************************************************************
+ * Filename: test_par_index.cpp
+ * Author: agent
+ * Date: 2026-10-17
+ * Description:
+ *     Native unit tests of ParIndex address and name lookup and
+ *     comparison with the former linear lookups: Register::GetPar
+ *     (scan of the table in declaration order from the last hit) and
+ *     Register::ParameterSearch (strcmp of every name). The table has the
+ *     shape of the real one: 178 parameters in groups of addresses,
+ *     mostly single registers, some S32 and string parameters, a few
+ *     declared out of address order. Lookups of random mapped
+ *     addresses, of a sequential block (Modbus FC3 sweep) and of
+ *     unmapped addresses are measured, and names of a get_params
+ *     request for 30 parameters.
+ *     Run: pio test -e native -f native/test_par_index
+ *
+ ***********************************************************************/
+
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include <unity.h>
+#include "par_index.h"
+
+#define TABLE_PARAMS 178
+#define BENCH_LOOKUPS 2000000
+#define NOT_FOUND PAR_INDEX_NONE
+#define REQUEST_NAMES 30
+#define BENCH_REQUESTS 100000
+
+typedef struct
+{
+	uint16_t adr;
+	uint16_t size;
+} simpar_t;
+
+static std::mt19937 rng(1);
+static simpar_t table[TABLE_PARAMS]; /*poradi deklarace*/
+static regspan_t spans[TABLE_PARAMS];
+static uint16_t cursor;					/*ActiveIdx puvodniho GetPar*/
+static char names[TABLE_PARAMS][24];
+static uint16_t nameMap[TABLE_PARAMS];
+
+void setUp(void) {}
+void tearDown(void) {}
+
+static const char *Name(uint16_t idx)
+{
+	return names[idx];
+}
+
+//*****************************************************************************
+//! Groups of addresses like parameters_table.h, every 9th parameter is S32,
+//! every 25th string, every 30th is declared behind its group
+//*****************************************************************************
+static void BuildTable(void)
+{
+	const uint16_t groups[] = {0, 100, 200, 300, 400, 500, 600, 1000, 1100};
+	const uint8_t nGroups = sizeof(groups) / sizeof(groups[0]);
+	uint16_t n = 0;
+	for (uint8_t g = 0; g < nGroups; g++)
+	{
+		uint16_t adr = groups[g];
+		uint16_t cnt = (TABLE_PARAMS - n) / (nGroups - g);
+		for (uint16_t i = 0; i < cnt; i++)
+		{
+			uint16_t size = ((n % 25) == 24) ? 16 : (((n % 9) == 8) ? 2 : 1);
+			table[n++] = {adr, size};
+			adr += size + (((i % 7) == 6) ? 2 : 0); /*obcasna mezera*/
+		}
+	}
+	for (uint16_t i = 29; i + 1 < TABLE_PARAMS; i += 30)
+	{
+		std::swap(table[i], table[i + 1]);
+	}
+
+	for (uint16_t i = 0; i < TABLE_PARAMS; i++)
+	{
+		spans[i] = {table[i].adr, (uint16_t)(table[i].adr + table[i].size - 1), i};
+	}
+	ParIndex::SortSpans(spans, TABLE_PARAMS);
+	cursor = 0;
+
+	/*jmena se spolecnymi prefixy jako v tabulce (MdbPoll1Slave, WiFiScanSSID3...)*/
+	const char *const prefix[] = {"Mdb", "MdbPoll", "WiFi", "WiFiScan", "Cas", "Tcp", "MQTT", "Poloha", "Teplota", "EspNow"};
+	for (uint16_t i = 0; i < TABLE_PARAMS; i++)
+	{
+		snprintf(names[i], sizeof(names[i]), "%s%uPar%u", prefix[i % 10], (unsigned)(i / 10) % 4, (unsigned)i);
+		nameMap[i] = i;
+	}
+	ParIndex::SortNames(nameMap, TABLE_PARAMS, Name);
+}
+
+//*****************************************************************************
+//! Former Register::GetPar, returns index into table or NOT_FOUND
+//*****************************************************************************
+static uint16_t LinearLookup(uint16_t adr)
+{
+	for (uint16_t i = 0; i < TABLE_PARAMS; i++)
+	{
+		if (cursor >= TABLE_PARAMS)
+		{
+			cursor = 0;
+		}
+		uint16_t hr = table[cursor].adr;
+		if ((adr >= hr) && (adr < (hr + table[cursor].size)))
+		{
+			return cursor;
+		}
+		cursor++;
+	}
+	cursor = TABLE_PARAMS;
+	return NOT_FOUND;
+}
+
+static uint16_t SpanLookup(uint16_t adr)
+{
+	uint16_t s = ParIndex::FindSpan(spans, TABLE_PARAMS, adr);
+	if ((s < TABLE_PARAMS) && (spans[s].first <= adr))
+	{
+		return spans[s].idx;
+	}
+	return NOT_FOUND;
+}
+
+//*****************************************************************************
+//! Former Register::ParameterSearch
+//*****************************************************************************
+static uint16_t LinearName(const char *key)
+{
+	for (uint16_t i = 0; i < TABLE_PARAMS; i++)
+	{
+		if (strcmp(key, names[i]) == 0)
+		{
+			return i;
+		}
+	}
+	return NOT_FOUND;
+}
+
+static uint16_t IndexName(const char *key)
+{
+	return ParIndex::FindName(nameMap, TABLE_PARAMS, Name, key);
+}
+
+static void test_spans_sorted(void)
+{
+	for (uint16_t i = 1; i < TABLE_PARAMS; i++)
+	{
+		TEST_ASSERT_TRUE(spans[i - 1].last < spans[i].first);
+	}
+}
+
+static void test_lookup_matches_linear(void)
+{
+	for (uint32_t adr = 0; adr <= 0xFFFF; adr++)
+	{
+		TEST_ASSERT_EQUAL_UINT16(LinearLookup(adr), SpanLookup(adr));
+	}
+}
+
+static void test_find_span_edges(void)
+{
+	TEST_ASSERT_EQUAL_UINT16(0, ParIndex::FindSpan(spans, 0, 100));
+	TEST_ASSERT_EQUAL_UINT16(0, ParIndex::FindSpan(spans, TABLE_PARAMS, 0));
+	TEST_ASSERT_EQUAL_UINT16(TABLE_PARAMS, ParIndex::FindSpan(spans, TABLE_PARAMS, 0xFFFF));
+	for (uint16_t i = 0; i < TABLE_PARAMS; i++)
+	{ /*kazdy registr vicewordoveho parametru vede na jeho span*/
+		for (uint32_t adr = spans[i].first; adr <= spans[i].last; adr++)
+		{
+			TEST_ASSERT_EQUAL_UINT16(i, ParIndex::FindSpan(spans, TABLE_PARAMS, adr));
+		}
+	}
+}
+
+//*****************************************************************************
+//! Lookups per second of addresses from adrs (repeated)
+//*****************************************************************************
+static double Bench(uint16_t (*lookup)(uint16_t), const std::vector<uint16_t> &adrs)
+{
+	uint32_t sink = 0;
+	cursor = 0;
+	auto t0 = std::chrono::steady_clock::now();
+	for (uint32_t i = 0; i < BENCH_LOOKUPS; i++)
+	{
+		sink += lookup(adrs[i % adrs.size()]);
+	}
+	double s = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+	TEST_ASSERT_NOT_EQUAL(0, sink + 1);
+	return BENCH_LOOKUPS / s / 1e6;
+}
+
+static void test_lookup_speed(void)
+{
+	std::vector<uint16_t> random;
+	std::vector<uint16_t> sweep;
+	std::vector<uint16_t> missing;
+	for (uint16_t i = 0; i < 1024; i++)
+	{
+		const simpar_t &p = table[rng() % TABLE_PARAMS];
+		random.push_back(p.adr + rng() % p.size);
+		missing.push_back(2000 + rng() % 60000);
+	}
+	for (uint16_t adr = 400; adr < 440; adr++)
+	{ /*blok FC3, vcetne mezer*/
+		sweep.push_back(adr);
+	}
+
+	struct
+	{
+		const char *name;
+		const std::vector<uint16_t> &adrs;
+	} cases[] = {{"random", random}, {"FC3 sweep", sweep}, {"unmapped", missing}};
+
+	char msg[112];
+	for (auto &c : cases)
+	{
+		double lin = Bench(LinearLookup, c.adrs);
+		double bin = Bench(SpanLookup, c.adrs);
+		snprintf(msg, sizeof(msg), "%-9s: linear %7.1f M/s, binary search %7.1f M/s (x%.1f)", c.name, lin, bin, bin / lin);
+		TEST_MESSAGE(msg);
+		if (c.adrs.size() > 100)
+		{ /*sekvencni blok je pro kurzor linearniho hledani nejlepsi pripad*/
+			TEST_ASSERT_TRUE(bin > lin);
+		}
+	}
+}
+
+static void test_name_lookup(void)
+{
+	for (uint16_t i = 1; i < TABLE_PARAMS; i++)
+	{
+		TEST_ASSERT_TRUE(strcmp(names[nameMap[i - 1]], names[nameMap[i]]) < 0);
+	}
+	for (uint16_t i = 0; i < TABLE_PARAMS; i++)
+	{
+		TEST_ASSERT_EQUAL_UINT16(i, IndexName(names[i]));
+	}
+	TEST_ASSERT_EQUAL_UINT16(NOT_FOUND, IndexName(""));
+	TEST_ASSERT_EQUAL_UINT16(NOT_FOUND, IndexName("Mdb"));
+	TEST_ASSERT_EQUAL_UINT16(NOT_FOUND, IndexName("zzz"));
+	TEST_ASSERT_EQUAL_UINT16(NOT_FOUND, ParIndex::FindName(nameMap, 0, Name, names[0]));
+}
+
+//*****************************************************************************
+//! Requests per second, every request looks up REQUEST_NAMES names
+//*****************************************************************************
+static double BenchNames(uint16_t (*lookup)(const char *), const std::vector<const char *> &req)
+{
+	uint32_t sink = 0;
+	auto t0 = std::chrono::steady_clock::now();
+	for (uint32_t r = 0; r < BENCH_REQUESTS; r++)
+	{
+		for (uint16_t i = 0; i < REQUEST_NAMES; i++)
+		{
+			sink += lookup(req[(r * REQUEST_NAMES + i) % req.size()]);
+		}
+	}
+	double s = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+	TEST_ASSERT_NOT_EQUAL(0, sink + 1);
+	return BENCH_REQUESTS / s;
+}
+
+static void test_name_speed(void)
+{
+	std::vector<const char *> req;
+	for (uint16_t i = 0; i < 16 * REQUEST_NAMES; i++)
+	{
+		req.push_back(names[rng() % TABLE_PARAMS]);
+	}
+	double lin = BenchNames(LinearName, req);
+	double bin = BenchNames(IndexName, req);
+	char msg[112];
+	snprintf(msg, sizeof(msg), "get_params %u names: linear %.0f req/s (%.2f us), name index %.0f req/s (%.2f us), x%.1f",
+			 REQUEST_NAMES, lin, 1e6 / lin, bin, 1e6 / bin, bin / lin);
+	TEST_MESSAGE(msg);
+	TEST_ASSERT_TRUE(bin > lin);
+}
+
+int main(void)
+{
+	BuildTable();
+	UNITY_BEGIN();
+	RUN_TEST(test_spans_sorted);
+	RUN_TEST(test_lookup_matches_linear);
+	RUN_TEST(test_find_span_edges);
+	RUN_TEST(test_lookup_speed);
+	RUN_TEST(test_name_lookup);
+	RUN_TEST(test_name_speed);
+	return UNITY_END();
+}